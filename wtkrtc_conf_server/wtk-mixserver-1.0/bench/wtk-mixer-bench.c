@@ -0,0 +1,823 @@
+/*
+ * wtk-mixer-bench: load generator for wtk-mixer.
+ *
+ * Starts wtk-mixer in the foreground, opens M conferences with NEWCNF as
+ * app_statectl does and joins N synthetic participants to each.  Every
+ * participant sends a 20 ms Opus packet with the RFC 6464 audio level;
+ * the first few of a conference (the talkers) alternate bursts of speech
+ * with silence, everyone else is silent.  Speech comes from an opus_demo
+ * bitstream file, or is random CELT frames that decode to noise.  The
+ * first participants can also send VP8.
+ *
+ * Latency is from the first speech packet of a burst to the first packet
+ * of the mix a listener gets that is large enough to be speech (VBR Opus
+ * codes silence in a few bytes), so it covers NetEq, the mixer tick and
+ * the encoder.  Loss is counted from the mixer's sequence numbers per
+ * participant, CPU and RSS over the mixer and its conference processes.
+ *
+ * With a list of participant counts (-n 10,50,100) every step runs on a
+ * fresh mixer and prints one row of the scaling curve.
+ */
+#include "../wtk-mixer.h"
+#include "../../wtkrtc_mixer_api/wtk_rtc_mixer_api.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+
+#define BENCH_PORT_DEFAULT		18585
+#define BENCH_STEPS_MAX			32
+#define BENCH_FRAME_MS			20
+#define BENCH_SAMPLES_PER_FRAME	960			/* 20 ms at 48 kHz */
+#define BENCH_TALK_MS			1000		/* talkers speak this long, then are silent as long */
+#define BENCH_SPEECH_BYTES		20			/* a mixed packet this large carries speech */
+#define BENCH_SPEECH_LEVEL		30			/* -dBov in the audio level extension */
+#define BENCH_SILENCE_LEVEL		127
+#define BENCH_SYNTH_FRAMES		50
+#define BENCH_SYNTH_SIZE		80			/* about 32 kbps */
+#define BENCH_VIDEO_FPS			30
+#define BENCH_VIDEO_SIZE		1000
+#define BENCH_VIDEO_KEY_FRAMES	90			/* a keyframe every 3 s */
+#define BENCH_AUDIO_SSRC		0x10000000
+#define BENCH_VIDEO_SSRC		0x20000000	/* + conference << 12 + participant */
+#define BENCH_STARTUP_MS		3000		/* for the mixer to answer NEWCNF */
+#define BENCH_NEWCNF_TRIES		10
+#define BENCH_WARMUP			2			/* seconds before measuring, NetEq and selection settle */
+#define BENCH_LATENCY_BUCKETS	2000		/* 1 ms buckets */
+#define BENCH_RECV_BATCH		32
+#define BENCH_SOCKBUF_SIZE		(1 << 20)
+
+static const struct option long_options[] = {
+	{ "mixer",           required_argument, NULL, 'm' },
+	{ "mixer-ip",        required_argument, NULL, 'a' },
+	{ "mixer-port",      required_argument, NULL, 'l' },
+	{ "conferences",     required_argument, NULL, 'c' },
+	{ "participants",    required_argument, NULL, 'n' },
+	{ "talkers",         required_argument, NULL, 't' },
+	{ "video",           required_argument, NULL, 'V' },
+	{ "opus",            required_argument, NULL, 'i' },
+	{ "duration",        required_argument, NULL, 'd' },
+	{ "workers",         required_argument, NULL, 'w' },
+	{ "speakers",        required_argument, NULL, 'k' },
+	{ "max-loss",        required_argument, NULL, 'x' },
+	{ "max-latency",     required_argument, NULL, 'L' },
+	{ "verbose",         no_argument,       NULL, 'v' },
+	{ "help",            no_argument,       NULL, 'h' },
+	{ NULL,              0,                 NULL,  0  }
+};
+
+/* What a participant receives, receiver thread only */
+struct bench_stream {
+	uint32_t first;				/* extended sequence numbers */
+	uint32_t last;
+	uint64_t received;
+};
+struct bench_participant {
+	int fd;
+	int conf;
+	int index;					/* in its conference, talkers and video senders first */
+	uint16_t seq;
+	uint32_t ts;
+	uint16_t video_seq;
+	uint32_t video_ts;
+	int video_frames;
+
+	uint32_t burst_seen;
+	struct bench_stream audio;
+	struct bench_stream video[MS_VIDEO_FORWARDS];
+};
+struct bench_conference {
+	char key[64];				/* session and number, as NEWCNF carries it */
+	struct sockaddr_in addr;
+	uint32_t burst;				/* talk bursts started, written by the sender */
+	uint64_t onset_ns;
+};
+struct bench_frames {
+	uint8_t **data;
+	int *len;
+	int count;
+};
+struct bench_info {
+	char mixer[256];
+	char mixer_ip[32];
+	int mixer_port;
+	int conferences;
+	int steps[BENCH_STEPS_MAX];
+	int num_steps;
+	int participants;			/* per conference, this step */
+	int talkers;
+	int video;
+	int duration;
+	int workers;
+	int speakers;
+	double max_loss;
+	int max_latency;
+	int verbose;
+	struct bench_frames speech;
+
+	pid_t pid;
+	int epoll_fd;
+	struct bench_conference *conf;
+	struct bench_participant *p;
+
+	volatile int running;
+	volatile int measuring;
+	uint64_t latency[BENCH_LATENCY_BUCKETS];	/* receiver thread only */
+	uint64_t late;
+	uint64_t rtcp;
+	uint64_t foreign;
+};
+typedef struct bench_info bench_info_t;
+
+static void exit_help(int argc, char * const argv[])
+{
+	fprintf( stderr, "%s usage\n", argv[0] );
+	fprintf( stderr, "-m <path> \twtk-mixer to start (default ./wtk-mixer)\n" );
+	fprintf( stderr, "-a <ip>   \tMixer ip (default 127.0.0.1)\n" );
+	fprintf( stderr, "-l <port> \tMixer port (default %d)\n", BENCH_PORT_DEFAULT );
+	fprintf( stderr, "-c <num>  \tConferences (default 1)\n" );
+	fprintf( stderr, "-n <list> \tParticipants per conference, a comma separated list runs one step each (default 10)\n" );
+	fprintf( stderr, "-t <num>  \tTalkers per conference (default 1)\n" );
+	fprintf( stderr, "-V <num>  \tVP8 senders per conference, at most %d (default 0)\n", MS_VIDEO_FORWARDS );
+	fprintf( stderr, "-i <file> \tSpeech as an opus_demo bitstream of 20 ms frames (default random CELT frames)\n" );
+	fprintf( stderr, "-d <secs> \tDuration of each step (default 10)\n" );
+	fprintf( stderr, "-w <num>  \tStart the mixer with -w <num>\n" );
+	fprintf( stderr, "-k <num>  \tStart the mixer with -k <num>\n" );
+	fprintf( stderr, "-x <pct>  \tExit with 2 if any step lost more than <pct> percent of audio\n" );
+	fprintf( stderr, "-L <ms>   \tExit with 2 if any step's p99 latency is above <ms>\n" );
+	fprintf( stderr, "-v        \tKeep the mixer's output\n" );
+	fprintf( stderr, "-h        \tThis help message.\n" );
+	fprintf( stderr, "\n" );
+	exit(1);
+}
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+static inline uint32_t read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static inline void write32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+//Speech
+static int add_frame(struct bench_frames *frames, const uint8_t *data, int len)
+{
+	uint8_t **d;
+	int *l;
+
+	if ((d = realloc(frames->data, (frames->count + 1) * sizeof(uint8_t *))) == NULL)
+		return -1;
+	frames->data = d;
+	if ((l = realloc(frames->len, (frames->count + 1) * sizeof(int))) == NULL)
+		return -1;
+	frames->len = l;
+	if ((frames->data[frames->count] = malloc(len)) == NULL)
+		return -1;
+	memcpy(frames->data[frames->count], data, len);
+	frames->len[frames->count++] = len;
+	return 0;
+}
+/* opus_demo -e output: per frame a 32 bit length, the encoder's final range, the packet */
+static int load_opus_file(struct bench_frames *frames, const char *path)
+{
+	uint8_t hdr[8], buf[MS_PKTBUF_SIZE];
+	uint32_t len;
+	FILE *fp;
+
+	if ((fp = fopen(path, "rb")) == NULL)
+		return -1;
+	while (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr))
+	{
+		len = read32(hdr);
+		if (len == 0 || len > sizeof(buf) - 64 || fread(buf, 1, len, fp) != len)
+			break;
+		if (add_frame(frames, buf, len) < 0)
+			break;
+	}
+	fclose(fp);
+	return frames->count > 0 ? 0 : -1;
+}
+/* CELT fullband stereo 20 ms frames of random bytes, any of them decodes to noise */
+static void synth_frames(struct bench_frames *frames)
+{
+	uint8_t buf[BENCH_SYNTH_SIZE];
+	int i, k;
+
+	srand(1);
+	for (i = 0; i < BENCH_SYNTH_FRAMES; i++)
+	{
+		buf[0] = 0xfc;
+		for (k = 1; k < BENCH_SYNTH_SIZE; k++)
+			buf[k] = rand() & 0xff;
+		add_frame(frames, buf, BENCH_SYNTH_SIZE);
+	}
+}
+
+//Mixer process
+static pid_t start_mixer(bench_info_t *bi)
+{
+	char port[16], workers[16], speakers[16];
+	char *argv[16];
+	int argc = 0, fd;
+	pid_t pid;
+
+	snprintf(port, sizeof(port), "%d", bi->mixer_port);
+	snprintf(workers, sizeof(workers), "%d", bi->workers);
+	snprintf(speakers, sizeof(speakers), "%d", bi->speakers);
+	argv[argc++] = bi->mixer;
+	argv[argc++] = "-f";
+	argv[argc++] = "-l";
+	argv[argc++] = port;
+	argv[argc++] = "-a";
+	argv[argc++] = bi->mixer_ip;
+	if (bi->workers > 0)
+	{
+		argv[argc++] = "-w";
+		argv[argc++] = workers;
+	}
+	if (bi->speakers > 0)
+	{
+		argv[argc++] = "-k";
+		argv[argc++] = speakers;
+	}
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid == 0)
+	{
+		if (!bi->verbose && (fd = open("/dev/null", O_WRONLY)) >= 0)
+		{
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		/* one process group, the conference children go with it */
+		setpgid(0, 0);
+		execv(bi->mixer, argv);
+		fprintf(stderr, "Failed to start %s. %s\n", bi->mixer, strerror(errno));
+		_exit(127);
+	}
+	return pid;
+}
+static void stop_mixer(bench_info_t *bi)
+{
+	if (bi->pid <= 0)
+		return;
+	kill(-bi->pid, SIGINT);
+	usleep(500000);
+	kill(-bi->pid, SIGKILL);
+	waitpid(bi->pid, NULL, 0);
+	bi->pid = 0;
+}
+/* CPU ticks and resident pages of pid and its direct children, the fork mode conferences */
+static void mixer_usage(pid_t pid, uint64_t *ticks, uint64_t *pages)
+{
+	char path[300], buf[1024], *p;
+	unsigned long utime, stime;
+	long rss;
+	int ppid;
+	DIR *dir;
+	struct dirent *de;
+	FILE *fp;
+
+	*ticks = *pages = 0;
+	if ((dir = opendir("/proc")) == NULL)
+		return;
+	while ((de = readdir(dir)) != NULL)
+	{
+		if (!isdigit((unsigned char)de->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		if ((fp = fopen(path, "r")) == NULL)
+			continue;
+		p = fgets(buf, sizeof(buf), fp);
+		fclose(fp);
+		/* the command may hold spaces, fields start after its ')' */
+		if (p == NULL || (p = strrchr(buf, ')')) == NULL)
+			continue;
+		if (sscanf(p + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+			&ppid, &utime, &stime, &rss) != 4)
+			continue;
+		if (atoi(de->d_name) != pid && ppid != pid)
+			continue;
+		*ticks += utime + stime;
+		*pages += rss;
+	}
+	closedir(dir);
+}
+
+//Conferences
+static int open_socket(bench_info_t *bi)
+{
+	struct sockaddr_in addr;
+	int fd, size = BENCH_SOCKBUF_SIZE;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	memset(&addr, 0x00, sizeof(addr));
+	addr.sin_family = AF_INET;
+	inet_pton(AF_INET, bi->mixer_ip, &addr.sin_addr);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+/* NEWCNF <32 hex session> <number>, answered with the conference's own port */
+static int new_conference(bench_info_t *bi, int fd, int index, uint64_t deadline)
+{
+	struct bench_conference *conf = &bi->conf[index];
+	struct sockaddr_in mixer;
+	struct mixservice_rep rep;
+	char req[128];
+	struct timeval tv = { 0, 100000 };
+	ssize_t len;
+	int tries;
+
+	snprintf(conf->key, sizeof(conf->key), "%08x%08x%016x %d", (unsigned int)getpid(), (unsigned int)index, 0, 9000 + index);
+	snprintf(req, sizeof(req), "%s %s", MS_CMD_NCF, conf->key);
+	memset(&mixer, 0x00, sizeof(mixer));
+	mixer.sin_family = AF_INET;
+	mixer.sin_port = htons(bi->mixer_port);
+	inet_pton(AF_INET, bi->mixer_ip, &mixer.sin_addr);
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	for (tries = 0; tries < BENCH_NEWCNF_TRIES || now_ns() < deadline; tries++)
+	{
+		sendto(fd, req, strlen(req) + 1, 0, (struct sockaddr *)&mixer, sizeof(mixer));
+		while ((len = recv(fd, &rep, sizeof(rep), 0)) > 0)
+		{
+			/* the mixer answers twice, an earlier conference's second answer may still be queued */
+			if (len < (ssize_t)sizeof(rep) || strncmp(rep.action, MS_CMD_NCF, MS_CMD_LEN) != 0 || strncmp(rep.session, conf->key, 32) != 0)
+				continue;
+			memcpy(&conf->addr, &rep.addr, sizeof(struct sockaddr_in));
+			conf->addr.sin_addr = mixer.sin_addr;
+			return 0;
+		}
+	}
+	return -1;
+}
+static void hangup_conference(bench_info_t *bi, int index)
+{
+	struct bench_participant *p = &bi->p[index * bi->participants];
+
+	sendto(p->fd, MS_CMD_HCF, MS_CMD_LEN, 0, (struct sockaddr *)&bi->conf[index].addr, sizeof(struct sockaddr_in));
+	sendto(p->fd, MS_CMD_HCF, MS_CMD_LEN, 0, (struct sockaddr *)&bi->conf[index].addr, sizeof(struct sockaddr_in));
+}
+
+//Media
+static inline uint32_t video_ssrc(int conf, int index)
+{
+	return BENCH_VIDEO_SSRC + (conf << 12) + index;
+}
+static void send_audio(bench_info_t *bi, struct bench_participant *p, int speech, int frame, int onset)
+{
+	const uint8_t silence[] = { 0xf8, 0xff, 0xfe };
+	uint8_t pkt[MS_PKTBUF_SIZE];
+	const uint8_t *payload = silence;
+	int len = sizeof(silence);
+
+	if (speech)
+	{
+		payload = bi->speech.data[frame % bi->speech.count];
+		len = bi->speech.len[frame % bi->speech.count];
+	}
+	pkt[0] = 0x90;			/* V=2, X */
+	pkt[1] = kWtkPayloadTypeOpus | (onset ? 0x80 : 0);
+	pkt[2] = p->seq >> 8;
+	pkt[3] = p->seq & 0xff;
+	write32(pkt + 4, p->ts);
+	write32(pkt + 8, BENCH_AUDIO_SSRC + p->conf * bi->participants + p->index);
+	/* one-byte header extension, the audio level */
+	pkt[12] = 0xbe;
+	pkt[13] = 0xde;
+	pkt[14] = 0;
+	pkt[15] = 1;
+	pkt[16] = AUDIO_LEVEL_EXTENSION_ID << 4;
+	pkt[17] = (speech ? 0x80 : 0) | (speech ? BENCH_SPEECH_LEVEL : BENCH_SILENCE_LEVEL);
+	pkt[18] = 0;
+	pkt[19] = 0;
+	memcpy(pkt + 20, payload, len);
+	sendto(p->fd, pkt, 20 + len, 0, (struct sockaddr *)&bi->conf[p->conf].addr, sizeof(struct sockaddr_in));
+	p->seq++;
+	p->ts += BENCH_SAMPLES_PER_FRAME;
+}
+/* One packet per frame, VP8 payload descriptor with S set and the key frame bit */
+static void send_video(bench_info_t *bi, struct bench_participant *p)
+{
+	uint8_t pkt[12 + BENCH_VIDEO_SIZE];
+	int keyframe = p->video_frames++ % BENCH_VIDEO_KEY_FRAMES == 0;
+
+	memset(pkt, 0x00, sizeof(pkt));
+	pkt[0] = 0x80;
+	pkt[1] = kWtkPayloadTypeVP8 | 0x80;
+	pkt[2] = p->video_seq >> 8;
+	pkt[3] = p->video_seq & 0xff;
+	write32(pkt + 4, p->video_ts);
+	write32(pkt + 8, video_ssrc(p->conf, p->index));
+	pkt[12] = 0x10;
+	pkt[13] = keyframe ? 0x00 : 0x01;
+	sendto(p->fd, pkt, sizeof(pkt), 0, (struct sockaddr *)&bi->conf[p->conf].addr, sizeof(struct sockaddr_in));
+	p->video_seq++;
+	p->video_ts += 90000 / BENCH_VIDEO_FPS;
+}
+static void account_seq(struct bench_stream *s, uint16_t seq)
+{
+	uint32_t ext;
+
+	if (s->received == 0)
+	{
+		s->first = s->last = 0x10000 + seq;	/* room for a few late ones below */
+		s->received = 1;
+		return;
+	}
+	ext = s->last + (int16_t)(seq - (uint16_t)s->last);
+	if ((int32_t)(ext - s->last) > 0)
+		s->last = ext;
+	if ((int32_t)(ext - s->first) < 0)
+		s->first = ext;
+	s->received++;
+}
+static void account_packet(bench_info_t *bi, struct bench_participant *p, uint8_t *pkt, ssize_t len, uint64_t ns)
+{
+	struct bench_conference *conf = &bi->conf[p->conf];
+	uint32_t burst;
+	uint64_t ms;
+	int offset, sender;
+
+	if (len >= 8 && pkt[1] >= 192 && pkt[1] <= 223)
+	{
+		bi->rtcp++;
+		return;
+	}
+	if (len < 12 || (pkt[0] >> 6) != 2)
+	{
+		bi->foreign++;
+		return;
+	}
+	if (!bi->measuring)
+		return;
+	offset = 12 + 4 * (pkt[0] & 0x0f);
+	if ((pkt[0] & 0x10) && offset + 4 <= len)
+		offset += 4 + 4 * ((pkt[offset + 2] << 8) | pkt[offset + 3]);
+	switch (pkt[1] & 0x7f)
+	{
+		case kWtkPayloadTypeOpus:
+			account_seq(&p->audio, (pkt[2] << 8) | pkt[3]);
+			burst = __atomic_load_n(&conf->burst, __ATOMIC_ACQUIRE);
+			if (p->index < bi->talkers || burst == p->burst_seen || len - offset < BENCH_SPEECH_BYTES)
+				break;
+			p->burst_seen = burst;
+			ms = (ns - __atomic_load_n(&conf->onset_ns, __ATOMIC_RELAXED)) / 1000000;
+			if (ms >= BENCH_LATENCY_BUCKETS)
+				bi->late++;
+			else
+				bi->latency[ms]++;
+			break;
+		case kWtkPayloadTypeVP8:
+			sender = read32(pkt + 8) - video_ssrc(p->conf, 0);
+			if (sender >= 0 && sender < bi->video)
+				account_seq(&p->video[sender], (pkt[2] << 8) | pkt[3]);
+			break;
+		default:
+			bi->foreign++;
+			break;
+	}
+}
+static void* receive_loop(void *arg)
+{
+	bench_info_t *bi = (bench_info_t *)arg;
+	struct epoll_event events[MS_EPOLL_EVENTS];
+	struct mmsghdr msgs[BENCH_RECV_BATCH];
+	struct iovec iovs[BENCH_RECV_BATCH];
+	uint8_t *bufs;
+	int n, i, k, got;
+
+	bufs = (uint8_t *)malloc(BENCH_RECV_BATCH * MS_PKTBUF_SIZE);
+	if (bufs == NULL)
+		return NULL;
+	memset(msgs, 0x00, sizeof(msgs));
+	for (k = 0; k < BENCH_RECV_BATCH; k++)
+	{
+		iovs[k].iov_base = bufs + k * MS_PKTBUF_SIZE;
+		iovs[k].iov_len = MS_PKTBUF_SIZE;
+		msgs[k].msg_hdr.msg_iov = &iovs[k];
+		msgs[k].msg_hdr.msg_iovlen = 1;
+	}
+	while (bi->running)
+	{
+		n = epoll_wait(bi->epoll_fd, events, MS_EPOLL_EVENTS, 100);
+		for (i = 0; i < n; i++)
+		{
+			struct bench_participant *p = &bi->p[events[i].data.u32];
+
+			while ((got = recvmmsg(p->fd, msgs, BENCH_RECV_BATCH, MSG_DONTWAIT, NULL)) > 0)
+			{
+				uint64_t ns = now_ns();
+
+				for (k = 0; k < got; k++)
+					account_packet(bi, p, iovs[k].iov_base, msgs[k].msg_len, ns);
+				if (got < BENCH_RECV_BATCH)
+					break;
+			}
+		}
+	}
+	free(bufs);
+	return NULL;
+}
+
+//Report
+static int latency_percentile(bench_info_t *bi, uint64_t total, double pct)
+{
+	uint64_t want = (uint64_t)(total * pct / 100.0), seen = 0;
+	int ms;
+
+	for (ms = 0; ms < BENCH_LATENCY_BUCKETS; ms++)
+	{
+		seen += bi->latency[ms];
+		if (seen > want)
+			return ms;
+	}
+	return BENCH_LATENCY_BUCKETS;
+}
+static void stream_loss(struct bench_stream *s, uint64_t *expected, uint64_t *received)
+{
+	if (s->received == 0)
+		return;
+	*expected += s->last - s->first + 1;
+	*received += s->received;
+}
+
+/* One step of the curve, 0 if it is within the -x/-L limits */
+static int run_step(bench_info_t *bi, int participants)
+{
+	struct epoll_event ev;
+	pthread_t receiver;
+	uint64_t start, next, end, measure, ticks0, ticks1, pages, pages_idle, rss_max = 0, samples = 0;
+	uint64_t expected = 0, received = 0, video_expected = 0, video_received = 0, latencies = 0;
+	double cpu, loss, video_loss;
+	int total = bi->conferences * participants, tick, talking = 0, frame = 0, i, k, p50 = 0, p99 = 0;
+	long page_kb = sysconf(_SC_PAGESIZE) / 1024, hz = sysconf(_SC_CLK_TCK);
+
+	bi->participants = participants;
+	bi->conf = (struct bench_conference *)calloc(bi->conferences, sizeof(struct bench_conference));
+	bi->p = (struct bench_participant *)calloc(total, sizeof(struct bench_participant));
+	bi->epoll_fd = epoll_create(MS_EPOLL_EVENTS);
+	memset(bi->latency, 0x00, sizeof(bi->latency));
+	bi->late = bi->rtcp = bi->foreign = 0;
+	if (bi->conf == NULL || bi->p == NULL || bi->epoll_fd < 0)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	for (i = 0; i < total; i++)
+	{
+		bi->p[i].conf = i / participants;
+		bi->p[i].index = i % participants;
+		bi->p[i].seq = rand() & 0xffff;
+		bi->p[i].video_seq = rand() & 0xffff;
+		if ((bi->p[i].fd = open_socket(bi)) < 0)
+		{
+			fprintf(stderr, "Failed to open participant socket. %s\n", strerror(errno));
+			exit(-2);
+		}
+	}
+
+	if ((bi->pid = start_mixer(bi)) < 0)
+	{
+		fprintf(stderr, "Failed to fork. %s\n", strerror(errno));
+		exit(-3);
+	}
+	start = now_ns();
+	for (i = 0; i < bi->conferences; i++)
+	{
+		if (new_conference(bi, bi->p[i * participants].fd, i, start + BENCH_STARTUP_MS * 1000000ULL) < 0)
+		{
+			fprintf(stderr, "No answer to NEWCNF for conference %d, is %s listening on %s:%d?\n", i, bi->mixer, bi->mixer_ip, bi->mixer_port);
+			stop_mixer(bi);
+			exit(-4);
+		}
+	}
+	mixer_usage(bi->pid, &ticks0, &pages_idle);
+
+	for (i = 0; i < total; i++)
+	{
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		ev.data.u32 = i;
+		epoll_ctl(bi->epoll_fd, EPOLL_CTL_ADD, bi->p[i].fd, &ev);
+	}
+	bi->running = 1;
+	bi->measuring = 0;
+	if (pthread_create(&receiver, NULL, receive_loop, bi) != 0)
+	{
+		fprintf(stderr, "Failed to start receiver. %s\n", strerror(errno));
+		exit(-5);
+	}
+
+	start = next = now_ns();
+	measure = start + BENCH_WARMUP * 1000000000ULL;
+	end = measure + (uint64_t)bi->duration * 1000000000ULL;
+	for (tick = 0; now_ns() < end; tick++)
+	{
+		uint64_t ns = now_ns();
+		int onset = 0;
+
+		if (!bi->measuring && ns >= measure)
+		{
+			mixer_usage(bi->pid, &ticks0, &pages);
+			measure = ns;
+			bi->measuring = 1;
+		}
+		if (tick % (BENCH_TALK_MS / BENCH_FRAME_MS) == 0)
+		{
+			talking = !talking;
+			onset = talking;
+		}
+		for (i = 0; i < bi->conferences; i++)
+		{
+			if (onset)
+			{
+				__atomic_store_n(&bi->conf[i].onset_ns, ns, __ATOMIC_RELAXED);
+				__atomic_store_n(&bi->conf[i].burst, bi->conf[i].burst + 1, __ATOMIC_RELEASE);
+			}
+			for (k = 0; k < participants; k++)
+			{
+				struct bench_participant *p = &bi->p[i * participants + k];
+
+				send_audio(bi, p, talking && k < bi->talkers, frame, onset && k < bi->talkers);
+				/* 30 fps on a 50 Hz tick, 3 frames every 5 ticks */
+				if (k < bi->video && (tick % 5) != 1 && (tick % 5) != 3)
+					send_video(bi, p);
+			}
+		}
+		frame++;
+		if (tick % (1000 / BENCH_FRAME_MS) == 0)
+		{
+			mixer_usage(bi->pid, &ticks1, &pages);
+			rss_max = MAX(rss_max, pages);
+			samples++;
+		}
+
+		next += BENCH_FRAME_MS * 1000000ULL;
+		ns = now_ns();
+		if (next > ns)
+		{
+			struct timespec ts = { (next - ns) / 1000000000ULL, (next - ns) % 1000000000ULL };
+			nanosleep(&ts, NULL);
+		}
+		else if (ns - next > 1000000000ULL)
+		{
+			next = ns;	/* can not keep up, do not burst to catch up */
+		}
+	}
+	end = now_ns();
+	mixer_usage(bi->pid, &ticks1, &pages);
+	rss_max = MAX(rss_max, pages);
+	usleep(200000);		/* in flight packets */
+	bi->measuring = 0;
+	bi->running = 0;
+	pthread_join(receiver, NULL);
+	for (i = 0; i < bi->conferences; i++)
+		hangup_conference(bi, i);
+	usleep(100000);
+	stop_mixer(bi);
+
+	for (i = 0; i < total; i++)
+	{
+		stream_loss(&bi->p[i].audio, &expected, &received);
+		for (k = 0; k < MS_VIDEO_FORWARDS; k++)
+			stream_loss(&bi->p[i].video[k], &video_expected, &video_received);
+		close(bi->p[i].fd);
+	}
+	close(bi->epoll_fd);
+	for (i = 0; i < BENCH_LATENCY_BUCKETS; i++)
+		latencies += bi->latency[i];
+	latencies += bi->late;
+	if (latencies)
+	{
+		p50 = latency_percentile(bi, latencies, 50);
+		p99 = latency_percentile(bi, latencies, 99);
+	}
+	cpu = (ticks1 - ticks0) * 100.0 / hz / ((end - measure) / 1e9);
+	loss = expected ? (expected - MIN(expected, received)) * 100.0 / expected : 100.0;
+	video_loss = video_expected ? (video_expected - MIN(video_expected, video_received)) * 100.0 / video_expected : 0.0;
+	printf("%5d %6d %8.1f %10.3f %8.1f %10.1f %7d %7d %7.3f %7.3f %9.1f\n",
+		bi->conferences, total, cpu, cpu / total,
+		rss_max * page_kb / 1024.0, (double)(rss_max > pages_idle ? rss_max - pages_idle : 0) * page_kb / total,
+		p50, p99, loss, video_loss, received * 1e9 / (end - measure) / total);
+	fflush(stdout);
+	if (bi->verbose && (bi->rtcp || bi->foreign))
+		printf("      rtcp %" PRIu64 " unexpected %" PRIu64 " late %" PRIu64 "\n", bi->rtcp, bi->foreign, bi->late);
+
+	free(bi->conf);
+	free(bi->p);
+	bi->conf = NULL;
+	bi->p = NULL;
+	if (bi->max_loss >= 0 && loss > bi->max_loss)
+		return -1;
+	if (bi->max_latency > 0 && (latencies == 0 || p99 > bi->max_latency))
+		return -1;
+	return 0;
+}
+
+int main(int argc, char* const argv[])
+{
+	bench_info_t bi;
+	struct rlimit rl;
+	char *step, *save = NULL;
+	char opus[256] = "";
+	int opt, i, failed = 0, most = 0;
+
+	memset(&bi, 0x00, sizeof(bi));
+	strcpy(bi.mixer, "./wtk-mixer");
+	strcpy(bi.mixer_ip, "127.0.0.1");
+	bi.mixer_port = BENCH_PORT_DEFAULT;
+	bi.conferences = 1;
+	bi.talkers = 1;
+	bi.duration = 10;
+	bi.max_loss = -1;
+	while ((opt = getopt_long(argc, argv, "m:a:l:c:n:t:V:i:d:w:k:x:L:vh", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'm': snprintf(bi.mixer, sizeof(bi.mixer), "%s", optarg); break;
+			case 'a': snprintf(bi.mixer_ip, sizeof(bi.mixer_ip), "%s", optarg); break;
+			case 'l': bi.mixer_port = atoi(optarg); break;
+			case 'c': bi.conferences = atoi(optarg); break;
+			case 'n':
+				for (step = strtok_r(optarg, ",", &save); step != NULL && bi.num_steps < BENCH_STEPS_MAX; step = strtok_r(NULL, ",", &save))
+					bi.steps[bi.num_steps++] = atoi(step);
+				break;
+			case 't': bi.talkers = atoi(optarg); break;
+			case 'V': bi.video = atoi(optarg); break;
+			case 'i': snprintf(opus, sizeof(opus), "%s", optarg); break;
+			case 'd': bi.duration = atoi(optarg); break;
+			case 'w': bi.workers = atoi(optarg); break;
+			case 'k': bi.speakers = atoi(optarg); break;
+			case 'x': bi.max_loss = atof(optarg); break;
+			case 'L': bi.max_latency = atoi(optarg); break;
+			case 'v': bi.verbose = 1; break;
+			default: exit_help(argc, argv);
+		}
+	}
+	if (bi.num_steps == 0)
+		bi.steps[bi.num_steps++] = 10;
+	for (i = 0; i < bi.num_steps; i++)
+	{
+		if (bi.steps[i] < 1 || bi.steps[i] > MS_PARTICIPANTS_MAX)
+			exit_help(argc, argv);
+		most = MAX(most, bi.steps[i]);
+	}
+	if (bi.conferences < 1 || bi.conferences > 4096 || bi.duration < 1 || bi.talkers < 0
+		|| bi.video < 0 || bi.video > MS_VIDEO_FORWARDS || bi.workers < 0 || bi.speakers < 0)
+		exit_help(argc, argv);
+	if (access(bi.mixer, X_OK) < 0)
+	{
+		fprintf(stderr, "%s is not executable, point -m at wtk-mixer\n", bi.mixer);
+		exit(1);
+	}
+
+	if (opus[0] != '\0')
+	{
+		if (load_opus_file(&bi.speech, opus) < 0)
+		{
+			fprintf(stderr, "No Opus frames in %s\n", opus);
+			exit(1);
+		}
+	}
+	else
+	{
+		synth_frames(&bi.speech);
+	}
+	/* a socket per participant */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)(bi.conferences * most + 64))
+	{
+		rl.rlim_cur = MIN(rl.rlim_max, (rlim_t)(bi.conferences * most + 64));
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%d conference(s), %d talker(s), %d video sender(s), %d speech frames, %ds per step%s\n",
+		bi.conferences, bi.talkers, bi.video, bi.speech.count, bi.duration, bi.workers ? "" : ", process per conference");
+	printf("confs  parts     cpu%% cpu%%/part   rss MB rss KB/part lat p50 lat p99  loss%%  vloss%%  rx pps/part\n");
+	for (i = 0; i < bi.num_steps; i++)
+	{
+		if (run_step(&bi, bi.steps[i]) < 0)
+			failed = 1;
+	}
+	return failed ? 2 : 0;
+}
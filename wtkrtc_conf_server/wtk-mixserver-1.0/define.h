@@ -7,11 +7,35 @@
 #define TRACE_NORMAL    2, __FILE__, __LINE__
 #define TRACE_INFO      3, __FILE__, __LINE__
 #define TRACE_DEBUG     4, __FILE__, __LINE__
+#define TRACE_MSG_SIZE	600		/* message text per ring record */
+#define TRACE_RING_SIZE	256		/* records per thread, power of 2 */
+#define TRACE_FLUSH_MS	20		/* flusher wakeup and clock refresh */
+#define TRACE_SITES		64		/* rate limited call sites per thread, power of 2 */
+#define TRACE_SITE_BURST	10		/* messages per call site per second */
+#define CACHELINE_SIZE	64
 
 #define MS_VERSION_NUM	"WTK-MIXER.V01"
 #define MS_PORT_DEFAULT 	8585
 #define MS_PKTBUF_SIZE		2048
 #define MS_RECV_TIMEOUT		45
+#define MS_PARTICIPANT_TIMEOUT	45	/* silent this long and a participant's channel is freed */
+#define MS_PARTICIPANTS_MAX	1024	/* per conference */
+#define MS_CHANNEL_HASH_SIZE	16		/* initial participant hash buckets, power of two */
+#define MS_SIMULCAST_LAYERS	3		/* lowest resolution first */
+#define MS_SIMULCAST_SSRC_STRIDE	0x10000	/* layer k on base ssrc + k * stride, as the client sends it */
+#define MS_VIDEO_FORWARDS	4		/* video senders one receiver shows, MAX_VIDEO_PARTICIPANT */
+#define MS_VIDEO_FORWARD_IDLE_MS	2000	/* a receiver's slot goes to another sender only after this long without video */
+#define MS_REMB_TIMEOUT		5		/* seconds a receiver's REMB estimate stays valid */
+#define MS_KEYFRAME_REQ_MS	500		/* keyframe requests per sender layer, at most one per */
+#define MS_RTCP_SSRC		1		/* sender ssrc of the mixer's own RTCP */
+#define MS_RTX_CACHE		256		/* packets kept per video stream for NACKs, power of two */
+#define MS_RTX_PKT_SIZE		1280	/* larger packets are not kept, clients send 1200 */
+#define MS_NACK_MAX			64		/* sequence numbers taken from one RTCP packet */
+#define MS_WORKERS_MAX		64
+#define MS_EPOLL_EVENTS		64
+#define MS_RECV_BATCH		32	/* datagrams read per conference wakeup */
+#define MS_TICK_CATCHUP		10	/* mixer ticks made up after a stall, a longer one is skipped */
+#define MS_MAX_SPEAKERS		MIXER_DEFAULT_SPEAKERS	/* loudest participants mixed per conference */
 
 #define MS_CMD_LEN 			6
 #define MS_CMD_NCF 			"NEWCNF" 
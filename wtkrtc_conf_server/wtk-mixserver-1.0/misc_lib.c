@@ -1,57 +1,380 @@
 #include "misc_lib.h"
 
+/*
+ * Asynchronous TraceEvent: every thread formats into its own single
+ * producer/single consumer ring, a flusher thread drains all rings to
+ * stdout or syslog. The timestamp comes from a clock the flusher ticks.
+ * A NORMAL/INFO/DEBUG call site logging more than TRACE_SITE_BURST times
+ * a second is suppressed until the next second, whatever its arguments,
+ * and the flusher reports the count once a second; errors and warnings
+ * are never suppressed. A ring lives as long as its thread.
+ */
+struct trace_record {
+	time_t when;
+	const char *file;
+	int line;
+	int level;
+	char msg[TRACE_MSG_SIZE];
+};
+struct trace_site {
+	const char *file;				/* file/line/level written by the owning thread */
+	int line;
+	int level;
+	time_t sec;
+	unsigned int count;
+	unsigned int suppressed;		/* added by the owner, reported and cleared by the flusher */
+};
+struct trace_ring {
+	unsigned int head;				/* written by the owning thread */
+	unsigned int dropped;			/* records lost on a full ring */
+	struct trace_site sites[TRACE_SITES];
+	unsigned int tail __attribute__ ((aligned (CACHELINE_SIZE)));	/* written by the flusher */
+	struct trace_ring *next;
+	struct trace_record recs[TRACE_RING_SIZE];
+};
+static struct trace_ring *TraceRings = NULL;
+static pthread_mutex_t TraceRingsLock = PTHREAD_MUTEX_INITIALIZER;	/* ring list and the consumer side */
+static pthread_key_t TraceRingKey;
+static pthread_t TraceFlusher;
+static int TraceStarted = 0;
+static time_t TraceClock;
+static time_t TraceTimeCached = -1;
+static char TraceTimeStr[TRACE_DATESIZE];
+static __thread struct trace_ring *TraceRing = NULL;
 int traceLevel = 0;
 int useSyslog = 0;
 int syslog_opened = 0;
 
+static void trace_time(time_t when, char *LogTime)
+{
+	struct tm tm_now;
+
+	strftime(LogTime, TRACE_DATESIZE, "%d/%b/%Y %H:%M:%S", localtime_r(&when, &tm_now));
+}
+static void write_trace(const char *LogTime, int level, const char *file, int line, const char *msg)
+{
+	char* extra_msg = "";
+
+	if(level == 0)
+		extra_msg = "ERROR: ";
+	else if(level == 1)
+		extra_msg = "WARNING: ";
+	else if(level == 2)
+		extra_msg = "NORMAL: ";
+	else if(level == 3)
+		extra_msg = "INFO: ";
+	else if(level == 4)
+		extra_msg = "DEBUG: ";
+
+	if(useSyslog) {
+		if(!syslog_opened) {
+			openlog("mixerserver", LOG_PID, LOG_LOCAL6);
+			syslog_opened = 1;
+		}
+		syslog(LOG_INFO, "%s%s", extra_msg, msg);
+	} else {
+		printf("%s [Mixer Server] %s%s\n", LogTime, extra_msg, msg);
+	}
+}
+static void strip_trace(char *msg)
+{
+	size_t len = strlen(msg);
+
+	while(len > 0 && msg[len-1] == '\n')
+		msg[--len] = '\0';
+}
+static struct trace_ring *get_trace_ring(void)
+{
+	struct trace_ring *ring;
+
+	if (TraceRing)
+		return TraceRing;
+
+	if (posix_memalign((void **)&ring, CACHELINE_SIZE, sizeof(struct trace_ring)) != 0)
+		return NULL;
+	memset(ring, 0x00, sizeof(struct trace_ring));
+	pthread_mutex_lock(&TraceRingsLock);
+	ring->next = TraceRings;
+	TraceRings = ring;
+	pthread_mutex_unlock(&TraceRingsLock);
+
+	TraceRing = ring;
+	pthread_setspecific(TraceRingKey, ring);
+	return ring;
+}
+static struct trace_record *reserve_trace(struct trace_ring *ring)
+{
+	unsigned int head = ring->head;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE)
+	{
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &ring->recs[head & (TRACE_RING_SIZE - 1)];
+}
+static void commit_trace(struct trace_ring *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+static void format_suppressed(char *buf, size_t size, unsigned int count, const char *file, int line)
+{
+	snprintf(buf, size, "Suppressed %u messages from %s:%d", count, file, line);
+}
+/* 1 if the call site may log now */
+static int trace_rate_limit(struct trace_ring *ring, int level, const char *file, int line, time_t now)
+{
+	struct trace_site *site;
+	struct trace_record *rec;
+	unsigned int suppressed;
+
+	if (level <= 1)		/* errors and warnings always get through */
+		return 1;
+	site = &ring->sites[(((uintptr_t)file >> 3) ^ ((unsigned int)line * 2654435761u)) & (TRACE_SITES - 1)];
+	if (site->file != file || site->line != line)
+	{
+		/* The slot changes hands, report what the old site had suppressed itself */
+		suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+		if (suppressed && (rec = reserve_trace(ring)) != NULL)
+		{
+			rec->when = now;
+			rec->file = site->file;
+			rec->line = site->line;
+			rec->level = site->level;
+			format_suppressed(rec->msg, sizeof(rec->msg), suppressed, site->file, site->line);
+			commit_trace(ring);
+		}
+		__atomic_store_n(&site->file, file, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->line, line, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->level, level, __ATOMIC_RELAXED);
+		site->sec = now;
+		site->count = 1;
+		return 1;
+	}
+	if (site->sec != now)
+	{
+		site->sec = now;
+		site->count = 1;
+		return 1;
+	}
+	if (site->count < TRACE_SITE_BURST)
+	{
+		site->count++;
+		return 1;
+	}
+	__atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+/* Caller holds TraceRingsLock, returns the lines written */
+static int drain_trace_ring(struct trace_ring *ring)
+{
+	struct trace_record *rec;
+	unsigned int head, tail, dropped;
+	char buf[64];
+	int written = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	for (tail = ring->tail; tail != head; tail++, written++)
+	{
+		rec = &ring->recs[tail & (TRACE_RING_SIZE - 1)];
+		if (rec->when != TraceTimeCached)
+		{
+			trace_time(rec->when, TraceTimeStr);
+			TraceTimeCached = rec->when;
+		}
+		write_trace(TraceTimeStr, rec->level, rec->file, rec->line, rec->msg);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) > 0)
+	{
+		snprintf(buf, sizeof(buf), "Trace ring full, %u messages dropped", dropped);
+		write_trace(TraceTimeStr, 1, __FILE__, __LINE__, buf);
+		written++;
+	}
+	return written;
+}
+/* Caller holds TraceRingsLock, reports the call sites of ring suppressed since the last report */
+static int report_trace_sites(struct trace_ring *ring)
+{
+	struct trace_site *site;
+	unsigned int suppressed;
+	time_t now = __atomic_load_n(&TraceClock, __ATOMIC_RELAXED);
+	char buf[TRACE_MSG_SIZE];
+	const char *file;
+	int line, written = 0;
+
+	for (site = ring->sites; site < ring->sites + TRACE_SITES; site++)
+	{
+		file = __atomic_load_n(&site->file, __ATOMIC_RELAXED);
+		line = __atomic_load_n(&site->line, __ATOMIC_RELAXED);
+		if ((suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED)) == 0)
+			continue;
+		if (now != TraceTimeCached)
+		{
+			trace_time(now, TraceTimeStr);
+			TraceTimeCached = now;
+		}
+		format_suppressed(buf, sizeof(buf), suppressed, file, line);
+		write_trace(TraceTimeStr, __atomic_load_n(&site->level, __ATOMIC_RELAXED), file, line, buf);
+		written++;
+	}
+	return written;
+}
+/* Caller holds TraceRingsLock */
+static void drain_trace_rings(int report_sites)
+{
+	struct trace_ring *ring;
+	int written = 0;
+
+	for (ring = TraceRings; ring; ring = ring->next)
+	{
+		written += drain_trace_ring(ring);
+		if (report_sites)
+			written += report_trace_sites(ring);
+	}
+	if (written && !useSyslog)
+		fflush(stdout);
+}
+static void release_trace_ring(void *arg)
+{
+	struct trace_ring *ring = (struct trace_ring *)arg;
+	struct trace_ring **prev;
+	int written;
+
+	pthread_mutex_lock(&TraceRingsLock);
+	written = drain_trace_ring(ring) + report_trace_sites(ring);
+	for (prev = &TraceRings; *prev != ring; prev = &(*prev)->next)
+		;
+	*prev = ring->next;
+	if (written && !useSyslog)
+		fflush(stdout);
+	pthread_mutex_unlock(&TraceRingsLock);
+	free(ring);
+	TraceRing = NULL;
+}
+static void *run_trace_flusher(void *arg)
+{
+	struct timespec ts;
+	time_t now, last = 0;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = TRACE_FLUSH_MS * 1000000L;
+	while (1)
+	{
+		now = time(NULL);
+		__atomic_store_n(&TraceClock, now, __ATOMIC_RELAXED);
+		pthread_mutex_lock(&TraceRingsLock);
+		drain_trace_rings(now != last);
+		pthread_mutex_unlock(&TraceRingsLock);
+		last = now;
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+static void flush_trace_logger(void)
+{
+	pthread_mutex_lock(&TraceRingsLock);
+	drain_trace_rings(1);
+	pthread_mutex_unlock(&TraceRingsLock);
+}
+/* fork() keeps no flusher and no other threads: drop what the parent had queued and restart it */
+static void trace_prepare_fork(void)
+{
+	pthread_mutex_lock(&TraceRingsLock);
+	if (!useSyslog)
+		fflush(stdout);
+}
+static void trace_parent_fork(void)
+{
+	pthread_mutex_unlock(&TraceRingsLock);
+}
+static void trace_child_fork(void)
+{
+	struct trace_ring *ring, *next;
+
+	/* Only the forking thread lives on in the child, the other rings have no owner */
+	for (ring = TraceRings; ring; ring = next)
+	{
+		next = ring->next;
+		if (ring != TraceRing)
+			free(ring);
+	}
+	TraceRings = TraceRing;
+	if (TraceRing)
+	{
+		TraceRing->next = NULL;
+		TraceRing->tail = TraceRing->head;
+		TraceRing->dropped = 0;
+		memset(TraceRing->sites, 0x00, sizeof(TraceRing->sites));
+	}
+	pthread_mutex_unlock(&TraceRingsLock);
+	if (pthread_create(&TraceFlusher, NULL, run_trace_flusher, NULL) != 0)
+		__atomic_store_n(&TraceStarted, 0, __ATOMIC_RELEASE);
+}
+/* Until this runs (and if it fails) TraceEvent writes synchronously */
+int init_trace_logger(void)
+{
+	if (TraceStarted)
+		return 0;
+
+	if (pthread_key_create(&TraceRingKey, release_trace_ring) != 0)
+		return -1;
+	TraceClock = time(NULL);
+	if (pthread_create(&TraceFlusher, NULL, run_trace_flusher, NULL) != 0)
+	{
+		pthread_key_delete(TraceRingKey);
+		return -1;
+	}
+	atexit(flush_trace_logger);
+	pthread_atfork(trace_prepare_fork, trace_parent_fork, trace_child_fork);
+	__atomic_store_n(&TraceStarted, 1, __ATOMIC_RELEASE);
+	return 0;
+}
 void TraceEvent(int level, char* file, int line, char* format, ...)
 {
 	va_list va_ap;
-	if(level <= traceLevel)
-	{
-		char LogTime[TRACE_DATESIZE] = {0};
-		char buf[1024];
-		char out_buf[640];
-		char* extra_msg = "";
-		
-		time_t timenow = time(NULL);
-
-		memset(buf, 0, sizeof(buf));
-		strftime(LogTime, TRACE_DATESIZE, "%d/%b/%Y %H:%M:%S", localtime(&timenow));
-		
+	struct trace_ring *ring = NULL;
+	struct trace_record *rec;
+	time_t now;
+
+	if(level > traceLevel)
+		return;
+
+	if (__atomic_load_n(&TraceStarted, __ATOMIC_ACQUIRE))
+		ring = get_trace_ring();
+
+	/* Synchronous until the flusher runs, and not rate limited */
+	if (!ring)
+	{
+		char LogTime[TRACE_DATESIZE];
+		char buf[TRACE_MSG_SIZE];
+
+		trace_time(time(NULL), LogTime);
 		va_start (va_ap, format);
-		vsnprintf(buf, sizeof(buf)-1, format, va_ap);
+		vsnprintf(buf, sizeof(buf), format, va_ap);
 		va_end(va_ap);
-		
-		if(level == 0)
-			extra_msg = "ERROR: ";
-		else if(level == 1)
-			extra_msg = "WARNING: ";
-		else if(level == 2)
-			extra_msg = "NORMAL: ";
-		else if(level == 3)
-			extra_msg = "INFO: ";
-		else if(level == 4)
-			extra_msg = "DEBUG: ";
-
-		while(buf[strlen(buf)-1] == '\n') 
-			buf[strlen(buf)-1] = '\0';
-
-		if(useSyslog) {
-			if(!syslog_opened) {
-				openlog("mixerserver", LOG_PID, LOG_LOCAL6);
-				syslog_opened = 1;
-			}
-
-			snprintf(out_buf, sizeof(out_buf), "%s%s", extra_msg, buf);
-			syslog(LOG_INFO, "%s", out_buf);
-		} else {
-			snprintf(out_buf, sizeof(out_buf), "%s [%11s:%4d] %s%s", LogTime, file, line, extra_msg, buf);
-			snprintf(out_buf, sizeof(out_buf), "%s [Mixer Server] %s%s", LogTime, extra_msg, buf);
-			printf("%s\n", out_buf);
+		strip_trace(buf);
+		write_trace(LogTime, level, file, line, buf);
+		if (!useSyslog)
 			fflush(stdout);
-		}
+		return;
 	}
+
+	now = __atomic_load_n(&TraceClock, __ATOMIC_RELAXED);
+	if (!trace_rate_limit(ring, level, file, line, now))
+		return;
+	if ((rec = reserve_trace(ring)) == NULL)
+		return;
+	rec->when = now;
+	rec->file = file;
+	rec->line = line;
+	rec->level = level;
+	va_start (va_ap, format);
+	vsnprintf(rec->msg, sizeof(rec->msg), format, va_ap);
+	va_end(va_ap);
+	strip_trace(rec->msg);
+	commit_trace(ring);
 }
 int setup_ms_socket(int local_port, char *ip, int bind_any)
 {
@@ -79,28 +402,283 @@ int setup_ms_socket(int local_port, char *ip, int bind_any)
 	}
 	return(sock_fd);
 }
-struct channel_info * find_channel_info_by_sockaddr( struct channel_info *list, struct sockaddr_in *addr)
+static inline unsigned int channel_hash(const struct sockaddr_in *addr)
+{
+	/* murmur3 finalizer over addr:port */
+	uint64_t h = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+int channel_table_init(struct channel_table *table, unsigned int size)
 {
-	while(list != NULL)
+	table->buckets = (struct channel_info **)calloc(size, sizeof(struct channel_info *));
+	if (table->buckets == NULL)
 	{
-		if (!inaddrcmp(&list->addr, addr))
+		TraceEvent(TRACE_ERROR, "Unable to allocate participant table of %u buckets", size);
+		return -1;
+	}
+	table->size = size;
+	table->count = 0;
+	return 0;
+}
+void channel_table_free(struct channel_table *table)
+{
+	free(table->buckets);
+	table->buckets = NULL;
+	table->size = 0;
+	table->count = 0;
+}
+static int resize_channel_table(struct channel_table *table, unsigned int size)
+{
+	struct channel_info **buckets, *ch, *next;
+	unsigned int idx, mask = size - 1;
+
+	buckets = (struct channel_info **)calloc(size, sizeof(struct channel_info *));
+	if (buckets == NULL)
+	{
+		TraceEvent(TRACE_ERROR, "Unable to grow participant table to %u buckets", size);
+		return -1;
+	}
+	for (idx = 0; idx < table->size; idx++)
+	{
+		for (ch = table->buckets[idx]; ch != NULL; ch = next)
 		{
-			return list;
+			next = ch->hnext;
+			ch->hnext = buckets[channel_hash(&ch->addr) & mask];
+			buckets[channel_hash(&ch->addr) & mask] = ch;
 		}
-		list = list->next;
 	}
-	return NULL;
+	free(table->buckets);
+	table->buckets = buckets;
+	table->size = size;
+	return 0;
 }
-struct channel_info * find_sockaddr_by_channelno( struct channel_info *list, const int channelno)
+int channel_table_insert(struct channel_table *table, struct channel_info *ch)
 {
-	while(list != NULL)
+	unsigned int idx;
+
+	/* a failed grow only makes the chains longer */
+	if (table->count >= table->size)
+		resize_channel_table(table, table->size << 1);
+	idx = channel_hash(&ch->addr) & (table->size - 1);
+	ch->hnext = table->buckets[idx];
+	table->buckets[idx] = ch;
+	table->count++;
+	return 0;
+}
+void channel_table_remove(struct channel_table *table, struct channel_info *ch)
+{
+	struct channel_info **pp = &table->buckets[channel_hash(&ch->addr) & (table->size - 1)];
+
+	for (; *pp != NULL; pp = &(*pp)->hnext)
 	{
-		if(channelno == list->channel_num)
+		if (*pp == ch)
 		{
-  			return list;
+			*pp = ch->hnext;
+			ch->hnext = NULL;
+			table->count--;
+			return;
 		}
-		list = list->next;
+	}
+}
+struct channel_info * channel_table_lookup(struct channel_table *table, const struct sockaddr_in *addr)
+{
+	struct channel_info *ch = table->buckets[channel_hash(addr) & (table->size - 1)];
+
+	for (; ch != NULL; ch = ch->hnext)
+	{
+		if (!inaddrcmp(&ch->addr, addr))
+			return ch;
 	}
 	return NULL;
 }
+/* Where the payload starts past CSRCs and header extension, -1 if malformed */
+int rtp_payload_offset(const uint8_t *pkt, int len)
+{
+	int offset;
+
+	if (len < 12 || (pkt[0] >> 6) != 2)
+		return -1;
+	offset = 12 + 4 * (pkt[0] & 0x0f);
+	if (pkt[0] & 0x10)
+	{
+		if (offset + 4 > len)
+			return -1;
+		offset += 4 + 4 * ((pkt[offset + 2] << 8) | pkt[offset + 3]);
+	}
+	return offset < len ? offset : -1;
+}
+/* First packet of a VP8 key frame: RFC 7741 descriptor, then the P bit of the payload header */
+int rtp_vp8_keyframe_start(const uint8_t *payload, int len)
+{
+	int offset = 1;
+
+	if (len < 1 || !(payload[0] & 0x10) || (payload[0] & 0x07))
+		return 0;
+	if (payload[0] & 0x80)
+	{
+		if (len < 2)
+			return 0;
+		offset = 2;
+		if (payload[1] & 0x80)		/* picture id, 7 or 15 bits */
+			offset += (len > offset && (payload[offset] & 0x80)) ? 2 : 1;
+		if (payload[1] & 0x40)		/* tl0picidx */
+			offset++;
+		if (payload[1] & 0x30)		/* tid/keyidx */
+			offset++;
+	}
+	return offset < len && !(payload[offset] & 0x01);
+}
+static inline uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static inline void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+void rtp_stats_update(struct rtp_stats *stats, uint32_t ssrc, uint16_t seq, uint32_t ts, int64_t now_ms, int clock_khz)
+{
+	uint32_t transit = (uint32_t)(now_ms * clock_khz) - ts;
+	int32_t d;
+
+	if (stats->ssrc != ssrc || stats->received == 0)
+	{
+		memset(stats, 0x00, sizeof(struct rtp_stats));
+		stats->ssrc = ssrc;
+		stats->base_seq = seq;
+		stats->max_seq = seq;
+		stats->received = 1;
+		stats->transit = transit;
+		return;
+	}
+	/* in order, possibly wrapped; anything older is a late packet */
+	if ((uint16_t)(seq - stats->max_seq) < 0x8000)
+	{
+		if (seq < stats->max_seq)
+			stats->cycles += 0x10000;
+		stats->max_seq = seq;
+	}
+	stats->received++;
+	d = (int32_t)(transit - stats->transit);
+	stats->transit = transit;
+	if (d < 0)
+		d = -d;
+	stats->jitter += d - ((stats->jitter + 8) >> 4);
+}
+/* Everything in a compound RTCP packet the mixer acts on; the packet itself goes no further */
+void rtcp_parse_feedback(const uint8_t *pkt, int len, struct rtcp_feedback *fb)
+{
+	int offset = 0, size, fmt, i, bit;
+	const uint8_t *block;
+	uint16_t pid, blp;
+
+	memset(fb, 0x00, sizeof(struct rtcp_feedback));
+	while (offset + 4 <= len)
+	{
+		block = pkt + offset;
+		size = 4 * (((block[2] << 8) | block[3]) + 1);
+		if ((block[0] >> 6) != 2 || offset + size > len)
+			break;
+		fmt = block[0] & 0x1f;
+		offset += size;
+		if (block[1] == 200 && size >= 28 && fb->srs < 4)
+		{
+			fb->sr_ssrc[fb->srs] = get32(block + 4);
+			fb->sr_ntp[fb->srs++] = get32(block + 10);
+		}
+		else if (block[1] == 205 && fmt == 1)
+		{
+			/* generic NACK: a lost packet and a bitmask of the 16 after it */
+			for (i = 12; i + 4 <= size; i += 4)
+			{
+				pid = (block[i] << 8) | block[i + 1];
+				blp = (block[i + 2] << 8) | block[i + 3];
+				for (bit = -1; bit < 16 && fb->nacks < MS_NACK_MAX; bit++)
+				{
+					if (bit >= 0 && !(blp & (1 << bit)))
+						continue;
+					fb->nack_ssrc[fb->nacks] = get32(block + 8);
+					fb->nack_seq[fb->nacks++] = pid + bit + 1;
+				}
+			}
+		}
+		else if (block[1] == 206 && fmt == 15 && size >= 20 && memcmp(block + 12, "REMB", 4) == 0)
+		{
+			/* 6 bit exponent, 18 bit mantissa */
+			uint64_t bps = (uint64_t)(((block[17] & 0x03) << 16) | (block[18] << 8) | block[19]) << (block[17] >> 2);
+			fb->remb_bps = bps > 0xffffffffULL ? 0xffffffff : (uint32_t)bps;
+		}
+		else if (block[1] == 206 && fmt == 1 && size >= 12)
+		{
+			if (fb->keyframes < 4)
+				fb->keyframe_ssrc[fb->keyframes++] = get32(block + 8);
+		}
+		else if (block[1] == 206 && fmt == 4)
+		{
+			for (i = 12; i + 8 <= size && fb->keyframes < 4; i += 8)
+				fb->keyframe_ssrc[fb->keyframes++] = get32(block + i);
+		}
+	}
+}
+int rtcp_build_pli(uint8_t *buf, uint32_t media_ssrc)
+{
+	buf[0] = 0x80 | 1;		/* V=2, FMT=1 */
+	buf[1] = 206;			/* PSFB */
+	buf[2] = 0;
+	buf[3] = 2;
+	put32(buf + 4, MS_RTCP_SSRC);
+	put32(buf + 8, media_ssrc);
+	return 12;
+}
+/* One receiver report with a block per stream, buf takes 8 + 24 * count bytes, count < 32 */
+int rtcp_build_rr(uint8_t *buf, struct rtp_stats **stats, int count, int64_t now_ms)
+{
+	struct rtp_stats *s;
+	uint8_t *block;
+	uint32_t extended, expected, expected_interval, received_interval;
+	int32_t lost, lost_interval;
+	int i, fraction;
+
+	buf[0] = 0x80 | count;
+	buf[1] = 201;			/* RR */
+	buf[2] = 0;
+	buf[3] = 1 + 6 * count;
+	put32(buf + 4, MS_RTCP_SSRC);
+	for (i = 0; i < count; i++)
+	{
+		s = stats[i];
+		block = buf + 8 + 24 * i;
+		extended = s->cycles + s->max_seq;
+		expected = extended - s->base_seq + 1;
+		lost = (int32_t)(expected - s->received);
+		if (lost > 0x7fffff)
+			lost = 0x7fffff;
+		else if (lost < -0x800000)
+			lost = -0x800000;
+		expected_interval = expected - s->expected_prior;
+		received_interval = s->received - s->received_prior;
+		lost_interval = (int32_t)(expected_interval - received_interval);
+		s->expected_prior = expected;
+		s->received_prior = s->received;
+		fraction = (expected_interval == 0 || lost_interval <= 0) ? 0 : (lost_interval << 8) / expected_interval;
+
+		put32(block, s->ssrc);
+		put32(block + 4, ((uint32_t)(fraction > 255 ? 255 : fraction) << 24) | ((uint32_t)lost & 0xffffff));
+		put32(block + 8, extended);
+		put32(block + 12, s->jitter >> 4);
+		put32(block + 16, s->lsr);
+		/* delay since that SR, in 1/65536 s */
+		put32(block + 20, s->lsr_ms ? (uint32_t)((now_ms - s->lsr_ms) * 65536 / 1000) : 0);
+	}
+	return 8 + 24 * count;
+}
 
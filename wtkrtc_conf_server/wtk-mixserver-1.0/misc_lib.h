@@ -1,6 +1,9 @@
 #ifndef _misc_lib_h_
 #define _misc_lib_h_
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* sendmmsg */
+#endif
 #include "define.h"
 
 #include <time.h>
@@ -28,6 +31,7 @@
 #include <getopt.h>
 #include <sys/time.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <net/if.h>
 #include <net/if_arp.h>
 
@@ -37,19 +41,98 @@ static inline int inaddrcmp(const struct sockaddr_in *sin1, const struct sockadd
 			|| (sin1->sin_port != sin2->sin_port));
 }
 
+/* Reception of one stream, as RFC 3550 A.1/A.3/A.8 keep it for a receiver report */
+struct rtp_stats {
+	uint32_t ssrc;
+	uint16_t base_seq;
+	uint16_t max_seq;
+	uint32_t cycles;
+	uint32_t received;
+	uint32_t expected_prior;
+	uint32_t received_prior;
+	uint32_t transit;
+	uint32_t jitter;		/* scaled by 16 */
+	uint32_t lsr;			/* middle of the last SR's NTP time */
+	int64_t lsr_ms;
+};
+/* Recent packets of one stream, by sequence number, for NACKs */
+struct rtx_cache {
+	uint16_t seq[MS_RTX_CACHE];
+	uint16_t len[MS_RTX_CACHE];	/* 0 for an empty slot */
+	uint8_t pkt[MS_RTX_CACHE][MS_RTX_PKT_SIZE];
+};
+/* Video a participant sends, one ssrc per simulcast layer */
+struct video_source {
+	uint32_t base_ssrc;		/* layer 0, the ssrc receivers know; 0 until video is seen */
+	uint32_t layer_bytes[MS_SIMULCAST_LAYERS];	/* this second */
+	uint32_t layer_bps[MS_SIMULCAST_LAYERS];	/* last second, 0 for a layer not sent */
+	int64_t keyframe_ms[MS_SIMULCAST_LAYERS];	/* last keyframe request */
+	struct rtp_stats stats[MS_SIMULCAST_LAYERS];
+	struct rtx_cache *rtx[MS_SIMULCAST_LAYERS];	/* allocated with the layer's first packet */
+};
+/* One sender as one receiver gets it: a single layer, rewritten onto the base ssrc */
+struct video_forward {
+	struct channel_info *src;
+	int layer;				/* forwarded layer, -1 before the first packet */
+	int target;				/* switched to on its next keyframe */
+	uint16_t seq_offset;
+	uint32_t ts_offset;
+	uint16_t switch_seq;	/* first sequence number sent of this layer */
+	uint16_t last_seq;
+	uint32_t last_ts;
+	int64_t last_ms;		/* last packet forwarded */
+	int64_t seen_ms;		/* last packet of src, forwarded or not */
+};
+
 struct channel_info {
 	int sock;
 	int channel_num;
 	time_t updateTime;
 	struct sockaddr_in addr;
 	struct channel_info *  next;
+	struct channel_info *  hnext;	/* addr:port hash chain */
+	struct rtp_stats audio;
+	struct video_source video;
+	struct video_forward fwd[MS_VIDEO_FORWARDS];
+	uint32_t remb_bps;		/* this receiver's estimate */
+	time_t remb_time;
+};
+
+/* What a participant's RTCP told or asked the mixer */
+struct rtcp_feedback {
+	uint32_t remb_bps;		/* 0 if none */
+	int keyframes;
+	uint32_t keyframe_ssrc[4];	/* PLI/FIR media ssrcs */
+	int srs;
+	uint32_t sr_ssrc[4];
+	uint32_t sr_ntp[4];		/* middle 32 bits of the NTP time */
+	int nacks;
+	uint32_t nack_ssrc[MS_NACK_MAX];
+	uint16_t nack_seq[MS_NACK_MAX];
+};
+
+/* Participants of a conference hashed by addr:port, chained, grows past one entry per bucket */
+struct channel_table {
+	struct channel_info **buckets;
+	unsigned int size;		/* power of two */
+	unsigned int count;
 };
 
 
 extern int traceLevel;
 extern int useSyslog;
 extern void TraceEvent(int level, char* file, int line, char* format, ...);
+extern int init_trace_logger(void);
 extern int setup_ms_socket(int local_port, char *ip, int bind_any);
-extern struct channel_info * find_channel_info_by_sockaddr( struct channel_info *list, struct sockaddr_in *addr);
-extern struct channel_info * find_sockaddr_by_channelno( struct channel_info *list, const int channelno);
+extern int channel_table_init(struct channel_table *table, unsigned int size);
+extern void channel_table_free(struct channel_table *table);
+extern int channel_table_insert(struct channel_table *table, struct channel_info *ch);
+extern void channel_table_remove(struct channel_table *table, struct channel_info *ch);
+extern struct channel_info * channel_table_lookup(struct channel_table *table, const struct sockaddr_in *addr);
+extern int rtp_payload_offset(const uint8_t *pkt, int len);
+extern int rtp_vp8_keyframe_start(const uint8_t *payload, int len);
+extern void rtp_stats_update(struct rtp_stats *stats, uint32_t ssrc, uint16_t seq, uint32_t ts, int64_t now_ms, int clock_khz);
+extern void rtcp_parse_feedback(const uint8_t *pkt, int len, struct rtcp_feedback *fb);
+extern int rtcp_build_pli(uint8_t *buf, uint32_t media_ssrc);
+extern int rtcp_build_rr(uint8_t *buf, struct rtp_stats **stats, int count, int64_t now_ms);
 #endif
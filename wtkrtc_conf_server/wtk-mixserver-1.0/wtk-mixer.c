@@ -1,11 +1,11 @@
 #include "wtk-mixer.h"
-#include "../wtkrtc_mixer_api/wtk_rtc_mixer_api.h"
 
-struct channel_info  *p_chi = NULL;
 static const struct option long_options[] = {
 	{ "foreground",      no_argument,       NULL, 'f' },
 	{ "mixer_port",      required_argument, NULL, 'l' },
 	{ "mixer_ip",        required_argument, NULL, 'a' },
+	{ "speakers",        required_argument, NULL, 'k' },
+	{ "workers",         required_argument, NULL, 'w' },
 	{ "help"   ,         no_argument,       NULL, 'h' },
 	{ "verbose",         no_argument,       NULL, 'v' },
 	{ NULL,              0,                 NULL,  0  }
@@ -14,7 +14,9 @@ static void exit_help(int argc, char * const argv[])
 {
 	fprintf( stderr, "%s usage\n", argv[0] );
 	fprintf( stderr, "-l <mixer_port>\tSet UDP main listen port to <lport>\n" );
-	fprintf( stderr, "-a <mixer_ip>\tSet UDP main listen ip to <lip>\n" );  
+	fprintf( stderr, "-a <mixer_ip>\tSet UDP main listen ip to <lip>\n" );
+	fprintf( stderr, "-k <speakers>\tMix only the <speakers> loudest participants, 0 mixes everyone (default %d)\n", MS_MAX_SPEAKERS );
+	fprintf( stderr, "-w <workers>\tRun all conferences in this process on <workers> threads (default 0, fork per conference)\n" );
 	fprintf( stderr, "-f        \tRun in foreground.\n" );
 	fprintf( stderr, "-v        \tIncrease verbosity. Can be used multiple times.\n" );
 	fprintf( stderr, "-h        \tThis help message.\n" );
@@ -29,8 +31,11 @@ static int init_ms_info( ms_info_t * ms_info )
 	ms_info->daemon = 1; /* By defult run as a daemon. */
 	ms_info->mixer_port = MS_PORT_DEFAULT;
 	ms_info->mixer_fd = -1;
+	ms_info->num_workers = 0;
+	ms_info->workers = NULL;
+	ms_info->max_speakers = MS_MAX_SPEAKERS;
 	memset(ms_info->mixer_ip, 0x00, sizeof(ms_info->mixer_ip));
-	return 0; 
+	return 0;
 }
 static void deinit_ms_info( ms_info_t * ms_info )
 {
@@ -41,110 +46,793 @@ static void deinit_ms_info( ms_info_t * ms_info )
 	ms_info->mixer_fd = -1;
 	return;
 }
-static int send_to_audio_channel(char* buf, int len, int channel)
+static inline struct channel_info *channel_by_num(struct mixer_conference *conf, int channel)
 {
-	struct channel_info  *p_ch = NULL;
+	return (channel >= 0 && channel < conf->by_channel_size) ? conf->by_channel[channel] : NULL;
+}
+static int set_channel_slot(struct mixer_conference *conf, int channel, struct channel_info *p_ch)
+{
+	struct channel_info **slots;
+	int size;
+
+	if (channel < 0)
+		return -1;
+	if (channel >= conf->by_channel_size)
+	{
+		size = conf->by_channel_size ? conf->by_channel_size : MS_CHANNEL_HASH_SIZE;
+		while (size <= channel)
+			size <<= 1;
+		if ((slots = (struct channel_info **)realloc(conf->by_channel, size * sizeof(struct channel_info *))) == NULL)
+			return -1;
+		memset(slots + conf->by_channel_size, 0x00, (size - conf->by_channel_size) * sizeof(struct channel_info *));
+		conf->by_channel = slots;
+		conf->by_channel_size = size;
+	}
+	conf->by_channel[channel] = p_ch;
+	return 0;
+}
+/* The engine's transports, called from the conference's tick on the thread that owns it */
+static int send_to_audio_channel(void* ctx, const uint8_t* buf, int len, int channel)
+{
+	struct mixer_conference *conf = (struct mixer_conference *)ctx;
+	struct channel_info  *p_ch = channel_by_num(conf, channel);
+
+	if (p_ch!=NULL)
+	{
+		//TraceEvent( TRACE_DEBUG, "Meetme(%s): channel=%d, len=%d", conf->session, channel, len );
+		sendto(p_ch->sock, buf, len, 0, (struct sockaddr *)&(p_ch->addr), sizeof(struct sockaddr_in));
+	}
+
+	return 0;
+}
+/* A timer expiring every MIXER_TICK_MS, the mixer clock of the thread that reads it */
+static int setup_tick_timer(void)
+{
+	struct itimerspec its;
+	int fd;
 
-	if ((channel >= 0 ) && (channel < MAX_PARTICIPANT )) 
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	memset(&its, 0x00, sizeof(its));
+	its.it_interval.tv_nsec = MIXER_TICK_MS * 1000000L;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL) < 0)
 	{
-		p_ch = find_sockaddr_by_channelno(p_chi, channel);
-		if (p_ch!=NULL)
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+/* Ticks due on the timer, a stall longer than MS_TICK_CATCHUP ticks is not made up */
+static int read_ticks(int fd)
+{
+	uint64_t expired;
+
+	if (read(fd, &expired, sizeof(expired)) != sizeof(expired))
+		return 0;
+	if (expired > MS_TICK_CATCHUP)
+	{
+		TraceEvent( TRACE_WARNING, "Mixer clock %d ms behind, skip ticks", (int)((expired - 1) * MIXER_TICK_MS));
+		return 1;
+	}
+	return (int)expired;
+}
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+static inline uint32_t read32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static inline void write32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+/* Queue body for addr as message msg, behind the 12 byte RTP header hdr if there is one */
+static void fanout_add(struct mixer_conference *conf, int msg, struct sockaddr_in *addr, const uint8_t *hdr, const void *body, int len)
+{
+	struct iovec *iov = &conf->fanout_iov[2 * msg];
+
+	memset(&conf->fanout[msg], 0x00, sizeof(struct mmsghdr));
+	conf->fanout[msg].msg_hdr.msg_name = addr;
+	conf->fanout[msg].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	conf->fanout[msg].msg_hdr.msg_iov = iov;
+	if (hdr == NULL)
+	{
+		iov[0].iov_base = (void *)body;
+		iov[0].iov_len = len;
+		conf->fanout[msg].msg_hdr.msg_iovlen = 1;
+		return;
+	}
+	iov[0].iov_base = (void *)hdr;
+	iov[0].iov_len = MIXER_RTP_HEADER_SIZE;
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = len;
+	conf->fanout[msg].msg_hdr.msg_iovlen = 2;
+}
+static void fanout_send(struct mixer_conference *conf, int msgs)
+{
+	int sent = 0, n;
+
+	while(sent < msgs)
+	{
+		n = sendmmsg(conf->sock, &conf->fanout[sent], msgs - sent, 0);
+		if (n < 0)
 		{
-			//TraceEvent( TRACE_DEBUG, "Child(Pid=%u): channel=%d, len=%d", getpid(), channel, len );
-			sendto(p_ch->sock, buf, len, 0, (struct sockaddr *)&(p_ch->addr), sizeof(struct sockaddr_in));
+			if (errno == EINTR)
+				continue;
+			/* skip the participant the kernel refused and carry on with the rest */
+			TraceEvent( TRACE_DEBUG, "Meetme(%s): sendmmsg() failed to '%s:%d' errno %d (%s)", conf->session, inet_ntoa(((struct sockaddr_in *)conf->fanout[sent].msg_hdr.msg_name)->sin_addr), ntohs(((struct sockaddr_in *)conf->fanout[sent].msg_hdr.msg_name)->sin_port), errno, strerror(errno));
+			n = 1;
 		}
+		sent += n;
 	}
-	
-	return 0;	
 }
-static int send_to_video_channel(char* buf, int len, int channel)
+/* One packet to everyone but its sender, all in one sendmmsg */
+static int send_to_all_video_channel(struct mixer_conference *conf, char* buf, int len, int own_channel)
 {
-	struct channel_info  *p_ch = NULL;
-	
-	if ((channel >= 0 ) && (channel < MAX_PARTICIPANT )) 
+	struct channel_info  *p_ch = conf->chi;
+	int msgs = 0;
+
+	while(p_ch != NULL && msgs < conf->fanout_size)
 	{
-		p_ch = find_sockaddr_by_channelno(p_chi, channel);
-		if (p_ch!=NULL)
+		if(p_ch->channel_num != own_channel)
 		{
-			//TraceEvent( TRACE_DEBUG, "Child(Pid=%u):Video channel=%d, len=%d", getpid(), channel, len );
-			sendto(p_ch->sock, buf, len, 0, (struct sockaddr *)&(p_ch->addr), sizeof(struct sockaddr_in));
+			fanout_add(conf, msgs++, &p_ch->addr, NULL, buf, len);
 		}
+		p_ch = p_ch->next;
 	}
+	fanout_send(conf, msgs);
 
-	return 0;	
+	return 0;
 }
-static int send_to_all_video_channel(char* buf, int len, int own_channel)
+/* The listeners' shared audio packet, all in one sendmmsg */
+static int send_to_audio_listeners(void* ctx, const uint8_t (*headers)[MIXER_RTP_HEADER_SIZE], const int* channels, int count, const uint8_t* payload, int len)
 {
-	struct channel_info  *p_ch = p_chi;
-	while(p_ch != NULL)
+	struct mixer_conference *conf = (struct mixer_conference *)ctx;
+	struct channel_info  *p_ch;
+	int i, msgs = 0;
+
+	for (i = 0; i < count && msgs < conf->fanout_size; i++)
 	{
-		if(p_ch->channel_num != own_channel)
+		if ((p_ch = channel_by_num(conf, channels[i])) != NULL)
+			fanout_add(conf, msgs++, &p_ch->addr, headers[i], payload, len);
+	}
+	fanout_send(conf, msgs);
+
+	return 0;
+}
+static int reserve_fanout(struct mixer_conference *conf, int participants)
+{
+	void *p;
+	int size = conf->fanout_size ? conf->fanout_size : MS_CHANNEL_HASH_SIZE;
+
+	if (participants <= conf->fanout_size)
+		return 0;
+	while (size < participants)
+		size <<= 1;
+	/* a failed realloc keeps the old block, fanout_size stays right for all three */
+	if ((p = realloc(conf->fanout, size * sizeof(struct mmsghdr))) == NULL)
+		return -1;
+	conf->fanout = (struct mmsghdr *)p;
+	if ((p = realloc(conf->fanout_iov, 2 * size * sizeof(struct iovec))) == NULL)
+		return -1;
+	conf->fanout_iov = (struct iovec *)p;
+	if ((p = realloc(conf->fanout_hdr, size * sizeof(conf->fanout_hdr[0]))) == NULL)
+		return -1;
+	conf->fanout_hdr = (uint8_t (*)[MIXER_RTP_HEADER_SIZE])p;
+	conf->fanout_size = size;
+	return 0;
+}
+
+/* Ask src for a keyframe on one of its layers, at most once per MS_KEYFRAME_REQ_MS */
+static void request_keyframe(struct mixer_conference *conf, struct channel_info *src, int layer, int64_t now)
+{
+	uint8_t pli[12];
+	int len;
+
+	if (now - src->video.keyframe_ms[layer] < MS_KEYFRAME_REQ_MS)
+		return;
+	src->video.keyframe_ms[layer] = now;
+	len = rtcp_build_pli(pli, src->video.base_ssrc + layer * MS_SIMULCAST_SSRC_STRIDE);
+	sendto(conf->sock, pli, len, 0, (struct sockaddr *)&src->addr, sizeof(struct sockaddr_in));
+}
+static void free_channel(struct channel_info *p_ch)
+{
+	int layer;
+
+	for (layer = 0; layer < MS_SIMULCAST_LAYERS; layer++)
+		free(p_ch->video.rtx[layer]);
+	free(p_ch);
+}
+/* Forget every receiver's view of src, its layers are about to mean something else */
+static void drop_video_forwards(struct mixer_conference *conf, struct channel_info *src)
+{
+	struct channel_info *rcv;
+	int i;
+
+	for (rcv = conf->chi; rcv != NULL; rcv = rcv->next)
+	{
+		for (i = 0; i < MS_VIDEO_FORWARDS; i++)
 		{
-			sendto(p_ch->sock, buf, len, 0, (struct sockaddr *)&(p_ch->addr), sizeof(struct sockaddr_in));
+			if (rcv->fwd[i].src == src)
+				memset(&rcv->fwd[i], 0x00, sizeof(struct video_forward));
 		}
-		p_ch = p_ch->next;
 	}
+}
+/* Simulcast layer of ssrc for src, -1 for a stream that is none of its layers */
+static int video_layer(struct mixer_conference *conf, struct channel_info *src, uint32_t ssrc)
+{
+	struct video_source *video = &src->video;
+	uint32_t delta;
+	int shift, layer;
 
-	return 0;	
+	if (video->base_ssrc == 0)
+	{
+		video->base_ssrc = ssrc;
+		return 0;
+	}
+	delta = ssrc - video->base_ssrc;
+	if (delta % MS_SIMULCAST_SSRC_STRIDE == 0 && delta / MS_SIMULCAST_SSRC_STRIDE < MS_SIMULCAST_LAYERS)
+		return delta / MS_SIMULCAST_SSRC_STRIDE;
+	/* a lower layer showed up after a higher one: it is the base */
+	delta = video->base_ssrc - ssrc;
+	if (delta % MS_SIMULCAST_SSRC_STRIDE != 0 || delta / MS_SIMULCAST_SSRC_STRIDE >= MS_SIMULCAST_LAYERS)
+		return -1;
+	shift = delta / MS_SIMULCAST_SSRC_STRIDE;
+	for (layer = MS_SIMULCAST_LAYERS - shift; layer < MS_SIMULCAST_LAYERS; layer++)
+		free(video->rtx[layer]);
+	for (layer = MS_SIMULCAST_LAYERS - 1; layer >= 0; layer--)
+	{
+		video->layer_bytes[layer] = layer >= shift ? video->layer_bytes[layer - shift] : 0;
+		video->layer_bps[layer] = layer >= shift ? video->layer_bps[layer - shift] : 0;
+		video->keyframe_ms[layer] = layer >= shift ? video->keyframe_ms[layer - shift] : 0;
+		video->rtx[layer] = layer >= shift ? video->rtx[layer - shift] : NULL;
+		if (layer >= shift)
+			video->stats[layer] = video->stats[layer - shift];
+		else
+			memset(&video->stats[layer], 0x00, sizeof(struct rtp_stats));
+	}
+	video->base_ssrc = ssrc;
+	drop_video_forwards(conf, src);
+	return 0;
 }
+/*
+ * rcv's slot for src. A new sender only gets a free slot or one whose
+ * sender has been silent for MS_VIDEO_FORWARD_IDLE_MS, NULL if there is
+ * none: more senders than slots must not evict each other packet by packet.
+ */
+static struct video_forward *video_forward(struct channel_info *rcv, struct channel_info *src, int64_t now)
+{
+	struct video_forward *unused = NULL, *idle = NULL, *slot;
+	int i;
 
-static int start_meetme(int sockfd, struct sockaddr_in *sender_sock, char *meetmekey)
+	for (i = 0; i < MS_VIDEO_FORWARDS; i++)
+	{
+		if (rcv->fwd[i].src == src)
+			return &rcv->fwd[i];
+		if (rcv->fwd[i].src == NULL)
+		{
+			if (unused == NULL)
+				unused = &rcv->fwd[i];
+		}
+		else if (now - rcv->fwd[i].seen_ms > MS_VIDEO_FORWARD_IDLE_MS && (idle == NULL || rcv->fwd[i].seen_ms < idle->seen_ms))
+		{
+			idle = &rcv->fwd[i];
+		}
+	}
+	if ((slot = (unused != NULL) ? unused : idle) == NULL)
+		return NULL;
+	memset(slot, 0x00, sizeof(struct video_forward));
+	slot->src = src;
+	slot->layer = -1;
+	return slot;
+}
+/* Keep pkt for NACKs, a stream's cache is allocated with its first packet */
+static void cache_video(struct channel_info *src, int layer, uint16_t seq, const uint8_t *pkt, int len)
+{
+	struct rtx_cache *rtx = src->video.rtx[layer];
+	int slot = seq & (MS_RTX_CACHE - 1);
+
+	if (len > MS_RTX_PKT_SIZE)
+		return;
+	if (rtx == NULL)
+	{
+		if ((rtx = (struct rtx_cache *)calloc(1, sizeof(struct rtx_cache))) == NULL)
+			return;
+		src->video.rtx[layer] = rtx;
+	}
+	rtx->seq[slot] = seq;
+	rtx->len[slot] = len;
+	memcpy(rtx->pkt[slot], pkt, len);
+}
+/*
+ * Simulcast forwarding: every receiver gets one layer of src, moved onto
+ * the base ssrc with its own sequence numbers and timestamps, so layer
+ * switches look like a continuous stream. A switch, like a receiver's
+ * first packet of src, waits for a keyframe of the new layer.
+ */
+static void forward_video(struct mixer_conference *conf, struct channel_info *src, uint8_t *pkt, int len)
+{
+	struct channel_info *rcv;
+	struct video_forward *fwd;
+	uint8_t *hdr;
+	uint32_t ts;
+	uint16_t seq;
+	int64_t now, elapsed;
+	int layer, offset, vp8, keyframe, msgs = 0;
+
+	layer = len > 12 ? video_layer(conf, src, read32(pkt + 8)) : -1;
+	if (layer < 0)
+	{
+		send_to_all_video_channel(conf, (char *)pkt, len, src->channel_num);
+		return;
+	}
+	src->video.layer_bytes[layer] += len;
+	now = now_ms();
+	seq = (pkt[2] << 8) | pkt[3];
+	ts = read32(pkt + 4);
+	offset = rtp_payload_offset(pkt, len);
+	vp8 = (pkt[1] & 0x7f) == kWtkPayloadTypeVP8;
+	keyframe = vp8 && offset > 0 && rtp_vp8_keyframe_start(pkt + offset, len - offset);
+	rtp_stats_update(&src->video.stats[layer], read32(pkt + 8), seq, ts, now, 90);
+	cache_video(src, layer, seq, pkt, len);
+
+	for (rcv = conf->chi; rcv != NULL && msgs < conf->fanout_size; rcv = rcv->next)
+	{
+		if (rcv == src)
+			continue;
+		if ((fwd = video_forward(rcv, src, now)) == NULL)
+			continue;
+		fwd->seen_ms = now;
+		if (layer != fwd->layer)
+		{
+			if (layer != fwd->target)
+				continue;
+			/* a first packet can only wait for a keyframe it can tell apart */
+			if (!keyframe && (fwd->layer >= 0 || vp8))
+			{
+				request_keyframe(conf, src, layer, now);
+				continue;
+			}
+			if (fwd->layer >= 0)
+			{
+				/* pick up right after what the receiver has seen */
+				elapsed = now - fwd->last_ms;
+				fwd->seq_offset = (uint16_t)(fwd->last_seq + 1 - seq);
+				fwd->ts_offset = fwd->last_ts + (elapsed > 0 ? (uint32_t)elapsed * 90 : 1) - ts;
+			}
+			fwd->layer = layer;
+			fwd->switch_seq = seq + fwd->seq_offset;
+		}
+		fwd->last_seq = seq + fwd->seq_offset;
+		fwd->last_ts = ts + fwd->ts_offset;
+		fwd->last_ms = now;
+
+		hdr = conf->fanout_hdr[msgs];
+		memcpy(hdr, pkt, 12);
+		hdr[2] = fwd->last_seq >> 8;
+		hdr[3] = fwd->last_seq & 0xff;
+		write32(hdr + 4, fwd->last_ts);
+		write32(hdr + 8, src->video.base_ssrc);
+		fanout_add(conf, msgs++, &rcv->addr, hdr, pkt + MIXER_RTP_HEADER_SIZE, len - MIXER_RTP_HEADER_SIZE);
+	}
+	fanout_send(conf, msgs);
+}
+/* Resend what rcv NACKed of src, from the layer it is getting now */
+static void retransmit_video(struct mixer_conference *conf, struct channel_info *rcv, struct channel_info *src, uint16_t seq)
+{
+	struct video_forward *fwd = NULL;
+	struct rtx_cache *rtx;
+	uint8_t pkt[MS_RTX_PKT_SIZE];
+	uint16_t orig;
+	int i, slot;
+
+	for (i = 0; i < MS_VIDEO_FORWARDS; i++)
+	{
+		if (rcv->fwd[i].src == src)
+			fwd = &rcv->fwd[i];
+	}
+	/* packets from before the last layer switch are gone for good */
+	if (fwd == NULL || fwd->layer < 0 || (int16_t)(seq - fwd->switch_seq) < 0 || (int16_t)(fwd->last_seq - seq) < 0)
+		return;
+	if ((rtx = src->video.rtx[fwd->layer]) == NULL)
+		return;
+	orig = seq - fwd->seq_offset;
+	slot = orig & (MS_RTX_CACHE - 1);
+	if (rtx->len[slot] == 0 || rtx->seq[slot] != orig)
+		return;
+	memcpy(pkt, rtx->pkt[slot], rtx->len[slot]);
+	pkt[2] = seq >> 8;
+	pkt[3] = seq & 0xff;
+	write32(pkt + 4, read32(pkt + 4) + fwd->ts_offset);
+	write32(pkt + 8, src->video.base_ssrc);
+	sendto(conf->sock, pkt, rtx->len[slot], 0, (struct sockaddr *)&rcv->addr, sizeof(struct sockaddr_in));
+}
+static struct channel_info *find_video_source(struct mixer_conference *conf, struct channel_info *rcv, uint32_t base_ssrc)
+{
+	struct channel_info *src;
+
+	for (src = conf->chi; src != NULL; src = src->next)
+	{
+		if (src != rcv && src->video.base_ssrc == base_ssrc)
+			return src;
+	}
+	return NULL;
+}
+/*
+ * RTCP ends here, nothing a participant sends is forwarded: NACKs are
+ * answered from the retransmission cache, keyframe requests go to the
+ * sender coalesced, REMB picks layers and senders get the mixer's own
+ * receiver reports.
+ */
+static void process_rtcp(struct mixer_conference *conf, struct channel_info *rcv, uint8_t *pkt, int len)
+{
+	struct rtcp_feedback fb;
+	struct channel_info *src = NULL;
+	struct rtp_stats *stats;
+	int64_t now = now_ms();
+	int i, j, layer;
+
+	rtcp_parse_feedback(pkt, len, &fb);
+	if (fb.remb_bps != 0)
+	{
+		rcv->remb_bps = fb.remb_bps;
+		rcv->remb_time = time(NULL);
+	}
+	for (i = 0; i < fb.srs; i++)
+	{
+		stats = &rcv->audio;
+		for (layer = 0; layer < MS_SIMULCAST_LAYERS && stats->ssrc != fb.sr_ssrc[i]; layer++)
+			stats = &rcv->video.stats[layer];
+		if (stats->ssrc == fb.sr_ssrc[i] && stats->received != 0)
+		{
+			stats->lsr = fb.sr_ntp[i];
+			stats->lsr_ms = now;
+		}
+	}
+	for (i = 0; i < fb.nacks; i++)
+	{
+		if (src == NULL || src->video.base_ssrc != fb.nack_ssrc[i])
+			src = find_video_source(conf, rcv, fb.nack_ssrc[i]);
+		if (src != NULL)
+			retransmit_video(conf, rcv, src, fb.nack_seq[i]);
+	}
+	for (i = 0; i < fb.keyframes; i++)
+	{
+		if ((src = find_video_source(conf, rcv, fb.keyframe_ssrc[i])) == NULL)
+			continue;
+		/* the receiver asked for the base ssrc, the keyframe is due on the layer it gets */
+		layer = 0;
+		for (j = 0; j < MS_VIDEO_FORWARDS; j++)
+		{
+			if (rcv->fwd[j].src == src && rcv->fwd[j].layer > 0)
+				layer = rcv->fwd[j].layer;
+		}
+		request_keyframe(conf, src, layer, now);
+	}
+}
+/* Once a second: one receiver report per sender, on what reached the mixer from it */
+static void send_receiver_reports(struct mixer_conference *conf)
+{
+	struct channel_info *p_ch;
+	struct rtp_stats *stats[1 + MS_SIMULCAST_LAYERS];
+	uint8_t rr[8 + 24 * (1 + MS_SIMULCAST_LAYERS)];
+	int64_t now = now_ms();
+	int count, layer;
+
+	for (p_ch = conf->chi; p_ch != NULL; p_ch = p_ch->next)
+	{
+		count = 0;
+		if (p_ch->audio.received != 0)
+			stats[count++] = &p_ch->audio;
+		for (layer = 0; layer < MS_SIMULCAST_LAYERS; layer++)
+		{
+			if (p_ch->video.stats[layer].received != 0)
+				stats[count++] = &p_ch->video.stats[layer];
+		}
+		if (count > 0)
+			sendto(conf->sock, rr, rtcp_build_rr(rr, stats, count, now), 0, (struct sockaddr *)&p_ch->addr, sizeof(struct sockaddr_in));
+	}
+}
+/* Once a second: measure every layer, then fit each receiver's layers into its REMB */
+static void update_video_layers(struct mixer_conference *conf, time_t now)
+{
+	struct channel_info *p_ch, *rcv;
+	struct video_forward *fwd;
+	uint32_t budget, bps;
+	int64_t elapsed = now_ms() - conf->rate_ms;
+	int senders = 0, i, layer;
+
+	if (elapsed <= 0)
+		return;
+	conf->rate_ms += elapsed;
+	for (p_ch = conf->chi; p_ch != NULL; p_ch = p_ch->next)
+	{
+		if (p_ch->video.base_ssrc != 0)
+			senders++;
+		for (layer = 0; layer < MS_SIMULCAST_LAYERS; layer++)
+		{
+			p_ch->video.layer_bps[layer] = (uint32_t)((uint64_t)p_ch->video.layer_bytes[layer] * 8000 / elapsed);
+			p_ch->video.layer_bytes[layer] = 0;
+		}
+	}
+	for (rcv = conf->chi; rcv != NULL; rcv = rcv->next)
+	{
+		budget = 0xffffffff;
+		if (rcv->remb_bps != 0 && (now - rcv->remb_time) <= MS_REMB_TIMEOUT)
+		{
+			i = senders - (rcv->video.base_ssrc != 0);
+			budget = rcv->remb_bps / (i > 0 ? i : 1);
+		}
+		for (i = 0; i < MS_VIDEO_FORWARDS; i++)
+		{
+			fwd = &rcv->fwd[i];
+			if (fwd->src == NULL)
+				continue;
+			fwd->target = 0;
+			for (layer = 1; layer < MS_SIMULCAST_LAYERS; layer++)
+			{
+				bps = fwd->src->video.layer_bps[layer];
+				/* going up wants 10% headroom, a receiver on the edge does not flap */
+				if (bps != 0 && (layer > fwd->layer ? bps + bps / 10 : bps) <= budget)
+					fwd->target = layer;
+			}
+			if (fwd->layer >= 0 && fwd->target != fwd->layer)
+				request_keyframe(conf, fwd->src, fwd->target, now_ms());
+		}
+	}
+}
+
+static int init_conference(struct mixer_conference *conf, char *meetmekey)
+{
+	memset(conf, 0x00, sizeof(struct mixer_conference));
+	conf->sock = -1;
+	strncpy(conf->session, meetmekey, 32);
+	snprintf(conf->number, 32, "%s", &meetmekey[33]);
+	conf->recv_time = time(NULL);
+	conf->rate_ms = now_ms();
+	return channel_table_init(&conf->channels, MS_CHANNEL_HASH_SIZE);
+}
+static void free_conference(struct mixer_conference *conf)
+{
+	struct channel_info *p_ch, *next;
+
+	/* stops the engine threads, nothing calls send_to_audio_channel() afterwards */
+	if (conf->engine != NULL)
+	{
+		libwtk_mixer_destroy_conference(conf->engine);
+		conf->engine = NULL;
+	}
+	for (p_ch = conf->chi; p_ch != NULL; p_ch = next)
+	{
+		next = p_ch->next;
+		free_channel(p_ch);
+	}
+	conf->chi = NULL;
+	channel_table_free(&conf->channels);
+	free(conf->by_channel);
+	conf->by_channel = NULL;
+	conf->by_channel_size = 0;
+	free(conf->fanout);
+	conf->fanout = NULL;
+	free(conf->fanout_iov);
+	conf->fanout_iov = NULL;
+	free(conf->fanout_hdr);
+	conf->fanout_hdr = NULL;
+	conf->fanout_size = 0;
+	if (conf->sock >= 0)
+	{
+		close(conf->sock);
+		conf->sock = -1;
+	}
+}
+static void reply_new_conference(int sockfd, struct sockaddr_in *sender_sock, struct mixer_conference *conf)
+{
+	struct mixservice_rep ms_rep;
+	socklen_t slen = sizeof(struct sockaddr_in);
+
+	memset(&ms_rep, 0x00, sizeof(struct mixservice_rep));
+	strcpy(ms_rep.action, MS_CMD_NCF);
+	strcpy(ms_rep.session, conf->session);
+	getsockname(conf->sock, (struct sockaddr *)&ms_rep.addr, &slen);
+	TraceEvent(TRACE_DEBUG, "Meetme(%s): started Success at ip[%s], port[%d]", conf->session, inet_ntoa(ms_rep.addr.sin_addr), ntohs(ms_rep.addr.sin_port));
+
+	sendto(sockfd, &ms_rep, sizeof(struct mixservice_rep), 0, (struct sockaddr *)sender_sock, sizeof(struct sockaddr_in));
+	sendto(sockfd, &ms_rep, sizeof(struct mixservice_rep), 0, (struct sockaddr *)sender_sock, sizeof(struct sockaddr_in));
+}
+/* Once a second: free the channels of participants gone silent, the engine hands them out again */
+static void expire_participants(struct mixer_conference *conf, time_t now)
+{
+	struct channel_info **pp_ch, *p_ch;
+
+	if (now == conf->check_time)
+		return;
+	conf->check_time = now;
+	pp_ch = &conf->chi;
+	while ((p_ch = *pp_ch) != NULL)
+	{
+		if ((now - p_ch->updateTime) <= MS_PARTICIPANT_TIMEOUT)
+		{
+			pp_ch = &p_ch->next;
+			continue;
+		}
+		TraceEvent( TRACE_INFO, "Meetme(%s): Participant %s:%d timed out, channel = %d", conf->session, inet_ntoa(p_ch->addr.sin_addr), ntohs(p_ch->addr.sin_port), p_ch->channel_num);
+		*pp_ch = p_ch->next;
+		channel_table_remove(&conf->channels, p_ch);
+		set_channel_slot(conf, p_ch->channel_num, NULL);
+		libwtk_mixer_conference_remove_participant(conf->engine, p_ch->channel_num);
+		drop_video_forwards(conf, p_ch);
+		free_channel(p_ch);
+		conf->num_participants--;
+	}
+	update_video_layers(conf, now);
+	send_receiver_reports(conf);
+}
+/* Returns -1 once the conference is hung up */
+static int process_conference_packet(struct mixer_conference *conf, uint8_t *pktbuf, ssize_t bread, struct sockaddr_in *sender_sock)
+{
+	struct channel_info  *p_ch = NULL;
+
+	if(strncmp((const char *)pktbuf, MS_CMD_HCF, MS_CMD_LEN)==0)
+	{
+		TraceEvent(TRACE_NORMAL, "Meetme(%s): Meetme stop Success", conf->session);
+		return -1;
+	}
+	switch(pktbuf[1]&0x7f)
+	{
+		case kWtkPayloadTypeOpus:
+		{
+			p_ch = channel_table_lookup(&conf->channels, sender_sock);
+			if(p_ch == NULL)
+			{
+				if(conf->num_participants >= MS_PARTICIPANTS_MAX)
+				{
+					TraceEvent( TRACE_WARNING, "Meetme(%s): Participant limit %d reached, drop %s:%d", conf->session, MS_PARTICIPANTS_MAX, inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+					return 0;
+				}
+				p_ch = (struct channel_info*)calloc(1, sizeof(struct channel_info));
+				if(p_ch == NULL || reserve_fanout(conf, conf->num_participants + 1) < 0)
+				{
+					free(p_ch);
+					TraceEvent( TRACE_ERROR, "Meetme(%s): Failed to allocate participant", conf->session);
+					return 0;
+				}
+				memcpy(&(p_ch->addr), sender_sock, sizeof(struct sockaddr_in));
+				p_ch->sock = conf->sock;
+				p_ch->channel_num = libwtk_mixer_conference_add_participant(conf->engine);
+				if(set_channel_slot(conf, p_ch->channel_num, p_ch) < 0)
+				{
+					libwtk_mixer_conference_remove_participant(conf->engine, p_ch->channel_num);
+					free(p_ch);
+					TraceEvent( TRACE_ERROR, "Meetme(%s): Failed to allocate participant", conf->session);
+					return 0;
+				}
+				channel_table_insert(&conf->channels, p_ch);
+				p_ch->next = conf->chi;
+				conf->chi = p_ch;
+				conf->num_participants++;
+
+				TraceEvent( TRACE_INFO, "Meetme(%s): New Participant insert, bread=[%d], channel = %d", conf->session, bread, p_ch->channel_num);
+				libwtk_mixer_conference_decode_audio(conf->engine, pktbuf, bread, p_ch->channel_num);
+			}
+			else
+			{
+				libwtk_mixer_conference_decode_audio(conf->engine, pktbuf, bread, p_ch->channel_num);
+			}
+
+			if(bread > 12)
+				rtp_stats_update(&p_ch->audio, read32(pktbuf + 8), (pktbuf[2] << 8) | pktbuf[3], read32(pktbuf + 4), now_ms(), 48);
+			p_ch->updateTime = time(NULL);
+			conf->recv_time = p_ch->updateTime;
+		}
+		break;
+		/*
+		case kWtkPayloadTypeVP8:
+		case kWtkPayloadTypeVP9:
+		case kWtkPayloadTypeH264:
+		{
+			p_ch = channel_table_lookup(&conf->channels, sender_sock);
+			if(p_ch == NULL)
+			{
+				TraceEvent( TRACE_INFO, "Meetme(%s): This video frame has no a exsit audio channel, so unknown where is to be forward!!!", conf->session);
+			}
+			else
+			{
+				send_to_all_video_channel(conf, (char*)pktbuf, bread, p_ch->channel_num);
+			}
+		}
+		break;
+		default:
+			TraceEvent( TRACE_INFO, "Meetme(%s): Does not support this data PT(%d), and the data len=[%d]", conf->session,pktbuf[1]&0x7f,bread);
+		break;
+		*/
+		default:
+		{
+			p_ch = channel_table_lookup(&conf->channels, sender_sock);
+			if(p_ch == NULL)
+			{
+				TraceEvent( TRACE_INFO, "Meetme(%s): This video frame has no a exsit audio channel, so unknown where is to be forward!!!", conf->session);
+			}
+			else if(pktbuf[1] >= 192 && pktbuf[1] <= 223)
+			{
+				/* RTCP, RFC 5761 */
+				process_rtcp(conf, p_ch, pktbuf, bread);
+			}
+			else
+			{
+				forward_video(conf, p_ch, pktbuf, bread);
+			}
+		}
+		break;
+	}
+	return 0;
+}
+
+static int start_meetme(int sockfd, struct sockaddr_in *sender_sock, char *meetmekey, int max_speakers)
 {
 	uint8_t pktbuf[MS_PKTBUF_SIZE];
-	char conf_session[36];
-	char conf_number[36];
-	int sock = -1;
+	struct mixer_conference conf;
 	int keep_running = 1;
 	int rc;
 	ssize_t bread;
-	struct mixservice_rep ms_rep;
-	socklen_t slen = sizeof(struct sockaddr_in);
 	struct sockaddr_in local_sender_addr;
-	int max_sock;
+	int max_sock, timer_fd, ticks;
 	fd_set socket_mask;
 	struct timeval wait_time;
-	int i_recv_timeout = 0;
 	socklen_t i;
-	struct channel_info  *p_ch = NULL;
-	
+
 	memcpy(&local_sender_addr, sender_sock, sizeof(struct sockaddr_in));
-	memset(conf_session, 0x00, sizeof(conf_session));
-	memset(conf_number, 0x00, sizeof(conf_number));
-	strncpy(conf_session, meetmekey, 32);
-	snprintf(conf_number, 32, "%s", &meetmekey[33]);
-	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): parse meetmekey::conf_session=%s,conf_number=%s",getpid(),conf_session, conf_number);
-	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start init lib WtkRTC Engine!");
-	libwtk_set_mixer_audio_transport(send_to_audio_channel);
-	//libwtk_set_mixer_video_transport(send_to_video_channel);
-
-	libwtk_mixer_init();
-	
-	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start init lib WtkRTC Engine end!");
+	if (init_conference(&conf, meetmekey) < 0)
+	{
+		TraceEvent( TRACE_ERROR, "Child(Pid=%u): Failed to allocate Meetme, Meetme started Fail!", getpid());
+		free_conference(&conf);
+		return -1;
+	}
+	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): parse meetmekey::conf_session=%s,conf_number=%s",getpid(),conf.session, conf.number);
+	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start init lib WtkRTC Engine!", getpid());
+
+	conf.engine = libwtk_mixer_create_owned_conference(send_to_audio_channel, &conf);
+	libwtk_mixer_conference_set_fanout_transport(conf.engine, send_to_audio_listeners);
+	conf.max_speakers = max_speakers;
+	libwtk_mixer_conference_set_max_speakers(conf.engine, conf.max_speakers);
+
+	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start init lib WtkRTC Engine end!", getpid());
 
-	TraceEvent( TRACE_INFO,"Child(Pid=%u): conf_session=%s, Begin Createing New Meetme",getpid(), conf_session);
-	sock = setup_ms_socket(0, NULL, 1 );/*bind ANY*/
-	if(-1 == sock)
+	TraceEvent( TRACE_INFO,"Child(Pid=%u): conf_session=%s, Begin Createing New Meetme",getpid(), conf.session);
+	conf.sock = setup_ms_socket(0, NULL, 1 );/*bind ANY*/
+	if(-1 == conf.sock)
 	{
 		TraceEvent( TRACE_ERROR, "Child(Pid=%u): Failed to open main socket. %s, Meetme started Fail!",getpid(), strerror(errno));
+		free_conference(&conf);
+		return -1;
+	}
+	timer_fd = setup_tick_timer();
+	if(-1 == timer_fd)
+	{
+		TraceEvent( TRACE_ERROR, "Child(Pid=%u): Failed to create mixer clock. %s, Meetme started Fail!",getpid(), strerror(errno));
+		free_conference(&conf);
 		return -1;
 	}
 
-	memset(&ms_rep, 0x00, sizeof(struct mixservice_rep));
-	strcpy(ms_rep.action, MS_CMD_NCF);
-	strcpy(ms_rep.session, conf_session);
-	getsockname(sock, (struct sockaddr *)&ms_rep.addr, &slen);
-	TraceEvent(TRACE_DEBUG, "Child(Pid=%u):Meetme started Success at ip[%s], port[%d]",getpid(), inet_ntoa(ms_rep.addr.sin_addr), ntohs(ms_rep.addr.sin_port));
-	
-	sendto(sockfd, &ms_rep, sizeof(struct mixservice_rep), 0, (struct sockaddr *)&local_sender_addr, sizeof(struct sockaddr_in));
-	sendto(sockfd, &ms_rep, sizeof(struct mixservice_rep), 0, (struct sockaddr *)&local_sender_addr, sizeof(struct sockaddr_in));
+	reply_new_conference(sockfd, &local_sender_addr, &conf);
 	usleep(200*1000);
 	close(sockfd);
-	i_recv_timeout = time(NULL);
+	conf.recv_time = time(NULL);
 	while(keep_running)
 	{
 		FD_ZERO(&socket_mask);
-		max_sock = sock;
-		FD_SET(sock, &socket_mask);
+		max_sock = conf.sock > timer_fd ? conf.sock : timer_fd;
+		FD_SET(conf.sock, &socket_mask);
+		FD_SET(timer_fd, &socket_mask);
 
 		wait_time.tv_sec = 10;
 		wait_time.tv_usec = 0;
@@ -152,87 +840,23 @@ static int start_meetme(int sockfd, struct sockaddr_in *sender_sock, char *meetm
 		rc = select(max_sock+1, &socket_mask, NULL, NULL, &wait_time);
 		if(rc > 0)
 		{
-			if (FD_ISSET(sock, &socket_mask))
+			if (FD_ISSET(timer_fd, &socket_mask))
 			{
-				i = sizeof(sender_sock);
-				bread = recvfrom(sock, pktbuf, MS_PKTBUF_SIZE, 0/*flags*/, (struct sockaddr *)&local_sender_addr, (socklen_t*)&i);
+				for (ticks = read_ticks(timer_fd); ticks > 0; ticks--)
+					libwtk_mixer_conference_tick(conf.engine);
+			}
+			if (FD_ISSET(conf.sock, &socket_mask))
+			{
+				i = sizeof(local_sender_addr);
+				bread = recvfrom(conf.sock, pktbuf, MS_PKTBUF_SIZE, 0/*flags*/, (struct sockaddr *)&local_sender_addr, (socklen_t*)&i);
 				if(bread < MS_CMD_LEN)
 				{
 					TraceEvent( TRACE_ERROR, "Child(Pid=%u): recvfrom() failed %d errno %d (%s)", getpid(), bread, errno, strerror(errno));
 				}
-				else
+				else if(process_conference_packet(&conf, pktbuf, bread, &local_sender_addr) < 0)
 				{
-					if(strncmp((const char *)pktbuf, MS_CMD_HCF, MS_CMD_LEN)==0)
-					{
-						keep_running = 0;
-						TraceEvent(TRACE_NORMAL, "Child(Pid=%u): Meetme stop Success", getpid());
-						break;
-					}
-					switch(pktbuf[1]&0x7f)
-					{
-						case kWtkPayloadTypeOpus:
-						{
-							//audio rtcp pt = 200(sender report Source description, 40 byte) 
-							//201(reciver report, 32 byte), seems no effect?
-							static int channel = 0;
-							p_ch = find_channel_info_by_sockaddr(p_chi, &local_sender_addr);
-							if(p_ch == NULL)
-							{
-								p_ch = (struct channel_info*)calloc(1, sizeof(struct channel_info));
-								memcpy(&(p_ch->addr), &local_sender_addr, sizeof(struct sockaddr_in));
-								p_ch->sock = sock;
-								p_ch->channel_num = channel;
-								p_ch->next = p_chi;
-								p_chi = p_ch;
-	
-								TraceEvent( TRACE_INFO, "Child(Pid=%u): New Participant insert, bread=[%d], channel = %d", getpid(), bread,channel);
-								libwtk_mixer_setup_mixer(channel);
-								libwtk_mixer_decode_audio(pktbuf, bread, channel);
-								channel++;
-							}
-							else
-							{
-								libwtk_mixer_decode_audio(pktbuf, bread, p_ch->channel_num);
-							}
-							
-							p_ch->updateTime = time(NULL);
-							i_recv_timeout = p_ch->updateTime;
-						}
-						break;
-						/*
-						case kWtkPayloadTypeVP8:
-						case kWtkPayloadTypeVP9:
-						case kWtkPayloadTypeH264:
-						{
-							p_ch = find_channel_info_by_sockaddr(p_chi, &local_sender_addr);
-							if(p_ch == NULL)
-							{
-								TraceEvent( TRACE_INFO, "Child(Pid=%u): This video frame has no a exsit audio channel, so unknown where is to be forward!!!", getpid(), bread);
-							}
-							else
-							{
-								send_to_all_video_channel((char*)pktbuf, bread, p_ch->channel_num);
-							}
-						}
-						break;
-						default:
-							TraceEvent( TRACE_INFO, "Child(Pid=%u): Does not support this data PT(%d), and the data len=[%d]", getpid(),pktbuf[1]&0x7f,bread);
-						break;
-						*/
-						default:
-						{
-							p_ch = find_channel_info_by_sockaddr(p_chi, &local_sender_addr);
-							if(p_ch == NULL)
-							{
-								TraceEvent( TRACE_INFO, "Child(Pid=%u): This video frame has no a exsit audio channel, so unknown where is to be forward!!!", getpid(), bread);
-							}
-							else
-							{
-								send_to_all_video_channel((char*)pktbuf, bread, p_ch->channel_num);
-							}
-						}
-						break;
-					}
+					keep_running = 0;
+					break;
 				}
 			}
 		}
@@ -245,20 +869,286 @@ static int start_meetme(int sockfd, struct sockaddr_in *sender_sock, char *meetm
 			TraceEvent( TRACE_ERROR, "Child(Pid=%u): select error!!!", getpid());
 		}
 
-		if((time(NULL)-i_recv_timeout) > MS_RECV_TIMEOUT)
+		expire_participants(&conf, time(NULL));
+		if((time(NULL)-conf.recv_time) > MS_RECV_TIMEOUT)
 		{
 			keep_running = 0;
 			TraceEvent(TRACE_NORMAL, "Child(Pid=%u): MeetMe Recv Timeout,May be network interruption.Meetme stop Success", getpid());
 			break;
 		}
 	}
-	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start de-init lib WtkRTC Engine!");
-	libwtk_mixer_deinit();
-	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start de-init lib WtkRTC Engine end!");
+	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start de-init lib WtkRTC Engine!", getpid());
+	close(timer_fd);
+	free_conference(&conf);
+	TraceEvent( TRACE_DEBUG,"Child(Pid=%u): Mix Server start de-init lib WtkRTC Engine end!", getpid());
+
+	return 0;
+}
+
+/* Single-process mode: worker side, every conference call below runs on its owning worker */
+static void close_conference(struct mixer_worker *worker, struct mixer_conference *conf)
+{
+	struct mixer_conference **pp;
+
+	for (pp = &worker->confs; *pp != NULL; pp = &(*pp)->next)
+	{
+		if (*pp == conf)
+		{
+			*pp = conf->next;
+			break;
+		}
+	}
+	epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conf->sock, NULL);
+	free_conference(conf);
+	free(conf);
+	__atomic_sub_fetch(&worker->num_confs, 1, __ATOMIC_RELAXED);
+}
+static void adopt_conferences(struct mixer_worker *worker)
+{
+	struct mixer_conference *conf, *next;
+	struct epoll_event ev;
+	uint64_t count;
+
+	if (read(worker->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	{
+		TraceEvent( TRACE_ERROR, "Worker %d: eventfd read failed (%s)", worker->id, strerror(errno));
+	}
+	pthread_mutex_lock(&worker->lock);
+	conf = worker->pending;
+	worker->pending = NULL;
+	pthread_mutex_unlock(&worker->lock);
+
+	for (; conf != NULL; conf = next)
+	{
+		next = conf->next;
+		conf->next = NULL;
+		conf->recv_time = time(NULL);
+		conf->engine = libwtk_mixer_create_owned_conference(send_to_audio_channel, conf);
+		if (conf->engine != NULL)
+		{
+			libwtk_mixer_conference_set_fanout_transport(conf->engine, send_to_audio_listeners);
+			libwtk_mixer_conference_set_max_speakers(conf->engine, conf->max_speakers);
+		}
+
+		memset(&ev, 0x00, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = conf;
+		if (conf->engine == NULL || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, conf->sock, &ev) < 0)
+		{
+			TraceEvent( TRACE_ERROR, "Worker %d: conf_session=%s, Failed to start Meetme (%s)", worker->id, conf->session, strerror(errno));
+			free_conference(conf);
+			free(conf);
+			__atomic_sub_fetch(&worker->num_confs, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		conf->next = worker->confs;
+		worker->confs = conf;
+		TraceEvent( TRACE_INFO, "Worker %d: conf_session=%s, Begin Createing New Meetme", worker->id, conf->session);
+	}
+}
+/* Returns -1 once the conference is hung up */
+static int process_conference(struct mixer_conference *conf, uint8_t *pktbuf)
+{
+	struct sockaddr_in sender_sock;
+	socklen_t slen;
+	ssize_t bread;
+	int n;
+
+	for (n = 0; n < MS_RECV_BATCH; n++)
+	{
+		slen = sizeof(sender_sock);
+		bread = recvfrom(conf->sock, pktbuf, MS_PKTBUF_SIZE, MSG_DONTWAIT, (struct sockaddr *)&sender_sock, &slen);
+		if (bread < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				TraceEvent( TRACE_ERROR, "Meetme(%s): recvfrom() failed errno %d (%s)", conf->session, errno, strerror(errno));
+			}
+			break;
+		}
+		if (bread < MS_CMD_LEN)
+		{
+			continue;
+		}
+		if (process_conference_packet(conf, pktbuf, bread, &sender_sock) < 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+/* Every conference of the worker mixes on the worker's own clock */
+static void tick_conferences(struct mixer_worker *worker)
+{
+	struct mixer_conference *conf;
+	int ticks;
+
+	for (ticks = read_ticks(worker->timer_fd); ticks > 0; ticks--)
+	{
+		for (conf = worker->confs; conf != NULL; conf = conf->next)
+			libwtk_mixer_conference_tick(conf->engine);
+	}
+}
+static void expire_conferences(struct mixer_worker *worker, time_t now)
+{
+	struct mixer_conference *conf, *next;
 
+	for (conf = worker->confs; conf != NULL; conf = next)
+	{
+		next = conf->next;
+		if ((now - conf->recv_time) > MS_RECV_TIMEOUT)
+		{
+			TraceEvent(TRACE_NORMAL, "Meetme(%s): MeetMe Recv Timeout,May be network interruption.Meetme stop Success", conf->session);
+			close_conference(worker, conf);
+		}
+		else
+		{
+			expire_participants(conf, now);
+		}
+	}
+}
+static void *run_worker(void *arg)
+{
+	struct mixer_worker *worker = (struct mixer_worker *)arg;
+	struct epoll_event events[MS_EPOLL_EVENTS];
+	uint8_t pktbuf[MS_PKTBUF_SIZE];
+	struct mixer_conference *conf;
+	time_t now, last_check = time(NULL);
+	int i, rc;
+
+	TraceEvent(TRACE_NORMAL, "Worker %d: started", worker->id);
+	while(1)
+	{
+		rc = epoll_wait(worker->epoll_fd, events, MS_EPOLL_EVENTS, 1000);
+		if (rc < 0 && errno != EINTR)
+		{
+			TraceEvent( TRACE_ERROR, "Worker %d: epoll_wait error (%s)", worker->id, strerror(errno));
+		}
+		for (i = 0; i < rc; i++)
+		{
+			conf = (struct mixer_conference *)events[i].data.ptr;
+			if (conf == NULL)
+			{
+				adopt_conferences(worker);
+			}
+			else if (events[i].data.ptr == (void *)worker)
+			{
+				tick_conferences(worker);
+			}
+			else if (process_conference(conf, pktbuf) < 0)
+			{
+				/* a closed conference may still be listed later in this batch, stop here */
+				close_conference(worker, conf);
+				break;
+			}
+		}
+
+		now = time(NULL);
+		if (now != last_check)
+		{
+			expire_conferences(worker, now);
+			last_check = now;
+		}
+	}
+	return NULL;
+}
+static int setup_workers(ms_info_t *ms_info)
+{
+	struct mixer_worker *worker;
+	struct epoll_event ev;
+	int id;
+
+	ms_info->workers = (struct mixer_worker *)calloc(ms_info->num_workers, sizeof(struct mixer_worker));
+	if (ms_info->workers == NULL)
+	{
+		TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to allocate %d workers", getpid(), ms_info->num_workers);
+		return -1;
+	}
+	for (id = 0; id < ms_info->num_workers; id++)
+	{
+		worker = &ms_info->workers[id];
+		worker->id = id;
+		pthread_mutex_init(&worker->lock, NULL);
+		worker->epoll_fd = epoll_create1(0);
+		worker->event_fd = eventfd(0, EFD_NONBLOCK);
+		worker->timer_fd = setup_tick_timer();
+		if (worker->epoll_fd < 0 || worker->event_fd < 0 || worker->timer_fd < 0)
+		{
+			TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to create worker %d. %s", getpid(), id, strerror(errno));
+			return -1;
+		}
+		memset(&ev, 0x00, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->event_fd, &ev) < 0)
+		{
+			TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to start worker %d. %s", getpid(), id, strerror(errno));
+			return -1;
+		}
+		ev.data.ptr = worker;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->timer_fd, &ev) < 0
+			|| pthread_create(&worker->thread, NULL, run_worker, worker) != 0)
+		{
+			TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to start worker %d. %s", getpid(), id, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+/* Single-process mode: main thread side, open the conference socket and hand it to the least loaded worker */
+static int start_conference(ms_info_t *ms_info, struct sockaddr_in *sender_sock, char *meetmekey)
+{
+	struct mixer_conference *conf;
+	struct mixer_worker *worker;
+	uint64_t one = 1;
+	int id;
+
+	conf = (struct mixer_conference *)malloc(sizeof(struct mixer_conference));
+	if (conf == NULL)
+	{
+		TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to allocate Meetme", getpid());
+		return -1;
+	}
+	if (init_conference(conf, meetmekey) < 0)
+	{
+		TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to allocate Meetme", getpid());
+		free_conference(conf);
+		free(conf);
+		return -1;
+	}
+	conf->max_speakers = ms_info->max_speakers;
+	conf->sock = setup_ms_socket(0, NULL, 1 );/*bind ANY*/
+	if (-1 == conf->sock)
+	{
+		TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to open Meetme socket. %s, Meetme started Fail!", getpid(), strerror(errno));
+		free_conference(conf);
+		free(conf);
+		return -1;
+	}
+
+	worker = &ms_info->workers[0];
+	for (id = 1; id < ms_info->num_workers; id++)
+	{
+		if (__atomic_load_n(&ms_info->workers[id].num_confs, __ATOMIC_RELAXED) < __atomic_load_n(&worker->num_confs, __ATOMIC_RELAXED))
+			worker = &ms_info->workers[id];
+	}
+	conf->worker = worker;
+	__atomic_add_fetch(&worker->num_confs, 1, __ATOMIC_RELAXED);
+
+	reply_new_conference(ms_info->mixer_fd, sender_sock, conf);
+
+	pthread_mutex_lock(&worker->lock);
+	conf->next = worker->pending;
+	worker->pending = conf;
+	pthread_mutex_unlock(&worker->lock);
+	if (write(worker->event_fd, &one, sizeof(one)) < 0)
+	{
+		TraceEvent( TRACE_ERROR, "Father(Pid=%u): Failed to wake worker %d. %s", getpid(), worker->id, strerror(errno));
+	}
+	TraceEvent(TRACE_NORMAL, "Father(Pid=%u): conf_session=%s handed to worker %d", getpid(), conf->session, worker->id);
 	return 0;
 }
-static int process_udp(int socket, struct sockaddr_in *sender_sock, uint8_t *udp_buf, size_t udp_size)
+static int process_udp(ms_info_t *ms_info, struct sockaddr_in *sender_sock, uint8_t *udp_buf, size_t udp_size)
 {
 	char tmpkey[64];
 	pid_t pid;
@@ -272,14 +1162,19 @@ static int process_udp(int socket, struct sockaddr_in *sender_sock, uint8_t *udp
 		TraceEvent( TRACE_WARNING,"Father(Pid=%u): The request data is abnormal[%s]!!!!",getpid(), udp_buf);
 		return 0;
 	}
-	
+
 	snprintf(tmpkey, 60, "%s", &udp_buf[MS_CMD_LEN+1]);
 	TraceEvent( TRACE_NORMAL,"Father(Pid=%u): tmpkey=%s, Create New Meetme",getpid(), tmpkey);
 
+	if (ms_info->num_workers > 0)
+	{
+		return start_conference(ms_info, &sockaddr, tmpkey);
+	}
+
 	pid = fork();
 	if(pid == 0)
 	{
-		start_meetme(socket, &sockaddr, tmpkey);
+		start_meetme(ms_info->mixer_fd, &sockaddr, tmpkey, ms_info->max_speakers);
 		TraceEvent(TRACE_NORMAL, "Child(Pid=%u): Exit MeetMe the process", getpid());
 		exit(0);
 	}
@@ -329,7 +1224,7 @@ static int run_loop( ms_info_t * ms_info )
 				{
 					if (strncmp((const char *)pktbuf, MS_CMD_NCF, MS_CMD_LEN)==0)
 					{
-						process_udp(ms_info->mixer_fd, &sender_sock, pktbuf, bread);
+						process_udp(ms_info, &sender_sock, pktbuf, bread);
 					}
 				}
 			}
@@ -354,7 +1249,7 @@ int main( int argc, char * const argv[] )
 	int opt;
 	init_ms_info( &ms_info );
 	//libvd_delete_video_channel(0);
-	while((opt = getopt_long(argc, argv, "fl:a:vh", long_options, NULL)) != -1) 
+	while((opt = getopt_long(argc, argv, "fl:a:k:w:vh", long_options, NULL)) != -1) 
 	{
 		switch (opt) 
 		{
@@ -365,6 +1260,18 @@ int main( int argc, char * const argv[] )
 	  	    strcpy(ms_info.mixer_ip, optarg);
 	  	    bind_any = 0;
 	  	    break;	  	     	  	             
+	  	case 'k': /* speakers */
+	  	    ms_info.max_speakers = atoi(optarg);
+	  	    if (ms_info.max_speakers < 0)
+	  	        ms_info.max_speakers = 0;
+	  	    break;
+	  	case 'w': /* workers */
+	  	    ms_info.num_workers = atoi(optarg);
+	  	    if (ms_info.num_workers < 0)
+	  	        ms_info.num_workers = 0;
+	  	    else if (ms_info.num_workers > MS_WORKERS_MAX)
+	  	        ms_info.num_workers = MS_WORKERS_MAX;
+	  	    break;
 	  	case 'f': /* foreground */
 	  	    ms_info.daemon = 0;
 	  	    break;
@@ -389,6 +1296,11 @@ int main( int argc, char * const argv[] )
 			TraceEvent( TRACE_NORMAL, "Father(Pid=%u): traceLevel is %d", getpid(), traceLevel);
 		}
 	}
+	/* restarted in each NEWCNF child by its pthread_atfork handler */
+	if (init_trace_logger() < 0)
+	{
+		TraceEvent( TRACE_WARNING, "Father(Pid=%u): Failed to start trace logger, logging synchronously", getpid() );
+	}
 	TraceEvent( TRACE_NORMAL, "Mixer Server version is [%s],data_hdr_len is 28", MS_VERSION_NUM);
 
 	ms_info.mixer_fd = setup_ms_socket(ms_info.mixer_port, ms_info.mixer_ip, bind_any );
@@ -401,6 +1313,14 @@ int main( int argc, char * const argv[] )
 	{
 		TraceEvent( TRACE_NORMAL, "Father(Pid=%u): MixingServer is listening on UDP %u (main)", getpid(), ms_info.mixer_port);
 	}
+	if (ms_info.num_workers > 0)
+	{
+		if (setup_workers(&ms_info) < 0)
+		{
+			exit(-6);
+		}
+		TraceEvent( TRACE_NORMAL, "Father(Pid=%u): Single-process mode, %d worker(s)", getpid(), ms_info.num_workers);
+	}
 	
 	return run_loop(&ms_info);
 }
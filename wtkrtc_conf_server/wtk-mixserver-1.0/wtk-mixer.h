@@ -2,6 +2,51 @@
 #define _wtk_relay_h_
 
 #include "misc_lib.h"
+#include "../wtkrtc_mixer_api/wtk_rtc_mixer_api.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+struct wtk_mixer_conference;
+struct mixer_worker;
+
+/* One conference: its socket, participants and mixer engine handle */
+struct mixer_conference
+{
+	int			sock;
+	char		session[32+1];
+	char		number[32+1];
+	struct channel_info *chi;		/* participants, newest first */
+	int			num_participants;
+	struct channel_table channels;	/* participants by addr:port */
+	struct channel_info **by_channel;	/* participants by engine channel, which the engine keeps dense */
+	int			by_channel_size;
+	struct mmsghdr *fanout;		/* one per participant, video forwarding */
+	struct iovec *fanout_iov;	/* two per message: rewritten header, shared rest */
+	uint8_t		(*fanout_hdr)[MIXER_RTP_HEADER_SIZE];
+	int			fanout_size;
+	time_t		check_time;		/* last participant expiry pass */
+	int64_t		rate_ms;		/* start of the video rate window */
+	time_t		recv_time;
+	int			max_speakers;
+	struct wtk_mixer_conference *engine;
+	struct mixer_worker *worker;
+	struct mixer_conference *next;
+};
+
+/* Single-process mode: a worker thread owns many conferences and epolls their sockets */
+struct mixer_worker
+{
+	int			id;
+	pthread_t	thread;
+	int			epoll_fd;
+	int			event_fd;		/* wakes the worker for new conferences */
+	int			timer_fd;		/* every MIXER_TICK_MS, ticks the worker's conferences */
+	pthread_mutex_t lock;
+	struct mixer_conference *pending;	/* handed over by the main thread, under lock */
+	struct mixer_conference *confs;	/* owned by the worker thread */
+	int			num_confs;
+};
 
 struct mixservice_info
 {
@@ -9,6 +54,9 @@ struct mixservice_info
 	char		mixer_ip[32];
 	uint16_t	mixer_port;
 	int			mixer_fd;
+	int			num_workers;	/* 0: fork one process per conference */
+	int			max_speakers;	/* 0: mix every participant */
+	struct mixer_worker *workers;
 };
 typedef struct mixservice_info ms_info_t;
 
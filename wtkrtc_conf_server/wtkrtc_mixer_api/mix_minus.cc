@@ -0,0 +1,65 @@
+#include "mix_minus.h"
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+#include "system_wrappers/include/cpu_features_wrapper.h"
+#endif
+
+static inline int16_t saturate16(int32_t sample)
+{
+	return sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample);
+}
+
+void MixAccumulate_C(int32_t* sum, const int16_t* audio, size_t samples)
+{
+	for(size_t i = 0; i < samples; i++)
+		sum[i] += audio[i];
+}
+void MixMinus_C(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples)
+{
+	if(own == nullptr)
+	{
+		for(size_t i = 0; i < samples; i++)
+			out[i] = saturate16(sum[i]);
+		return;
+	}
+	for(size_t i = 0; i < samples; i++)
+		out[i] = saturate16(sum[i] - own[i]);
+}
+
+struct MixKernels {
+	mix_accumulate_t accumulate;
+	mix_minus_t minus;
+
+	MixKernels():accumulate(MixAccumulate_C),minus(MixMinus_C)
+	{
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+		//cpu_features_wrapper predates AVX2, ask the compiler
+		if(__builtin_cpu_supports("avx2"))
+		{
+			accumulate = MixAccumulate_AVX2;
+			minus = MixMinus_AVX2;
+		}
+		else if(WebRtc_GetCPUInfo(kSSE2))
+		{
+			accumulate = MixAccumulate_SSE2;
+			minus = MixMinus_SSE2;
+		}
+#elif defined(WEBRTC_HAS_NEON)
+		accumulate = MixAccumulate_NEON;
+		minus = MixMinus_NEON;
+#endif
+	}
+};
+static const MixKernels& mix_kernels()
+{
+	static const MixKernels kernels;
+	return kernels;
+}
+
+void MixAccumulate(int32_t* sum, const int16_t* audio, size_t samples)
+{
+	mix_kernels().accumulate(sum, audio, samples);
+}
+void MixMinus(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples)
+{
+	mix_kernels().minus(sum, own, out, samples);
+}
@@ -0,0 +1,36 @@
+#ifndef _mix_minus_h
+#define _mix_minus_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "typedefs.h"
+
+/*
+ * Conference mix kernels. A tick sums every participant once into an
+ * int32 accumulator (65536 int16 frames cannot overflow it),
+ * then each participant gets the sum minus its own frame, saturated to
+ * int16. The best of SSE2/AVX2/NEON is picked at first use, with a
+ * scalar fallback.
+ */
+typedef void (*mix_accumulate_t)(int32_t* sum, const int16_t* audio, size_t samples);
+typedef void (*mix_minus_t)(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+
+/* sum[i] += audio[i] */
+void MixAccumulate(int32_t* sum, const int16_t* audio, size_t samples);
+/* out[i] = saturate16(sum[i] - own[i]), own may be null for a silent participant */
+void MixMinus(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+
+void MixAccumulate_C(int32_t* sum, const int16_t* audio, size_t samples);
+void MixMinus_C(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+#if defined(WEBRTC_ARCH_X86_FAMILY)
+void MixAccumulate_SSE2(int32_t* sum, const int16_t* audio, size_t samples);
+void MixMinus_SSE2(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+void MixAccumulate_AVX2(int32_t* sum, const int16_t* audio, size_t samples);
+void MixMinus_AVX2(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+#endif
+#if defined(WEBRTC_HAS_NEON)
+void MixAccumulate_NEON(int32_t* sum, const int16_t* audio, size_t samples);
+void MixMinus_NEON(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples);
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#include <immintrin.h>
+#include "mix_minus.h"
+
+void MixAccumulate_AVX2(int32_t* sum, const int16_t* audio, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 16 <= samples; i += 16)
+	{
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&audio[i])));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&audio[i + 8])));
+		__m256i* s = reinterpret_cast<__m256i*>(&sum[i]);
+		_mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), lo));
+		_mm256_storeu_si256(s + 1, _mm256_add_epi32(_mm256_loadu_si256(s + 1), hi));
+	}
+	MixAccumulate_C(sum + i, audio + i, samples - i);
+}
+void MixMinus_AVX2(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 16 <= samples; i += 16)
+	{
+		const __m256i* s = reinterpret_cast<const __m256i*>(&sum[i]);
+		__m256i lo = _mm256_loadu_si256(s);
+		__m256i hi = _mm256_loadu_si256(s + 1);
+		if(own != nullptr)
+		{
+			lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&own[i]))));
+			hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&own[i + 8]))));
+		}
+		//packs works per 128-bit lane, put the 64-bit quarters back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]), packed);
+	}
+	MixMinus_C(sum + i, own ? own + i : nullptr, out + i, samples - i);
+}
@@ -0,0 +1,33 @@
+#include <arm_neon.h>
+#include "mix_minus.h"
+
+void MixAccumulate_NEON(int32_t* sum, const int16_t* audio, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 8 <= samples; i += 8)
+	{
+		int16x8_t x = vld1q_s16(&audio[i]);
+		vst1q_s32(&sum[i], vaddw_s16(vld1q_s32(&sum[i]), vget_low_s16(x)));
+		vst1q_s32(&sum[i + 4], vaddw_s16(vld1q_s32(&sum[i + 4]), vget_high_s16(x)));
+	}
+	MixAccumulate_C(sum + i, audio + i, samples - i);
+}
+void MixMinus_NEON(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 8 <= samples; i += 8)
+	{
+		int32x4_t lo = vld1q_s32(&sum[i]);
+		int32x4_t hi = vld1q_s32(&sum[i + 4]);
+		if(own != nullptr)
+		{
+			int16x8_t x = vld1q_s16(&own[i]);
+			lo = vsubw_s16(lo, vget_low_s16(x));
+			hi = vsubw_s16(hi, vget_high_s16(x));
+		}
+		vst1q_s16(&out[i], vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+	}
+	MixMinus_C(sum + i, own ? own + i : nullptr, out + i, samples - i);
+}
@@ -0,0 +1,37 @@
+#include <emmintrin.h>
+#include "mix_minus.h"
+
+void MixAccumulate_SSE2(int32_t* sum, const int16_t* audio, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 8 <= samples; i += 8)
+	{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&audio[i]));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		__m128i* s = reinterpret_cast<__m128i*>(&sum[i]);
+		_mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s), lo));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), hi));
+	}
+	MixAccumulate_C(sum + i, audio + i, samples - i);
+}
+void MixMinus_SSE2(const int32_t* sum, const int16_t* own, int16_t* out, size_t samples)
+{
+	size_t i = 0;
+
+	for(; i + 8 <= samples; i += 8)
+	{
+		const __m128i* s = reinterpret_cast<const __m128i*>(&sum[i]);
+		__m128i lo = _mm_loadu_si128(s);
+		__m128i hi = _mm_loadu_si128(s + 1);
+		if(own != nullptr)
+		{
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&own[i]));
+			lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+			hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]), _mm_packs_epi32(lo, hi));
+	}
+	MixMinus_C(sum + i, own ? own + i : nullptr, out + i, samples - i);
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include "mixer_clock.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/timeutils.h"
+#include "system_wrappers/include/sleep.h"
+
+/* Fall this far behind and the clock gives up catching up */
+static const int64_t kMaxTickLagMs = 100;
+
+MixerClock* MixerClock::Instance()
+{
+	static MixerClock* const clock = new MixerClock();
+	return clock;
+}
+
+MixerClock::MixerClock()
+	:ticking_(nullptr),
+	tick_done_(true, true),
+	thread_(&MixerClock::Run, this, "WtkMixerClock", rtc::kRealtimePriority),
+	started_(false)
+{
+}
+
+void MixerClock::Register(MixerClockTarget* target)
+{
+	rtc::CritScope cs(&crit_);
+	targets_.push_back(target);
+	if(!started_)
+	{
+		thread_.Start();
+		started_ = true;
+	}
+}
+void MixerClock::Unregister(MixerClockTarget* target)
+{
+	crit_.Enter();
+	//the slot is dropped between rounds, so a round in progress keeps its order
+	std::replace(targets_.begin(), targets_.end(), target, static_cast<MixerClockTarget*>(nullptr));
+	while(ticking_ == target)
+	{
+		crit_.Leave();
+		tick_done_.Wait(rtc::Event::kForever);
+		crit_.Enter();
+	}
+	crit_.Leave();
+}
+
+void MixerClock::Run(void* obj)
+{
+	static_cast<MixerClock*>(obj)->Process();
+}
+/* false past the last target, *target is nullptr for an unregistered one */
+bool MixerClock::BeginTick(size_t index, MixerClockTarget** target)
+{
+	rtc::CritScope cs(&crit_);
+	if(index >= targets_.size())
+		return false;
+	*target = targets_[index];
+	if(*target != nullptr)
+	{
+		ticking_ = *target;
+		tick_done_.Reset();
+	}
+	return true;
+}
+void MixerClock::EndTick()
+{
+	rtc::CritScope cs(&crit_);
+	ticking_ = nullptr;
+	tick_done_.Set();
+}
+void MixerClock::Process()
+{
+	int64_t next_tick_ms = rtc::TimeMillis();
+	MixerClockTarget* target;
+
+	while(true)
+	{
+		int64_t now_ms = rtc::TimeMillis();
+		{
+			rtc::CritScope cs(&crit_);
+			targets_.erase(std::remove(targets_.begin(), targets_.end(), static_cast<MixerClockTarget*>(nullptr)), targets_.end());
+		}
+		//the lock is only held between targets, never across a tick
+		for(size_t index = 0; BeginTick(index, &target); index++)
+		{
+			if(target == nullptr)
+				continue;
+			target->OnTick(now_ms);
+			EndTick();
+		}
+
+		next_tick_ms += MIXER_TICK_MS;
+		now_ms = rtc::TimeMillis();
+		if(now_ms - next_tick_ms > kMaxTickLagMs)
+		{
+			RTC_LOG(LS_WARNING) << __FUNCTION__ << " :mixer clock " << now_ms - next_tick_ms << " ms behind, skip ticks";
+			next_tick_ms = now_ms;
+		}
+		if(next_tick_ms > now_ms)
+		{
+			webrtc::SleepMs(static_cast<int>(next_tick_ms - now_ms));
+		}
+	}
+}
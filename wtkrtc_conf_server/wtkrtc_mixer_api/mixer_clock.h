@@ -0,0 +1,47 @@
+#ifndef _mixer_clock_h
+#define _mixer_clock_h
+
+#include <vector>
+#include "rtc_base/criticalsection.h"
+#include "rtc_base/event.h"
+#include "rtc_base/platform_thread.h"
+#include "wtk_rtc_mixer_api.h"
+
+class MixerClockTarget {
+public:
+	virtual void OnTick(int64_t now_ms) = 0;
+protected:
+	virtual ~MixerClockTarget() {}
+};
+
+/*
+ * A 10 ms timing thread for conferences nobody else ticks. Every
+ * registered target is ticked in turn, without the clock's lock held, so
+ * Register()/Unregister() never wait for a whole round. Unregister()
+ * returns only once the target is no longer being ticked, so it can be
+ * deleted right after; it must not be called from OnTick(). Servers with
+ * many conferences tick each one from the thread that owns it instead,
+ * see libwtk_mixer_conference_tick().
+ */
+class MixerClock {
+public:
+	static MixerClock* Instance();
+
+	void Register(MixerClockTarget* target);
+	void Unregister(MixerClockTarget* target);
+private:
+	MixerClock();
+	static void Run(void* obj);
+	void Process();
+	bool BeginTick(size_t index, MixerClockTarget** target);
+	void EndTick();
+
+	rtc::CriticalSection crit_;
+	std::vector<MixerClockTarget*> targets_;	/* nullptr for one unregistered this round */
+	MixerClockTarget* ticking_;	/* under crit_ */
+	rtc::Event tick_done_;	/* set whenever ticking_ is cleared */
+	rtc::PlatformThread thread_;
+	bool started_;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include "mixer_conference.h"
+#include "mix_minus.h"
+#include "rtc_base/logging.h"
+
+MixerConference::MixerConference(conference_transport_mixer_callback_t audio_transport, void* ctx, bool clocked)
+	:audio_transport_(audio_transport),
+	fanout_transport_(nullptr),
+	ctx_(ctx),
+	clocked_(clocked),
+	speakers_(MIXER_DEFAULT_SPEAKERS),
+	shared_active_(false),
+	timestamp_(0),
+	ticks_(0)
+{
+	mixed_audio_frame_.UpdateFrame(0, nullptr, OPUS_SAMPLES_PER_CHAN, OPUS_SAMPLE_RATE_HZ, webrtc::AudioFrame::kNormalSpeech, webrtc::AudioFrame::kVadUnknown, OPUS_NUMBER_OF_CHAN);
+	if(clocked_)
+		MixerClock::Instance()->Register(this);
+}
+MixerConference::~MixerConference()
+{
+	//once unregistered no tick touches this conference any more
+	if(clocked_)
+		MixerClock::Instance()->Unregister(this);
+	participants_.clear();
+}
+
+int MixerConference::AddParticipant()
+{
+	int channel = static_cast<int>(participants_.size());
+	if(!free_channels_.empty())
+		channel = free_channels_.front();
+	SetupParticipant(channel);
+	return channel;
+}
+void MixerConference::SetupParticipant(int channel)
+{
+	if(channel < 0)
+	{
+		RTC_LOG(LS_ERROR) << __FUNCTION__ << " :channel " << channel << " out of range!";
+		return;
+	}
+	if(static_cast<size_t>(channel) < participants_.size() && participants_[channel] != nullptr)
+	{
+		RTC_LOG(LS_INFO) << __FUNCTION__ << " :participant already exsit, so return success!";
+		return;
+	}
+
+	std::unique_ptr<MixerParticipant> participant(new MixerParticipant(this, channel));
+	rtc::CritScope cs(&mix_crit_);
+	//slots skipped by an explicit channel become free ones
+	for(int slot = static_cast<int>(participants_.size()); slot < channel; slot++)
+	{
+		free_channels_.push_back(slot);
+		std::push_heap(free_channels_.begin(), free_channels_.end(), std::greater<int>());
+	}
+	if(static_cast<size_t>(channel) >= participants_.size())
+	{
+		participants_.resize(channel + 1);
+		mixed_.resize(channel + 1, false);
+	}
+	else
+	{
+		free_channels_.erase(std::remove(free_channels_.begin(), free_channels_.end(), channel), free_channels_.end());
+		std::make_heap(free_channels_.begin(), free_channels_.end(), std::greater<int>());
+	}
+	participants_[channel] = std::move(participant);
+}
+void MixerConference::RemoveParticipant(int channel)
+{
+	std::unique_ptr<MixerParticipant> participant;
+
+	if(channel < 0 || static_cast<size_t>(channel) >= participants_.size() || participants_[channel] == nullptr)
+		return;
+	{
+		//returns once no tick uses the participant any more
+		rtc::CritScope cs(&mix_crit_);
+		participant = std::move(participants_[channel]);
+		mixed_[channel] = false;
+		speakers_.Remove(channel);
+		free_channels_.push_back(channel);
+		std::push_heap(free_channels_.begin(), free_channels_.end(), std::greater<int>());
+	}
+	participant.reset();
+}
+
+int MixerConference::DecodeAudio(uint8_t* buf, int buflen, int channel)
+{
+	if(buflen && channel >= 0 && static_cast<size_t>(channel) < participants_.size() && participants_[channel] != nullptr)
+	{
+		participants_[channel]->InsertPacket(buf, buflen);
+	}
+	return buflen;
+}
+int MixerConference::DecodeVideo(uint8_t* buf, int buflen, int channel)
+{
+	//video is forwarded by the server, the mixer only handles audio
+	return buflen;
+}
+
+void MixerConference::SetMaxSpeakers(int max_speakers)
+{
+	rtc::CritScope cs(&mix_crit_);
+	speakers_.set_max_speakers(max_speakers > 0 ? max_speakers : 0);
+}
+void MixerConference::SetFanoutTransport(conference_fanout_mixer_callback_t fanout_transport)
+{
+	rtc::CritScope cs(&mix_crit_);
+	fanout_transport_ = fanout_transport;
+}
+
+void MixerConference::OnTick(int64_t now_ms)
+{
+	rtc::CritScope cs(&mix_crit_);
+	int16_t* out = mixed_audio_frame_.mutable_data();
+	//every encoder packs two ticks, roles only change before the first
+	bool packet_start = (ticks_++ & 1) == 0;
+	bool listeners = false;
+
+	if(packet_start)
+	{
+		for(size_t channel = 0; channel < participants_.size(); channel++)
+		{
+			if(participants_[channel] != nullptr)
+				speakers_.Update(channel, participants_[channel]->level(now_ms));
+		}
+		speakers_.Select(now_ms);
+	}
+
+	//one frame per speaker per tick, NetEq conceals late or lost packets.
+	//Listeners without an audio level are still decoded, only to be measured
+	memset(mix_sum_, 0x00, sizeof(mix_sum_));
+	for(size_t channel = 0; channel < participants_.size(); channel++)
+	{
+		MixerParticipant* participant = participants_[channel].get();
+		mixed_[channel] = false;
+		if(participant == nullptr)
+			continue;
+		if(packet_start)
+			participant->SetSelected(speakers_.selected(channel));
+		bool speaker = participant->selected();
+		listeners |= !speaker;
+		if(!speaker && participant->has_audio_level())
+			continue;
+		mixed_[channel] = participant->PullAudio() && speaker;
+		if(!mixed_[channel])
+			continue;
+		MixAccumulate(mix_sum_, participant->audio().data(), MIXER_FRAME_SAMPLES);
+	}
+
+	//the listeners' mix, encoded once for all of them
+	if(packet_start && listeners && !shared_active_)
+		shared_encoder_.Reset();
+	if(packet_start)
+		shared_active_ = listeners;
+	if(shared_active_)
+	{
+		MixMinus(mix_sum_, nullptr, out, MIXER_FRAME_SAMPLES);
+		if(shared_encoder_.Encode(mixed_audio_frame_, timestamp_))
+			SendSharedPayload();
+	}
+
+	for(size_t channel = 0; channel < participants_.size(); channel++)
+	{
+		MixerParticipant* participant = participants_[channel].get();
+		if(participant == nullptr || !participant->selected())
+			continue;
+		MixMinus(mix_sum_, mixed_[channel] ? participant->audio().data() : nullptr, out, MIXER_FRAME_SAMPLES);
+		participant->SendAudio(mixed_audio_frame_, timestamp_);
+	}
+	timestamp_ += OPUS_SAMPLES_PER_CHAN;
+}
+void MixerConference::SendSharedPayload()
+{
+	const rtc::Buffer& payload = shared_encoder_.payload();
+
+	if(fanout_transport_ == nullptr)
+	{
+		for(size_t channel = 0; channel < participants_.size(); channel++)
+		{
+			MixerParticipant* participant = participants_[channel].get();
+			if(participant != nullptr && !participant->selected())
+				participant->SendPayload(shared_encoder_);
+		}
+		return;
+	}
+	//every listener's header in one block, the payload is shared
+	fanout_headers_.resize(participants_.size() * MIXER_RTP_HEADER_SIZE);
+	fanout_channels_.clear();
+	for(size_t channel = 0; channel < participants_.size(); channel++)
+	{
+		MixerParticipant* participant = participants_[channel].get();
+		if(participant == nullptr || participant->selected())
+			continue;
+		participant->WriteHeader(shared_encoder_, &fanout_headers_[fanout_channels_.size() * MIXER_RTP_HEADER_SIZE]);
+		fanout_channels_.push_back(static_cast<int>(channel));
+	}
+	if(!fanout_channels_.empty())
+		fanout_transport_(ctx_, reinterpret_cast<const uint8_t (*)[MIXER_RTP_HEADER_SIZE]>(fanout_headers_.data()), fanout_channels_.data(), static_cast<int>(fanout_channels_.size()), payload.data(), static_cast<int>(payload.size()));
+}
+void MixerConference::SendPacket(const uint8_t* packet, size_t length, int channel)
+{
+	if(audio_transport_ != nullptr)
+		audio_transport_(ctx_, packet, length, channel);
+}
@@ -0,0 +1,70 @@
+#ifndef _mixer_conference_h
+#define _mixer_conference_h
+
+#include <memory>
+#include <vector>
+#include "modules/include/module_common_types.h"
+#include "rtc_base/criticalsection.h"
+#include "mixer_clock.h"
+#include "mixer_encoder.h"
+#include "mixer_participant.h"
+#include "speaker_selector.h"
+#include "wtk_rtc_mixer_api.h"
+
+#define MIXER_FRAME_SAMPLES (OPUS_SAMPLES_PER_CHAN*OPUS_NUMBER_OF_CHAN)
+
+/*
+ * One conference: its participants and their mix.
+ * Participants live in a registry indexed by channel that grows on
+ * demand and hands freed channels out again, lowest first.
+ * Setup, removal, decode and destruction run on the thread that owns it. Once
+ * every 10 ms the tick, from the MixerClock or from the owning thread
+ * itself, pulls one frame from each of the loudest speakers and sums them
+ * once. Listeners all hear that same sum, so it
+ * is encoded once and the payload goes out under each listener's own
+ * RTP header; only speakers get a private encode of the sum minus their
+ * own frame. Speakers change on 20 ms packet boundaries, so switching
+ * encoders never splits a packet. Packets leave through the transport callback with the caller's
+ * context, the listeners' shared one through the fan-out callback in a
+ * single call when there is one.
+ */
+class MixerConference:public MixerClockTarget {
+public:
+	/* clocked: ticked by the MixerClock, otherwise the owner calls OnTick() */
+	MixerConference(conference_transport_mixer_callback_t audio_transport, void* ctx, bool clocked);
+	~MixerConference() override;
+
+	int AddParticipant();
+	void SetupParticipant(int channel);
+	void RemoveParticipant(int channel);
+	int DecodeAudio(uint8_t* buf, int buflen, int channel);
+	int DecodeVideo(uint8_t* buf, int buflen, int channel);
+	void SetMaxSpeakers(int max_speakers);
+	void SetFanoutTransport(conference_fanout_mixer_callback_t fanout_transport);
+
+	//MixerClockTarget
+	void OnTick(int64_t now_ms) override;
+
+	void SendPacket(const uint8_t* packet, size_t length, int channel);
+private:
+	void SendSharedPayload();
+	conference_transport_mixer_callback_t audio_transport_;
+	conference_fanout_mixer_callback_t fanout_transport_;
+	void* ctx_;
+	bool clocked_;
+	rtc::CriticalSection mix_crit_;
+	SpeakerSelector speakers_;
+	MixerEncoder shared_encoder_;
+	bool shared_active_;
+	uint32_t timestamp_;	/* conference sample clock, drives every encoder */
+	uint64_t ticks_;
+	int32_t mix_sum_[MIXER_FRAME_SAMPLES];
+	std::vector<bool> mixed_;
+	webrtc::AudioFrame mixed_audio_frame_;
+	std::vector<std::unique_ptr<MixerParticipant>> participants_;
+	std::vector<int> free_channels_;	/* below participants_.size(), kept as a min heap */
+	std::vector<uint8_t> fanout_headers_;	/* MIXER_RTP_HEADER_SIZE per listener */
+	std::vector<int> fanout_channels_;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "mixer_encoder.h"
+#include "api/audio_codecs/opus/audio_encoder_opus.h"
+#include "rtc_base/logging.h"
+#include "wtk_rtc_mixer_api.h"
+
+MixerEncoder::MixerEncoder()
+	:payload_type_(kWtkPayloadTypeOpus),
+	timestamp_(0)
+{
+	webrtc::AudioEncoderOpusConfig encoder_config;
+	encoder_config.frame_size_ms = 20;
+	encoder_config.num_channels = OPUS_NUMBER_OF_CHAN;
+	encoder_config.bitrate_bps = 32*1000;
+	encoder_ = webrtc::AudioEncoderOpus::MakeAudioEncoder(encoder_config, kWtkPayloadTypeOpus);
+}
+MixerEncoder::~MixerEncoder()
+{
+}
+
+bool MixerEncoder::Encode(const webrtc::AudioFrame& frame, uint32_t timestamp)
+{
+	if(frame.sample_rate_hz_ != encoder_->SampleRateHz() || frame.num_channels_ != encoder_->NumChannels())
+	{
+		RTC_LOG(LS_WARNING) << __FUNCTION__ << " :can not encode " << frame.sample_rate_hz_ << " Hz/" << frame.num_channels_;
+		return false;
+	}
+
+	encoded_.Clear();
+	webrtc::AudioEncoder::EncodedInfo info = encoder_->Encode(timestamp, rtc::ArrayView<const int16_t>(frame.data(), frame.samples_per_channel_ * frame.num_channels_), &encoded_);
+	if(info.encoded_bytes == 0)
+		return false;
+	payload_type_ = info.payload_type;
+	timestamp_ = info.encoded_timestamp;
+	return true;
+}
+void MixerEncoder::Reset()
+{
+	encoder_->Reset();
+	encoded_.Clear();
+}
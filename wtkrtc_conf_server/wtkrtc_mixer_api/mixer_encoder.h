@@ -0,0 +1,35 @@
+#ifndef _mixer_encoder_h
+#define _mixer_encoder_h
+
+#include <memory>
+#include "api/audio_codecs/audio_encoder.h"
+#include "modules/include/module_common_types.h"
+#include "rtc_base/buffer.h"
+
+/*
+ * Opus encoder for the mix, 20 ms packets out of 10 ms frames. The
+ * conference drives every encoder with its own sample clock, so a payload
+ * can go to any participant as is and a listener moving between the
+ * shared and a private encoder keeps a continuous RTP timestamp.
+ */
+class MixerEncoder {
+public:
+	MixerEncoder();
+	~MixerEncoder();
+
+	/* true once a whole packet is ready in payload() */
+	bool Encode(const webrtc::AudioFrame& frame, uint32_t timestamp);
+	/* Drop what is buffered, the next frame starts a new packet */
+	void Reset();
+
+	const rtc::Buffer& payload() const { return encoded_; }
+	uint8_t payload_type() const { return payload_type_; }
+	uint32_t timestamp() const { return timestamp_; }
+private:
+	std::unique_ptr<webrtc::AudioEncoder> encoder_;
+	rtc::Buffer encoded_;
+	uint8_t payload_type_;
+	uint32_t timestamp_;
+};
+
+#endif
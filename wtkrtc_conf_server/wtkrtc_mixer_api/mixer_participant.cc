@@ -0,0 +1,170 @@
+#include <math.h>
+#include <string.h>
+#include "mixer_participant.h"
+#include "mixer_conference.h"
+#include "speaker_selector.h"
+#include "api/audio_codecs/audio_decoder_factory_template.h"
+#include "api/audio_codecs/opus/audio_decoder_opus.h"
+#include "modules/rtp_rtcp/source/byte_io.h"
+#include "modules/rtp_rtcp/source/rtp_header_extensions.h"
+#include "modules/rtp_rtcp/source/rtp_utility.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/timeutils.h"
+
+static const uint32_t wtk_audio_ssrc = 10000000;
+static const size_t kRtpHeaderSize = MIXER_RTP_HEADER_SIZE;
+static const size_t kMaxRtpPacketSize = 1500;
+/* No packet for this long and the participant counts as silent */
+static const int64_t kLevelTimeoutMs = 200;
+
+/* One decoder factory for every participant in the process */
+static rtc::scoped_refptr<webrtc::AudioDecoderFactory> participant_decoder_factory()
+{
+	static rtc::scoped_refptr<webrtc::AudioDecoderFactory> factory = webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus>();
+	return factory;
+}
+
+MixerParticipant::MixerParticipant(MixerConference* conference, int channel)
+	:conference_(conference),
+	channel_(channel),
+	decoded_muted_(true),
+	sequence_number_(0),
+	ssrc_(wtk_audio_ssrc),
+	level_(0),
+	level_ms_(0),
+	has_audio_level_(false),
+	selected_(false)
+{
+	extensions_.Register<webrtc::AudioLevel>(AUDIO_LEVEL_EXTENSION_ID);
+
+	webrtc::NetEq::Config neteq_config;
+	neteq_config.sample_rate_hz = OPUS_SAMPLE_RATE_HZ;
+	neteq_config.enable_muted_state = true;
+	neteq_.reset(webrtc::NetEq::Create(neteq_config, participant_decoder_factory()));
+	neteq_->RegisterPayloadType(kWtkPayloadTypeOpus, webrtc::SdpAudioFormat("opus", 48000, 2));
+
+	decoded_frame_.UpdateFrame(0, nullptr, OPUS_SAMPLES_PER_CHAN, OPUS_SAMPLE_RATE_HZ, webrtc::AudioFrame::kNormalSpeech, webrtc::AudioFrame::kVadUnknown, OPUS_NUMBER_OF_CHAN);
+}
+MixerParticipant::~MixerParticipant()
+{
+}
+
+int MixerParticipant::InsertPacket(const uint8_t* buf, int buflen)
+{
+	webrtc::RTPHeader header;
+	webrtc::RtpUtility::RtpHeaderParser parser(buf, buflen);
+
+	if(!parser.Parse(&header, &extensions_) || header.payloadType != kWtkPayloadTypeOpus)
+		return -1;
+	if(header.headerLength + header.paddingLength >= static_cast<size_t>(buflen))
+		return -1;
+
+	//the level rides in the header, a muted speaker costs no decode at all
+	if(header.extension.hasAudioLevel)
+	{
+		has_audio_level_.store(true, std::memory_order_relaxed);
+		UpdateLevel(SPEAKER_LEVEL_MAX - (header.extension.audioLevel & 0x7f));
+		if(!selected_.load(std::memory_order_relaxed))
+			return buflen;
+	}
+
+	rtc::ArrayView<const uint8_t> payload(buf + header.headerLength, buflen - header.headerLength - header.paddingLength);
+	uint32_t receive_timestamp = static_cast<uint32_t>(rtc::TimeMillis() * (OPUS_SAMPLE_RATE_HZ / 1000));
+	if(neteq_->InsertPacket(header, payload, receive_timestamp) != webrtc::NetEq::kOK)
+	{
+		RTC_LOG(LS_WARNING) << __FUNCTION__ << " :channel " << channel_ << " NetEq rejected packet, error " << neteq_->LastError();
+		return -1;
+	}
+	return buflen;
+}
+
+bool MixerParticipant::PullAudio()
+{
+	//a late or lost packet comes back as expanded (kPLC) audio, a long gone
+	//source as muted
+	if(neteq_->GetAudio(&decoded_frame_, &decoded_muted_) != webrtc::NetEq::kOK)
+	{
+		decoded_frame_.Mute();
+		decoded_muted_ = true;
+	}
+	if(!has_audio_level())
+	{
+		int level = 0;
+		if(!decoded_muted_)
+		{
+			const int16_t* data = decoded_frame_.data();
+			size_t samples = decoded_frame_.samples_per_channel_ * decoded_frame_.num_channels_;
+			int64_t energy = 0;
+			for(size_t i = 0; i < samples; i++)
+				energy += data[i] * data[i];
+			//dBov of the mean square, as the clients would have sent it
+			if(samples && energy)
+				level = SPEAKER_LEVEL_MAX + static_cast<int>(10 * log10(static_cast<double>(energy) / samples / (32768.0 * 32768.0)));
+		}
+		UpdateLevel(level);
+	}
+	return !decoded_muted_
+		&& decoded_frame_.sample_rate_hz_ == OPUS_SAMPLE_RATE_HZ
+		&& decoded_frame_.num_channels_ == OPUS_NUMBER_OF_CHAN
+		&& decoded_frame_.samples_per_channel_ == OPUS_SAMPLES_PER_CHAN;
+}
+
+void MixerParticipant::SetSelected(bool selected)
+{
+	bool was_selected = selected_.exchange(selected, std::memory_order_relaxed);
+	if(was_selected == selected)
+		return;
+	//what was buffered before a break is stale once the speaker is back
+	if(!selected && has_audio_level())
+		neteq_->FlushBuffers();
+	//a new speaker's first packet starts on this frame
+	if(selected && encoder_ != nullptr)
+		encoder_->Reset();
+}
+void MixerParticipant::UpdateLevel(int level)
+{
+	if(level < 0)
+		level = 0;
+	else if(level > SPEAKER_LEVEL_MAX)
+		level = SPEAKER_LEVEL_MAX;
+	//rises at once, decays over a few packets, a breath is not a lost turn
+	int smoothed = level_.load(std::memory_order_relaxed);
+	if(level < smoothed)
+		level = (3 * smoothed + level) / 4;
+	level_.store(level, std::memory_order_relaxed);
+	level_ms_.store(rtc::TimeMillis(), std::memory_order_relaxed);
+}
+int MixerParticipant::level(int64_t now_ms) const
+{
+	if(now_ms - level_ms_.load(std::memory_order_relaxed) > kLevelTimeoutMs)
+		return 0;
+	return level_.load(std::memory_order_relaxed);
+}
+
+void MixerParticipant::SendAudio(const webrtc::AudioFrame& frame, uint32_t timestamp)
+{
+	if(encoder_ == nullptr)
+		encoder_.reset(new MixerEncoder());
+	if(encoder_->Encode(frame, timestamp))
+		SendPayload(*encoder_);
+}
+void MixerParticipant::SendPayload(const MixerEncoder& encoder)
+{
+	uint8_t packet[kMaxRtpPacketSize];
+	const rtc::Buffer& payload = encoder.payload();
+
+	if(kRtpHeaderSize + payload.size() > kMaxRtpPacketSize)
+		return;
+
+	WriteHeader(encoder, packet);
+	memcpy(&packet[kRtpHeaderSize], payload.data(), payload.size());
+	conference_->SendPacket(packet, kRtpHeaderSize + payload.size(), channel_);
+}
+void MixerParticipant::WriteHeader(const MixerEncoder& encoder, uint8_t* header)
+{
+	header[0] = 0x80;
+	header[1] = encoder.payload_type() & 0x7f;
+	webrtc::ByteWriter<uint16_t>::WriteBigEndian(&header[2], sequence_number_++);
+	webrtc::ByteWriter<uint32_t>::WriteBigEndian(&header[4], encoder.timestamp());
+	webrtc::ByteWriter<uint32_t>::WriteBigEndian(&header[8], ssrc_);
+}
@@ -0,0 +1,66 @@
+#ifndef _mixer_participant_h
+#define _mixer_participant_h
+
+#include <atomic>
+#include <memory>
+#include "modules/audio_coding/neteq/include/neteq.h"
+#include "modules/include/module_common_types.h"
+#include "modules/rtp_rtcp/include/rtp_header_extension_map.h"
+#include "mixer_encoder.h"
+#include "wtk_rtc_mixer_api.h"
+
+class MixerConference;
+
+/*
+ * Server side participant: RTP goes straight into NetEq and an Opus
+ * decoder, the return path is a hand written RTP header in front of
+ * either the conference's shared payload or, for a speaker, the output
+ * of its own encoder. No Call, no audio device, no per participant
+ * threads.
+ * InsertPacket() runs on the conference thread, everything else on the
+ * thread that ticks the conference.
+ * Clients sending the RFC 6464 audio level are measured from the header,
+ * and their packets are dropped before NetEq while they are not among
+ * the conference's speakers. Anyone else has to be decoded to be
+ * measured, from the energy of the decoded frame.
+ */
+class MixerParticipant {
+public:
+	MixerParticipant(MixerConference* conference, int channel);
+	~MixerParticipant();
+
+	int InsertPacket(const uint8_t* buf, int buflen);
+	/* Pull the next 10 ms, false when there is nothing to mix */
+	bool PullAudio();
+	const webrtc::AudioFrame& audio() const { return decoded_frame_; }
+	/* Speakers: encode their own mix minus, timestamp on the conference clock */
+	void SendAudio(const webrtc::AudioFrame& frame, uint32_t timestamp);
+	/* Send what encoder just produced under this participant's RTP header */
+	void SendPayload(const MixerEncoder& encoder);
+	/* Only that header, MIXER_RTP_HEADER_SIZE bytes, for a payload sent by the conference */
+	void WriteHeader(const MixerEncoder& encoder, uint8_t* header);
+	int channel() const { return channel_; }
+
+	/* Smoothed speech level, 0 (silence) to SPEAKER_LEVEL_MAX */
+	int level(int64_t now_ms) const;
+	bool has_audio_level() const { return has_audio_level_.load(std::memory_order_relaxed); }
+	bool selected() const { return selected_.load(std::memory_order_relaxed); }
+	void SetSelected(bool selected);
+private:
+	void UpdateLevel(int level);
+	MixerConference* conference_;
+	int channel_;
+	webrtc::RtpHeaderExtensionMap extensions_;
+	std::unique_ptr<webrtc::NetEq> neteq_;
+	std::unique_ptr<MixerEncoder> encoder_;	/* created once the participant speaks */
+	webrtc::AudioFrame decoded_frame_;
+	bool decoded_muted_;
+	uint16_t sequence_number_;
+	uint32_t ssrc_;
+	std::atomic<int> level_;
+	std::atomic<int64_t> level_ms_;
+	std::atomic<bool> has_audio_level_;
+	std::atomic<bool> selected_;
+};
+
+#endif
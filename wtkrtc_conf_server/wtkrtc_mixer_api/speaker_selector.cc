@@ -0,0 +1,111 @@
+#include <algorithm>
+#include "speaker_selector.h"
+
+static const int64_t kMinHoldMs = 500;
+static const int kSwitchMargin = 6;	/* dB */
+
+SpeakerSelector::SpeakerSelector(size_t max_speakers)
+	:max_speakers_(max_speakers)
+{
+}
+
+SpeakerSelector::Entry* SpeakerSelector::entry(int channel)
+{
+	if(channel < 0)
+		return nullptr;
+	if(static_cast<size_t>(channel) >= entries_.size())
+		entries_.resize(channel + 1, Entry{false, false, 0, 0});
+	return &entries_[channel];
+}
+
+void SpeakerSelector::Update(int channel, int level)
+{
+	Entry* e = entry(channel);
+	if(e == nullptr)
+		return;
+	e->present = true;
+	e->level = level;
+}
+bool SpeakerSelector::selected(int channel) const
+{
+	if(channel < 0 || static_cast<size_t>(channel) >= entries_.size())
+		return false;
+	return entries_[channel].selected;
+}
+void SpeakerSelector::Remove(int channel)
+{
+	if(channel < 0 || static_cast<size_t>(channel) >= entries_.size())
+		return;
+	entries_[channel] = Entry{false, false, 0, 0};
+}
+
+/* Selected channel with the lowest level, -1 if none */
+int SpeakerSelector::Weakest() const
+{
+	int weakest = -1;
+	for(size_t channel = 0; channel < entries_.size(); channel++)
+	{
+		const Entry& e = entries_[channel];
+		if(e.selected && (weakest < 0 || e.level < entries_[weakest].level))
+			weakest = channel;
+	}
+	return weakest;
+}
+
+void SpeakerSelector::Select(int64_t now_ms)
+{
+	size_t speakers = 0;
+
+	candidates_.clear();
+	for(size_t channel = 0; channel < entries_.size(); channel++)
+	{
+		Entry& e = entries_[channel];
+		if(!e.present)
+		{
+			e.selected = false;
+			continue;
+		}
+		e.present = false;	//must be reported again next tick
+		if(max_speakers_ == 0)
+		{
+			e.selected = true;
+			continue;
+		}
+		if(e.selected)
+			speakers++;
+		else
+			candidates_.push_back(channel);
+	}
+	if(max_speakers_ == 0)
+		return;
+
+	std::sort(candidates_.begin(), candidates_.end(), [this](int a, int b) {
+		return entries_[a].level > entries_[b].level;
+	});
+	for(int channel : candidates_)
+	{
+		Entry& candidate = entries_[channel];
+		if(speakers < max_speakers_)
+		{
+			candidate.selected = true;
+			candidate.selected_ms = now_ms;
+			speakers++;
+			continue;
+		}
+		int weakest = Weakest();
+		if(weakest < 0)
+			break;
+		Entry& speaker = entries_[weakest];
+		if(candidate.level < speaker.level + kSwitchMargin || now_ms - speaker.selected_ms < kMinHoldMs)
+			break;	//candidates are sorted, nobody after this one wins either
+		speaker.selected = false;
+		candidate.selected = true;
+		candidate.selected_ms = now_ms;
+	}
+	//K lowered at runtime: drop the weakest until it fits
+	while(speakers > max_speakers_)
+	{
+		entries_[Weakest()].selected = false;
+		speakers--;
+	}
+}
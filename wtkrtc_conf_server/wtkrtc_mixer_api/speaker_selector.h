@@ -0,0 +1,45 @@
+#ifndef _speaker_selector_h
+#define _speaker_selector_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Speech level as 127 + dBov: 0 is silence, 127 full scale */
+#define SPEAKER_LEVEL_MAX 127
+
+/*
+ * Picks the loudest K participants of a conference once per tick.
+ * A speaker keeps its slot for at least kMinHoldMs, and is only pushed
+ * out by someone kSwitchMargin louder, so the mix does not flap between
+ * people talking at about the same level. K = 0 selects everyone.
+ */
+class SpeakerSelector {
+public:
+	explicit SpeakerSelector(size_t max_speakers);
+
+	void set_max_speakers(size_t max_speakers) { max_speakers_ = max_speakers; }
+	size_t max_speakers() const { return max_speakers_; }
+
+	/* Report every present participant each tick, then Select() */
+	void Update(int channel, int level);
+	void Select(int64_t now_ms);
+	bool selected(int channel) const;
+	/* The channel left, its slot may come back as someone else */
+	void Remove(int channel);
+private:
+	struct Entry {
+		bool present;
+		bool selected;
+		int level;
+		int64_t selected_ms;
+	};
+	Entry* entry(int channel);
+	int Weakest() const;
+
+	size_t max_speakers_;
+	std::vector<Entry> entries_;
+	std::vector<int> candidates_;
+};
+
+#endif
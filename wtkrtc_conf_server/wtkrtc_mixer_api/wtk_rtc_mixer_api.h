@@ -4,8 +4,11 @@
 #define OPUS_SAMPLE_RATE_HZ 48000
 #define OPUS_SAMPLES_PER_CHAN OPUS_SAMPLE_RATE_HZ/100
 #define OPUS_NUMBER_OF_CHAN	1
-#define MAX_PARTICIPANT 50
 #define MAX_VIDEO_PARTICIPANT 4
+#define MIXER_DEFAULT_SPEAKERS 3	/* loudest participants mixed, 0 mixes everyone */
+#define AUDIO_LEVEL_EXTENSION_ID 5	/* RFC 6464 ssrc-audio-level, as negotiated by the clients */
+#define MIXER_TICK_MS 10	/* one mix per conference every tick */
+#define MIXER_RTP_HEADER_SIZE 12
 
 enum videoCodec{
 	kWtkVideoCodecVP8 = 0,
@@ -26,17 +29,35 @@ enum classPayloadTypes{
 #define RTC_EXPORT __attribute__((visibility("default")))
 
 typedef int (*audio_transport_mixer_callback_t)(const uint8_t* buf, int len,int channel);
-typedef int (*video_transport_mixer_callback_t)(const uint8_t* buf, int len,int channel);
+/* Single-process mode: one handle per conference, packets leave with the caller's context */
+typedef struct wtk_mixer_conference wtk_mixer_conference_t;
+typedef int (*conference_transport_mixer_callback_t)(void* ctx, const uint8_t* buf, int len, int channel);
+/* The listeners' shared packet in one call: payload under each of the count channels' own RTP header */
+typedef int (*conference_fanout_mixer_callback_t)(void* ctx, const uint8_t (*headers)[MIXER_RTP_HEADER_SIZE], const int* channels, int count, const uint8_t* payload, int len);
 #ifdef __cplusplus
 extern "C" {
 #endif
 RTC_EXPORT extern void 	libwtk_set_mixer_audio_transport(audio_transport_mixer_callback_t func);
-RTC_EXPORT extern void 	libwtk_set_mixer_video_transport(video_transport_mixer_callback_t func);
 RTC_EXPORT extern int		libwtk_mixer_decode_audio(uint8_t* buf, int buflen,int channel);
 RTC_EXPORT extern int 	libwtk_mixer_decode_video(uint8_t* buf, int buflen,int channel);
 RTC_EXPORT extern void	libwtk_mixer_init(void);
 RTC_EXPORT extern void	libwtk_mixer_deinit(void);
 RTC_EXPORT extern void	libwtk_mixer_setup_mixer(int channel);
+RTC_EXPORT extern wtk_mixer_conference_t*	libwtk_mixer_create_conference(conference_transport_mixer_callback_t audio_func, void* ctx);
+/* Same, but no clock thread ticks it: the thread that owns the conference calls
+ * libwtk_mixer_conference_tick() every MIXER_TICK_MS, and packets leave on that thread */
+RTC_EXPORT extern wtk_mixer_conference_t*	libwtk_mixer_create_owned_conference(conference_transport_mixer_callback_t audio_func, void* ctx);
+RTC_EXPORT extern void	libwtk_mixer_conference_tick(wtk_mixer_conference_t* conf);
+/* Optional, without it the shared packet goes out through the transport once per listener */
+RTC_EXPORT extern void	libwtk_mixer_conference_set_fanout_transport(wtk_mixer_conference_t* conf, conference_fanout_mixer_callback_t fanout_func);
+RTC_EXPORT extern void	libwtk_mixer_destroy_conference(wtk_mixer_conference_t* conf);
+RTC_EXPORT extern void	libwtk_mixer_conference_setup_mixer(wtk_mixer_conference_t* conf, int channel);
+/* Participant registry: returns the lowest free channel, freed channels are handed out again */
+RTC_EXPORT extern int		libwtk_mixer_conference_add_participant(wtk_mixer_conference_t* conf);
+RTC_EXPORT extern void	libwtk_mixer_conference_remove_participant(wtk_mixer_conference_t* conf, int channel);
+RTC_EXPORT extern int		libwtk_mixer_conference_decode_audio(wtk_mixer_conference_t* conf, uint8_t* buf, int buflen, int channel);
+RTC_EXPORT extern int		libwtk_mixer_conference_decode_video(wtk_mixer_conference_t* conf, uint8_t* buf, int buflen, int channel);
+RTC_EXPORT extern void	libwtk_mixer_conference_set_max_speakers(wtk_mixer_conference_t* conf, int max_speakers);
 #ifdef __cplusplus
 }
 #endif
@@ -2,8 +2,10 @@
 #include <utility>
 #include <vector>
 #include <string>
+#include <string.h>
 
 #include "call/call.h"
+#include "rtc_base/criticalsection.h"
 #include "rtc_base/logging.h"
 #include "logging/rtc_event_log/rtc_event_log.h"
 #include "modules/audio_device/include/audio_device.h"
@@ -43,84 +45,212 @@
 #define MAX_VIDEO_PARTICIPANT 4
 #define AV_SYNC_GROUP "wtk_av_sync"
 
-static int g_audio_min_bps = 8 * 1000;
-static int g_audio_max_bps = 32 * 1000;
-static int g_video_min_bps = 64 * 1000;
-static int g_video_max_bps = 512 * 1000;
+//Every engine's call records and plays out through this one AudioState, the
+//device can be opened once per process and its threads serve all engines
+static rtc::CriticalSection g_audio_state_crit;
+static rtc::scoped_refptr<webrtc::AudioState> g_audio_state;
+static int g_audio_state_users = 0;
+
+//Receive buffers, back in the pool once the event carrying them is freed
+struct wtk_packet {
+	rtc::CopyOnWriteBuffer buffer;
+	uint8_t* data;
+	wtk_packet* next;
+};
+static rtc::CriticalSection g_packet_crit;
+static wtk_packet* g_packet_pool = nullptr;
 
-static int g_call_min_bps = g_audio_min_bps + g_video_min_bps;
-static int g_call_start_bps = g_audio_min_bps + g_video_min_bps;
-static int g_call_max_bps = g_audio_max_bps + g_video_max_bps;
+class AudioTransport:public webrtc::Transport{
+public:
+	explicit AudioTransport(wtk_engine* engine):engine_(engine) {}
+	bool SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options) override;
+	bool SendRtcp(const uint8_t* packet, size_t length) override;
+private:
+	wtk_engine* engine_;
+};
 
-static bool g_use_rtp_exten = false;
-static bool g_send_side_bwe = false;
+class VideoTransport:public webrtc::Transport{
+public:
+	explicit VideoTransport(wtk_engine* engine):engine_(engine) {}
+	bool SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options) override;
+	bool SendRtcp(const uint8_t* packet, size_t length) override;
+private:
+	wtk_engine* engine_;
+};
 
-static int g_used_video_codec = kWtkVideoCodecH264;
-//capturer
-static int g_used_video_width = 640;
-static int g_used_video_height = 480;
-//encode
-static int g_used_video_fps = 15;
-static int g_used_video_maxqp = 30;
+//One call: its configuration, its Call and streams, where its packets go
+struct wtk_engine {
+	wtk_engine():audio_send_transport(this),video_send_transport(this) {}
+
+	int audio_min_bps = 8 * 1000;
+	int audio_max_bps = 32 * 1000;
+	int video_min_bps = 64 * 1000;
+	int video_max_bps = 512 * 1000;
+
+	int call_min_bps = audio_min_bps + video_min_bps;
+	int call_start_bps = audio_min_bps + video_min_bps;
+	int call_max_bps = audio_max_bps + video_max_bps;
+
+	bool use_rtp_exten = false;
+	bool send_side_bwe = false;
+
+	int used_video_codec = kWtkVideoCodecH264;
+	//capturer
+	int used_video_width = 640;
+	int used_video_height = 480;
+	//encode
+	int used_video_fps = 15;
+	int used_video_maxqp = 30;
+
+	std::unique_ptr<webrtc::Call> call;
+
+	webrtc::VideoCapturer* video_capturers = nullptr;
+	rtc::VideoSinkInterface<webrtc::VideoFrame>* remote_display = nullptr;
+
+	webrtc::AudioSendStream* audio_send_stream = nullptr;
+	webrtc::AudioReceiveStream* audio_receive_stream = nullptr;
+	webrtc::VideoSendStream* video_send_stream = nullptr;
+	webrtc::VideoReceiveStream* video_receive_stream = nullptr;
+
+	wtk_transport_callback_t send_audio_packet = nullptr;
+	void* send_audio_opaque = nullptr;
+	wtk_transport_callback_t send_video_packet = nullptr;
+	void* send_video_opaque = nullptr;
+	AudioTransport audio_send_transport;
+	VideoTransport video_send_transport;
+
+	//For conference
+	rtc::VideoSinkInterface<webrtc::VideoFrame>* conf_display[MAX_VIDEO_PARTICIPANT] = {nullptr};
+	webrtc::VideoSendStream* conf_send_stream = nullptr;
+	webrtc::VideoReceiveStream* conf_receive_stream[MAX_VIDEO_PARTICIPANT] = {nullptr};
+
+	//libwtk_engine_get_call_quality() history
+	int64_t video_rec_avg_bps = 0;
+	int64_t last_bytes_rcvd = 0;
+	int64_t last_bytes_rcvd_time = 0;
+};
 
-static std::unique_ptr<webrtc::Call> g_call = nullptr;
+bool AudioTransport::SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options)
+{
+	int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
+	rtc::SentPacket sent_packet(options.packet_id,send_time);
+	engine_->call->OnSentPacket(sent_packet);
+	engine_->send_audio_packet(engine_->send_audio_opaque, packet, length);
+	return true;
+}
+bool AudioTransport::SendRtcp(const uint8_t* packet, size_t length)
+{
+	engine_->send_audio_packet(engine_->send_audio_opaque, packet, length);
+	return true;
+}
 
-static webrtc::VideoCapturer* g_video_capturers = nullptr;
-static rtc::VideoSinkInterface<webrtc::VideoFrame>* g_remote_display = nullptr;
+bool VideoTransport::SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options)
+{
+	int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
+	rtc::SentPacket sent_packet(options.packet_id,send_time);
+	engine_->call->OnSentPacket(sent_packet);
+	engine_->send_video_packet(engine_->send_video_opaque, packet, length);
+	//RTC_LOG(LS_INFO) << __FUNCTION__ << ":: SendRtp length " << length;
+	return true;
+}
+bool VideoTransport::SendRtcp(const uint8_t* packet, size_t length)
+{
+	engine_->send_video_packet(engine_->send_video_opaque, packet, length);
+	//RTC_LOG(LS_INFO) << __FUNCTION__ << ":: SendRtcp length " << length;
+	return true;
+}
 
-static webrtc::AudioSendStream* g_audio_send_stream = nullptr;
-static webrtc::AudioReceiveStream* g_audio_receive_stream = nullptr;
-static webrtc::VideoSendStream* g_video_send_stream = nullptr;
-static webrtc::VideoReceiveStream* g_video_receive_stream = nullptr;
+//The engine behind the functions without an engine argument
+static wtk_engine* default_engine()
+{
+	static wtk_engine* const engine = new wtk_engine();
+	return engine;
+}
 
+//Callbacks from libwtk_set_audio/video_transport(), they know no engine
 static audio_transport_callback_t g_send_audio_packet = nullptr;
 static video_transport_callback_t g_send_video_packet = nullptr;
 
-//For conference
-static rtc::VideoSinkInterface<webrtc::VideoFrame>* g_conf_display[MAX_VIDEO_PARTICIPANT] = {nullptr};
-static webrtc::VideoSendStream* g_conf_send_stream = nullptr;
-static webrtc::VideoReceiveStream* g_conf_receive_stream[MAX_VIDEO_PARTICIPANT] = {nullptr};
-
-class AudioTransport:public webrtc::Transport{
-public:
-	bool SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options) override
-	{		
-		int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
-		rtc::SentPacket sent_packet(options.packet_id,send_time);
-		g_call->OnSentPacket(sent_packet);
-		g_send_audio_packet(packet, length);
-		return true;
-	}
+static int send_default_audio(void* opaque, const uint8_t* buf, int len)
+{
+	return g_send_audio_packet(buf, len);
+}
+static int send_default_video(void* opaque, const uint8_t* buf, int len)
+{
+	return g_send_video_packet(buf, len);
+}
 
-	bool SendRtcp(const uint8_t* packet, size_t length) override
+static rtc::scoped_refptr<webrtc::AudioState> acquire_audio_state()
+{
+	rtc::CritScope cs(&g_audio_state_crit);
+	if(g_audio_state == nullptr)
 	{
-		g_send_audio_packet(packet, length);
-		return true;
-	}
-};
+		//audio device module
+		rtc::scoped_refptr<webrtc::AudioDeviceModule> adm = webrtc::AudioDeviceModule::Create(webrtc::AudioDeviceModule::kPlatformDefaultAudio);
+//#ifdef WEBRTC_ANDROID
+		if(adm->BuiltInAECIsAvailable())
+			adm->EnableBuiltInAEC(1);
+		if(adm->BuiltInAGCIsAvailable())
+			adm->EnableBuiltInAGC(1);
+		if(adm->BuiltInNSIsAvailable())
+			adm->EnableBuiltInNS(1);
+//#endif
+		adm->Init();
+		//audio process module
+		rtc::scoped_refptr<webrtc::AudioProcessing> apm = webrtc::AudioProcessingBuilder().Create();
+		webrtc::AudioProcessing::Config config;
+		config.high_pass_filter.enabled = true;
+		config.gain_controller2.enabled = true;
+		apm->ApplyConfig(config);
+		apm->level_estimator()->Enable(true);
+		apm->echo_cancellation()->enable_drift_compensation(true);
+		apm->echo_cancellation()->Enable(true);
+		apm->echo_cancellation()->enable_metrics(true);
+		apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kVeryHigh);
+		apm->noise_suppression()->Enable(true);
+		apm->gain_control()->set_analog_level_limits(0, 255);
+		apm->gain_control()->set_mode(webrtc::GainControl::kAdaptiveAnalog);
+		apm->gain_control()->Enable(true);
+		apm->voice_detection()->Enable(true);
+		apm->voice_detection()->set_likelihood( webrtc::VoiceDetection::kModerateLikelihood);
+		apm->Initialize();
 
-class VideoTransport:public webrtc::Transport{
-public:
-	bool SendRtp(const uint8_t* packet,size_t length,const webrtc::PacketOptions& options) override
-	{
-		int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
-		rtc::SentPacket sent_packet(options.packet_id,send_time);
-		g_call->OnSentPacket(sent_packet);
-		g_send_video_packet(packet, length);
-		//RTC_LOG(LS_INFO) << __FUNCTION__ << ":: SendRtp length " << length;
-		return true;
-	}
+		webrtc::AudioState::Config audioStateConfig;
+		audioStateConfig.audio_device_module = adm;
+		audioStateConfig.audio_mixer = webrtc::AudioMixerImpl::Create();
+		audioStateConfig.audio_processing = apm;
+		g_audio_state = webrtc::AudioState::Create(audioStateConfig);
 
-	bool SendRtcp(const uint8_t* packet, size_t length) override
-	{
-		g_send_video_packet(packet, length);
-		//RTC_LOG(LS_INFO) << __FUNCTION__ << ":: SendRtcp length " << length;
-		return true;
+		adm->RegisterAudioCallback(g_audio_state->audio_transport());
 	}
-};
+	g_audio_state_users++;
+	return g_audio_state;
+}
+//the device closes with the last engine's call
+static void release_audio_state()
+{
+	rtc::CritScope cs(&g_audio_state_crit);
+	if(--g_audio_state_users == 0)
+		g_audio_state = nullptr;
+}
 
-AudioTransport* g_audio_send_transport = new AudioTransport();
-VideoTransport* g_video_send_transport = new VideoTransport();
+wtk_engine_t* libwtk_engine_create(void)
+{
+	return new wtk_engine();
+}
+void libwtk_engine_destroy(wtk_engine_t* engine)
+{
+	if(engine == nullptr || engine == default_engine())
+		return;
+	libwtk_engine_destroy_video_conf_stream(engine);
+	libwtk_engine_destroy_audio_send_stream(engine);
+	libwtk_engine_destroy_audio_receive_stream(engine);
+	libwtk_engine_destroy_video_send_stream(engine);
+	libwtk_engine_destroy_video_receive_stream(engine);
+	libwtk_engine_destroy_call(engine);
+	libwtk_engine_destory_capture(engine);
+	delete engine;
+}
 
 #ifdef WEBRTC_ANDROID
 int libwtk_init_AndroidVideoEnv(void* javaVM, void* context)
@@ -140,77 +270,131 @@ int libwtk_init_AndroidVideoEnv(void* javaVM, void* context)
 }
 #endif
 
-void libwtk_set_audio_transport(audio_transport_callback_t func)
+void libwtk_engine_set_audio_transport(wtk_engine_t* engine, wtk_transport_callback_t func, void* opaque)
 {
-	g_send_audio_packet = func;
+	engine->send_audio_packet = func;
+	engine->send_audio_opaque = opaque;
 }
-void libwtk_set_video_transport(video_transport_callback_t func)
+void libwtk_engine_set_video_transport(wtk_engine_t* engine, wtk_transport_callback_t func, void* opaque)
 {
-	g_send_video_packet = func;
+	engine->send_video_packet = func;
+	engine->send_video_opaque = opaque;
 }
-int libwtk_decode_audio(uint8_t* buf, int buflen)
+int libwtk_engine_decode_audio(wtk_engine_t* engine, uint8_t* buf, int buflen)
 {
-	if( buflen && g_call != nullptr)
+	if( buflen && engine->call != nullptr)
 	{
 		int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
-		g_call->Receiver()->DeliverPacket(webrtc::MediaType::AUDIO, rtc::CopyOnWriteBuffer(buf, buflen), webrtc::PacketTime(send_time, -1));
+		engine->call->Receiver()->DeliverPacket(webrtc::MediaType::AUDIO, rtc::CopyOnWriteBuffer(buf, buflen), webrtc::PacketTime(send_time, -1));
 	}
 	return buflen;
 }
-int libwtk_decode_video(uint8_t* buf, int buflen)
+int libwtk_engine_decode_video(wtk_engine_t* engine, uint8_t* buf, int buflen)
 {
-	if( buflen && g_call != nullptr)
+	if( buflen && engine->call != nullptr)
 	{
 		int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
-		g_call->Receiver()->DeliverPacket(webrtc::MediaType::VIDEO, rtc::CopyOnWriteBuffer(buf, buflen), webrtc::PacketTime(send_time, -1));
+		engine->call->Receiver()->DeliverPacket(webrtc::MediaType::VIDEO, rtc::CopyOnWriteBuffer(buf, buflen), webrtc::PacketTime(send_time, -1));
 	}
 	return buflen;
 }
 
-void libwtk_config_video(int codec, int width, int height, int fps, int maxqp)
+wtk_packet_t* libwtk_packet_alloc(void)
 {
-	g_used_video_codec = codec;
-	g_used_video_width = width;
-	g_used_video_height = height;
-	g_used_video_fps = fps;
-	g_used_video_maxqp = maxqp;
+	wtk_packet* packet;
+	{
+		rtc::CritScope cs(&g_packet_crit);
+		packet = g_packet_pool;
+		if(packet != nullptr)
+			g_packet_pool = packet->next;
+	}
+	if(packet == nullptr)
+		packet = new wtk_packet();
+	packet->next = nullptr;
+	//if the call still holds the last packet Clear() swaps in new storage, nothing is copied
+	packet->buffer.Clear();
+	packet->buffer.SetSize(WTK_PACKET_SIZE);
+	packet->data = packet->buffer.data();
+	return packet;
 }
-void libwtk_config_bitrate(int audio_min_bps, int audio_max_bps, int video_min_bps, int video_max_bps)
+uint8_t* libwtk_packet_data(wtk_packet_t* packet)
+{
+	return packet->data;
+}
+void libwtk_packet_free(wtk_packet_t* packet)
+{
+	rtc::CritScope cs(&g_packet_crit);
+	packet->next = g_packet_pool;
+	g_packet_pool = packet;
+}
+static int deliver_packet(wtk_engine* engine, webrtc::MediaType media_type, wtk_packet* packet, int offset, int len)
 {
-	g_audio_min_bps = audio_min_bps;
-	g_audio_max_bps = audio_max_bps;
-	g_video_min_bps = video_min_bps;
-	g_video_max_bps = video_max_bps;
+	if(len <= 0 || offset < 0 || offset + len > WTK_PACKET_SIZE)
+		return -1;
+	if(engine->call != nullptr)
+	{
+		//CopyOnWriteBuffer has no slices, a packet not at the front moves down in place
+		if(offset > 0)
+			memmove(packet->data, packet->data + offset, len);
+		packet->buffer.SetSize(len);
+		int64_t send_time = webrtc::Clock::GetRealTimeClock()->TimeInMicroseconds();
+		engine->call->Receiver()->DeliverPacket(media_type, packet->buffer, webrtc::PacketTime(send_time, -1));
+	}
+	return len;
+}
+int libwtk_engine_deliver_audio(wtk_engine_t* engine, wtk_packet_t* packet, int offset, int len)
+{
+	return deliver_packet(engine, webrtc::MediaType::AUDIO, packet, offset, len);
+}
+int libwtk_engine_deliver_video(wtk_engine_t* engine, wtk_packet_t* packet, int offset, int len)
+{
+	return deliver_packet(engine, webrtc::MediaType::VIDEO, packet, offset, len);
+}
 
-	g_call_min_bps = g_audio_min_bps + g_video_min_bps;
-	g_call_start_bps = g_audio_min_bps + g_video_min_bps;
-	g_call_max_bps = g_audio_max_bps + g_video_max_bps;
+void libwtk_engine_config_video(wtk_engine_t* engine, int codec, int width, int height, int fps, int maxqp)
+{
+	engine->used_video_codec = codec;
+	engine->used_video_width = width;
+	engine->used_video_height = height;
+	engine->used_video_fps = fps;
+	engine->used_video_maxqp = maxqp;
+}
+void libwtk_engine_config_bitrate(wtk_engine_t* engine, int audio_min_bps, int audio_max_bps, int video_min_bps, int video_max_bps)
+{
+	engine->audio_min_bps = audio_min_bps;
+	engine->audio_max_bps = audio_max_bps;
+	engine->video_min_bps = video_min_bps;
+	engine->video_max_bps = video_max_bps;
+
+	engine->call_min_bps = engine->audio_min_bps + engine->video_min_bps;
+	engine->call_start_bps = engine->audio_min_bps + engine->video_min_bps;
+	engine->call_max_bps = engine->audio_max_bps + engine->video_max_bps;
 }
 
-int libwtk_create_local_render(void* surfaceView)
+int libwtk_engine_create_local_render(wtk_engine_t* engine, void* surfaceView)
 {
 	int cameraId = 1;//1:Front; 0:back
-	if(g_video_capturers != nullptr)
+	if(engine->video_capturers != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << ":: g_video_capturers already create success";
 	}
 	else
 	{
-		g_video_capturers = webrtc::VcmCapturer::Create(g_used_video_width, g_used_video_height,g_used_video_fps,cameraId);
+		engine->video_capturers = webrtc::VcmCapturer::Create(engine->used_video_width, engine->used_video_height,engine->used_video_fps,cameraId);
 		RTC_LOG(LS_INFO) << __FUNCTION__ << ":: g_video_capturers create success!!";
 	
 #ifdef WEBRTC_IOS
-		g_video_capturers->SetVideoPreviewRender(surfaceView);  
+		engine->video_capturers->SetVideoPreviewRender(surfaceView);  
 #endif
 #ifdef WEBRTC_ANDROID
-		g_video_capturers->SetCaptureRotation(webrtc::kVideoRotation_270);
+		engine->video_capturers->SetCaptureRotation(webrtc::kVideoRotation_270);
 #endif
 
 	}
 
 	return 0;
 }
-int libwtk_create_remote_render(void* surfaceView)
+int libwtk_engine_create_remote_render(wtk_engine_t* engine, void* surfaceView)
 {
 	int streamId = 0;
 	int is_full_screen = 1;
@@ -221,10 +405,10 @@ int libwtk_create_remote_render(void* surfaceView)
 		if(remote_render != nullptr)
 		{
 #ifdef WEBRTC_IOS
-			g_remote_display = remote_render->AddIncomingRenderStream(streamId, 0, 0, 1, 1, 0);
+			engine->remote_display = remote_render->AddIncomingRenderStream(streamId, 0, 0, 1, 1, 0);
 #endif
 #ifdef WEBRTC_ANDROID
-			g_remote_display = remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
+			engine->remote_display = remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
 #endif
 			remote_render->StartRender(streamId);
 			return 0;
@@ -242,34 +426,34 @@ int libwtk_create_remote_render(void* surfaceView)
 	}
 }
 
-void libwtk_start_capture(void)
+void libwtk_engine_start_capture(wtk_engine_t* engine)
 {
-	if(g_video_capturers != nullptr)
+	if(engine->video_capturers != nullptr)
 	{
-		g_video_capturers->Start();
+		engine->video_capturers->Start();
 	}
 	else
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << ":: g_video_capturers = null";
 	}
 }
-void libwtk_stop_capture(void)
+void libwtk_engine_stop_capture(wtk_engine_t* engine)
 {
-	if(g_video_capturers != nullptr)
+	if(engine->video_capturers != nullptr)
 	{
-		g_video_capturers->Stop();
+		engine->video_capturers->Stop();
 	}
 	else
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << ":: g_video_capturers = null";
 	}
 }
-void libwtk_switch_camera(int device_id)
+void libwtk_engine_switch_camera(wtk_engine_t* engine, int device_id)
 {
-	if(g_video_capturers != nullptr){
-		g_video_capturers->SetCaptureDevice(device_id);
+	if(engine->video_capturers != nullptr){
+		engine->video_capturers->SetCaptureDevice(device_id);
 #ifdef WEBRTC_ANDROID
-		g_video_capturers->SetCaptureRotation(webrtc::kVideoRotation_270);
+		engine->video_capturers->SetCaptureRotation(webrtc::kVideoRotation_270);
 #endif
 	}
 	else
@@ -278,16 +462,16 @@ void libwtk_switch_camera(int device_id)
 	}
 }
 
-void libwtk_destory_capture()
+void libwtk_engine_destory_capture(wtk_engine_t* engine)
 {
-	if(g_video_capturers != nullptr)
+	if(engine->video_capturers != nullptr)
 	{
-		g_video_capturers->Destroy();
-		g_video_capturers = nullptr;
+		engine->video_capturers->Destroy();
+		engine->video_capturers = nullptr;
 	}
 }
 //not used
-void libwtk_set_capture_rotation(int rotation)
+void libwtk_engine_set_capture_rotation(wtk_engine_t* engine, int rotation)
 {
 	webrtc::VideoRotation rotation_set;
 
@@ -309,9 +493,9 @@ void libwtk_set_capture_rotation(int rotation)
 			rotation_set = webrtc::kVideoRotation_270;
 			break;
 	}
-	if(g_video_capturers != nullptr)
+	if(engine->video_capturers != nullptr)
 	{
-		g_video_capturers->SetCaptureRotation(rotation_set);
+		engine->video_capturers->SetCaptureRotation(rotation_set);
 	}
 	else
 	{
@@ -319,9 +503,9 @@ void libwtk_set_capture_rotation(int rotation)
 	}
 }
 
-int libwtk_create_call(void)
+int libwtk_engine_create_call(wtk_engine_t* engine)
 {
-	if(g_call != nullptr)
+	if(engine->call != nullptr)
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << " :g_Call already exsit, so return success!";
 		return 0;
@@ -329,75 +513,37 @@ int libwtk_create_call(void)
 	else
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << " :g_Call is nullprt, so start creat call object!";
-		//audio device module
-		rtc::scoped_refptr<webrtc::AudioDeviceModule> adm = webrtc::AudioDeviceModule::Create(webrtc::AudioDeviceModule::kPlatformDefaultAudio);
-//#ifdef WEBRTC_ANDROID
-		if(adm->BuiltInAECIsAvailable())
-			adm->EnableBuiltInAEC(1);
-		if(adm->BuiltInAGCIsAvailable())
-			adm->EnableBuiltInAGC(1);
-		if(adm->BuiltInNSIsAvailable())
-			adm->EnableBuiltInNS(1);
-//#endif
-		adm->Init();
-		//audio process module
-		rtc::scoped_refptr<webrtc::AudioProcessing> apm = webrtc::AudioProcessingBuilder().Create();
-		webrtc::AudioProcessing::Config config;
-		config.high_pass_filter.enabled = true;
-		config.gain_controller2.enabled = true;
-		apm->ApplyConfig(config);
-		apm->level_estimator()->Enable(true);
-		apm->echo_cancellation()->enable_drift_compensation(true);
-		apm->echo_cancellation()->Enable(true);
-		apm->echo_cancellation()->enable_metrics(true);
-		apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kVeryHigh);
-		apm->noise_suppression()->Enable(true);
-		apm->gain_control()->set_analog_level_limits(0, 255);
-		apm->gain_control()->set_mode(webrtc::GainControl::kAdaptiveAnalog);
-		apm->gain_control()->Enable(true);
-		apm->voice_detection()->Enable(true);
-		apm->voice_detection()->set_likelihood( webrtc::VoiceDetection::kModerateLikelihood);
-		apm->Initialize();
-
-		webrtc::AudioState::Config audioStateConfig;
-		audioStateConfig.audio_device_module = adm;
-		audioStateConfig.audio_mixer = webrtc::AudioMixerImpl::Create();
-		audioStateConfig.audio_processing = apm;
-
 		webrtc::BitrateConstraints call_bitrate_config;
-		call_bitrate_config.min_bitrate_bps = g_call_min_bps;
-		call_bitrate_config.start_bitrate_bps = g_call_start_bps;
-		call_bitrate_config.max_bitrate_bps = g_call_max_bps;
+		call_bitrate_config.min_bitrate_bps = engine->call_min_bps;
+		call_bitrate_config.start_bitrate_bps = engine->call_start_bps;
+		call_bitrate_config.max_bitrate_bps = engine->call_max_bps;
 		
 		static std::unique_ptr<webrtc::RtcEventLog> event_log =  webrtc::RtcEventLog::CreateNull();
 		webrtc::CallConfig callConfig(event_log.get());
-		callConfig.audio_state = webrtc::AudioState::Create(audioStateConfig);
+		callConfig.audio_state = acquire_audio_state();
 		callConfig.bitrate_config = call_bitrate_config;
 		
-		adm->RegisterAudioCallback(callConfig.audio_state->audio_transport());
-		
-		g_call.reset(webrtc::Call::Create(callConfig));
-		if(g_call != nullptr)
+		engine->call.reset(webrtc::Call::Create(callConfig));
+		if(engine->call != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " :Init Call Success!";
 			return 0;
 		}else{
+			release_audio_state();
 			RTC_LOG(LS_ERROR) << __FUNCTION__ << " :Init Call Failed!";
 			return -1;
 		}
 	}
 }
 
-static int64_t video_rec_avg_bps = 0; 
-
-int libwtk_get_audio_stats(int* send_bps, int* rec_bps, int* package_lost)
+int libwtk_engine_get_audio_stats(wtk_engine_t* engine, int* send_bps, int* rec_bps, int* package_lost)
 {
-	if((g_audio_send_stream != nullptr)&&(g_audio_receive_stream != nullptr))
+	if((engine->audio_send_stream != nullptr)&&(engine->audio_receive_stream != nullptr))
 	{
 		webrtc::AudioSendStream::Stats audio_send_stats;
-		audio_send_stats = g_audio_send_stream->GetStats();
+		audio_send_stats = engine->audio_send_stream->GetStats();
 		webrtc::AudioReceiveStream::Stats audio_rec_stats;
-		audio_rec_stats = g_audio_receive_stream->GetStats();
+		audio_rec_stats = engine->audio_receive_stream->GetStats();
 		
 		*package_lost = audio_send_stats.packets_lost + audio_rec_stats.packets_lost;
 		*send_bps = (audio_send_stats.bytes_sent/(int64_t)audio_send_stats.total_input_duration + 1)*8;
@@ -410,23 +556,23 @@ int libwtk_get_audio_stats(int* send_bps, int* rec_bps, int* package_lost)
 		return -1;
 	}
 }
-int libwtk_get_video_stats(int* send_bps, int* rec_bps, int* prefer_bps)
+int libwtk_engine_get_video_stats(wtk_engine_t* engine, int* send_bps, int* rec_bps, int* prefer_bps)
 {
-	if((g_video_send_stream != nullptr)&&(g_video_receive_stream != nullptr))
+	if((engine->video_send_stream != nullptr)&&(engine->video_receive_stream != nullptr))
 	{
 		webrtc::VideoSendStream::Stats video_send_stats;
-		video_send_stats = g_video_send_stream->GetStats();
+		video_send_stats = engine->video_send_stream->GetStats();
 		webrtc::VideoReceiveStream::Stats video_rec_stats;
-		video_rec_stats = g_video_receive_stream->GetStats();
+		video_rec_stats = engine->video_receive_stream->GetStats();
 		
 		*send_bps = video_send_stats.media_bitrate_bps;
-		if(video_rec_avg_bps == 0)
+		if(engine->video_rec_avg_bps == 0)
 		{
 			*rec_bps = video_rec_stats.total_bitrate_bps;
 		}
 		else
 		{
-			*rec_bps = video_rec_avg_bps;
+			*rec_bps = engine->video_rec_avg_bps;
 		}
 		*prefer_bps = video_send_stats.preferred_media_bitrate_bps;
 
@@ -438,52 +584,50 @@ int libwtk_get_video_stats(int* send_bps, int* rec_bps, int* prefer_bps)
 	}
 }
 
-int libwtk_get_call_quality(int* audio_level, int* video_level)
+int libwtk_engine_get_call_quality(wtk_engine_t* engine, int* audio_level, int* video_level)
 {
-	static int64_t last_bytes_rcvd = 0;
-	static int64_t last_bytes_rcvd_time = 0;
 
-	if(g_audio_send_stream != nullptr)
+	if(engine->audio_send_stream != nullptr)
 	{
 		webrtc::AudioSendStream::Stats audio_send_stats;
-		audio_send_stats = g_audio_send_stream->GetStats();
+		audio_send_stats = engine->audio_send_stream->GetStats();
 
 		webrtc::AudioReceiveStream::Stats audio_rec_stats;
-		audio_rec_stats = g_audio_receive_stream->GetStats();
+		audio_rec_stats = engine->audio_receive_stream->GetStats();
 
 		int measured_bytes;
 		int64_t measured_time;
 		int cur_bps;
-		if(last_bytes_rcvd_time == 0)
+		if(engine->last_bytes_rcvd_time == 0)
 		{
 			measured_time = 5000;
 		}
 		else
 		{
-			measured_time = webrtc::Clock::GetRealTimeClock()->TimeInMilliseconds() - last_bytes_rcvd_time;
+			measured_time = webrtc::Clock::GetRealTimeClock()->TimeInMilliseconds() - engine->last_bytes_rcvd_time;
 		}
-		measured_bytes = audio_rec_stats.bytes_rcvd - last_bytes_rcvd;
+		measured_bytes = audio_rec_stats.bytes_rcvd - engine->last_bytes_rcvd;
 
 		cur_bps = (measured_bytes*8*1000)/measured_time;
 
-		last_bytes_rcvd = audio_rec_stats.bytes_rcvd;
-		last_bytes_rcvd_time = webrtc::Clock::GetRealTimeClock()->TimeInMilliseconds();
+		engine->last_bytes_rcvd = audio_rec_stats.bytes_rcvd;
+		engine->last_bytes_rcvd_time = webrtc::Clock::GetRealTimeClock()->TimeInMilliseconds();
 
 		*audio_level = cur_bps;
 	}
-	if(g_video_send_stream != nullptr)
+	if(engine->video_send_stream != nullptr)
 	{
 		webrtc::VideoReceiveStream::Stats video_rec_stats;
-		video_rec_stats = g_video_receive_stream->GetStats();
+		video_rec_stats = engine->video_receive_stream->GetStats();
 		
 		int tmp_total_bitrate_bps = video_rec_stats.total_bitrate_bps;
-		if(video_rec_avg_bps == 0)
+		if(engine->video_rec_avg_bps == 0)
 		{
-			video_rec_avg_bps = tmp_total_bitrate_bps;
+			engine->video_rec_avg_bps = tmp_total_bitrate_bps;
 		}
 		else
 		{
-			video_rec_avg_bps = (video_rec_avg_bps + tmp_total_bitrate_bps)/2;
+			engine->video_rec_avg_bps = (engine->video_rec_avg_bps + tmp_total_bitrate_bps)/2;
 		}
 		
 		*video_level = tmp_total_bitrate_bps;
@@ -492,9 +636,9 @@ int libwtk_get_call_quality(int* audio_level, int* video_level)
 	return 0;
 }
 
-int libwtk_create_audio_send_stream(uint32_t local_audio_ssrc)
+int libwtk_engine_create_audio_send_stream(wtk_engine_t* engine, uint32_t local_audio_ssrc)
 {
-	if(g_audio_send_stream != nullptr)
+	if(engine->audio_send_stream != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_audio_send_stream already exsit, so return success!";
 		return 0;
@@ -503,21 +647,21 @@ int libwtk_create_audio_send_stream(uint32_t local_audio_ssrc)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_audio_send_stream is nullprt, so start creat audio stream!";
 	
-		webrtc::AudioSendStream::Config audio_send_config(g_audio_send_transport);
+		webrtc::AudioSendStream::Config audio_send_config(&engine->audio_send_transport);
 		audio_send_config.send_codec_spec = webrtc::AudioSendStream::Config::SendCodecSpec(kWtkPayloadTypeOpus, {"OPUS", 48000, 2,{{"usedtx", "0"},{"stereo", "1"}}});
 		audio_send_config.encoder_factory = webrtc::CreateAudioEncoderFactory<webrtc::AudioEncoderOpus>();
 		audio_send_config.rtp.ssrc = local_audio_ssrc;
 		//audio_send_config.rtp.nack.rtp_history_ms = 1000;
 		audio_send_config.rtp.extensions.clear();
-		audio_send_config.min_bitrate_bps = g_audio_min_bps;
-		audio_send_config.max_bitrate_bps = g_audio_max_bps;
+		audio_send_config.min_bitrate_bps = engine->audio_min_bps;
+		audio_send_config.max_bitrate_bps = engine->audio_max_bps;
 
-		if(g_send_side_bwe)
+		if(engine->send_side_bwe)
 		{
 			audio_send_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kTransportSequenceNumberUri,webrtc::kRtpExtensionTransportSequenceNumber));
 		}
-	    g_audio_send_stream = g_call->CreateAudioSendStream(audio_send_config);
-		if (g_audio_send_stream != nullptr)
+	    engine->audio_send_stream = engine->call->CreateAudioSendStream(audio_send_config);
+		if (engine->audio_send_stream != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			return 0;
@@ -530,9 +674,9 @@ int libwtk_create_audio_send_stream(uint32_t local_audio_ssrc)
 	}
 }
 
-int libwtk_create_audio_receive_stream(uint32_t remote_audio_ssrc)
+int libwtk_engine_create_audio_receive_stream(wtk_engine_t* engine, uint32_t remote_audio_ssrc)
 {
-	if(g_audio_receive_stream != nullptr)
+	if(engine->audio_receive_stream != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_AudioReceiveStream already exsit, so return success!";
 		return 0;
@@ -542,21 +686,21 @@ int libwtk_create_audio_receive_stream(uint32_t remote_audio_ssrc)
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_AudioReceiveStream is nullprt, so go on!";
 	
 		webrtc::AudioReceiveStream::Config audio_rev_config;
-		audio_rev_config.rtcp_send_transport = g_audio_send_transport;
+		audio_rev_config.rtcp_send_transport = &engine->audio_send_transport;
 		audio_rev_config.decoder_factory = webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus>();
 		audio_rev_config.sync_group = AV_SYNC_GROUP;
 		audio_rev_config.decoder_map = {{kWtkPayloadTypeOpus, {"OPUS", 48000, 2}}};
 		audio_rev_config.rtp.remote_ssrc = remote_audio_ssrc;
-		audio_rev_config.rtp.transport_cc = g_send_side_bwe;
+		audio_rev_config.rtp.transport_cc = engine->send_side_bwe;
 		//audio_rev_config.rtp.nack.rtp_history_ms = 1000;
 		audio_rev_config.rtp.extensions.clear();
-		if(g_send_side_bwe)
+		if(engine->send_side_bwe)
 		{
 			audio_rev_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kTransportSequenceNumberUri,webrtc::kRtpExtensionTransportSequenceNumber));
 		}
-		g_audio_receive_stream = g_call->CreateAudioReceiveStream(audio_rev_config);
+		engine->audio_receive_stream = engine->call->CreateAudioReceiveStream(audio_rev_config);
 
-		if (g_audio_receive_stream != nullptr)
+		if (engine->audio_receive_stream != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			return 0;
@@ -569,10 +713,10 @@ int libwtk_create_audio_receive_stream(uint32_t remote_audio_ssrc)
 	}
 }
 
-int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
+int libwtk_engine_create_video_send_stream(wtk_engine_t* engine, uint32_t local_video_ssrc)
 {
 	RTC_LOG(LS_INFO) << __FUNCTION__;
-	if(g_video_send_stream != nullptr)
+	if(engine->video_send_stream != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoSendStream already exsit, so return success!";
 		return 0;
@@ -581,28 +725,28 @@ int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoSendStream is nullprt, so go on!";
 	
-		webrtc::VideoSendStream::Config video_send_config(g_video_send_transport);
+		webrtc::VideoSendStream::Config video_send_config(&engine->video_send_transport);
 		video_send_config.rtp.ssrcs.push_back(local_video_ssrc);
-		if(g_used_video_codec == kWtkVideoCodecVP8)
+		if(engine->used_video_codec == kWtkVideoCodecVP8)
 		{
 			video_send_config.rtp.payload_name = "VP8";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeVP8;
 			video_send_config.encoder_settings.encoder = webrtc::VP8Encoder::Create().release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecVP9)
+		else if(engine->used_video_codec == kWtkVideoCodecVP9)
 		{
 			video_send_config.rtp.payload_name = "VP9";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeVP9;
 			video_send_config.encoder_settings.encoder = webrtc::VP9Encoder::Create().release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecH264)
+		else if(engine->used_video_codec == kWtkVideoCodecH264)
 		{
 			video_send_config.rtp.payload_name = "H264";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeH264;
 			cricket::VideoCodec codec("H264");
 			video_send_config.encoder_settings.encoder = webrtc::H264Encoder::Create(codec).release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecH264Auto)
+		else if(engine->used_video_codec == kWtkVideoCodecH264Auto)
 		{
 #if defined(WEBRTC_ANDROID)
 			webrtc::jni::MediaCodecVideoEncoderFactory* encoder_factory = new webrtc::jni::MediaCodecVideoEncoderFactory();
@@ -632,12 +776,12 @@ int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
 		//video_send_config.pre_encode_callback = g_local_display;
 		video_send_config.rtp.max_packet_size = 1200;
 		video_send_config.rtp.extensions.clear();
-		if(g_send_side_bwe){
+		if(engine->send_side_bwe){
 			video_send_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kTransportSequenceNumberUri,webrtc::kRtpExtensionTransportSequenceNumber));
 		}
-		if(g_use_rtp_exten)
+		if(engine->use_rtp_exten)
 		{
-			if(!g_send_side_bwe){
+			if(!engine->send_side_bwe){
 				video_send_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kAbsSendTimeUri,webrtc::kRtpExtensionAbsoluteSendTime));
 			}
 			video_send_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kVideoContentTypeUri,webrtc::kRtpExtensionVideoContentType));
@@ -646,41 +790,41 @@ int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
 		webrtc::VideoEncoderConfig encoder_config;
 		
 		encoder_config.number_of_streams = 1;
-		encoder_config.min_transmit_bitrate_bps = g_video_min_bps;
-		encoder_config.max_bitrate_bps = g_video_max_bps;
+		encoder_config.min_transmit_bitrate_bps = engine->video_min_bps;
+		encoder_config.max_bitrate_bps = engine->video_max_bps;
 		encoder_config.content_type = webrtc::VideoEncoderConfig::ContentType::kRealtimeVideo;
 
-		if(g_used_video_codec == kWtkVideoCodecVP8)
+		if(engine->used_video_codec == kWtkVideoCodecVP8)
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecVP8;
 
 			webrtc::VideoCodecVP8 vp8_settings = webrtc::VideoEncoder::GetDefaultVp8Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::Vp8EncoderSpecificSettings>(vp8_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP8", g_used_video_maxqp, g_used_video_fps, false, false);
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP8", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
-		else if(g_used_video_codec == kWtkVideoCodecVP9)
+		else if(engine->used_video_codec == kWtkVideoCodecVP9)
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecVP9;
 
 			webrtc::VideoCodecVP9 vp9_settings = webrtc::VideoEncoder::GetDefaultVp9Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::Vp9EncoderSpecificSettings>(vp9_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP9", g_used_video_maxqp, g_used_video_fps, false, false);
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP9", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
-		else if((g_used_video_codec == kWtkVideoCodecH264)||(g_used_video_codec == kWtkVideoCodecH264Auto))
+		else if((engine->used_video_codec == kWtkVideoCodecH264)||(engine->used_video_codec == kWtkVideoCodecH264Auto))
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecH264;
 
 			webrtc::VideoCodecH264 h264_settings = webrtc::VideoEncoder::GetDefaultH264Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::H264EncoderSpecificSettings>(h264_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("H264", g_used_video_maxqp, g_used_video_fps, false, false);
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("H264", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
 
-		g_video_send_stream = g_call->CreateVideoSendStream(std::move(video_send_config), std::move(encoder_config));
-		if (g_video_send_stream != nullptr)
+		engine->video_send_stream = engine->call->CreateVideoSendStream(std::move(video_send_config), std::move(encoder_config));
+		if (engine->video_send_stream != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			//kDegradationDisabled,kMaintainResolution,kMaintainFramerate,kBalanced,
-			g_video_send_stream->SetSource(g_video_capturers, webrtc::VideoSendStream::DegradationPreference::kBalanced);
+			engine->video_send_stream->SetSource(engine->video_capturers, webrtc::VideoSendStream::DegradationPreference::kBalanced);
 			return 0;
 		}
 		else
@@ -691,9 +835,9 @@ int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
 	}
 }
 
-int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
+int libwtk_engine_create_video_receive_stream(wtk_engine_t* engine, uint32_t remote_video_ssrc)
 {
-	if(g_video_receive_stream != nullptr)
+	if(engine->video_receive_stream != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoReceiveStream already exsit, so return success!";
 		return 0;
@@ -702,23 +846,23 @@ int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoReceiveStream is nullprt, so go on!";
 	
-		webrtc::VideoReceiveStream::Config video_rev_config(g_video_send_transport);
-		video_rev_config.renderer = g_remote_display;
+		webrtc::VideoReceiveStream::Config video_rev_config(&engine->video_send_transport);
+		video_rev_config.renderer = engine->remote_display;
 		video_rev_config.sync_group = AV_SYNC_GROUP;
 		video_rev_config.rtp.remote_ssrc = remote_video_ssrc;
 
-		video_rev_config.rtp.transport_cc = g_send_side_bwe;
-		video_rev_config.rtp.remb = g_send_side_bwe;
+		video_rev_config.rtp.transport_cc = engine->send_side_bwe;
+		video_rev_config.rtp.remb = engine->send_side_bwe;
 		
 		video_rev_config.rtp.rtcp_mode = webrtc::RtcpMode::kReducedSize;
 		
 		video_rev_config.rtp.extensions.clear();
-		if(g_send_side_bwe){
+		if(engine->send_side_bwe){
 			video_rev_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kTransportSequenceNumberUri,webrtc::kRtpExtensionTransportSequenceNumber));
 		}
-		if(g_use_rtp_exten)
+		if(engine->use_rtp_exten)
 		{
-			if(!g_send_side_bwe){
+			if(!engine->send_side_bwe){
 				video_rev_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kAbsSendTimeUri,webrtc::kRtpExtensionAbsoluteSendTime));
 			}
 			video_rev_config.rtp.extensions.push_back(webrtc::RtpExtension(webrtc::RtpExtension::kVideoContentTypeUri,webrtc::kRtpExtensionVideoContentType));
@@ -736,7 +880,7 @@ int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
 		decoder_config.decoder = webrtc::VP9Decoder::Create().release();
 		video_rev_config.decoders.push_back(decoder_config);
 				
-		if(g_used_video_codec == kWtkVideoCodecH264)
+		if(engine->used_video_codec == kWtkVideoCodecH264)
 		{
 			decoder_config.payload_name = "H264";
 			decoder_config.payload_type = kWtkPayloadTypeH264;
@@ -773,8 +917,8 @@ int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
 #endif
 		}
 		
-	    g_video_receive_stream = g_call->CreateVideoReceiveStream(std::move(video_rev_config));
-		if (g_video_receive_stream != nullptr)
+	    engine->video_receive_stream = engine->call->CreateVideoReceiveStream(std::move(video_rev_config));
+		if (engine->video_receive_stream != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			return 0;
@@ -786,12 +930,12 @@ int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
 		}
 	}
 }
-void libwtk_destroy_audio_send_stream(void)
+void libwtk_engine_destroy_audio_send_stream(wtk_engine_t* engine)
 {
-	if (g_audio_send_stream != nullptr && g_call != nullptr)
+	if (engine->audio_send_stream != nullptr && engine->call != nullptr)
 	{
-		g_call->DestroyAudioSendStream(g_audio_send_stream);
-		g_audio_send_stream = nullptr;
+		engine->call->DestroyAudioSendStream(engine->audio_send_stream);
+		engine->audio_send_stream = nullptr;
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 	}
 	else
@@ -800,12 +944,12 @@ void libwtk_destroy_audio_send_stream(void)
 	}
 }
 
-void libwtk_destroy_audio_receive_stream(void)
+void libwtk_engine_destroy_audio_receive_stream(wtk_engine_t* engine)
 {
-	if (g_audio_receive_stream != nullptr && g_call != nullptr)
+	if (engine->audio_receive_stream != nullptr && engine->call != nullptr)
 	{
-		g_call->DestroyAudioReceiveStream(g_audio_receive_stream);
-		g_audio_receive_stream = nullptr;
+		engine->call->DestroyAudioReceiveStream(engine->audio_receive_stream);
+		engine->audio_receive_stream = nullptr;
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 	}
 	else
@@ -814,12 +958,12 @@ void libwtk_destroy_audio_receive_stream(void)
 	}
 }
 
-void libwtk_destroy_video_send_stream(void)
+void libwtk_engine_destroy_video_send_stream(wtk_engine_t* engine)
 {
-	if (g_video_send_stream != nullptr && g_call != nullptr)
+	if (engine->video_send_stream != nullptr && engine->call != nullptr)
 	{
-		g_call->DestroyVideoSendStream(g_video_send_stream);
-		g_video_send_stream = nullptr;
+		engine->call->DestroyVideoSendStream(engine->video_send_stream);
+		engine->video_send_stream = nullptr;
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 	}
 	else
@@ -827,12 +971,12 @@ void libwtk_destroy_video_send_stream(void)
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , no stream to destroy!";
 	}
 }
-void libwtk_destroy_video_receive_stream(void)
+void libwtk_engine_destroy_video_receive_stream(wtk_engine_t* engine)
 {
-	if (g_video_receive_stream != nullptr && g_call != nullptr)
+	if (engine->video_receive_stream != nullptr && engine->call != nullptr)
 	{
-		g_call->DestroyVideoReceiveStream(g_video_receive_stream);
-		g_video_receive_stream = nullptr;
+		engine->call->DestroyVideoReceiveStream(engine->video_receive_stream);
+		engine->video_receive_stream = nullptr;
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 	}
 	else
@@ -840,23 +984,24 @@ void libwtk_destroy_video_receive_stream(void)
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , no stream to destroy!";
 	}
 }
-void libwtk_destroy_call(void)
+void libwtk_engine_destroy_call(wtk_engine_t* engine)
 {
-	if(g_call != nullptr)
+	if(engine->call != nullptr)
 	{
-		g_call.reset();
-		g_call = nullptr;
+		engine->call.reset();
+		engine->call = nullptr;
+		release_audio_state();
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :Destroy Call Success!";
 	}else{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_Call is nullptr, no call object to destroy!";
 	}
 }
 
-void libwtk_set_mute(bool muted)
+void libwtk_engine_set_mute(wtk_engine_t* engine, bool muted)
 {
-	if(g_audio_send_stream != nullptr)
+	if(engine->audio_send_stream != nullptr)
   {
-  	g_audio_send_stream->SetMuted(muted);
+  	engine->audio_send_stream->SetMuted(muted);
 	}
 	else
 	{
@@ -864,13 +1009,13 @@ void libwtk_set_mute(bool muted)
 	}
 }
 
-void libwtk_start_audio_stream(void)
+void libwtk_engine_start_audio_stream(wtk_engine_t* engine)
 {	
-	if(g_audio_send_stream != nullptr && g_audio_receive_stream != nullptr)
+	if(engine->audio_send_stream != nullptr && engine->audio_receive_stream != nullptr)
   {
-  	g_audio_send_stream->Start();
-    g_audio_receive_stream->Start();
-		g_call->SignalChannelNetworkState(webrtc::MediaType::AUDIO, webrtc::kNetworkUp);
+  	engine->audio_send_stream->Start();
+    engine->audio_receive_stream->Start();
+		engine->call->SignalChannelNetworkState(webrtc::MediaType::AUDIO, webrtc::kNetworkUp);
 	}
 	else
 	{
@@ -878,39 +1023,39 @@ void libwtk_start_audio_stream(void)
 	}
 }
 
-void libwtk_start_video_stream(void)
+void libwtk_engine_start_video_stream(wtk_engine_t* engine)
 {
-	if(g_video_send_stream != nullptr && g_video_receive_stream != nullptr)
+	if(engine->video_send_stream != nullptr && engine->video_receive_stream != nullptr)
   {
-  	g_video_send_stream->Start();
-		g_video_receive_stream->Start();
-		g_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
+  	engine->video_send_stream->Start();
+		engine->video_receive_stream->Start();
+		engine->call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
 	}
 	else
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << " , g_video_send_stream or g_video_receive_stream is null";
 	}
 }
-void libwtk_stop_audio_stream(void)
+void libwtk_engine_stop_audio_stream(wtk_engine_t* engine)
 {
-	if(g_audio_send_stream != nullptr && g_audio_receive_stream != nullptr)
+	if(engine->audio_send_stream != nullptr && engine->audio_receive_stream != nullptr)
   {
-  	g_audio_send_stream->Stop();
-		g_audio_receive_stream->Stop();
-		g_call->SignalChannelNetworkState(webrtc::MediaType::AUDIO, webrtc::kNetworkDown);
+  	engine->audio_send_stream->Stop();
+		engine->audio_receive_stream->Stop();
+		engine->call->SignalChannelNetworkState(webrtc::MediaType::AUDIO, webrtc::kNetworkDown);
 	}
 	else
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << " , g_AudioSendStream or g_AudioReceiveStream is null";
 	}
 }
-void libwtk_stop_video_stream(void)
+void libwtk_engine_stop_video_stream(wtk_engine_t* engine)
 {
-	if(g_video_send_stream != nullptr && g_video_receive_stream != nullptr)
+	if(engine->video_send_stream != nullptr && engine->video_receive_stream != nullptr)
   {
-		g_video_send_stream->Stop();
-		g_video_receive_stream->Stop();
-		g_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkDown);
+		engine->video_send_stream->Stop();
+		engine->video_receive_stream->Stop();
+		engine->call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkDown);
 	}
 	else
 	{
@@ -919,7 +1064,7 @@ void libwtk_stop_video_stream(void)
 }
 
 //conference, just deal receive video stream
-int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfaceView2,void* surfaceView3)
+int libwtk_engine_create_conf_render(wtk_engine_t* engine, void* surfaceView0,void* surfaceView1,void* surfaceView2,void* surfaceView3)
 {
 	int streamId = 1;
 	int is_full_screen = 0;
@@ -930,7 +1075,7 @@ int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfac
 		g_remote_render = webrtc::VideoRender::CreateVideoRender(streamId,surfaceView0,is_full_screen,webrtc::kRenderDefault);
 		if(g_remote_render != nullptr)
 		{
-			g_conf_display[0] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
+			engine->conf_display[0] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
 			g_remote_render->StartRender(streamId);
 		}
 		else
@@ -945,7 +1090,7 @@ int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfac
 		g_remote_render = webrtc::VideoRender::CreateVideoRender(streamId,surfaceView1,is_full_screen,webrtc::kRenderDefault);
 		if(g_remote_render != nullptr)
 		{
-			g_conf_display[1] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
+			engine->conf_display[1] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
 			g_remote_render->StartRender(streamId);
 		}
 		else
@@ -960,7 +1105,7 @@ int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfac
 		g_remote_render = webrtc::VideoRender::CreateVideoRender(streamId,surfaceView2,is_full_screen,webrtc::kRenderDefault);
 		if(g_remote_render != nullptr)
 		{
-			g_conf_display[2] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
+			engine->conf_display[2] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
 			g_remote_render->StartRender(streamId);
 		}
 		else
@@ -975,7 +1120,7 @@ int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfac
 		g_remote_render = webrtc::VideoRender::CreateVideoRender(streamId,surfaceView3,is_full_screen,webrtc::kRenderDefault);
 		if(g_remote_render != nullptr)
 		{
-			g_conf_display[3] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
+			engine->conf_display[3] = g_remote_render->AddIncomingRenderStream(streamId, 0, 0, 0, 1, 1);
 			g_remote_render->StartRender(streamId);
 		}
 		else
@@ -987,9 +1132,9 @@ int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfac
 
 	return 0;
 }
-int libwtk_create_video_conf_send_stream(uint32_t local_video_ssrc)
+int libwtk_engine_create_video_conf_send_stream(wtk_engine_t* engine, uint32_t local_video_ssrc)
 {
-	if(g_conf_send_stream != nullptr)
+	if(engine->conf_send_stream != nullptr)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoSendStream already exsit, so return success!";
 		return 0;
@@ -998,28 +1143,33 @@ int libwtk_create_video_conf_send_stream(uint32_t local_video_ssrc)
 	{
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoSendStream is nullprt, so go on!";
 	
-    webrtc::VideoSendStream::Config video_send_config(g_video_send_transport);
+    webrtc::VideoSendStream::Config video_send_config(&engine->video_send_transport);
 		video_send_config.rtp.ssrcs.push_back(local_video_ssrc);
-		if(g_used_video_codec == kWtkVideoCodecVP8)
+		if(engine->used_video_codec == kWtkVideoCodecVP8)
 		{
+			//the mixer forwards each receiver the layer its bandwidth allows
+			for(int layer = 1; layer < VIDEO_SIMULCAST_LAYERS; layer++)
+			{
+				video_send_config.rtp.ssrcs.push_back(local_video_ssrc + layer * VIDEO_SIMULCAST_SSRC_STRIDE);
+			}
 			video_send_config.rtp.payload_name = "VP8";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeVP8;
 			video_send_config.encoder_settings.encoder = webrtc::VP8Encoder::Create().release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecVP9)
+		else if(engine->used_video_codec == kWtkVideoCodecVP9)
 		{
 			video_send_config.rtp.payload_name = "VP9";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeVP9;
 			video_send_config.encoder_settings.encoder = webrtc::VP9Encoder::Create().release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecH264)
+		else if(engine->used_video_codec == kWtkVideoCodecH264)
 		{
 			video_send_config.rtp.payload_name = "H264";
 			video_send_config.rtp.payload_type = kWtkPayloadTypeH264;
 			cricket::VideoCodec codec("H264");
 			video_send_config.encoder_settings.encoder = webrtc::H264Encoder::Create(codec).release();
 		}
-		else if(g_used_video_codec == kWtkVideoCodecH264Auto)
+		else if(engine->used_video_codec == kWtkVideoCodecH264Auto)
 		{
 #if defined(WEBRTC_ANDROID)
 			webrtc::jni::MediaCodecVideoEncoderFactory* encoder_factory = new webrtc::jni::MediaCodecVideoEncoderFactory();
@@ -1048,42 +1198,43 @@ int libwtk_create_video_conf_send_stream(uint32_t local_video_ssrc)
 		video_send_config.rtp.extensions.clear();
 		
 		webrtc::VideoEncoderConfig encoder_config;
-		encoder_config.number_of_streams = 1;
-		encoder_config.min_transmit_bitrate_bps = g_video_min_bps;
-		encoder_config.max_bitrate_bps = g_video_max_bps;
+		encoder_config.number_of_streams = video_send_config.rtp.ssrcs.size();
+		encoder_config.min_transmit_bitrate_bps = engine->video_min_bps;
+		encoder_config.max_bitrate_bps = engine->video_max_bps;
 		encoder_config.content_type = webrtc::VideoEncoderConfig::ContentType::kRealtimeVideo;
 
-		if(g_used_video_codec == kWtkVideoCodecVP8)
+		if(engine->used_video_codec == kWtkVideoCodecVP8)
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecVP8;
 
 			webrtc::VideoCodecVP8 vp8_settings = webrtc::VideoEncoder::GetDefaultVp8Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::Vp8EncoderSpecificSettings>(vp8_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP8", g_used_video_maxqp, g_used_video_fps, false, false);
+			//with more than one stream the factory lays out the simulcast layers for the capture size
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP8", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
-		else if(g_used_video_codec == kWtkVideoCodecVP9)
+		else if(engine->used_video_codec == kWtkVideoCodecVP9)
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecVP9;
 
 			webrtc::VideoCodecVP9 vp9_settings = webrtc::VideoEncoder::GetDefaultVp9Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::Vp9EncoderSpecificSettings>(vp9_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP9", g_used_video_maxqp, g_used_video_fps, false, false);
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("VP9", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
-		else if((g_used_video_codec == kWtkVideoCodecH264)||(g_used_video_codec == kWtkVideoCodecH264Auto))
+		else if((engine->used_video_codec == kWtkVideoCodecH264)||(engine->used_video_codec == kWtkVideoCodecH264Auto))
 		{
 			encoder_config.codec_type = webrtc::kVideoCodecH264;
 
 			webrtc::VideoCodecH264 h264_settings = webrtc::VideoEncoder::GetDefaultH264Settings();
 			encoder_config.encoder_specific_settings = new rtc::RefCountedObject<webrtc::VideoEncoderConfig::H264EncoderSpecificSettings>(h264_settings);
-			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("H264", g_used_video_maxqp, g_used_video_fps, false, false);
+			encoder_config.video_stream_factory = new rtc::RefCountedObject<cricket::EncoderStreamFactory>("H264", engine->used_video_maxqp, engine->used_video_fps, false, false);
 		}
 
-		g_conf_send_stream = g_call->CreateVideoSendStream(std::move(video_send_config), std::move(encoder_config));
-		if (g_conf_send_stream != nullptr)
+		engine->conf_send_stream = engine->call->CreateVideoSendStream(std::move(video_send_config), std::move(encoder_config));
+		if (engine->conf_send_stream != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			//kDegradationDisabled,kMaintainResolution,kMaintainFramerate,kBalanced,
-			g_conf_send_stream->SetSource(g_video_capturers, webrtc::VideoSendStream::DegradationPreference::kBalanced);
+			engine->conf_send_stream->SetSource(engine->video_capturers, webrtc::VideoSendStream::DegradationPreference::kBalanced);
 			return 0;
 		}
 		else
@@ -1094,12 +1245,12 @@ int libwtk_create_video_conf_send_stream(uint32_t local_video_ssrc)
 	}
 }
 
-int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
+int libwtk_engine_create_video_conf_receive_stream(wtk_engine_t* engine, uint32_t remote_video_ssrc)
 {
 	int i = 0;
 	for(i=0;i<MAX_VIDEO_PARTICIPANT;i++)
 	{
-		if(g_conf_receive_stream[i] != nullptr)
+		if(engine->conf_receive_stream[i] != nullptr)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoReceiveStream already exsit, so return success!";
 			continue;
@@ -1108,13 +1259,16 @@ int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
 		{
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " :g_VideoReceiveStream is nullprt, so go on!";
 		
-			webrtc::VideoReceiveStream::Config video_rev_config(g_video_send_transport);
-			video_rev_config.renderer = g_conf_display[i];
+			webrtc::VideoReceiveStream::Config video_rev_config(&engine->video_send_transport);
+			video_rev_config.renderer = engine->conf_display[i];
 			video_rev_config.sync_group = AV_SYNC_GROUP;
 			video_rev_config.rtp.remote_ssrc = remote_video_ssrc++;
 			video_rev_config.rtp.transport_cc = false;
-			video_rev_config.rtp.remb = false;
+			//the mixer picks each sender's simulcast layer from this estimate
+			video_rev_config.rtp.remb = true;
 			video_rev_config.rtp.rtcp_mode = webrtc::RtcpMode::kReducedSize;
+			//losses are answered by the mixer from its retransmission cache
+			video_rev_config.rtp.nack.rtp_history_ms = 1000;
 			video_rev_config.rtp.extensions.clear();
 			
 			webrtc::VideoReceiveStream::Decoder decoder_config;
@@ -1127,7 +1281,7 @@ int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
 			decoder_config.decoder = webrtc::VP9Decoder::Create().release();
 			video_rev_config.decoders.push_back(decoder_config);
 			
-			if(g_used_video_codec == kWtkVideoCodecH264)
+			if(engine->used_video_codec == kWtkVideoCodecH264)
 			{
 				decoder_config.payload_name = "H264";
 				decoder_config.payload_type = kWtkPayloadTypeH264;
@@ -1163,8 +1317,8 @@ int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
 			video_rev_config.decoders.push_back(decoder_config);
 #endif
 			}
-			g_conf_receive_stream[i] = g_call->CreateVideoReceiveStream(std::move(video_rev_config));
-			if (g_conf_receive_stream[i] != nullptr)
+			engine->conf_receive_stream[i] = engine->call->CreateVideoReceiveStream(std::move(video_rev_config));
+			if (engine->conf_receive_stream[i] != nullptr)
 			{
 				RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 			}
@@ -1175,47 +1329,47 @@ int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
 		}
 	}
 
-	g_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
+	engine->call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
 	return 0;
 }
-void libwtk_start_video_conf_stream(void)
+void libwtk_engine_start_video_conf_stream(wtk_engine_t* engine)
 {
 	int i=0;
-	if(g_conf_send_stream != nullptr)
+	if(engine->conf_send_stream != nullptr)
     {
-    	g_conf_send_stream->Start();
+    	engine->conf_send_stream->Start();
 	}
 
 	for(i=0;i<MAX_VIDEO_PARTICIPANT;i++)
 	{
-		if(g_conf_receive_stream[i] != nullptr)
-			g_conf_receive_stream[i]->Start();
+		if(engine->conf_receive_stream[i] != nullptr)
+			engine->conf_receive_stream[i]->Start();
 	}
-	g_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
+	engine->call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkUp);
 }
-void libwtk_stop_video_conf_stream(void)
+void libwtk_engine_stop_video_conf_stream(wtk_engine_t* engine)
 {
 	int i=0;
-	if(g_conf_send_stream != nullptr)
+	if(engine->conf_send_stream != nullptr)
   {
-  	g_conf_send_stream->Stop();		
+  	engine->conf_send_stream->Stop();		
 	}
 	for(i=0;i<MAX_VIDEO_PARTICIPANT;i++)
 	{
-		if(g_conf_receive_stream[i] != nullptr)
-			g_conf_receive_stream[i]->Stop();
+		if(engine->conf_receive_stream[i] != nullptr)
+			engine->conf_receive_stream[i]->Stop();
 	}
-	g_call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkDown);
+	engine->call->SignalChannelNetworkState(webrtc::MediaType::VIDEO, webrtc::kNetworkDown);
 }
-void libwtk_destroy_video_conf_stream(void)
+void libwtk_engine_destroy_video_conf_stream(wtk_engine_t* engine)
 {
 	int i=0;
 	for(i=0;i<MAX_VIDEO_PARTICIPANT;i++)
 	{
-		if (g_conf_receive_stream[i] != nullptr && g_call != nullptr)
+		if (engine->conf_receive_stream[i] != nullptr && engine->call != nullptr)
 		{
-			g_call->DestroyVideoReceiveStream(g_conf_receive_stream[i]);
-			g_conf_receive_stream[i] = nullptr;
+			engine->call->DestroyVideoReceiveStream(engine->conf_receive_stream[i]);
+			engine->conf_receive_stream[i] = nullptr;
 			RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 		}
 		else
@@ -1224,10 +1378,10 @@ void libwtk_destroy_video_conf_stream(void)
 		}
 	}
 
-	if (g_conf_send_stream != nullptr && g_call != nullptr)
+	if (engine->conf_send_stream != nullptr && engine->call != nullptr)
 	{
-		g_call->DestroyVideoSendStream(g_conf_send_stream);
-		g_conf_send_stream = nullptr;
+		engine->call->DestroyVideoSendStream(engine->conf_send_stream);
+		engine->conf_send_stream = nullptr;
 		RTC_LOG(LS_INFO) << __FUNCTION__ << " , Success!";
 	}
 	else
@@ -1236,3 +1390,162 @@ void libwtk_destroy_video_conf_stream(void)
 	}
 }
 
+//The API from before engines, all of it on the default engine
+void libwtk_set_audio_transport(audio_transport_callback_t func)
+{
+	g_send_audio_packet = func;
+	libwtk_engine_set_audio_transport(default_engine(), send_default_audio, nullptr);
+}
+void libwtk_set_video_transport(video_transport_callback_t func)
+{
+	g_send_video_packet = func;
+	libwtk_engine_set_video_transport(default_engine(), send_default_video, nullptr);
+}
+int libwtk_decode_audio(uint8_t* buf, int buflen)
+{
+	return libwtk_engine_decode_audio(default_engine(), buf, buflen);
+}
+int libwtk_decode_video(uint8_t* buf, int buflen)
+{
+	return libwtk_engine_decode_video(default_engine(), buf, buflen);
+}
+int libwtk_deliver_audio(wtk_packet_t* packet, int offset, int len)
+{
+	return libwtk_engine_deliver_audio(default_engine(), packet, offset, len);
+}
+int libwtk_deliver_video(wtk_packet_t* packet, int offset, int len)
+{
+	return libwtk_engine_deliver_video(default_engine(), packet, offset, len);
+}
+void libwtk_config_video(int codec, int width, int height, int fps, int maxqp)
+{
+	libwtk_engine_config_video(default_engine(), codec, width, height, fps, maxqp);
+}
+void libwtk_config_bitrate(int audio_min_bps, int audio_max_bps, int video_min_bps, int video_max_bps)
+{
+	libwtk_engine_config_bitrate(default_engine(), audio_min_bps, audio_max_bps, video_min_bps, video_max_bps);
+}
+int libwtk_create_local_render(void* surfaceView)
+{
+	return libwtk_engine_create_local_render(default_engine(), surfaceView);
+}
+int libwtk_create_remote_render(void* surfaceView)
+{
+	return libwtk_engine_create_remote_render(default_engine(), surfaceView);
+}
+void libwtk_start_capture(void)
+{
+	libwtk_engine_start_capture(default_engine());
+}
+void libwtk_stop_capture(void)
+{
+	libwtk_engine_stop_capture(default_engine());
+}
+void libwtk_switch_camera(int device_id)
+{
+	libwtk_engine_switch_camera(default_engine(), device_id);
+}
+void libwtk_destory_capture(void)
+{
+	libwtk_engine_destory_capture(default_engine());
+}
+void libwtk_set_capture_rotation(int rotation)
+{
+	libwtk_engine_set_capture_rotation(default_engine(), rotation);
+}
+int libwtk_create_call(void)
+{
+	return libwtk_engine_create_call(default_engine());
+}
+int libwtk_get_audio_stats(int* send_bps, int* rec_bps, int* package_lost)
+{
+	return libwtk_engine_get_audio_stats(default_engine(), send_bps, rec_bps, package_lost);
+}
+int libwtk_get_video_stats(int* send_bps, int* rec_bps, int* prefer_bps)
+{
+	return libwtk_engine_get_video_stats(default_engine(), send_bps, rec_bps, prefer_bps);
+}
+int libwtk_get_call_quality(int* audio_level, int* video_level)
+{
+	return libwtk_engine_get_call_quality(default_engine(), audio_level, video_level);
+}
+int libwtk_create_audio_send_stream(uint32_t local_audio_ssrc)
+{
+	return libwtk_engine_create_audio_send_stream(default_engine(), local_audio_ssrc);
+}
+int libwtk_create_audio_receive_stream(uint32_t remote_audio_ssrc)
+{
+	return libwtk_engine_create_audio_receive_stream(default_engine(), remote_audio_ssrc);
+}
+int libwtk_create_video_send_stream(uint32_t local_video_ssrc)
+{
+	return libwtk_engine_create_video_send_stream(default_engine(), local_video_ssrc);
+}
+int libwtk_create_video_receive_stream(uint32_t remote_video_ssrc)
+{
+	return libwtk_engine_create_video_receive_stream(default_engine(), remote_video_ssrc);
+}
+void libwtk_destroy_audio_send_stream(void)
+{
+	libwtk_engine_destroy_audio_send_stream(default_engine());
+}
+void libwtk_destroy_audio_receive_stream(void)
+{
+	libwtk_engine_destroy_audio_receive_stream(default_engine());
+}
+void libwtk_destroy_video_send_stream(void)
+{
+	libwtk_engine_destroy_video_send_stream(default_engine());
+}
+void libwtk_destroy_video_receive_stream(void)
+{
+	libwtk_engine_destroy_video_receive_stream(default_engine());
+}
+void libwtk_destroy_call(void)
+{
+	libwtk_engine_destroy_call(default_engine());
+}
+void libwtk_set_mute(bool muted)
+{
+	libwtk_engine_set_mute(default_engine(), muted);
+}
+void libwtk_start_audio_stream(void)
+{
+	libwtk_engine_start_audio_stream(default_engine());
+}
+void libwtk_start_video_stream(void)
+{
+	libwtk_engine_start_video_stream(default_engine());
+}
+void libwtk_stop_audio_stream(void)
+{
+	libwtk_engine_stop_audio_stream(default_engine());
+}
+void libwtk_stop_video_stream(void)
+{
+	libwtk_engine_stop_video_stream(default_engine());
+}
+int libwtk_create_conf_render(void* surfaceView0,void* surfaceView1,void* surfaceView2,void* surfaceView3)
+{
+	return libwtk_engine_create_conf_render(default_engine(), surfaceView0, surfaceView1, surfaceView2, surfaceView3);
+}
+int libwtk_create_video_conf_send_stream(uint32_t local_video_ssrc)
+{
+	return libwtk_engine_create_video_conf_send_stream(default_engine(), local_video_ssrc);
+}
+int libwtk_create_video_conf_receive_stream(uint32_t remote_video_ssrc)
+{
+	return libwtk_engine_create_video_conf_receive_stream(default_engine(), remote_video_ssrc);
+}
+void libwtk_start_video_conf_stream(void)
+{
+	libwtk_engine_start_video_conf_stream(default_engine());
+}
+void libwtk_stop_video_conf_stream(void)
+{
+	libwtk_engine_stop_video_conf_stream(default_engine());
+}
+void libwtk_destroy_video_conf_stream(void)
+{
+	libwtk_engine_destroy_video_conf_stream(default_engine());
+}
@@ -19,8 +19,29 @@ enum classPayloadTypes{
     kWtkPayloadTypeVP9 = 108,
 };
 
+/* Conference VP8 goes out as simulcast, layer k on local_video_ssrc + k * stride, lowest first.
+ * The mixer keeps the same convention. */
+#define VIDEO_SIMULCAST_LAYERS 3
+#define VIDEO_SIMULCAST_SSRC_STRIDE 0x10000
+
+/* Pooled receive buffer. The network read lands in it once, WTK_PACKET_HEADROOM
+ * bytes in when the payload may need an RTP header written in front of it, and
+ * libwtk_deliver_audio/video() hand it to the call without a copy. The pool is
+ * shared by all engines. */
+#define WTK_PACKET_HEADROOM 12
+#define WTK_PACKET_SIZE 4096
+typedef struct wtk_packet wtk_packet_t;
+
 typedef int (*audio_transport_callback_t)(const uint8_t* buf, int len);
 typedef int (*video_transport_callback_t)(const uint8_t* buf, int len);
+
+/* One call: its configuration, Call, streams, renders and transports. Every
+ * libwtk_engine_* function works on the engine it is given, the libwtk_*
+ * function of the same name on a default engine that is never destroyed, so
+ * existing single call users see no change. All engines record and play out
+ * through one shared audio device. */
+typedef struct wtk_engine wtk_engine_t;
+typedef int (*wtk_transport_callback_t)(void* opaque, const uint8_t* buf, int len);
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,6 +53,11 @@ extern void libwtk_set_audio_transport(audio_transport_callback_t func);
 extern void libwtk_set_video_transport(video_transport_callback_t func);
 extern int libwtk_decode_audio(uint8_t* buf, int buflen);
 extern int libwtk_decode_video(uint8_t* buf, int buflen);
+extern wtk_packet_t* libwtk_packet_alloc(void);
+extern uint8_t* libwtk_packet_data(wtk_packet_t* packet);
+extern void libwtk_packet_free(wtk_packet_t* packet);
+extern int libwtk_deliver_audio(wtk_packet_t* packet, int offset, int len);
+extern int libwtk_deliver_video(wtk_packet_t* packet, int offset, int len);
 extern void libwtk_config_video(int codec, int width, int height, int fps, int maxqp);
 extern void libwtk_config_bitrate(int audio_min_bps, int audio_max_bps, int video_min_bps, int video_max_bps);
 extern int libwtk_create_local_render(void* surfaceView);
@@ -67,6 +93,48 @@ extern void libwtk_start_video_conf_stream(void);
 extern void libwtk_stop_video_conf_stream(void);
 extern void libwtk_destroy_video_conf_stream(void);
 
+extern wtk_engine_t* libwtk_engine_create(void);
+extern void libwtk_engine_destroy(wtk_engine_t* engine);
+extern void libwtk_engine_set_audio_transport(wtk_engine_t* engine, wtk_transport_callback_t func, void* opaque);
+extern void libwtk_engine_set_video_transport(wtk_engine_t* engine, wtk_transport_callback_t func, void* opaque);
+extern int libwtk_engine_decode_audio(wtk_engine_t* engine, uint8_t* buf, int buflen);
+extern int libwtk_engine_decode_video(wtk_engine_t* engine, uint8_t* buf, int buflen);
+extern int libwtk_engine_deliver_audio(wtk_engine_t* engine, wtk_packet_t* packet, int offset, int len);
+extern int libwtk_engine_deliver_video(wtk_engine_t* engine, wtk_packet_t* packet, int offset, int len);
+extern void libwtk_engine_config_video(wtk_engine_t* engine, int codec, int width, int height, int fps, int maxqp);
+extern void libwtk_engine_config_bitrate(wtk_engine_t* engine, int audio_min_bps, int audio_max_bps, int video_min_bps, int video_max_bps);
+extern int libwtk_engine_create_local_render(wtk_engine_t* engine, void* surfaceView);
+extern int libwtk_engine_create_remote_render(wtk_engine_t* engine, void* surfaceView);
+extern void libwtk_engine_start_capture(wtk_engine_t* engine);
+extern void libwtk_engine_stop_capture(wtk_engine_t* engine);
+extern void libwtk_engine_switch_camera(wtk_engine_t* engine, int device_id);
+extern void libwtk_engine_destory_capture(wtk_engine_t* engine);
+extern void libwtk_engine_set_capture_rotation(wtk_engine_t* engine, int rotation);
+extern int libwtk_engine_create_call(wtk_engine_t* engine);
+extern int libwtk_engine_get_audio_stats(wtk_engine_t* engine, int* send_bps, int* rec_bps, int* package_lost);
+extern int libwtk_engine_get_video_stats(wtk_engine_t* engine, int* send_bps, int* rec_bps, int* prefer_bps);
+extern int libwtk_engine_get_call_quality(wtk_engine_t* engine, int* audio_level, int* video_level);
+extern int libwtk_engine_create_audio_send_stream(wtk_engine_t* engine, uint32_t local_audio_ssrc);
+extern int libwtk_engine_create_audio_receive_stream(wtk_engine_t* engine, uint32_t remote_audio_ssrc);
+extern int libwtk_engine_create_video_send_stream(wtk_engine_t* engine, uint32_t local_video_ssrc);
+extern int libwtk_engine_create_video_receive_stream(wtk_engine_t* engine, uint32_t remote_video_ssrc);
+extern void libwtk_engine_destroy_audio_send_stream(wtk_engine_t* engine);
+extern void libwtk_engine_destroy_audio_receive_stream(wtk_engine_t* engine);
+extern void libwtk_engine_destroy_video_send_stream(wtk_engine_t* engine);
+extern void libwtk_engine_destroy_video_receive_stream(wtk_engine_t* engine);
+extern void libwtk_engine_destroy_call(wtk_engine_t* engine);
+extern void libwtk_engine_set_mute(wtk_engine_t* engine, bool muted);
+extern void libwtk_engine_start_audio_stream(wtk_engine_t* engine);
+extern void libwtk_engine_start_video_stream(wtk_engine_t* engine);
+extern void libwtk_engine_stop_audio_stream(wtk_engine_t* engine);
+extern void libwtk_engine_stop_video_stream(wtk_engine_t* engine);
+extern int libwtk_engine_create_conf_render(wtk_engine_t* engine, void* surfaceView0,void* surfaceView1,void* surfaceView2,void* surfaceView3);
+extern int libwtk_engine_create_video_conf_send_stream(wtk_engine_t* engine, uint32_t local_video_ssrc);
+extern int libwtk_engine_create_video_conf_receive_stream(wtk_engine_t* engine, uint32_t remote_video_ssrc);
+extern void libwtk_engine_start_video_conf_stream(wtk_engine_t* engine);
+extern void libwtk_engine_stop_video_conf_stream(wtk_engine_t* engine);
+extern void libwtk_engine_destroy_video_conf_stream(wtk_engine_t* engine);
+
 #ifdef __cplusplus
 }
 #endif
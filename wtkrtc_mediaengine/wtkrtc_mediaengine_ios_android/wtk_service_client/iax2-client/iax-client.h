@@ -127,6 +127,8 @@ struct iax_event {
 	struct iax_session *session; /* Applicable session */
 	int datalen;                 /* Length of raw data */
 	struct iax_ies ies;          /* IE's for IAX2 frames */
+	struct wtk_packet *packet;   /* Media still in the receive buffer, data is empty */
+	int offset;                  /* Where the media starts in packet */
 	unsigned char data[0];       /* Raw data if applicable */
 };
 
@@ -145,6 +147,8 @@ extern int iax_init(int preferredportno);
 
 /* Get filedescriptor for IAX to use with select or gtk_input_add */
 extern int iax_get_fd(void);
+/* Get every descriptor iax_get_event() reads, returns the count (may exceed max) */
+extern int iax_get_fds(int *fds, int max);
 
 /* Find out how many milliseconds until the next scheduled event */
 extern int iax_time_to_next_event(void);
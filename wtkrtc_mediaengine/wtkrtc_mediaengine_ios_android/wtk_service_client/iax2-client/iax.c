@@ -322,11 +322,38 @@ struct iax_sched {
 	sched_func func;
 	/* and pass it this argument */
 	void *arg;
-	/* Easy linking */
+	/* Position in schedheap, -1 while not scheduled */
+	int index;
+	/* Pool slot and generation, together they make the handle */
+	int slot;
+	int gen;
+	/* Insertion order, keeps entries due at the same time first in first out */
+	unsigned int seq;
+	/* Free list link (and the VNAK retransmit list) */
 	struct iax_sched *next;
 };
 
-static struct iax_sched *schedq = NULL;
+/*
+ * The schedule is a binary min-heap ordered by due time, its entries come
+ * from a pool that grows by IAX_SCHED_CHUNK and never shrinks. Adding and
+ * cancelling are O(log n), the next due entry is always schedheap[0].
+ * iax_sched_add() returns a handle, (generation << 16) | slot, which stays
+ * safe to cancel after the entry has fired or been reused.
+ */
+#define IAX_SCHED_CHUNK		64
+#define IAX_SCHED_MAX_SLOTS	0x10000
+#define IAX_SCHED_MAX_GEN	0x7fff
+
+/* The receive buffer iax_net_process() is looking at, until a media event takes it */
+static wtk_packet_t *net_packet = NULL;
+
+static struct iax_sched **schedheap = NULL;
+static int schedcount = 0;
+static int schedsize = 0;
+static struct iax_sched **schedchunks = NULL;
+static int schedchunkcount = 0;
+static struct iax_sched *schedfree = NULL;
+static unsigned int schedseq = 0;
 static struct iax_session *sessions = NULL;
 static int callnums = 1;
 
@@ -340,27 +367,142 @@ static int inaddrcmp(struct sockaddr_in *sin1, struct sockaddr_in *sin2)
 	return (sin1->sin_addr.s_addr != sin2->sin_addr.s_addr) || (sin1->sin_port != sin2->sin_port);
 }
 
+static struct iax_sched *iax_sched_alloc(void)
+{
+	struct iax_sched *sched, **chunks;
+	int x;
+
+	if (!schedfree) {
+		if ((schedchunkcount + 1) * IAX_SCHED_CHUNK > IAX_SCHED_MAX_SLOTS)
+			return NULL;
+		chunks = (struct iax_sched **)realloc(schedchunks, (schedchunkcount + 1) * sizeof(struct iax_sched *));
+		if (!chunks)
+			return NULL;
+		schedchunks = chunks;
+		sched = (struct iax_sched *)calloc(IAX_SCHED_CHUNK, sizeof(struct iax_sched));
+		if (!sched)
+			return NULL;
+		schedchunks[schedchunkcount] = sched;
+		for (x = IAX_SCHED_CHUNK - 1; x >= 0; x--) {
+			sched[x].index = -1;
+			sched[x].slot = schedchunkcount * IAX_SCHED_CHUNK + x;
+			sched[x].gen = 1;
+			sched[x].next = schedfree;
+			schedfree = &sched[x];
+		}
+		schedchunkcount++;
+	}
+	sched = schedfree;
+	schedfree = sched->next;
+	sched->next = NULL;
+	return sched;
+}
+
+static void iax_sched_free(struct iax_sched *sched)
+{
+	sched->event = NULL;
+	sched->frame = NULL;
+	sched->func = NULL;
+	sched->arg = NULL;
+	sched->index = -1;
+	/* Outstanding handles to this slot are stale from now on */
+	if (++sched->gen > IAX_SCHED_MAX_GEN)
+		sched->gen = 1;
+	sched->next = schedfree;
+	schedfree = sched;
+}
+
+static int iax_sched_before(struct iax_sched *a, struct iax_sched *b)
+{
+	if (a->when.tv_sec != b->when.tv_sec)
+		return a->when.tv_sec < b->when.tv_sec;
+	if (a->when.tv_usec != b->when.tv_usec)
+		return a->when.tv_usec < b->when.tv_usec;
+	return (int)(a->seq - b->seq) < 0;
+}
+
+static void iax_sched_place(struct iax_sched *sched, int index)
+{
+	schedheap[index] = sched;
+	sched->index = index;
+}
+
+static void iax_sched_up(int index)
+{
+	struct iax_sched *sched = schedheap[index];
+	int parent;
+
+	while (index > 0) {
+		parent = (index - 1) / 2;
+		if (!iax_sched_before(sched, schedheap[parent]))
+			break;
+		iax_sched_place(schedheap[parent], index);
+		index = parent;
+	}
+	iax_sched_place(sched, index);
+}
+
+static void iax_sched_down(int index)
+{
+	struct iax_sched *sched = schedheap[index];
+	int child;
+
+	while ((child = 2 * index + 1) < schedcount) {
+		if (child + 1 < schedcount && iax_sched_before(schedheap[child + 1], schedheap[child]))
+			child++;
+		if (!iax_sched_before(schedheap[child], sched))
+			break;
+		iax_sched_place(schedheap[child], index);
+		index = child;
+	}
+	iax_sched_place(sched, index);
+}
+
+/* Take the entry at index out of the heap, the caller owns it afterwards */
+static struct iax_sched *iax_sched_remove(int index)
+{
+	struct iax_sched *sched = schedheap[index];
+
+	schedcount--;
+	if (index < schedcount) {
+		iax_sched_place(schedheap[schedcount], index);
+		iax_sched_up(index);
+		iax_sched_down(index);
+	}
+	sched->index = -1;
+	return sched;
+}
+
 static int iax_sched_add(struct iax_event *event, struct iax_frame *frame, sched_func func, void *arg, int ms)
 {
 
 	/* Schedule event to be delivered to the client
 	   in ms milliseconds from now, or a reliable frame to be retransmitted */
-	struct iax_sched *sched, *cur, *prev = NULL;
+	struct iax_sched *sched, **heap;
 
 	if (!event && !frame && !func) {
 		DEBU(G "No event, no frame, no func?  what are we scheduling?\n");
 		return -1;
 	}
 
+	if (schedcount == schedsize) {
+		heap = (struct iax_sched **)realloc(schedheap, (schedsize ? schedsize * 2 : IAX_SCHED_CHUNK) * sizeof(struct iax_sched *));
+		if (!heap) {
+			DEBU(G "Out of memory!\n");
+			return -1;
+		}
+		schedheap = heap;
+		schedsize = schedsize ? schedsize * 2 : IAX_SCHED_CHUNK;
+	}
+
 	//fprintf(stderr, "scheduling event %d ms from now\n", ms);
-	sched = (struct iax_sched*)malloc(sizeof(struct iax_sched));
+	sched = iax_sched_alloc();
 	if (sched) {
-		memset(sched, 0, sizeof(struct iax_sched));
 		sched->when = iax_tvnow();
 		sched->when.tv_sec += (ms / 1000);
 		ms = ms % 1000;
 		sched->when.tv_usec += (ms * 1000);
-		if (sched->when.tv_usec > 1000000) {
+		if (sched->when.tv_usec >= 1000000) {
 			sched->when.tv_usec -= 1000000;
 			sched->when.tv_sec++;
 		}
@@ -368,48 +510,29 @@ static int iax_sched_add(struct iax_event *event, struct iax_frame *frame, sched
 		sched->frame = frame;
 		sched->func = func;
 		sched->arg = arg;
-		/* Put it in the list, in order */
-		cur = schedq;
-		while(cur && ((cur->when.tv_sec < sched->when.tv_sec) ||
-					 ((cur->when.tv_usec <= sched->when.tv_usec) &&
-					  (cur->when.tv_sec == sched->when.tv_sec)))) {
-				prev = cur;
-				cur = cur->next;
-		}
-		sched->next = cur;
-		if (prev) {
-			prev->next = sched;
-		} else {
-			schedq = sched;
-		}
-		return 0;
+		sched->seq = schedseq++;
+		iax_sched_place(sched, schedcount++);
+		iax_sched_up(sched->index);
+		return (sched->gen << 16) | sched->slot;
 	} else {
 		DEBU(G "Out of memory!\n");
 		return -1;
 	}
 }
 
-static int iax_sched_del(struct iax_event *event, struct iax_frame *frame, sched_func func, void *arg, int all)
+/* Cancel a scheduled entry by the handle iax_sched_add() returned */
+static int iax_sched_del(int id)
 {
-	struct iax_sched *cur, *tmp, *prev = NULL;
+	struct iax_sched *sched;
+	int slot = id & 0xffff;
 
-	cur = schedq;
-	while (cur) {
-		if (cur->event == event && cur->frame == frame && cur->func == func && cur->arg == arg) {
-			if (prev)
-				prev->next = cur->next;
-			else
-				schedq = cur->next;
-			tmp = cur;
-			cur = cur->next;
-			free(tmp);
-			if (!all)
-				return -1;
-		} else {
-			prev = cur;
-			cur = cur->next;
-		}
-	}
+	if (id <= 0 || slot >= schedchunkcount * IAX_SCHED_CHUNK)
+		return -1;
+	sched = &schedchunks[slot / IAX_SCHED_CHUNK][slot % IAX_SCHED_CHUNK];
+	/* Already fired, cancelled or reused */
+	if (sched->gen != (id >> 16) || sched->index < 0)
+		return -1;
+	iax_sched_free(iax_sched_remove(sched->index));
 	return 0;
 }
 
@@ -417,23 +540,21 @@ static int iax_sched_del(struct iax_event *event, struct iax_frame *frame, sched
 int iax_time_to_next_event(void)
 {
 	struct timeval tv;
-	struct iax_sched *cur = schedq;
-	int ms, min = 999999999;
+	struct iax_sched *cur;
+	long long us;
 
 	/* If there are no pending events, we don't need to timeout */
-	if (!cur)
+	if (!schedcount)
 		return -1;
+	cur = schedheap[0];
 	tv = iax_tvnow();
-	while(cur) {
-		ms = (cur->when.tv_sec - tv.tv_sec) * 1000 +
-		     (cur->when.tv_usec - tv.tv_usec) / 1000;
-		if (ms < min)
-			min = ms;
-		cur = cur->next;
-	}
-	if (min < 0)
-		min = 0;
-	return min;
+	us = (cur->when.tv_sec - tv.tv_sec) * 1000000LL +
+	     (cur->when.tv_usec - tv.tv_usec);
+	if (us <= 0)
+		return 0;
+	/* Round up, a poll() that wakes before the event would just spin */
+	us = (us + 999) / 1000;
+	return us > 1000000 ? 1000000 : (int)us;
 }
 
 struct iax_session *iax_session_new(void)
@@ -1277,12 +1398,12 @@ int iax_transfer(struct iax_session *session, const char *number)
 static void stop_transfer(struct iax_session *session)
 {
 	struct iax_sched *sch;
+	int x;
 
-	sch = schedq;
-	while(sch) {
+	for (x = 0; x < schedcount; x++) {
+		sch = schedheap[x];
 		if (sch->frame && (sch->frame->session == session))
 					sch->frame->retries = -1;
-		sch = sch->next;
 	}
 }	/* stop_transfer */
 
@@ -1489,14 +1610,14 @@ static void complete_transfer(struct iax_session *session, int peercallno, int x
 	if (xfr2peer) {
 	    if(session->transfer_heartbeatid >= 0)
 	    {
-		    iax_sched_del(NULL, NULL, send_rs_heartbeat, (void *) session, 1);
+		    iax_sched_del(session->transfer_heartbeatid);
 	        session->transfer_heartbeatid = -1;
 	    }
 		session->transfer_heartbeatid = iax_sched_add(NULL,NULL, send_rs_heartbeat, (void *)session, HEARTBEAT_START_DELAYTIME*1000);
 		
 		if(session->pingid >= 0) 
 		{
-	        iax_sched_del(NULL, NULL, send_ping, (void *) session, 1);
+	        iax_sched_del(session->pingid);
 	        session->pingid = -1;
 	    }
 		session->pingid = iax_sched_add(NULL,NULL, send_ping, (void *)session, HEARTBEAT_START_DELAYTIME * 1000);
@@ -1691,27 +1812,29 @@ static void iax_handle_txreject(struct iax_session *s)
 static void destroy_session(struct iax_session *session)
 {
 	struct iax_session *cur, *prev=NULL;
-	struct iax_sched *curs, *prevs=NULL, *nexts=NULL;
-	int    loop_cnt=0;
-	curs = schedq;
-	while(curs) {
-		nexts = curs->next;
+	struct iax_sched *curs;
+	int x, kept = 0;
+
+	/* Pings and heartbeats would otherwise outlive the session */
+	iax_sched_del(session->pingid);
+	iax_sched_del(session->transfer_heartbeatid);
+	/* Drop the session's events in one pass and heapify what is left */
+	for (x = 0; x < schedcount; x++) {
+		curs = schedheap[x];
 		if (curs->frame && curs->frame->session == session) {
 			/* Just mark these frames as if they've been sent */
 			curs->frame->retries = -1;
 		} else if (curs->event && curs->event->session == session) {
-			if (prevs)
-				prevs->next = nexts;
-			else
-				schedq = nexts;
-			if (curs->event)
-				iax_event_free(curs->event);
-			free(curs);
-		} else {
-			prevs = curs;
+			iax_event_free(curs->event);
+			iax_sched_free(curs);
+			continue;
 		}
-		curs = nexts;
-		loop_cnt++;
+		iax_sched_place(curs, kept++);
+	}
+	if (kept != schedcount) {
+		schedcount = kept;
+		for (x = schedcount / 2 - 1; x >= 0; x--)
+			iax_sched_down(x);
 	}
 
 	cur = sessions;
@@ -1991,8 +2114,10 @@ int iax_reject(struct iax_session *session, char *reason)
 int iax_hangup(struct iax_session *session, char *byemsg)
 {
 	struct iax_ie_data ied;
-	iax_sched_del(NULL, NULL, send_ping, (void *) session, 1);
-	iax_sched_del(NULL, NULL, send_rs_heartbeat, (void *) session, 1);
+	iax_sched_del(session->pingid);
+	session->pingid = -1;
+	iax_sched_del(session->transfer_heartbeatid);
+	session->transfer_heartbeatid = -1;
 	
 	memset(&ied, 0, sizeof(ied));
 	iax_ie_append_str(&ied, IAX_IE_CAUSE, byemsg ? byemsg : "Normal clearing");
@@ -2561,6 +2686,7 @@ static int uncompress_subclass(unsigned char csub)
 static void iax_handle_vnak(struct iax_session *session, struct ast_iax2_full_hdr *fh)
 {
 	struct iax_sched *sch, *list, *l, *tmp;
+	int x;
 
 	/*
 	 * According to the IAX2 02 draft, we MUST immediately retransmit all frames
@@ -2568,10 +2694,10 @@ static void iax_handle_vnak(struct iax_session *session, struct ast_iax2_full_hd
 	 * However, it seems that the right thing to do would be to retransmit
 	 * frames with sequence numbers higher OR EQUAL to VNAK's iseqno.
 	 */
-	sch = schedq;
 	list = NULL;
-	while ( sch != NULL )
+	for ( x = 0; x < schedcount; x++ )
 	{
+		sch = schedheap[x];
 		if ( sch->frame != NULL &&
 		     sch->frame->session == session
 		   )
@@ -2616,7 +2742,6 @@ static void iax_handle_vnak(struct iax_session *session, struct ast_iax2_full_hd
 				}
 			}
 		}
-		sch = sch->next;
 	}
 
 	/* Transmit collected frames and free the space */
@@ -2767,19 +2892,17 @@ static struct iax_event *iax_header_to_event(struct iax_session *session, struct
 		
 		if ((x != session->oseqno) || (session->oseqno == fh->iseqno))
 		{
-			for (x=session->rseqno; x != fh->iseqno; x++)
+			/* One pass over the schedule for the whole acknowledged range */
+			int y, acked = (unsigned char)(fh->iseqno - session->rseqno);
+			for (y = 0; acked && y < schedcount; y++)
 			{
-				sch = schedq;
-				while(sch)
+				sch = schedheap[y];
+				if ( sch->frame &&
+				     sch->frame->session == session &&
+				     (unsigned char)(sch->frame->oseqno - session->rseqno) < acked
+				   )
 				{
-					if ( sch->frame &&
-					     sch->frame->session == session &&
-					     sch->frame->oseqno == x
-					   )
-					{
-						sch->frame->retries = -1;
-					}
-					sch = sch->next;
+					sch->frame->retries = -1;
 				}
 			}
 			/* Note how much we've received acknowledgement for */
@@ -3290,6 +3413,36 @@ static struct iax_event *iax_header_to_event(struct iax_session *session, struct
 	return e;
 }
 
+/* Media events keep the payload where the network read put it when it is
+   in net_packet, anything else is copied behind the event */
+static struct iax_event *iax_media_event_new(unsigned char *payload, int datalen)
+{
+	struct iax_event *e;
+	unsigned char *base;
+
+	if (net_packet) {
+		base = libwtk_packet_data(net_packet);
+		if (payload >= base && payload + datalen <= base + WTK_PACKET_SIZE) {
+			e = (struct iax_event *)malloc(sizeof(struct iax_event));
+			if (e) {
+				e->packet = net_packet;
+				e->offset = payload - base;
+				e->datalen = datalen;
+				net_packet = NULL;
+			}
+			return e;
+		}
+	}
+	e = (struct iax_event *)malloc(sizeof(struct iax_event) + datalen);
+	if (e) {
+		e->packet = NULL;
+		e->offset = 0;
+		e->datalen = datalen;
+		memcpy(e->data, payload, datalen);
+	}
+	return e;
+}
+
 static struct iax_event *iax_videoheader_to_event(struct iax_session *session,
 		struct ast_iax2_video_hdr *vh, int datalen)
 {
@@ -3303,7 +3456,7 @@ static struct iax_event *iax_videoheader_to_event(struct iax_session *session,
 		return 0;
 	}*/
 
-	e = (struct iax_event *)malloc(sizeof(struct iax_event) + datalen);
+	e = iax_media_event_new(vh->data, datalen);
 
 	if ( !e )
 	{
@@ -3314,8 +3467,6 @@ static struct iax_event *iax_videoheader_to_event(struct iax_session *session,
 	e->etype = IAX_EVENT_VIDEO;
 	e->session = session;
 	e->subclass = session->videoformat | (ntohs(vh->ts) & 0x8000 ? 1 : 0);
-	e->datalen = datalen;
-	memcpy(e->data, vh->data, e->datalen);
 	e->ts = (session->last_ts & 0xFFFF8000L) | (ntohs(vh->ts) & 0x7fff);
 
 	return schedule_delivery(e, e->ts, 1);
@@ -3332,7 +3483,7 @@ static struct iax_event *iax_miniheader_to_event(struct iax_session *session,
 		return 0;
 	}
 
-	e = (struct iax_event *)malloc(sizeof(struct iax_event) + datalen);
+	e = iax_media_event_new(mh->data, datalen);
 
 	if ( !e )
 	{
@@ -3343,8 +3494,6 @@ static struct iax_event *iax_miniheader_to_event(struct iax_session *session,
 	e->etype = IAX_EVENT_VOICE;
 	e->session = session;
 	e->subclass = session->voiceformat;
-	e->datalen = datalen;
-	memcpy(e->data, mh->data, datalen);
 	e->ts = (session->last_ts & 0xFFFF0000) | ntohs(mh->ts);
 
 	return schedule_delivery(e, e->ts, 1);
@@ -3357,7 +3506,11 @@ void iax_destroy(struct iax_session *session)
 
 static struct iax_event *iax_net_read(void)
 {
-	unsigned char buf[65536];
+	/* Everything is read straight into a pooled media buffer, media events
+	   take it over and the payload is never copied on the way to the call */
+	wtk_packet_t *packet = libwtk_packet_alloc();
+	unsigned char *base = libwtk_packet_data(packet);
+	unsigned char *buf = base;
 	int res = -1;
 	struct sockaddr_in sin;
 	socklen_t sinlen;
@@ -3369,15 +3522,16 @@ static struct iax_event *iax_net_read(void)
 		if(session->rtpfd>0 && res<0 )
 		{
 			sinlen = sizeof(sin);
-			res = iax_recvfrom(session->rtpfd, (char *)buf, sizeof(buf), 0, (struct sockaddr *) &sin, &sinlen);
+			res = iax_recvfrom(session->rtpfd, (char *)buf, WTK_PACKET_SIZE, 0, (struct sockaddr *) &sin, &sinlen);
 			
 			if(res>0 && inaddrcmp(&sin, (struct sockaddr_in*)(&session->rtp_addr))==0)
             {
             	//iaxci_usermsg(3, "Receive RTP packet from [%s:%d] Length = %d", inet_ntoa(sin.sin_addr), ntohs(session->rtp_addr.sin_port),res);
-            	event = (struct iax_event *)calloc(1, sizeof(struct iax_event) + res);
+            	event = (struct iax_event *)calloc(1, sizeof(struct iax_event));
 				if (!event )
                 {
                     DEBU(G "Out of memory\n");
+                    libwtk_packet_free(packet);
                     return NULL;
                 }
 				event->session = session;
@@ -3402,7 +3556,8 @@ static struct iax_event *iax_net_read(void)
                         break;
                 }
                 event->datalen = res;
-                memcpy(event->data, buf, res);
+                event->packet = packet;
+                event->offset = 0;
                
                 event->ts = session->last_ts + 20;
  
@@ -3416,8 +3571,10 @@ static struct iax_event *iax_net_read(void)
 	//Add rec rtp data event end
 	if(res<0)
 	{
+		/* A voice miniframe's payload lands WTK_PACKET_HEADROOM in, room for its RTP header */
+		buf = base + WTK_PACKET_HEADROOM - sizeof(struct ast_iax2_mini_hdr);
 		sinlen = sizeof(sin);
-		res = iax_recvfrom(netfd, (char *)buf, sizeof(buf), 0, (struct sockaddr *) &sin, &sinlen);
+		res = iax_recvfrom(netfd, (char *)buf, WTK_PACKET_SIZE - (buf - base), 0, (struct sockaddr *) &sin, &sinlen);
 		if (res < 0) {
 #if defined(WIN32)  ||  defined(_WIN32_WCE)
             if (WSAGetLastError() != WSAEWOULDBLOCK) {
@@ -3428,10 +3585,18 @@ static struct iax_event *iax_net_read(void)
                 //DEBU(G "Error on read: %s\n", strerror(errno));
             }
 #endif
+            libwtk_packet_free(packet);
             return NULL;
         }
 	}
+	net_packet = packet;
 	event = iax_net_process(buf, res, (struct SOCKADDR_ST*)&sin);
+	/* Not taken by a media event */
+	if ( net_packet )
+	{
+		libwtk_packet_free(net_packet);
+		net_packet = NULL;
+	}
 	if ( event == NULL )
 	{
 		// We have received a frame. The corresponding event is queued
@@ -3440,7 +3605,7 @@ static struct iax_event *iax_net_read(void)
 		// TODO: this is buttugly from a design point of view. Basically we
 		// change libiax2 behavior to accomodate iaxclient.
 		// There must be a way to do it better.
-		event = (struct iax_event *)malloc(sizeof(struct iax_event));
+		event = (struct iax_event *)calloc(1, sizeof(struct iax_event));
 		if ( event != NULL ) event->etype = IAX_EVENT_NULL;
 	}
 	return event;
@@ -3530,22 +3695,17 @@ struct iax_event *iax_net_process(unsigned char *buf, int len, struct sockaddr_i
 
 static struct iax_sched *iax_get_sched(struct timeval tv)
 {
-	struct iax_sched *cur, *prev=NULL;
-	cur = schedq;
-	/* Check the event schedule first. */
-	while(cur) {
-		if ((tv.tv_sec > cur->when.tv_sec) ||
-		    ((tv.tv_sec == cur->when.tv_sec) &&
-			(tv.tv_usec >= cur->when.tv_usec))) {
-				/* Take it out of the event queue */
-				if (prev) {
-					prev->next = cur->next;
-				} else {
-					schedq = cur->next;
-				}
-				return cur;
-		}
-		cur = cur->next;
+	struct iax_sched *cur;
+
+	/* Only the head of the heap can be due */
+	if (!schedcount)
+		return NULL;
+	cur = schedheap[0];
+	if ((tv.tv_sec > cur->when.tv_sec) ||
+	    ((tv.tv_sec == cur->when.tv_sec) &&
+		(tv.tv_usec >= cur->when.tv_usec))) {
+			/* Take it out of the event queue */
+			return iax_sched_remove(0);
 	}
 	return NULL;
 }
@@ -3570,7 +3730,7 @@ struct iax_event *iax_get_event(int blocking)
 			event = handle_event(event);
 			if (event)
 			{
-				free(cur);
+				iax_sched_free(cur);
 				return event;
 			}
 		} else if(frame)
@@ -3594,7 +3754,7 @@ struct iax_event *iax_get_event(int blocking)
 					if (frame->data)
 						free(frame->data);
 					free(frame);
-					free(cur);
+					iax_sched_free(cur);
 					break;
 				} else
 				{
@@ -3613,10 +3773,11 @@ struct iax_event *iax_get_event(int blocking)
 						{
 							event->etype = IAX_EVENT_TIMEOUT;
 							event->session = frame->session;
+							event->packet = NULL;
 							if (frame->data)
 								free(frame->data);
 							free(frame);
-							free(cur);
+							iax_sched_free(cur);
 							return handle_event(event);
 						}
 					}
@@ -3646,7 +3807,7 @@ struct iax_event *iax_get_event(int blocking)
 		{
 		    cur->func(cur->arg);
 		}
-		free(cur);
+		iax_sched_free(cur);
 	}
 
 	/* Now look for networking events */
@@ -3703,6 +3864,8 @@ void iax_event_free(struct iax_event *event)
 		}
 		break;
 	}
+	if (event->packet)
+		libwtk_packet_free(event->packet);
 	free(event);
 }
 
@@ -3714,6 +3877,32 @@ int iax_get_fd(void)
 	return netfd;
 }
 
+int iax_get_fds(int *fds, int max)
+{
+	/* Every socket iax_get_event() reads: netfd and the sessions' RTP
+	 * sockets, for a client that polls on all of them. Stores the first
+	 * max and returns how many there are, so the caller can grow fds */
+	struct iax_session *session;
+	int n = 0;
+
+	if (netfd > -1)
+	{
+		if (n < max)
+			fds[n] = netfd;
+		n++;
+	}
+	for (session = sessions; session != NULL; session = session->next)
+	{
+		if (session->rtpfd > 0)
+		{
+			if (n < max)
+				fds[n] = session->rtpfd;
+			n++;
+		}
+	}
+	return n;
+}
+
 int iax_quelch_moh(struct iax_session *session, int MOH)
 {
 	struct iax_ie_data ied;			//IE Data Structure (Stuff To Send)
@@ -38,6 +38,12 @@
 #include "iaxclient_lib.h"
 #include "iax-client.h"
 
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #if STDC_HEADERS
 # include <stdarg.h>
 #else
@@ -87,6 +93,12 @@ static THREADID main_proc_thread_id;
 /* 0 running, 1 should quit, -1 not running */
 static int main_proc_thread_flag = -1;
 
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+/* Written to whenever another thread changed what the processing thread
+ * waits for, a new call, registration or scheduled frame */
+static int main_proc_wake[2] = { -1, -1 };
+#endif
+
 static iaxc_event_callback_t iaxc_event_callback = NULL;
 
 // Internal queue of events, waiting to be posted once the library
@@ -178,17 +190,37 @@ int try_iaxc_lock()
 	return MUTEXTRYLOCK(&iaxc_lock);
 }
 
+static void wake_main_proc_thread(void)
+{
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+	char c = 0;
+
+	if ( main_proc_wake[1] >= 0 && write(main_proc_wake[1], &c, 1) < 0 )
+	{
+		/* pipe full, the thread is woken already */
+	}
+#endif
+}
+
 // Unlock the library and post any events that were queued in the meantime
 EXPORT void put_iaxc_lock(void)
 {
 	iaxc_event *prev, *event;
+	int wake = 0;
 
 	MUTEXLOCK(&event_queue_lock);
 	event = event_queue;
 	event_queue = NULL;
 	MUTEXUNLOCK(&event_queue_lock);
 
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+	// Anyone but the processing thread may have scheduled something it
+	// has to wait for now
+	wake = main_proc_thread_flag == 0 && !pthread_equal(pthread_self(), main_proc_thread);
+#endif
 	MUTEXUNLOCK(&iaxc_lock);
+	if ( wake )
+		wake_main_proc_thread();
 
 	while (event)
 	{
@@ -664,10 +696,41 @@ static void iaxc_refresh_registrations()
 	}
 }
 
+// Milliseconds until the next registration is due for a refresh, -1 if none
+static int iaxc_registration_timeout()
+{
+	struct iaxc_registration *cur;
+	struct timeval now;
+	long long ms, min = -1;
+
+	now = iax_tvnow();
+
+	for ( cur = registrations; cur != NULL; cur = cur->next )
+	{
+		ms = (cur->refresh - 3) * 1000LL - iaxci_usecdiff(&now, &cur->last) / 1000 + 1;
+		if ( ms < 0 )
+			ms = 0;
+		if ( min < 0 || ms < min )
+			min = ms;
+	}
+	return min > 1000000 ? 1000000 : (int)min;
+}
+
+#if defined(WIN32) || defined(_WIN32_WCE)
 #define LOOP_SLEEP 5 // In ms
+#else
+#define POLL_FDS_MIN 16 // netfd and the sessions' RTP sockets, grown on demand
+#endif
 static THREADFUNCDECL(main_proc_thread_func)
 {
+#if defined(WIN32) || defined(_WIN32_WCE)
 	static int refresh_registration_count = 0;
+#else
+	struct pollfd wake_pfd, *pfds = &wake_pfd, *new_pfds;
+	int *fds = NULL, *new_fds;
+	int fds_size = 0, nfds, i, timeout, refresh;
+	char drain[64];
+#endif
 
 	THREADFUNCRET(ret);
 
@@ -681,6 +744,7 @@ static THREADFUNCDECL(main_proc_thread_func)
 		service_network();
 		//service_audio();
 
+#if defined(WIN32) || defined(_WIN32_WCE)
 		// Check registration refresh once a second
 		if ( refresh_registration_count++ > 1000/LOOP_SLEEP )
 		{
@@ -691,11 +755,63 @@ static THREADFUNCDECL(main_proc_thread_func)
 		put_iaxc_lock();
 
 		iaxc_millisleep(LOOP_SLEEP);
+#else
+		iaxc_refresh_registrations();
+
+		// Sleep until a packet arrives or the next retransmission, ping or
+		// registration refresh is due; an idle client does not wake at all
+		timeout = iax_time_to_next_event();
+		refresh = iaxc_registration_timeout();
+		if ( refresh >= 0 && (timeout < 0 || refresh < timeout) )
+			timeout = refresh;
+		nfds = iax_get_fds(fds, fds_size);
+		if ( nfds > fds_size )
+		{
+			i = fds_size ? fds_size : POLL_FDS_MIN;
+			while ( i < nfds )
+				i *= 2;
+			new_fds = realloc(fds, i * sizeof(*fds));
+			if ( new_fds )
+				fds = new_fds;
+			new_pfds = realloc(pfds != &wake_pfd ? pfds : NULL, (1 + i) * sizeof(*pfds));
+			if ( new_pfds )
+				pfds = new_pfds;
+			if ( new_fds && new_pfds )
+				fds_size = i;
+			nfds = iax_get_fds(fds, fds_size);
+			if ( nfds > fds_size )
+			{
+				iaxci_usermsg(IAXC_ERROR, "Polling only %d of %d sockets, out of memory", fds_size, nfds);
+				nfds = fds_size;
+			}
+		}
+
+		put_iaxc_lock();
+
+		pfds[0].fd = main_proc_wake[0];
+		pfds[0].events = POLLIN;
+		for ( i = 0; i < nfds; i++ )
+		{
+			pfds[1 + i].fd = fds[i];
+			pfds[1 + i].events = POLLIN;
+		}
+		if ( poll(pfds, 1 + nfds, timeout) > 0 && (pfds[0].revents & POLLIN) )
+		{
+			while ( read(main_proc_wake[0], drain, sizeof(drain)) > 0 )
+				;
+		}
+#endif
 	}
 
 	/* Decrease priority */
 	iaxci_prioboostend();
 
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+	if ( pfds != &wake_pfd )
+		free(pfds);
+	free(fds);
+#endif
+
 	main_proc_thread_flag = -1;
 
 	return ret;
@@ -703,6 +819,20 @@ static THREADFUNCDECL(main_proc_thread_func)
 
 EXPORT int iaxc_start_processing_thread()
 {
+#if !defined(WIN32) && !defined(_WIN32_WCE)
+	int i;
+
+	if ( main_proc_wake[0] < 0 )
+	{
+		if ( pipe(main_proc_wake) < 0 )
+			return -1;
+		for ( i = 0; i < 2; i++ )
+		{
+			fcntl(main_proc_wake[i], F_SETFL, fcntl(main_proc_wake[i], F_GETFL) | O_NONBLOCK);
+			fcntl(main_proc_wake[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+#endif
 	main_proc_thread_flag = 0;
 
 	if ( THREADCREATE(main_proc_thread_func, NULL, main_proc_thread,
@@ -717,6 +847,7 @@ EXPORT int iaxc_stop_processing_thread()
 	if ( main_proc_thread_flag >= 0 )
 	{
 		main_proc_thread_flag = 1;
+		wake_main_proc_thread();
 		THREADJOIN(main_proc_thread);
 	}
 
@@ -851,8 +982,8 @@ static __inline void generate_rtp_header( struct iaxc_call *call, struct iax_eve
 		call->vrtp_ts = ts + rtp_sample;
 		buf[1] = kWtkPayloadTypeVP8;
 		*(unsigned short *)&buf[2] = htons( call->vrtp_seqno );
-		*(unsigned long *)&buf[4] = htonl( ts * 48 );
-		*((unsigned long *)&buf[8]) = htonl(wtk_video_ssrc);
+		*(uint32_t *)&buf[4] = htonl( ts * 48 );
+		*((uint32_t *)&buf[8]) = htonl(wtk_video_ssrc);
 
 		/*iaxci_usermsg(IAXC_STATUS, "WatterTek Lib -> IAX-TS=%d; ts = %u, RTP-SeqNo=%d; RTP-TS=%u;  RTP->SSRC=%u",
 				  e->ts,  // millisecond
@@ -874,9 +1005,32 @@ static __inline void generate_rtp_header( struct iaxc_call *call, struct iax_eve
 		call->rtp_ts = ts + rtp_sample;
 		buf[1] = kWtkPayloadTypeOpus;
 		*(unsigned short *)&buf[2] = htons( call->rtp_seqno );
-		*(unsigned long *)&buf[4] = htonl( ts * 48 );
-		*((unsigned long *)&buf[8]) = htonl(wtk_audio_ssrc);
+		*(uint32_t *)&buf[4] = htonl( ts * 48 );
+		*((uint32_t *)&buf[8]) = htonl(wtk_audio_ssrc);
+	}
+}
+
+/* Media still in the pooled receive buffer goes to the call from there, the
+   RTP header, if needed, is written into the headroom in front of it */
+static int wtkcall_deliver_packet(struct iaxc_call *call, struct iax_event *e, int offset, int is_video)
+{
+	unsigned char *base = libwtk_packet_data(e->packet);
+	int start = e->offset + offset;
+	int len = e->datalen - offset;
+
+	if(call->mstate & IAXC_MEDIA_STATE_NORTP)
+	{
+		generate_rtp_header( call, e, base + start - RTP_HEADER_LEN, is_video );
+		start -= RTP_HEADER_LEN;
+		len += RTP_HEADER_LEN;
 	}
+
+	if(is_video)
+		libwtk_deliver_video(e->packet, start, len);
+	else
+		libwtk_deliver_audio(e->packet, start, len);
+
+	return e->datalen - offset;
 }
 
 static int wtkcall_recv_audio_event(struct iaxc_call *call, struct iax_event *e, int offset)
@@ -893,7 +1047,10 @@ static int wtkcall_recv_audio_event(struct iaxc_call *call, struct iax_event *e,
 	if(rawlen <= 0) 
 		return -1;
 
-	raw = e->data + offset;
+	if(e->packet && (!(call->mstate & IAXC_MEDIA_STATE_NORTP) || e->offset + offset >= RTP_HEADER_LEN))
+		return wtkcall_deliver_packet( call, e, offset, 0 );
+
+	raw = (e->packet ? libwtk_packet_data(e->packet) + e->offset : e->data) + offset;
     retlen = rawlen;
 	
 	if(call->mstate & IAXC_MEDIA_STATE_NORTP)
@@ -932,7 +1089,10 @@ static int wtkcall_recv_video_event(struct iaxc_call *call, struct iax_event *e,
 	if(rawlen <= 0) 
 		return -1;
 
-	raw = e->data + offset;
+	if(e->packet && (!(call->mstate & IAXC_MEDIA_STATE_NORTP) || e->offset + offset >= RTP_HEADER_LEN))
+		return wtkcall_deliver_packet( call, e, offset, 1 );
+
+	raw = (e->packet ? libwtk_packet_data(e->packet) + e->offset : e->data) + offset;
     retlen = rawlen;
 
 	if(call->mstate & IAXC_MEDIA_STATE_NORTP)
@@ -0,0 +1,667 @@
+/*
+ * wtk-relay-bench: load generator for wtk-relay.
+ *
+ * Sets up synthetic routes with the TXCNT exchange of two IAX2 legs, keeps
+ * them alive with HEARTBEAT and streams mini (or video) frames both ways
+ * over loopback.  Every frame carries its route, sequence number and send
+ * time, the receiving side accounts drops and forwarding latency.  Routes
+ * are torn down with HANGUP at the end.
+ *
+ * TXREADY is never sent: it moves a route to NATTED/P2PED, after which the
+ * relay stops forwarding media.
+ *
+ * With -R every route is called again under a new token on the same
+ * sockets and callnos before streaming, and one HANGUP per route releases
+ * whichever of the two holds the legs: the frames must keep flowing through
+ * the other one.
+ */
+#include "../misc_lib.h"
+#include <inttypes.h>
+
+#define BENCH_SOCKETS_DEFAULT		16		/* sockets per leg side, routes are spread over them by callno */
+#define BENCH_ROUTES_PER_SOCKET		16383	/* left callnos 1..16383, right ones 16384 up */
+#define BENCH_RIGHT_CALLNO			0x4000
+#define BENCH_SETUP_CHUNK			256
+#define BENCH_TEARDOWN_CHUNK		64		/* HANGUPs per millisecond, the relay's socket buffer is not ours */
+#define BENCH_SETUP_TRIES			5
+#define BENCH_HEARTBEAT_INTERVAL	10		/* seconds, the client's slow heartbeat */
+#define BENCH_DRAIN_TIME			1		/* seconds to wait for in flight frames */
+#define BENCH_LATENCY_BUCKETS		100000	/* 1us buckets, anything slower lands in the last one */
+#define BENCH_SOCKBUF_SIZE			(4 << 20)
+
+static const struct option long_options[] = {
+	{ "relay-ip",        required_argument, NULL, 'a' },
+	{ "relay-port",      required_argument, NULL, 'l' },
+	{ "manager-port",    required_argument, NULL, 'p' },
+	{ "routes",          required_argument, NULL, 'n' },
+	{ "rate",            required_argument, NULL, 'r' },
+	{ "duration",        required_argument, NULL, 'd' },
+	{ "size",            required_argument, NULL, 's' },
+	{ "video",           required_argument, NULL, 'V' },
+	{ "sockets",         required_argument, NULL, 'S' },
+	{ "max-drop",        required_argument, NULL, 'x' },
+	{ "recall",          no_argument,       NULL, 'R' },
+	{ "help",            no_argument,       NULL, 'h' },
+	{ NULL,              0,                 NULL,  0  }
+};
+
+/* Carried by every media frame right after the mini/video header */
+struct bench_stamp {
+	uint32_t route;
+	uint32_t seq;
+	uint64_t sent_ns;
+	uint8_t side;
+} __attribute__ ((__packed__));
+
+/* Sender side state, the receiver thread only touches bench_info.received */
+struct bench_route {
+	unsigned char setup;			/* LEFT_SIDE_FRAME/RIGHT_SIDE_FRAME replies seen */
+	uint32_t seq[2];
+	uint64_t sent[2];
+};
+
+struct bench_info {
+	char relay_ip[32];
+	int relay_port;
+	int mgmt_port;
+	int routes;
+	int rate;						/* frames per second per leg, 0 floods */
+	int duration;
+	int size;
+	int video;						/* percent of frames sent as video */
+	int sockets;
+	double max_drop;
+	int recall;
+	unsigned int generation;		/* bumped by every re-call, part of the relay token */
+
+	struct sockaddr_in relay;
+	int *l_fds;
+	int *r_fds;
+	int epoll_fd;
+	struct bench_route *rt;
+
+	volatile int running;
+	uint64_t *received;				/* per route and sending leg, receiver thread only */
+	uint64_t *latency;				/* histogram, receiver thread only */
+	uint64_t late;
+	uint64_t latency_max;
+	uint64_t foreign;				/* datagrams that were not ours */
+};
+typedef struct bench_info bench_info_t;
+
+static void exit_help(int argc, char * const argv[])
+{
+	fprintf( stderr, "%s usage\n", argv[0] );
+	fprintf( stderr, "-a <ip>   \tRelay ip (default 127.0.0.1)\n" );
+	fprintf( stderr, "-l <port> \tRelay port (default %d)\n", RELAY_PORT_DEFAULT );
+	fprintf( stderr, "-p <port> \tRelay manager port, print the relay's global stats at the end\n" );
+	fprintf( stderr, "-n <num>  \tRoutes to set up (default 100)\n" );
+	fprintf( stderr, "-r <pps>  \tFrames per second per leg, 0 floods (default 50)\n" );
+	fprintf( stderr, "-d <secs> \tDuration (default 10)\n" );
+	fprintf( stderr, "-s <bytes>\tFrame size incl. IAX2 header (default 172)\n" );
+	fprintf( stderr, "-V <pct>  \tPercent of frames sent as video (default 0)\n" );
+	fprintf( stderr, "-S <num>  \tSockets per side (default %d)\n", BENCH_SOCKETS_DEFAULT );
+	fprintf( stderr, "-x <pct>  \tExit with 2 if more than <pct> percent of frames were dropped\n" );
+	fprintf( stderr, "-R        \tCall every route again under a new token, then hang up one of the two\n" );
+	fprintf( stderr, "-h        \tThis help message.\n" );
+	fprintf( stderr, "\n" );
+	exit(1);
+}
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+static inline int route_socket(bench_info_t *bi, int route)
+{
+	return route % bi->sockets;
+}
+static inline unsigned short route_callno(bench_info_t *bi, int route, int side)
+{
+	unsigned short callno = 1 + route / bi->sockets;
+
+	return (side == LEFT_SIDE_FRAME) ? callno : (callno | BENCH_RIGHT_CALLNO);
+}
+static inline int leg_fd(bench_info_t *bi, int route, int side)
+{
+	return (side == LEFT_SIDE_FRAME) ? bi->l_fds[route_socket(bi, route)] : bi->r_fds[route_socket(bi, route)];
+}
+static int open_socket(void)
+{
+	struct sockaddr_in addr;
+	int fd, size = BENCH_SOCKBUF_SIZE;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0)
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	memset(&addr, 0x00, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+//IAX2 frames
+static int build_full_frame(uint8_t *buf, unsigned short scallno, unsigned short dcallno, unsigned char csub)
+{
+	struct ast_iax2_full_hdr *fh = (struct ast_iax2_full_hdr *)buf;
+
+	memset(fh, 0x00, sizeof(*fh));
+	fh->scallno = htons(scallno | IAX_FLAG_FULL);
+	fh->dcallno = htons(dcallno);
+	fh->type = AST_FRAME_IAX;
+	fh->csub = csub;
+	return sizeof(*fh);
+}
+static int append_ie(uint8_t *buf, int len, unsigned char ie, const void *data, int datalen)
+{
+	buf[len] = ie;
+	buf[len+1] = datalen;
+	memcpy(buf + len + 2, data, datalen);
+	return len + 2 + datalen;
+}
+static void route_token(bench_info_t *bi, int route, char *token, int size)
+{
+	snprintf(token, size, "%08x%08x%016x", (unsigned int)getpid(), (unsigned int)route, bi->generation);
+}
+static void send_signalling(bench_info_t *bi, int route, int side, unsigned char csub)
+{
+	uint8_t buf[RELAY_PKTBUF_SIZE];
+	char token[RELAY_TOKEN_SIZE];
+	int len;
+
+	len = build_full_frame(buf, route_callno(bi, route, side),
+		(csub == IAX_COMMAND_HANGUP) ? route_callno(bi, route, side ^ (LEFT_SIDE_FRAME | RIGHT_SIDE_FRAME)) : 0, csub);
+	if (csub != IAX_COMMAND_HANGUP)
+	{
+		route_token(bi, route, token, sizeof(token));
+		len = append_ie(buf, len, IAX_IE_RELAY_TOKEN, token, strlen(token));
+		len = append_ie(buf, len, IAX_IE_USERNAME, (side == LEFT_SIDE_FRAME) ? "bench-l" : "bench-r", 7);
+	}
+	sendto(leg_fd(bi, route, side), buf, len, 0, (struct sockaddr *)&bi->relay, sizeof(bi->relay));
+}
+/* Replies to TXCNT are the peer leg's TXCNT, mapped back to the route by its source callno */
+static void handle_setup_reply(bench_info_t *bi, int fd_index, int side, uint8_t *buf, ssize_t len)
+{
+	struct ast_iax2_full_hdr *fh = (struct ast_iax2_full_hdr *)buf;
+	unsigned short callno;
+	int route;
+
+	if (len < (ssize_t)sizeof(*fh) || !(ntohs(fh->scallno) & IAX_FLAG_FULL) || fh->csub != IAX_COMMAND_TXCNT)
+		return;
+	callno = ntohs(fh->scallno) & ~(IAX_FLAG_FULL | BENCH_RIGHT_CALLNO);
+	route = (callno - 1) * bi->sockets + fd_index;
+	if (callno > 0 && route < bi->routes)
+		bi->rt[route].setup |= side;
+}
+static void drain_setup_replies(bench_info_t *bi, int timeout_ms)
+{
+	struct epoll_event events[MAXEPOLLSIZE];
+	uint8_t buf[RELAY_PKTBUF_SIZE];
+	int n, i;
+	ssize_t len;
+
+	while((n = epoll_wait(bi->epoll_fd, events, MAXEPOLLSIZE, timeout_ms)) > 0)
+	{
+		for(i = 0; i < n; i++)
+		{
+			int index = events[i].data.u32 >> 1;
+			int side = (events[i].data.u32 & 1) ? RIGHT_SIDE_FRAME : LEFT_SIDE_FRAME;
+			int fd = (side == LEFT_SIDE_FRAME) ? bi->l_fds[index] : bi->r_fds[index];
+
+			while((len = recv(fd, buf, sizeof(buf), 0)) > 0)
+				handle_setup_reply(bi, index, side, buf, len);
+		}
+	}
+}
+static int setup_routes(bench_info_t *bi)
+{
+	int first, route, tries, done = 0;
+
+	for(first = 0; first < bi->routes; first += BENCH_SETUP_CHUNK)
+	{
+		int last = MIN(first + BENCH_SETUP_CHUNK, bi->routes);
+
+		for(tries = 0; tries < BENCH_SETUP_TRIES; tries++)
+		{
+			int pending = 0;
+
+			for(route = first; route < last; route++)
+			{
+				if (bi->rt[route].setup == (LEFT_SIDE_FRAME | RIGHT_SIDE_FRAME))
+					continue;
+				send_signalling(bi, route, LEFT_SIDE_FRAME, IAX_COMMAND_TXCNT);
+				pending++;
+			}
+			if (pending == 0)
+				break;
+			drain_setup_replies(bi, 5);
+			for(route = first; route < last; route++)
+			{
+				if (bi->rt[route].setup != (LEFT_SIDE_FRAME | RIGHT_SIDE_FRAME))
+					send_signalling(bi, route, RIGHT_SIDE_FRAME, IAX_COMMAND_TXCNT);
+			}
+			drain_setup_replies(bi, 50);
+		}
+	}
+	for(route = 0; route < bi->routes; route++)
+	{
+		if (bi->rt[route].setup == (LEFT_SIDE_FRAME | RIGHT_SIDE_FRAME))
+			done++;
+	}
+	return done;
+}
+static void teardown_routes(bench_info_t *bi)
+{
+	int route;
+
+	for(route = 0; route < bi->routes; route++)
+	{
+		send_signalling(bi, route, LEFT_SIDE_FRAME, IAX_COMMAND_HANGUP);
+		if (route % BENCH_TEARDOWN_CHUNK == BENCH_TEARDOWN_CHUNK - 1)
+			usleep(1000);
+	}
+}
+
+/* Second call on every leg while the first is up, then release one of the two */
+static int recall_routes(bench_info_t *bi)
+{
+	int route, established;
+
+	bi->generation++;
+	for(route = 0; route < bi->routes; route++)
+		bi->rt[route].setup = 0;
+	established = setup_routes(bi);
+	teardown_routes(bi);
+	drain_setup_replies(bi, 100);
+	return established;
+}
+
+//Media
+static int build_media_frame(bench_info_t *bi, uint8_t *buf, int route, int side, uint64_t ns)
+{
+	struct bench_route *rt = &bi->rt[route];
+	unsigned short callno = route_callno(bi, route, side);
+	uint32_t seq = rt->seq[side - 1]++;
+	struct bench_stamp *stamp;
+	int hdr;
+
+	if ((int)(seq % 100) < bi->video)
+	{
+		struct ast_iax2_video_hdr *vh = (struct ast_iax2_video_hdr *)buf;
+		vh->zeros = 0;
+		vh->callno = htons(callno | 0x8000);
+		vh->ts = htons((ns / 1000000) & 0x7fff);
+		hdr = sizeof(*vh);
+	}
+	else
+	{
+		struct ast_iax2_mini_hdr *mh = (struct ast_iax2_mini_hdr *)buf;
+		mh->callno = htons(callno);
+		mh->ts = htons((ns / 1000000) & 0xffff);
+		hdr = sizeof(*mh);
+	}
+	stamp = (struct bench_stamp *)(buf + hdr);
+	stamp->route = route;
+	stamp->seq = seq;
+	stamp->sent_ns = ns;
+	stamp->side = side;
+	rt->sent[side - 1]++;
+	return MAX(bi->size, hdr + (int)sizeof(*stamp));
+}
+/* One frame per route and leg, batched per socket with sendmmsg */
+static void send_round(bench_info_t *bi, uint8_t *bufs, struct mmsghdr *msgs, struct iovec *iovs)
+{
+	int index, side, route, count, sent;
+	uint64_t ns;
+
+	for(side = LEFT_SIDE_FRAME; side <= RIGHT_SIDE_FRAME; side++)
+	{
+		for(index = 0; index < bi->sockets; index++)
+		{
+			int fd = (side == LEFT_SIDE_FRAME) ? bi->l_fds[index] : bi->r_fds[index];
+
+			route = index;
+			while(route < bi->routes)
+			{
+				ns = now_ns();
+				for(count = 0; count < RELAY_BATCH_SIZE && route < bi->routes; count++, route += bi->sockets)
+				{
+					iovs[count].iov_base = bufs + count * RELAY_PKTBUF_SIZE;
+					iovs[count].iov_len = build_media_frame(bi, iovs[count].iov_base, route, side, ns);
+					memset(&msgs[count].msg_hdr, 0x00, sizeof(struct msghdr));
+					msgs[count].msg_hdr.msg_name = &bi->relay;
+					msgs[count].msg_hdr.msg_namelen = sizeof(bi->relay);
+					msgs[count].msg_hdr.msg_iov = &iovs[count];
+					msgs[count].msg_hdr.msg_iovlen = 1;
+				}
+				for(sent = 0; sent < count; )
+				{
+					int n = sendmmsg(fd, msgs + sent, count - sent, 0);
+					if (n < 0)
+					{
+						if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+							continue;
+						fprintf(stderr, "sendmmsg() failed errno %d (%s)\n", errno, strerror(errno));
+						break;
+					}
+					sent += n;
+				}
+			}
+		}
+	}
+}
+static void account_frame(bench_info_t *bi, int side, uint8_t *buf, ssize_t len, uint64_t ns)
+{
+	struct ast_iax2_video_hdr *vh = (struct ast_iax2_video_hdr *)buf;
+	struct bench_stamp *stamp;
+	uint64_t latency;
+	int hdr;
+
+	if (len < (ssize_t)sizeof(struct ast_iax2_mini_hdr))
+		return;
+	if (vh->zeros == 0 && (ntohs(vh->callno) & 0x8000))
+		hdr = sizeof(struct ast_iax2_video_hdr);
+	else if (ntohs(vh->zeros) & IAX_FLAG_FULL)
+		return;		/* forwarded HEARTBEAT/HANGUP */
+	else
+		hdr = sizeof(struct ast_iax2_mini_hdr);
+	if (len < hdr + (ssize_t)sizeof(*stamp))
+	{
+		bi->foreign++;
+		return;
+	}
+	stamp = (struct bench_stamp *)(buf + hdr);
+	/* a frame sent by one leg arrives on the other */
+	if (stamp->route >= (uint32_t)bi->routes || stamp->side != (side ^ (LEFT_SIDE_FRAME | RIGHT_SIDE_FRAME)))
+	{
+		bi->foreign++;
+		return;
+	}
+	bi->received[stamp->route * 2 + stamp->side - 1]++;
+	latency = (ns - stamp->sent_ns) / 1000;
+	if (latency > bi->latency_max)
+		bi->latency_max = latency;
+	if (latency >= BENCH_LATENCY_BUCKETS)
+		bi->late++;
+	else
+		bi->latency[latency]++;
+}
+static void* receive_loop(void *arg)
+{
+	bench_info_t *bi = (bench_info_t *)arg;
+	struct epoll_event events[MAXEPOLLSIZE];
+	struct mmsghdr msgs[RELAY_BATCH_SIZE];
+	struct iovec iovs[RELAY_BATCH_SIZE];
+	uint8_t *bufs;
+	int n, i, k;
+
+	bufs = (uint8_t *)malloc(RELAY_BATCH_SIZE * RELAY_PKTBUF_SIZE);
+	if (bufs == NULL)
+		return NULL;
+	memset(msgs, 0x00, sizeof(msgs));
+	for(k = 0; k < RELAY_BATCH_SIZE; k++)
+	{
+		iovs[k].iov_base = bufs + k * RELAY_PKTBUF_SIZE;
+		iovs[k].iov_len = RELAY_PKTBUF_SIZE;
+		msgs[k].msg_hdr.msg_iov = &iovs[k];
+		msgs[k].msg_hdr.msg_iovlen = 1;
+	}
+	while(bi->running)
+	{
+		n = epoll_wait(bi->epoll_fd, events, MAXEPOLLSIZE, 100);
+		for(i = 0; i < n; i++)
+		{
+			int index = events[i].data.u32 >> 1;
+			int side = (events[i].data.u32 & 1) ? RIGHT_SIDE_FRAME : LEFT_SIDE_FRAME;
+			int fd = (side == LEFT_SIDE_FRAME) ? bi->l_fds[index] : bi->r_fds[index];
+			int got;
+
+			while((got = recvmmsg(fd, msgs, RELAY_BATCH_SIZE, MSG_DONTWAIT, NULL)) > 0)
+			{
+				uint64_t ns = now_ns();
+
+				for(k = 0; k < got; k++)
+					account_frame(bi, side, iovs[k].iov_base, msgs[k].msg_len, ns);
+				if (got < RELAY_BATCH_SIZE)
+					break;
+			}
+		}
+	}
+	free(bufs);
+	return NULL;
+}
+
+//Report
+static uint64_t latency_percentile(bench_info_t *bi, uint64_t total, double pct)
+{
+	uint64_t want = (uint64_t)(total * pct / 100.0), seen = 0;
+	int us;
+
+	for(us = 0; us < BENCH_LATENCY_BUCKETS; us++)
+	{
+		seen += bi->latency[us];
+		if (seen > want)
+			return us;
+	}
+	return bi->latency_max;
+}
+static void totals(bench_info_t *bi, uint64_t *sent, uint64_t *received)
+{
+	int route;
+
+	*sent = *received = 0;
+	for(route = 0; route < bi->routes; route++)
+	{
+		*sent += bi->rt[route].sent[0] + bi->rt[route].sent[1];
+		*received += bi->received[route * 2] + bi->received[route * 2 + 1];
+	}
+}
+static void print_relay_stats(bench_info_t *bi)
+{
+	struct sockaddr_in mgmt;
+	struct timeval tv = { 1, 0 };
+	char resbuf[MGMT_RESBUF_SIZE];
+	unsigned char req[2 + 64];
+	ssize_t len;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	memset(&mgmt, 0x00, sizeof(mgmt));
+	mgmt.sin_family = AF_INET;
+	mgmt.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	mgmt.sin_port = htons(bi->mgmt_port);
+	memset(req, 0x00, sizeof(req));
+	req[0] = MGMT_STATS;
+	req[1] = MGMT_STATS_GLOBAL;
+	sendto(fd, req, sizeof(req), 0, (struct sockaddr *)&mgmt, sizeof(mgmt));
+	len = recv(fd, resbuf, sizeof(resbuf) - 1, 0);
+	if (len > 0)
+	{
+		resbuf[len] = '\0';
+		printf("relay       %s", resbuf);
+	}
+	close(fd);
+}
+
+int main(int argc, char* const argv[])
+{
+	bench_info_t bi;
+	struct epoll_event ev;
+	pthread_t receiver;
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	uint8_t *bufs;
+	uint64_t start, next, end, heartbeat, last_report, sent, received, last_received = 0;
+	int opt, index, route, established;
+
+	memset(&bi, 0x00, sizeof(bi));
+	strcpy(bi.relay_ip, "127.0.0.1");
+	bi.relay_port = RELAY_PORT_DEFAULT;
+	bi.routes = 100;
+	bi.rate = 50;
+	bi.duration = 10;
+	bi.size = 172;		/* 160 bytes of G.711 plus the mini header and some */
+	bi.sockets = BENCH_SOCKETS_DEFAULT;
+	bi.max_drop = -1;
+	while((opt = getopt_long(argc, argv, "a:l:p:n:r:d:s:V:S:x:Rh", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'a': snprintf(bi.relay_ip, sizeof(bi.relay_ip), "%s", optarg); break;
+			case 'l': bi.relay_port = atoi(optarg); break;
+			case 'p': bi.mgmt_port = atoi(optarg); break;
+			case 'n': bi.routes = atoi(optarg); break;
+			case 'r': bi.rate = atoi(optarg); break;
+			case 'd': bi.duration = atoi(optarg); break;
+			case 's': bi.size = atoi(optarg); break;
+			case 'V': bi.video = atoi(optarg); break;
+			case 'S': bi.sockets = atoi(optarg); break;
+			case 'x': bi.max_drop = atof(optarg); break;
+			case 'R': bi.recall = 1; break;
+			default: exit_help(argc, argv);
+		}
+	}
+	if (bi.routes < 1 || bi.sockets < 1 || bi.rate < 0 || bi.duration < 1
+		|| bi.size > RELAY_PKTBUF_SIZE - RELAY_PKT_TAILROOM || bi.video < 0 || bi.video > 100
+		|| (bi.routes + bi.sockets - 1) / bi.sockets > BENCH_ROUTES_PER_SOCKET)
+		exit_help(argc, argv);
+
+	memset(&bi.relay, 0x00, sizeof(bi.relay));
+	bi.relay.sin_family = AF_INET;
+	bi.relay.sin_port = htons(bi.relay_port);
+	if (inet_pton(AF_INET, bi.relay_ip, &bi.relay.sin_addr) != 1)
+		exit_help(argc, argv);
+
+	bi.rt = (struct bench_route *)calloc(bi.routes, sizeof(struct bench_route));
+	bi.received = (uint64_t *)calloc(bi.routes * 2, sizeof(uint64_t));
+	bi.latency = (uint64_t *)calloc(BENCH_LATENCY_BUCKETS, sizeof(uint64_t));
+	bi.l_fds = (int *)calloc(bi.sockets, sizeof(int));
+	bi.r_fds = (int *)calloc(bi.sockets, sizeof(int));
+	bufs = (uint8_t *)malloc(RELAY_BATCH_SIZE * RELAY_PKTBUF_SIZE);
+	msgs = (struct mmsghdr *)calloc(RELAY_BATCH_SIZE, sizeof(struct mmsghdr));
+	iovs = (struct iovec *)calloc(RELAY_BATCH_SIZE, sizeof(struct iovec));
+	bi.epoll_fd = epoll_create(MAXEPOLLSIZE);
+	if (!bi.rt || !bi.received || !bi.latency || !bi.l_fds || !bi.r_fds || !bufs || !msgs || !iovs || bi.epoll_fd < 0)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	/* epoll data: socket index << 1 | right side */
+	for(index = 0; index < bi.sockets; index++)
+	{
+		bi.l_fds[index] = open_socket();
+		bi.r_fds[index] = open_socket();
+		if (bi.l_fds[index] < 0 || bi.r_fds[index] < 0)
+		{
+			fprintf(stderr, "Failed to open bench socket. %s\n", strerror(errno));
+			exit(-2);
+		}
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		ev.data.u32 = index << 1;
+		epoll_ctl(bi.epoll_fd, EPOLL_CTL_ADD, bi.l_fds[index], &ev);
+		ev.data.u32 = (index << 1) | 1;
+		epoll_ctl(bi.epoll_fd, EPOLL_CTL_ADD, bi.r_fds[index], &ev);
+	}
+
+	start = now_ns();
+	established = setup_routes(&bi);
+	printf("routes      %d/%d set up in %.2fs over %d socket pair(s)\n", established, bi.routes, (now_ns() - start) / 1e9, bi.sockets);
+	if (established == 0)
+	{
+		fprintf(stderr, "No route could be set up, is wtk-relay listening on %s:%d?\n", bi.relay_ip, bi.relay_port);
+		exit(-3);
+	}
+	if (bi.recall)
+	{
+		start = now_ns();
+		established = recall_routes(&bi);
+		printf("recalled    %d/%d route(s) in %.2fs, one of each pair hung up\n", established, bi.routes, (now_ns() - start) / 1e9);
+	}
+
+	bi.running = 1;
+	if (pthread_create(&receiver, NULL, receive_loop, &bi) != 0)
+	{
+		fprintf(stderr, "Failed to start receiver. %s\n", strerror(errno));
+		exit(-4);
+	}
+	start = next = heartbeat = last_report = now_ns();
+	end = start + (uint64_t)bi.duration * 1000000000ULL;
+	while(now_ns() < end)
+	{
+		uint64_t ns;
+
+		send_round(&bi, bufs, msgs, iovs);
+		ns = now_ns();
+		if (ns - heartbeat >= BENCH_HEARTBEAT_INTERVAL * 1000000000ULL)
+		{
+			heartbeat = ns;
+			for(route = 0; route < bi.routes; route++)
+				send_signalling(&bi, route, LEFT_SIDE_FRAME, IAX_COMMAND_HEARTBEAT);
+		}
+		if (ns - last_report >= 1000000000ULL)
+		{
+			totals(&bi, &sent, &received);
+			printf("%6.1fs     tx %" PRIu64 " rx %" PRIu64 " (%.0f pps)\n", (ns - start) / 1e9, sent, received,
+				(received - last_received) * 1e9 / (ns - last_report));
+			fflush(stdout);
+			last_received = received;
+			last_report = ns;
+		}
+		if (bi.rate > 0)
+		{
+			next += 1000000000ULL / bi.rate;
+			if (next > ns)
+			{
+				struct timespec ts = { (next - ns) / 1000000000ULL, (next - ns) % 1000000000ULL };
+				nanosleep(&ts, NULL);
+			}
+			else if (ns - next > 1000000000ULL)
+			{
+				next = ns;	/* can not keep up, do not burst to catch up */
+			}
+		}
+	}
+	end = now_ns();
+	sleep(BENCH_DRAIN_TIME);
+	bi.running = 0;
+	pthread_join(receiver, NULL);
+	teardown_routes(&bi);
+
+	totals(&bi, &sent, &received);
+	printf("sent        %" PRIu64 " frames in %.2fs (%.0f pps)\n", sent, (end - start) / 1e9, sent * 1e9 / (end - start));
+	printf("forwarded   %" PRIu64 " frames (%.0f pps)\n", received, received * 1e9 / (end - start));
+	printf("dropped     %" PRIu64 " (%.3f%%)\n", sent - MIN(sent, received), sent ? (sent - MIN(sent, received)) * 100.0 / sent : 0.0);
+	if (received)
+	{
+		printf("latency us  p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+			latency_percentile(&bi, received, 50), latency_percentile(&bi, received, 90),
+			latency_percentile(&bi, received, 99), latency_percentile(&bi, received, 99.9), bi.latency_max);
+	}
+	if (bi.foreign)
+		printf("unexpected  %" PRIu64 " datagrams\n", bi.foreign);
+	if (bi.mgmt_port)
+	{
+		usleep(100000);		/* let the relay work through the HANGUPs */
+		print_relay_stats(&bi);
+	}
+
+	if (bi.max_drop >= 0 && sent && (sent - MIN(sent, received)) * 100.0 / sent > bi.max_drop)
+		return 2;
+	return 0;
+}
@@ -7,6 +7,11 @@
 #define TRACE_NORMAL    2, __FILE__, __LINE__
 #define TRACE_INFO      3, __FILE__, __LINE__
 #define TRACE_DEBUG     4, __FILE__, __LINE__
+#define TRACE_MSG_SIZE	600		/* message text per ring record */
+#define TRACE_RING_SIZE	256		/* records per thread, power of 2 */
+#define TRACE_FLUSH_MS	20		/* flusher wakeup and clock refresh */
+#define TRACE_SITES		64		/* rate limited call sites per thread, power of 2 */
+#define TRACE_SITE_BURST	10		/* messages per call site per second */
 
 //IAX def
 #define IAX_FLAG_SC_LOG				0x80
@@ -34,11 +39,31 @@
 #define RELAY_PORT_DEFAULT			4579
 #define MGMT_PORT_DEFAULT			4580
 #define RELAY_PKTBUF_SIZE			2048
+#define RELAY_PKT_TAILROOM			32		/* IEs appended in place by HEARTBEAT/TXREADY handling */
+#define RELAY_BATCH_SIZE			64		/* datagrams per recvmmsg/sendmmsg */
+#define RELAY_BATCH_ROUNDS			8		/* recvmmsg rounds per wakeup before re-polling */
+#define RELAY_GSO_MAX_SEGS			64
+#define RELAY_GSO_MAX_BYTES			65000
+#define RELAY_URING_ENTRIES			256		/* io_uring submission queue entries */
+#define RELAY_URING_CQ_ENTRIES		4096
+#define RELAY_URING_BUFS			1024	/* provided receive buffers per worker, power of two */
+#define RELAY_URING_BUF_SIZE		(RELAY_PKTBUF_SIZE + 64)	/* recvmsg header and sender address precede the datagram */
 #define MAXEPOLLSIZE 				512
+#define RELAY_EPOLL_TIMEOUT			1000	/* ms */
+#define RELAY_MAX_WORKERS			64
+#define CACHELINE_SIZE				64
 #define USERNAME_SIZE				80
+#define RELAY_SIGBUF_SIZE			512		/* saved TXCNT/HEARTBEAT frame per leg, incl. RELAY_PKT_TAILROOM */
+#define RELAY_SLAB_OBJECTS			256		/* objects carved out of one slab */
+#define MGMT_RESBUF_SIZE			65000	/* one management reply, fits a single UDP datagram */
+#define MGMT_TRAILER_SIZE			32		/* room kept for the paging cursor line */
 
 //Route Table def.
-#define ROUTETABLE_LIST_SIZE		65537
+#define ROUTETABLE_FWD_SIZE			131072	/* initial (addr, port, callno) slots, power of two */
+#define ROUTETABLE_TOKEN_SIZE		65536	/* initial token hash slots, power of two */
+#define RELAY_TOKEN_SIZE			64
+#define ROUTETABLE_AGING_TIMEOUT	90		/* default seconds without signalling or media before a route expires */
+#define ROUTETABLE_WHEEL_SLOTS		256		/* idle timer wheel, one slot per second, power of two */
 
 #define ROUTETABLE_IDEL				0
 #define ROUTETABLE_SETTING			1
@@ -48,6 +73,11 @@
 #define ROUTETABLE_RELEASING		5
 #define ROUTETABLE_RELEASED			6
 
+#define RT_FWD_EMPTY				0
+#define RT_FWD_ACTIVE				1		/* route status forwards frames */
+#define RT_FWD_IDLE					2		/* leg known, route not forwarding */
+#define RT_FWD_DELETED				3
+
 #define TX_STATUS_EVENT_INIT_NAT	0
 #define TX_STATUS_EVENT_INIT_P2P	1
 #define TX_STATUS_EVENT_RS			2
@@ -59,6 +89,7 @@
 #define RIGHT_SIDE_FRAME			2
 
 //Mgmt def
+/* MGMT_ROUTELIST_ALL and MGMT_STATS_ROUTES are paged: value[0..3] is the start cursor (network order), 0 for the first page */
 #define MGMT_ROUTELIST			1
 #define MGMT_ROUTELIST_ALL		1
 #define MGMT_ROUTELIST_CUR		2
@@ -66,4 +97,9 @@
 #define MGMT_CONFIG				2
 #define MGMT_CONFIG_TRACELEVEL	1
 
+#define MGMT_STATS				3
+#define MGMT_STATS_GLOBAL		1		/* one JSON object, relay totals and table usage */
+#define MGMT_STATS_ROUTES		2		/* JSON lines, one per route, paged */
+#define MGMT_STATS_PROMETHEUS	3		/* Prometheus text exposition format */
+
 #endif
@@ -2,57 +2,419 @@
 
 //Log API
 
-struct RT_Info_List* RtInfoListArray[ROUTETABLE_LIST_SIZE];
+struct RT_Fwd_Table {
+	struct RT_Fwd_Entry *slots;
+	unsigned int size;
+	unsigned int used;
+	unsigned int deleted;
+};
+static struct RT_Fwd_Table RtFwdTable;
+/* Open addressing (linear probing) on the relay token, deleted slots keep a tombstone */
+struct RT_Token_Table {
+	struct RT_Info **slots;
+	unsigned int size;
+	unsigned int used;
+	unsigned int deleted;
+};
+static struct RT_Token_Table RtTokenTable;
+static struct RT_Info RtTokenTombstone;
+#define RT_TOKEN_TOMBSTONE	(&RtTokenTombstone)
+/* Hashed timer wheel of route idle deadlines, one slot per relay clock second */
+struct RT_Timer_Wheel {
+	struct RT_Info *slots[ROUTETABLE_WHEEL_SLOTS];
+	time_t now;				/* last second processed */
+	unsigned int timeout;
+};
+static struct RT_Timer_Wheel RtTimerWheel;
+static time_t RelayClock;	/* CLOCK_MONOTONIC seconds, ticked by the wheel's timerfd */
+/*
+ * Route table lock: one mutex per relay worker on its own cache line.
+ * Forwarding only takes the worker's own mutex, route changes (rare,
+ * full frames) take all of them in order.
+ */
+struct route_reader_lock {
+	pthread_mutex_t mutex;
+} __attribute__ ((aligned (CACHELINE_SIZE)));
+static struct route_reader_lock *RouteLock = NULL;
+static int RouteLockReaders = 0;
+static struct slab_pool RtInfoPool;
+static struct slab_pool RtSignalPool;
+static unsigned int RouteSerial = 0;
+/*
+ * Asynchronous TraceEvent: every thread formats into its own single
+ * producer/single consumer ring, a flusher thread drains all rings to
+ * stdout or syslog. The timestamp comes from a clock the flusher ticks.
+ * A NORMAL/INFO/DEBUG call site logging more than TRACE_SITE_BURST times
+ * a second is suppressed until the next second, whatever its arguments,
+ * and the flusher reports the count once a second; errors and warnings
+ * are never suppressed. A ring lives as long as its thread.
+ */
+struct trace_record {
+	time_t when;
+	const char *file;
+	int line;
+	int level;
+	char msg[TRACE_MSG_SIZE];
+};
+struct trace_site {
+	const char *file;				/* file/line/level written by the owning thread */
+	int line;
+	int level;
+	time_t sec;
+	unsigned int count;
+	unsigned int suppressed;		/* added by the owner, reported and cleared by the flusher */
+};
+struct trace_ring {
+	unsigned int head;				/* written by the owning thread */
+	unsigned int dropped;			/* records lost on a full ring */
+	struct trace_site sites[TRACE_SITES];
+	unsigned int tail __attribute__ ((aligned (CACHELINE_SIZE)));	/* written by the flusher */
+	struct trace_ring *next;
+	struct trace_record recs[TRACE_RING_SIZE];
+};
+static struct trace_ring *TraceRings = NULL;
+static pthread_mutex_t TraceRingsLock = PTHREAD_MUTEX_INITIALIZER;	/* ring list and the consumer side */
+static pthread_key_t TraceRingKey;
+static pthread_t TraceFlusher;
+static int TraceStarted = 0;
+static time_t TraceClock;
+static time_t TraceTimeCached = -1;
+static char TraceTimeStr[TRACE_DATESIZE];
+static __thread struct trace_ring *TraceRing = NULL;
 int traceLevel = 0;
 int useSyslog = 0;
 int syslog_opened = 0;
+
+static void trace_time(time_t when, char *LogTime)
+{
+	struct tm tm_now;
+
+	strftime(LogTime, TRACE_DATESIZE, "%d/%b/%Y %H:%M:%S", localtime_r(&when, &tm_now));
+}
+static void write_trace(const char *LogTime, int level, const char *file, int line, const char *msg)
+{
+	char* extra_msg = "";
+
+	if(level == 0)
+		extra_msg = "ERROR: ";
+	else if(level == 1)
+		extra_msg = "WARNING: ";
+	else if(level == 2)
+		extra_msg = "NORMAL: ";
+	else if(level == 3)
+		extra_msg = "INFO: ";
+	else if(level == 4)
+		extra_msg = "DEBUG: ";
+
+	if(useSyslog) {
+		if(!syslog_opened) {
+			openlog("relayserver", LOG_PID, LOG_LOCAL6);
+			syslog_opened = 1;
+		}
+		syslog(LOG_INFO, "%s%s", extra_msg, msg);
+	} else {
+		printf("%s [%11s:%4d] %s%s\n", LogTime, file, line, extra_msg, msg);
+	}
+}
+static void strip_trace(char *msg)
+{
+	size_t len = strlen(msg);
+
+	while(len > 0 && msg[len-1] == '\n')
+		msg[--len] = '\0';
+}
+static struct trace_ring *get_trace_ring(void)
+{
+	struct trace_ring *ring;
+
+	if (TraceRing)
+		return TraceRing;
+
+	if (posix_memalign((void **)&ring, CACHELINE_SIZE, sizeof(struct trace_ring)) != 0)
+		return NULL;
+	memset(ring, 0x00, sizeof(struct trace_ring));
+	pthread_mutex_lock(&TraceRingsLock);
+	ring->next = TraceRings;
+	TraceRings = ring;
+	pthread_mutex_unlock(&TraceRingsLock);
+
+	TraceRing = ring;
+	pthread_setspecific(TraceRingKey, ring);
+	return ring;
+}
+static struct trace_record *reserve_trace(struct trace_ring *ring)
+{
+	unsigned int head = ring->head;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE)
+	{
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &ring->recs[head & (TRACE_RING_SIZE - 1)];
+}
+static void commit_trace(struct trace_ring *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+static void format_suppressed(char *buf, size_t size, unsigned int count, const char *file, int line)
+{
+	snprintf(buf, size, "Suppressed %u messages from %s:%d", count, file, line);
+}
+/* 1 if the call site may log now */
+static int trace_rate_limit(struct trace_ring *ring, int level, const char *file, int line, time_t now)
+{
+	struct trace_site *site;
+	struct trace_record *rec;
+	unsigned int suppressed;
+
+	if (level <= 1)		/* errors and warnings always get through */
+		return 1;
+	site = &ring->sites[(((uintptr_t)file >> 3) ^ ((unsigned int)line * 2654435761u)) & (TRACE_SITES - 1)];
+	if (site->file != file || site->line != line)
+	{
+		/* The slot changes hands, report what the old site had suppressed itself */
+		suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+		if (suppressed && (rec = reserve_trace(ring)) != NULL)
+		{
+			rec->when = now;
+			rec->file = site->file;
+			rec->line = site->line;
+			rec->level = site->level;
+			format_suppressed(rec->msg, sizeof(rec->msg), suppressed, site->file, site->line);
+			commit_trace(ring);
+		}
+		__atomic_store_n(&site->file, file, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->line, line, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->level, level, __ATOMIC_RELAXED);
+		site->sec = now;
+		site->count = 1;
+		return 1;
+	}
+	if (site->sec != now)
+	{
+		site->sec = now;
+		site->count = 1;
+		return 1;
+	}
+	if (site->count < TRACE_SITE_BURST)
+	{
+		site->count++;
+		return 1;
+	}
+	__atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+/* Caller holds TraceRingsLock, returns the lines written */
+static int drain_trace_ring(struct trace_ring *ring)
+{
+	struct trace_record *rec;
+	unsigned int head, tail, dropped;
+	char buf[64];
+	int written = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	for (tail = ring->tail; tail != head; tail++, written++)
+	{
+		rec = &ring->recs[tail & (TRACE_RING_SIZE - 1)];
+		if (rec->when != TraceTimeCached)
+		{
+			trace_time(rec->when, TraceTimeStr);
+			TraceTimeCached = rec->when;
+		}
+		write_trace(TraceTimeStr, rec->level, rec->file, rec->line, rec->msg);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) > 0)
+	{
+		snprintf(buf, sizeof(buf), "Trace ring full, %u messages dropped", dropped);
+		write_trace(TraceTimeStr, 1, __FILE__, __LINE__, buf);
+		written++;
+	}
+	return written;
+}
+/* Caller holds TraceRingsLock, reports the call sites of ring suppressed since the last report */
+static int report_trace_sites(struct trace_ring *ring)
+{
+	struct trace_site *site;
+	unsigned int suppressed;
+	time_t now = __atomic_load_n(&TraceClock, __ATOMIC_RELAXED);
+	char buf[TRACE_MSG_SIZE];
+	const char *file;
+	int line, written = 0;
+
+	for (site = ring->sites; site < ring->sites + TRACE_SITES; site++)
+	{
+		file = __atomic_load_n(&site->file, __ATOMIC_RELAXED);
+		line = __atomic_load_n(&site->line, __ATOMIC_RELAXED);
+		if ((suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED)) == 0)
+			continue;
+		if (now != TraceTimeCached)
+		{
+			trace_time(now, TraceTimeStr);
+			TraceTimeCached = now;
+		}
+		format_suppressed(buf, sizeof(buf), suppressed, file, line);
+		write_trace(TraceTimeStr, __atomic_load_n(&site->level, __ATOMIC_RELAXED), file, line, buf);
+		written++;
+	}
+	return written;
+}
+/* Caller holds TraceRingsLock */
+static void drain_trace_rings(int report_sites)
+{
+	struct trace_ring *ring;
+	int written = 0;
+
+	for (ring = TraceRings; ring; ring = ring->next)
+	{
+		written += drain_trace_ring(ring);
+		if (report_sites)
+			written += report_trace_sites(ring);
+	}
+	if (written && !useSyslog)
+		fflush(stdout);
+}
+static void release_trace_ring(void *arg)
+{
+	struct trace_ring *ring = (struct trace_ring *)arg;
+	struct trace_ring **prev;
+	int written;
+
+	pthread_mutex_lock(&TraceRingsLock);
+	written = drain_trace_ring(ring) + report_trace_sites(ring);
+	for (prev = &TraceRings; *prev != ring; prev = &(*prev)->next)
+		;
+	*prev = ring->next;
+	if (written && !useSyslog)
+		fflush(stdout);
+	pthread_mutex_unlock(&TraceRingsLock);
+	free(ring);
+	TraceRing = NULL;
+}
+static void *run_trace_flusher(void *arg)
+{
+	struct timespec ts;
+	time_t now, last = 0;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = TRACE_FLUSH_MS * 1000000L;
+	while (1)
+	{
+		now = time(NULL);
+		__atomic_store_n(&TraceClock, now, __ATOMIC_RELAXED);
+		pthread_mutex_lock(&TraceRingsLock);
+		drain_trace_rings(now != last);
+		pthread_mutex_unlock(&TraceRingsLock);
+		last = now;
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+static void flush_trace_logger(void)
+{
+	pthread_mutex_lock(&TraceRingsLock);
+	drain_trace_rings(1);
+	pthread_mutex_unlock(&TraceRingsLock);
+}
+/* fork() keeps no flusher and no other threads: drop what the parent had queued and restart it */
+static void trace_prepare_fork(void)
+{
+	pthread_mutex_lock(&TraceRingsLock);
+	if (!useSyslog)
+		fflush(stdout);
+}
+static void trace_parent_fork(void)
+{
+	pthread_mutex_unlock(&TraceRingsLock);
+}
+static void trace_child_fork(void)
+{
+	struct trace_ring *ring, *next;
+
+	/* Only the forking thread lives on in the child, the other rings have no owner */
+	for (ring = TraceRings; ring; ring = next)
+	{
+		next = ring->next;
+		if (ring != TraceRing)
+			free(ring);
+	}
+	TraceRings = TraceRing;
+	if (TraceRing)
+	{
+		TraceRing->next = NULL;
+		TraceRing->tail = TraceRing->head;
+		TraceRing->dropped = 0;
+		memset(TraceRing->sites, 0x00, sizeof(TraceRing->sites));
+	}
+	pthread_mutex_unlock(&TraceRingsLock);
+	if (pthread_create(&TraceFlusher, NULL, run_trace_flusher, NULL) != 0)
+		__atomic_store_n(&TraceStarted, 0, __ATOMIC_RELEASE);
+}
+/* Until this runs (and if it fails) TraceEvent writes synchronously */
+int init_trace_logger(void)
+{
+	if (TraceStarted)
+		return 0;
+
+	if (pthread_key_create(&TraceRingKey, release_trace_ring) != 0)
+		return -1;
+	TraceClock = time(NULL);
+	if (pthread_create(&TraceFlusher, NULL, run_trace_flusher, NULL) != 0)
+	{
+		pthread_key_delete(TraceRingKey);
+		return -1;
+	}
+	atexit(flush_trace_logger);
+	pthread_atfork(trace_prepare_fork, trace_parent_fork, trace_child_fork);
+	__atomic_store_n(&TraceStarted, 1, __ATOMIC_RELEASE);
+	return 0;
+}
 void TraceEvent(int level, char* file, int line, char* format, ...)
 {
 	va_list va_ap;
-	if(level <= traceLevel)
-	{
-		char LogTime[TRACE_DATESIZE] = {0};
-		char buf[1024];
-		char out_buf[640];
-		char* extra_msg = "";
-		
-		time_t timenow = time(NULL);
-
-		memset(buf, 0, sizeof(buf));
-		strftime(LogTime, TRACE_DATESIZE, "%d/%b/%Y %H:%M:%S", localtime(&timenow));
-		
+	struct trace_ring *ring = NULL;
+	struct trace_record *rec;
+	time_t now;
+
+	if(level > traceLevel)
+		return;
+
+	if (__atomic_load_n(&TraceStarted, __ATOMIC_ACQUIRE))
+		ring = get_trace_ring();
+
+	/* Synchronous until the flusher runs, and not rate limited */
+	if (!ring)
+	{
+		char LogTime[TRACE_DATESIZE];
+		char buf[TRACE_MSG_SIZE];
+
+		trace_time(time(NULL), LogTime);
 		va_start (va_ap, format);
-		vsnprintf(buf, sizeof(buf)-1, format, va_ap);
+		vsnprintf(buf, sizeof(buf), format, va_ap);
 		va_end(va_ap);
-		
-		if(level == 0)
-			extra_msg = "ERROR: ";
-		else if(level == 1)
-			extra_msg = "WARNING: ";
-		else if(level == 2)
-			extra_msg = "NORMAL: ";
-		else if(level == 3)
-			extra_msg = "INFO: ";
-		else if(level == 4)
-			extra_msg = "DEBUG: ";
-
-		while(buf[strlen(buf)-1] == '\n') 
-			buf[strlen(buf)-1] = '\0';
-
-		if(useSyslog) {
-			if(!syslog_opened) {
-				openlog("relayserver", LOG_PID, LOG_LOCAL6);
-				syslog_opened = 1;
-			}
-
-			snprintf(out_buf, sizeof(out_buf), "%s%s", extra_msg, buf);
-			syslog(LOG_INFO, "%s", out_buf);
-		} else {
-			snprintf(out_buf, sizeof(out_buf), "%s [%11s:%4d] %s%s", LogTime, file, line, extra_msg, buf);
-			printf("%s\n", out_buf);
+		strip_trace(buf);
+		write_trace(LogTime, level, file, line, buf);
+		if (!useSyslog)
 			fflush(stdout);
-		}
+		return;
 	}
+
+	now = __atomic_load_n(&TraceClock, __ATOMIC_RELAXED);
+	if (!trace_rate_limit(ring, level, file, line, now))
+		return;
+	if ((rec = reserve_trace(ring)) == NULL)
+		return;
+	rec->when = now;
+	rec->file = file;
+	rec->line = line;
+	rec->level = level;
+	va_start (va_ap, format);
+	vsnprintf(rec->msg, sizeof(rec->msg), format, va_ap);
+	va_end(va_ap);
+	strip_trace(rec->msg);
+	commit_trace(ring);
 }
 int inaddrcmp(const struct sockaddr_in *sin1, const struct sockaddr_in *sin2)
 {
@@ -64,7 +426,7 @@ int inonlyaddrcmp(const struct sockaddr_in *sin1, const struct sockaddr_in *sin2
 	return (sin1->sin_addr.s_addr != sin2->sin_addr.s_addr);
 }
 //Socket API
-int setup_socket(int port, char* ipaddr, int bind_any)
+int setup_socket(int port, char* ipaddr, int bind_any, int reuseport)
 {
 	int socket_fd;
 	struct sockaddr_in local_address;
@@ -79,6 +441,12 @@ int setup_socket(int port, char* ipaddr, int bind_any)
 		return -1;
 	}
 	setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&sockopt, sizeof(sockopt));
+	if (reuseport && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, (char *)&sockopt, sizeof(sockopt)) < 0)
+	{
+		TraceEvent(TRACE_ERROR, "Unable to set SO_REUSEPORT [%s]\n", strerror(errno));
+		close(socket_fd);
+		return -1;
+	}
 
 	optlen = sizeof(sndbuf);
 	getsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen);
@@ -95,6 +463,7 @@ int setup_socket(int port, char* ipaddr, int bind_any)
 
 	if(bind(socket_fd, (struct sockaddr*) &local_address, sizeof(local_address)) == -1) {
 		TraceEvent(TRACE_ERROR, "Bind error [%s]\n", strerror(errno));
+		close(socket_fd);
 		return -1;
 	}
 	return socket_fd;
@@ -115,11 +484,15 @@ int iax_parse_ies(struct iax_ies *ies, unsigned char *data, int datalen)
 		}
 		switch(ie) {
 			case IAX_IE_RELAY_TOKEN:
+				if (len >= sizeof(ies->relaytoken)) {
+					TraceEvent(TRACE_ERROR, "Relay token IE too long (%d)", len);
+					return -1;
+				}
 				memcpy(ies->relaytoken, (char *)data + 2, len);
 				TraceEvent(TRACE_DEBUG, "ies->relaytoken=[%s], len=[%d]", ies->relaytoken, len);
 			break;
 			case IAX_IE_USERNAME:
-				memcpy(ies->username, (char *)data + 2, len);
+				memcpy(ies->username, (char *)data + 2, MIN(len, sizeof(ies->username) - 1));
 				TraceEvent(TRACE_DEBUG, "ies->username=[%s], len=[%d]", ies->username, len);
 			break;								
 			default:
@@ -148,126 +521,836 @@ int uncompress_subclass(unsigned char csub)
 	else
 		return csub;
 }
-//Route table API
-//#define DEBUG_ROUTETABLE
-struct RT_Info* find_routeinfo_by_relaytoken(struct RT_Info *list, const char *token)
+//Slab API
+int slab_pool_init(struct slab_pool *pool, size_t obj_size)
+{
+	memset(pool, 0x00, sizeof(struct slab_pool));
+	/* Objects are cache line aligned, the slab link lives in the first line */
+	pool->obj_size = (obj_size + CACHELINE_SIZE - 1) & ~(size_t)(CACHELINE_SIZE - 1);
+	return 0;
+}
+void* slab_alloc(struct slab_pool *pool)
 {
-	while(list != NULL)
+	void *obj;
+
+	if (pool->free_list == NULL)
 	{
-		if( 0 == memcmp(token, list->relaytoken, strlen(list->relaytoken)) )
+		uint8_t *slab;
+		unsigned int i;
+
+		if (posix_memalign((void **)&slab, CACHELINE_SIZE, CACHELINE_SIZE + RELAY_SLAB_OBJECTS * pool->obj_size))
+			return NULL;
+		*(void **)slab = pool->slabs;
+		pool->slabs = slab;
+		for(i = 0; i < RELAY_SLAB_OBJECTS; i++)
 		{
-			return list;
+			obj = slab + CACHELINE_SIZE + i * pool->obj_size;
+			*(void **)obj = pool->free_list;
+			pool->free_list = obj;
 		}
-		list = list->next;
+	}
+	obj = pool->free_list;
+	pool->free_list = *(void **)obj;
+	pool->in_use++;
+	memset(obj, 0x00, pool->obj_size);
+	return obj;
+}
+void slab_free(struct slab_pool *pool, void *obj)
+{
+	*(void **)obj = pool->free_list;
+	pool->free_list = obj;
+	pool->in_use--;
+}
+void slab_pool_destroy(struct slab_pool *pool)
+{
+	while(pool->slabs != NULL)
+	{
+		void *next = *(void **)pool->slabs;
+		free(pool->slabs);
+		pool->slabs = next;
+	}
+	pool->free_list = NULL;
+	pool->in_use = 0;
+}
+//Route table API
+int init_route_pools(void)
+{
+	slab_pool_init(&RtInfoPool, sizeof(struct RT_Info));
+	slab_pool_init(&RtSignalPool, sizeof(struct RT_Signal_Info));
+	return 0;
+}
+void destroy_route_pools(void)
+{
+	if (RtInfoPool.in_use || RtSignalPool.in_use)
+		TraceEvent(TRACE_WARNING, "Route pools destroyed with %u/%u objects in use", RtInfoPool.in_use, RtSignalPool.in_use);
+	slab_pool_destroy(&RtInfoPool);
+	slab_pool_destroy(&RtSignalPool);
+}
+struct RT_Info* alloc_route(void)
+{
+	struct RT_Info *rti = (struct RT_Info *)slab_alloc(&RtInfoPool);
+
+	if (rti == NULL)
+		return NULL;
+	rti->sig = (struct RT_Signal_Info *)slab_alloc(&RtSignalPool);
+	if (rti->sig == NULL)
+	{
+		slab_free(&RtInfoPool, rti);
+		return NULL;
+	}
+	rti->sig->serial = ++RouteSerial;
+	return rti;
+}
+/* Keep the last signalling frame of a leg, room is left for the TXEVENT IE appended on replay */
+int save_route_frame(struct RT_Info *rti, int side, const uint8_t *buf, size_t len)
+{
+	if (len > RELAY_SIGBUF_SIZE - RELAY_PKT_TAILROOM)
+	{
+		TraceEvent(TRACE_WARNING, "Signalling frame too large to keep (%d bytes), relaytoken=%s", (int)len, rti->sig->relaytoken);
+		return -1;
+	}
+	if (side == LEFT_SIDE_FRAME)
+	{
+		memcpy(rti->sig->l_pktbuf, buf, len);
+		rti->sig->l_pkt_len = len;
+	}
+	else
+	{
+		memcpy(rti->sig->r_pktbuf, buf, len);
+		rti->sig->r_pkt_len = len;
+	}
+	return 0;
+}
+int init_route_lock(int readers)
+{
+	int i;
+
+	if (posix_memalign((void **)&RouteLock, CACHELINE_SIZE, readers * sizeof(struct route_reader_lock)))
+		return -1;
+	for(i = 0; i < readers; i++)
+		pthread_mutex_init(&RouteLock[i].mutex, NULL);
+	RouteLockReaders = readers;
+	return 0;
+}
+void route_read_lock(int reader)
+{
+	if (RouteLockReaders > 1)
+		pthread_mutex_lock(&RouteLock[reader].mutex);
+}
+void route_read_unlock(int reader)
+{
+	if (RouteLockReaders > 1)
+		pthread_mutex_unlock(&RouteLock[reader].mutex);
+}
+void route_write_lock(void)
+{
+	int i;
+
+	if (RouteLockReaders > 1)
+		for(i = 0; i < RouteLockReaders; i++)
+			pthread_mutex_lock(&RouteLock[i].mutex);
+}
+void route_write_unlock(void)
+{
+	int i;
+
+	if (RouteLockReaders > 1)
+		for(i = RouteLockReaders - 1; i >= 0; i--)
+			pthread_mutex_unlock(&RouteLock[i].mutex);
+}
+static inline unsigned int fwd_hash(uint32_t addr, uint16_t port, uint16_t callno)
+{
+	/* murmur3 finalizer over the packed key */
+	uint64_t h = ((uint64_t)addr << 32) | ((uint32_t)port << 16) | callno;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+static inline int fwd_key_match(const struct RT_Fwd_Entry *e, uint32_t addr, uint16_t port, uint16_t callno)
+{
+	return (e->addr == addr) && (e->port == port) && (e->callno == callno);
+}
+static struct RT_Fwd_Entry* lookup_RtFwdTable(uint32_t addr, uint16_t port, uint16_t callno)
+{
+	unsigned int mask = RtFwdTable.size - 1;
+	unsigned int idx = fwd_hash(addr, port, callno) & mask;
+	struct RT_Fwd_Entry *e;
+
+	while((e = &RtFwdTable.slots[idx])->state != RT_FWD_EMPTY)
+	{
+		if (e->state != RT_FWD_DELETED && fwd_key_match(e, addr, port, callno))
+			return e;
+		idx = (idx + 1) & mask;
 	}
 	return NULL;
 }
-struct RT_Info* find_routeinfo_by_addr_and_callno(struct sockaddr_in *addr, unsigned short scallno, int *flag)
+static struct RT_Fwd_Entry* insert_into_RtFwdTable(struct RT_Fwd_Entry *slots, unsigned int size, uint32_t addr, uint16_t port, uint16_t callno)
+{
+	unsigned int mask = size - 1;
+	unsigned int idx = fwd_hash(addr, port, callno) & mask;
+
+	while(slots[idx].state != RT_FWD_EMPTY && slots[idx].state != RT_FWD_DELETED)
+		idx = (idx + 1) & mask;
+	return &slots[idx];
+}
+static int resize_RtFwdTable(unsigned int size)
+{
+	struct RT_Fwd_Entry *slots;
+	unsigned int idx;
+
+	if (posix_memalign((void **)&slots, CACHELINE_SIZE, size * sizeof(struct RT_Fwd_Entry)))
+	{
+		TraceEvent(TRACE_ERROR, "Unable to allocate route forwarding table of %u slots", size);
+		return -1;
+	}
+	memset(slots, 0x00, size * sizeof(struct RT_Fwd_Entry));
+	for(idx = 0; idx < RtFwdTable.size; idx++)
+	{
+		struct RT_Fwd_Entry *e = &RtFwdTable.slots[idx];
+		if (e->state == RT_FWD_ACTIVE || e->state == RT_FWD_IDLE)
+			*insert_into_RtFwdTable(slots, size, e->addr, e->port, e->callno) = *e;
+	}
+	free(RtFwdTable.slots);
+	RtFwdTable.slots = slots;
+	RtFwdTable.size = size;
+	RtFwdTable.deleted = 0;
+	return 0;
+}
+int init_RtFwdTable(unsigned int size)
+{
+	unsigned int pow2 = 16;
+
+	while(pow2 < size)
+		pow2 <<= 1;
+	memset(&RtFwdTable, 0x00, sizeof(RtFwdTable));
+	return resize_RtFwdTable(pow2);
+}
+static inline int route_forwards(const struct RT_Info *rti)
+{
+	return (rti->status == ROUTETABLE_SETTED) || (rti->status == ROUTETABLE_RELEASING);
+}
+static inline const struct sockaddr_in* route_leg_addr(const struct RT_Info *rti, int side)
+{
+	return (side == LEFT_SIDE_FRAME) ? &rti->l_ipaddr : &rti->r_ipaddr;
+}
+static inline unsigned short route_leg_callno(const struct RT_Info *rti, int side)
+{
+	return (side == LEFT_SIDE_FRAME) ? rti->l_callno : rti->r_callno;
+}
+/* Entry of one leg of rti, NULL if that leg is not (or no longer) owned by rti */
+static struct RT_Fwd_Entry* route_fwd_entry(const struct RT_Info *rti, int side)
+{
+	const struct sockaddr_in *addr = route_leg_addr(rti, side);
+	struct RT_Fwd_Entry *e;
+
+	if (!(rti->fwd_sides & side))
+		return NULL;
+	e = lookup_RtFwdTable(addr->sin_addr.s_addr, addr->sin_port, route_leg_callno(rti, side));
+	return (e != NULL && e->rti == rti) ? e : NULL;
+}
+/* Refresh the inline peer address and forwarding state of one leg */
+static void refresh_fwd_entry(struct RT_Info *rti, int side)
+{
+	struct RT_Fwd_Entry *e = route_fwd_entry(rti, side);
+	const struct sockaddr_in *peer;
+
+	if (e == NULL)
+		return;
+	peer = route_leg_addr(rti, (side == LEFT_SIDE_FRAME) ? RIGHT_SIDE_FRAME : LEFT_SIDE_FRAME);
+	e->peer_addr = peer->sin_addr.s_addr;
+	e->peer_port = peer->sin_port;
+	e->state = route_forwards(rti) ? RT_FWD_ACTIVE : RT_FWD_IDLE;
+}
+static inline struct route_counters* route_leg_counters(const struct RT_Info *rti, int side)
+{
+	return (side == LEFT_SIDE_FRAME) ? &rti->sig->l_stats : &rti->sig->r_stats;
+}
+/* Move the live counters of an entry into its route before the entry changes hands */
+static void fold_fwd_counters(struct RT_Fwd_Entry *e)
+{
+	struct route_counters *c = route_leg_counters(e->rti, e->side);
+
+	c->pkts += e->stats.pkts;
+	c->bytes += e->stats.bytes;
+	c->drops += e->stats.drops;
+	memset(&e->stats, 0x00, sizeof(e->stats));
+	if (e->last_active > e->rti->update_time)
+		e->rti->update_time = e->last_active;
+}
+static inline int route_newer(const struct RT_Info *a, const struct RT_Info *b)
+{
+	return (int)(a->sig->serial - b->sig->serial) > 0;
+}
+static inline struct route_pending_link* route_pending_link(struct RT_Info *rti, int side)
+{
+	return (side == LEFT_SIDE_FRAME) ? &rti->sig->l_pending : &rti->sig->r_pending;
+}
+/* Queue one leg of rti on the pending list of the entry another route holds */
+static void push_pending_leg(struct RT_Fwd_Entry *e, struct RT_Info *rti, int side)
+{
+	struct route_pending_link *link = route_pending_link(rti, side);
+
+	link->rti = e->pending;
+	link->side = e->pending_side;
+	e->pending = rti;
+	e->pending_side = side;
+	rti->fwd_pending |= side;
+}
+static void unlink_pending_leg(struct RT_Fwd_Entry *e, struct RT_Info *rti, int side)
+{
+	struct RT_Info **pp = &e->pending;
+	uint8_t *ps = &e->pending_side;
+	struct route_pending_link *link;
+
+	while(*pp != NULL)
+	{
+		link = route_pending_link(*pp, *ps);
+		if (*pp == rti && *ps == side)
+		{
+			*pp = link->rti;
+			*ps = link->side;
+			break;
+		}
+		pp = &link->rti;
+		ps = &link->side;
+	}
+	rti->fwd_pending &= ~side;
+}
+/* The pending leg next in line for e: the newest forwarding route, else the newest */
+static struct RT_Info* next_pending_leg(struct RT_Fwd_Entry *e, int *side)
 {
-	struct RT_Info_List* rt_info_list = NULL;
-	struct RT_Info * rt_info =NULL;
-#ifdef DEBUG_ROUTETABLE
-	TraceEvent(TRACE_ERROR, "To find [%s:%d] scallno:%d", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port),scallno);
-#endif
-	for(rt_info_list = RtInfoListArray[scallno]; rt_info_list != NULL; rt_info_list = rt_info_list->next)
-	{
-		rt_info = (struct RT_Info*)rt_info_list->RT_Info;
-#ifdef DEBUG_ROUTETABLE
-		TraceEvent(TRACE_ERROR, "L find_routeinfo_by_addr_and_callno [%s:%d] scallno:%d", inet_ntoa(rt_info->l_ipaddr.sin_addr), ntohs(rt_info->l_ipaddr.sin_port),rt_info->l_callno);
-		TraceEvent(TRACE_ERROR, "R find_routeinfo_by_addr_and_callno [%s:%d] scallno:%d", inet_ntoa(rt_info->r_ipaddr.sin_addr), ntohs(rt_info->r_ipaddr.sin_port),rt_info->r_callno);
-#endif
-		if ((rt_info->status == ROUTETABLE_SETTED)||(rt_info->status == ROUTETABLE_RELEASING))
+	struct RT_Info *rti = e->pending, *best = NULL;
+	unsigned char rti_side = e->pending_side;
+	struct route_pending_link *link;
+
+	while(rti != NULL)
+	{
+		if (best == NULL || (route_forwards(rti) != route_forwards(best) ? route_forwards(rti) : route_newer(rti, best)))
 		{
-			if(!inaddrcmp(&rt_info->l_ipaddr, addr) && (rt_info->l_callno == scallno))
-			{
-				*flag = LEFT_SIDE_FRAME;
-#ifdef DEBUG_ROUTETABLE
-				TraceEvent(TRACE_ERROR, "Find left over");
-#endif
-				return rt_info;
-			}
-			if(!inaddrcmp(&rt_info->r_ipaddr, addr) && (rt_info->r_callno == scallno))
-			{
-				*flag = RIGHT_SIDE_FRAME;
-#ifdef DEBUG_ROUTETABLE
-				TraceEvent(TRACE_ERROR, "Find right over");
-#endif
-				return rt_info;
-			}
+			best = rti;
+			*side = rti_side;
 		}
+		link = route_pending_link(rti, rti_side);
+		rti = link->rti;
+		rti_side = link->side;
 	}
-#ifdef DEBUG_ROUTETABLE
-	TraceEvent(TRACE_ERROR, "Not Find over");
-#endif
-	return NULL;
+	return best;
 }
-void add_route_to_RtInfoListArray(unsigned short scallno, struct RT_Info *rti)
+static void del_route_from_RtFwdTable(struct RT_Info *rti, int side)
 {
-	struct RT_Info_List* rt_info_list;
+	struct RT_Fwd_Entry *e = route_fwd_entry(rti, side);
+	struct RT_Info *next;
+	int next_side;
 
-	rt_info_list = (struct RT_Info_List *)malloc(sizeof(struct RT_Info_List));
-	rt_info_list->next = RtInfoListArray[scallno];
+	if (rti->fwd_pending & side)
+	{
+		const struct sockaddr_in *addr = route_leg_addr(rti, side);
+		struct RT_Fwd_Entry *held = lookup_RtFwdTable(addr->sin_addr.s_addr, addr->sin_port, route_leg_callno(rti, side));
 
-	RtInfoListArray[scallno] = rt_info_list;
-	RtInfoListArray[scallno]->RT_Info = (void *)rti;
-#ifdef DEBUG_ROUTETABLE
-	TraceEvent(TRACE_ERROR, "Add [%s:%d] scallno:%d", inet_ntoa(rti->l_ipaddr.sin_addr), ntohs(rti->l_ipaddr.sin_port),scallno);
-#endif
+		if (held != NULL)
+			unlink_pending_leg(held, rti, side);
+		rti->fwd_pending &= ~side;
+	}
+	rti->fwd_sides &= ~side;
+	if (e == NULL)
+		return;
+	fold_fwd_counters(e);
+	/* Hand the leg to a route waiting for it rather than dropping its frames as no-route */
+	if ((next = next_pending_leg(e, &next_side)) != NULL)
+	{
+		unlink_pending_leg(e, next, next_side);
+		e->side = next_side;
+		e->rti = next;
+		next->fwd_sides |= next_side;
+		refresh_fwd_entry(next, next_side);
+		return;
+	}
+	/* An entry followed by an empty slot ends every probe chain, no tombstone needed */
+	if (RtFwdTable.slots[((e - RtFwdTable.slots) + 1) & (RtFwdTable.size - 1)].state == RT_FWD_EMPTY)
+	{
+		e->state = RT_FWD_EMPTY;
+	}
+	else
+	{
+		e->state = RT_FWD_DELETED;
+		RtFwdTable.deleted++;
+	}
+	e->rti = NULL;
+	RtFwdTable.used--;
 }
-void del_route_from_RtInfoListArray(struct sockaddr_in *addr, unsigned short scallno)
+int add_route_to_RtFwdTable(struct RT_Info *rti, int side)
 {
-	struct RT_Info_List *cur_rt_info_list, *prev;
-	struct RT_Info *rti;
-	
-	cur_rt_info_list = RtInfoListArray[scallno];
-	prev = NULL;
-	while(cur_rt_info_list != NULL)
+	const struct sockaddr_in *addr = route_leg_addr(rti, side);
+	unsigned short callno = route_leg_callno(rti, side);
+	struct RT_Fwd_Entry *e;
+
+	del_route_from_RtFwdTable(rti, side);
+	e = lookup_RtFwdTable(addr->sin_addr.s_addr, addr->sin_port, callno);
+	if (e != NULL)
+	{
+		/*
+		 * Same sender and callno as another route.  The list walk gave the
+		 * leg to the newest forwarding route, so a forwarding holder keeps
+		 * it against an older route or one that does not forward yet.  The
+		 * route left out waits on the entry's pending list until it
+		 * forwards and is the newer one, or the holder lets go.
+		 */
+		if (e->state == RT_FWD_ACTIVE && !(route_forwards(rti) && route_newer(rti, e->rti)))
+		{
+			push_pending_leg(e, rti, side);
+			return 0;
+		}
+		fold_fwd_counters(e);
+		e->rti->fwd_sides &= ~e->side;
+		push_pending_leg(e, e->rti, e->side);
+	}
+	else
 	{
-		rti = (struct RT_Info*)cur_rt_info_list->RT_Info;
-		if((!inaddrcmp(&rti->l_ipaddr,addr)&&(rti->l_callno == scallno))||(!inaddrcmp(&rti->r_ipaddr,addr)&&(rti->r_callno == scallno)))
+		if ((RtFwdTable.used + RtFwdTable.deleted + 1) * 2 > RtFwdTable.size)
 		{
-			struct RT_Info_List *cur_next = cur_rt_info_list->next;
-			if(prev == NULL)
+			unsigned int size = RtFwdTable.size;
+			if ((RtFwdTable.used + 1) * 4 > size)
+				size <<= 1;
+			if (resize_RtFwdTable(size) < 0)
+				return -1;
+		}
+		e = insert_into_RtFwdTable(RtFwdTable.slots, RtFwdTable.size, addr->sin_addr.s_addr, addr->sin_port, callno);
+		if (e->state == RT_FWD_DELETED)
+			RtFwdTable.deleted--;
+		RtFwdTable.used++;
+		memset(&e->stats, 0x00, sizeof(e->stats));
+		e->last_active = relay_time();
+		e->pending = NULL;
+	}
+	e->addr = addr->sin_addr.s_addr;
+	e->port = addr->sin_port;
+	e->callno = callno;
+	e->side = side;
+	e->state = RT_FWD_IDLE;
+	e->rti = rti;
+	rti->fwd_sides |= side;
+	refresh_fwd_entry(rti, LEFT_SIDE_FRAME);
+	refresh_fwd_entry(rti, RIGHT_SIDE_FRAME);
+	return 0;
+}
+void set_route_addr(struct RT_Info *rti, int side, const struct sockaddr_in *addr)
+{
+	int registered = (rti->fwd_sides | rti->fwd_pending) & side;
+
+	if (registered)
+		del_route_from_RtFwdTable(rti, side);
+	memcpy((side == LEFT_SIDE_FRAME) ? &rti->l_ipaddr : &rti->r_ipaddr, addr, sizeof(struct sockaddr_in));
+	if (registered)
+		add_route_to_RtFwdTable(rti, side);
+	else
+		refresh_fwd_entry(rti, (side == LEFT_SIDE_FRAME) ? RIGHT_SIDE_FRAME : LEFT_SIDE_FRAME);
+}
+/* A pending leg is claimed once its route forwards, add_route_to_RtFwdTable() weighs it against the holder */
+static void claim_pending_leg(struct RT_Info *rti, int side)
+{
+	if ((rti->fwd_pending & side) && route_forwards(rti))
+		add_route_to_RtFwdTable(rti, side);
+}
+/* A leg rti holds but no longer forwards goes to a forwarding route waiting for it */
+static void yield_leg(struct RT_Info *rti, int side)
+{
+	struct RT_Fwd_Entry *e = route_fwd_entry(rti, side);
+	struct RT_Info *next;
+	int next_side;
+
+	if (e == NULL || e->state == RT_FWD_ACTIVE)
+		return;
+	next = next_pending_leg(e, &next_side);
+	if (next != NULL && route_forwards(next))
+		add_route_to_RtFwdTable(next, next_side);
+}
+void set_route_status(struct RT_Info *rti, unsigned char status)
+{
+	rti->status = status;
+	claim_pending_leg(rti, LEFT_SIDE_FRAME);
+	claim_pending_leg(rti, RIGHT_SIDE_FRAME);
+	refresh_fwd_entry(rti, LEFT_SIDE_FRAME);
+	refresh_fwd_entry(rti, RIGHT_SIDE_FRAME);
+	yield_leg(rti, LEFT_SIDE_FRAME);
+	yield_leg(rti, RIGHT_SIDE_FRAME);
+}
+struct RT_Info* find_routeinfo_by_addr_and_callno(struct sockaddr_in *addr, unsigned short scallno, int *flag)
+{
+	struct RT_Fwd_Entry *e = lookup_RtFwdTable(addr->sin_addr.s_addr, addr->sin_port, scallno);
+
+	if (e == NULL || e->state != RT_FWD_ACTIVE)
+		return NULL;
+	*flag = e->side;
+	return e->rti;
+}
+/* Forwarding lookup of the per packet path, also counts the frame against the sender's leg */
+int find_forward_by_addr_and_callno(struct sockaddr_in *addr, unsigned short scallno, size_t len, struct sockaddr_in *peer)
+{
+	struct RT_Fwd_Entry *e = lookup_RtFwdTable(addr->sin_addr.s_addr, addr->sin_port, scallno);
+
+	if (e == NULL)
+		return 0;
+	e->last_active = relay_time();
+	if (e->state != RT_FWD_ACTIVE)
+	{
+		e->stats.drops++;
+		return 0;
+	}
+	e->stats.pkts++;
+	e->stats.bytes += len;
+	memset(peer, 0x00, sizeof(struct sockaddr_in));
+	peer->sin_family = AF_INET;
+	peer->sin_addr.s_addr = e->peer_addr;
+	peer->sin_port = e->peer_port;
+	return 1;
+}
+/* Count a full frame forwarded from one leg, full frames run under the route write lock */
+void count_route_frame(struct RT_Info *rti, int side, size_t len)
+{
+	struct RT_Fwd_Entry *e = route_fwd_entry(rti, side);
+	struct route_counters *c = (e != NULL) ? &e->stats : route_leg_counters(rti, side);
+
+	c->pkts++;
+	c->bytes += len;
+	if (e != NULL)
+		e->last_active = relay_time();
+}
+//Idle timer API
+time_t update_relay_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	__atomic_store_n(&RelayClock, ts.tv_sec, __ATOMIC_RELAXED);
+	return ts.tv_sec;
+}
+time_t relay_time(void)
+{
+	return __atomic_load_n(&RelayClock, __ATOMIC_RELAXED);
+}
+static void unschedule_route(struct RT_Info *rti)
+{
+	struct RT_Signal_Info *sig = rti->sig;
+
+	if (sig->timer_pprev == NULL)
+		return;
+	*sig->timer_pprev = sig->timer_next;
+	if (sig->timer_next != NULL)
+		sig->timer_next->sig->timer_pprev = sig->timer_pprev;
+	sig->timer_next = NULL;
+	sig->timer_pprev = NULL;
+}
+static void schedule_route(struct RT_Info *rti, time_t expire)
+{
+	struct RT_Signal_Info *sig = rti->sig;
+	struct RT_Info **head;
+
+	/* Deadlines past one turn of the wheel are filed in the farthest slot and re-checked there */
+	if (expire <= RtTimerWheel.now)
+		expire = RtTimerWheel.now + 1;
+	else if (expire - RtTimerWheel.now >= ROUTETABLE_WHEEL_SLOTS)
+		expire = RtTimerWheel.now + ROUTETABLE_WHEEL_SLOTS - 1;
+	unschedule_route(rti);
+	head = &RtTimerWheel.slots[expire & (ROUTETABLE_WHEEL_SLOTS - 1)];
+	sig->timer_next = *head;
+	if (*head != NULL)
+		(*head)->sig->timer_pprev = &sig->timer_next;
+	sig->timer_pprev = head;
+	*head = rti;
+}
+static time_t route_last_active(const struct RT_Info *rti)
+{
+	time_t last = rti->update_time;
+	struct RT_Fwd_Entry *e;
+
+	if ((e = route_fwd_entry(rti, LEFT_SIDE_FRAME)) != NULL && e->last_active > last)
+		last = e->last_active;
+	if ((e = route_fwd_entry(rti, RIGHT_SIDE_FRAME)) != NULL && e->last_active > last)
+		last = e->last_active;
+	return last;
+}
+int init_RtTimerWheel(unsigned int timeout)
+{
+	memset(&RtTimerWheel, 0x00, sizeof(RtTimerWheel));
+	RtTimerWheel.timeout = timeout;
+	RtTimerWheel.now = update_relay_clock();
+	return 0;
+}
+/*
+ * Run the wheel up to now.  Traffic only stores a timestamp, so a route is
+ * re-filed at its real deadline when its slot comes round and it turns out
+ * to have been active; an idle one is released right there.
+ */
+void expire_idle_routes(time_t now)
+{
+	time_t tick, last;
+
+	if (now - RtTimerWheel.now > ROUTETABLE_WHEEL_SLOTS)
+		RtTimerWheel.now = now - ROUTETABLE_WHEEL_SLOTS;
+	for(tick = RtTimerWheel.now + 1; tick <= now; tick++)
+	{
+		struct RT_Info **head = &RtTimerWheel.slots[tick & (ROUTETABLE_WHEEL_SLOTS - 1)];
+
+		RtTimerWheel.now = tick;
+		while(*head != NULL)
+		{
+			struct RT_Info *rti = *head;
+
+			unschedule_route(rti);
+			last = route_last_active(rti);
+			if (now - last >= RtTimerWheel.timeout)
 			{
-				RtInfoListArray[scallno] = cur_next;
+				TraceEvent(TRACE_INFO, "Route expired, relaytoken=%s, idle %ds", rti->sig->relaytoken, (int)(now - last));
+				release_route(rti);
 			}
 			else
 			{
-				prev->next = cur_next;
+				schedule_route(rti, last + RtTimerWheel.timeout);
 			}
-			free(cur_rt_info_list);
-			cur_rt_info_list = cur_next;
-		}
-		else
-		{
-			prev = cur_rt_info_list;
-			cur_rt_info_list = cur_rt_info_list->next;
 		}
 	}
 }
+static unsigned int relaytoken_hash(const char *token)
+{
+	/* FNV-1a, the token is a 32 hex chars md5 so every byte carries entropy */
+	unsigned int hash = 2166136261u;
+	while(*token)
+	{
+		hash ^= (unsigned char)*token++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+/* Returns the free or tombstone slot rti belongs in, the caller stores it */
+static struct RT_Info** insert_into_RtTokenTable(struct RT_Info **slots, unsigned int size, const struct RT_Info *rti)
+{
+	unsigned int mask = size - 1;
+	unsigned int idx = rti->tokenhash & mask;
 
-//Mgmt API
-void list_all_detail_route( struct RT_Info *list,  char *resbuf)
+	while(slots[idx] != NULL && slots[idx] != RT_TOKEN_TOMBSTONE)
+		idx = (idx + 1) & mask;
+	return &slots[idx];
+}
+static int resize_RtTokenTable(unsigned int size)
+{
+	struct RT_Info **slots;
+	unsigned int idx;
+
+	slots = (struct RT_Info **)calloc(size, sizeof(struct RT_Info *));
+	if (slots == NULL)
+	{
+		TraceEvent(TRACE_ERROR, "Unable to allocate route token table of %u slots", size);
+		return -1;
+	}
+	for(idx = 0; idx < RtTokenTable.size; idx++)
+	{
+		if (RtTokenTable.slots[idx] != NULL && RtTokenTable.slots[idx] != RT_TOKEN_TOMBSTONE)
+			*insert_into_RtTokenTable(slots, size, RtTokenTable.slots[idx]) = RtTokenTable.slots[idx];
+	}
+	free(RtTokenTable.slots);
+	RtTokenTable.slots = slots;
+	RtTokenTable.size = size;
+	RtTokenTable.deleted = 0;
+	return 0;
+}
+/* Returns the slot index holding rti/token, or -1 */
+static int lookup_RtTokenTable(const char *token, unsigned int hash)
+{
+	unsigned int mask = RtTokenTable.size - 1;
+	unsigned int idx = hash & mask;
+	struct RT_Info *rti;
+
+	while((rti = RtTokenTable.slots[idx]) != NULL)
+	{
+		if (rti != RT_TOKEN_TOMBSTONE && rti->tokenhash == hash && 0 == strcmp(rti->sig->relaytoken, token))
+			return idx;
+		idx = (idx + 1) & mask;
+	}
+	return -1;
+}
+int init_RtTokenTable(unsigned int size)
+{
+	unsigned int pow2 = 16;
+
+	while(pow2 < size)
+		pow2 <<= 1;
+	memset(&RtTokenTable, 0x00, sizeof(RtTokenTable));
+	return resize_RtTokenTable(pow2);
+}
+void clear_RtTokenTable(void)
+{
+	unsigned int idx;
+
+	for(idx = 0; idx < RtTokenTable.size; idx++)
+	{
+		struct RT_Info *rti = RtTokenTable.slots[idx];
+		if (rti != NULL && rti != RT_TOKEN_TOMBSTONE)
+			release_route(rti);
+	}
+	free(RtTokenTable.slots);
+	memset(&RtTokenTable, 0x00, sizeof(RtTokenTable));
+}
+struct RT_Info* find_routeinfo_by_relaytoken(const char *token)
+{
+	int idx = lookup_RtTokenTable(token, relaytoken_hash(token));
+
+	return (idx < 0) ? NULL : RtTokenTable.slots[idx];
+}
+int add_route_to_RtTokenTable(struct RT_Info *rti)
 {
-	int len = 0;
-	while(list != NULL)
+	struct RT_Info **slot;
+
+	rti->tokenhash = relaytoken_hash(rti->sig->relaytoken);
+	/* Keep the load factor (live + tombstones) under 1/2 so probes stay short */
+	if ((RtTokenTable.used + RtTokenTable.deleted + 1) * 2 > RtTokenTable.size)
 	{
-		sprintf(resbuf+len, "RelayToken=[%s],Status=[%d]\n", list->relaytoken, list->status);
-		len = strlen(resbuf);
-		
-		list = list->next;
+		unsigned int size = RtTokenTable.size;
+		if ((RtTokenTable.used + 1) * 4 > size)
+			size <<= 1;
+		if (resize_RtTokenTable(size) < 0)
+			return -1;
 	}
+	slot = insert_into_RtTokenTable(RtTokenTable.slots, RtTokenTable.size, rti);
+	if (*slot == RT_TOKEN_TOMBSTONE)
+		RtTokenTable.deleted--;
+	*slot = rti;
+	RtTokenTable.used++;
+	schedule_route(rti, rti->update_time + RtTimerWheel.timeout);
+	return 0;
 }
-void list_detail_route( struct RT_Info *list,  char *relaytoken, char *resbuf)
+static void del_route_from_RtTokenTable(struct RT_Info *rti)
 {
-	int len = 0;
-	while(list != NULL)
+	int idx = lookup_RtTokenTable(rti->sig->relaytoken, rti->tokenhash);
+
+	if (idx < 0 || RtTokenTable.slots[idx] != rti)
+		return;
+	/* A slot followed by an empty one ends every probe chain, no tombstone needed */
+	if (RtTokenTable.slots[(idx + 1) & (RtTokenTable.size - 1)] == NULL)
 	{
-		if(0 == memcmp(relaytoken, list->relaytoken, strlen(list->relaytoken)))
+		RtTokenTable.slots[idx] = NULL;
+	}
+	else
+	{
+		RtTokenTable.slots[idx] = RT_TOKEN_TOMBSTONE;
+		RtTokenTable.deleted++;
+	}
+	RtTokenTable.used--;
+}
+void release_route(struct RT_Info *rti)
+{
+	TraceEvent(TRACE_INFO, "Release route relaytoken=%s, status=%d", rti->sig->relaytoken, rti->status);
+	unschedule_route(rti);
+	del_route_from_RtTokenTable(rti);
+	del_route_from_RtFwdTable(rti, LEFT_SIDE_FRAME);
+	del_route_from_RtFwdTable(rti, RIGHT_SIDE_FRAME);
+	slab_free(&RtSignalPool, rti->sig);
+	slab_free(&RtInfoPool, rti);
+}
+
+//Mgmt API
+typedef int (*route_format_fn)(struct RT_Info *rti, char *buf, int size);
+
+/*
+ * Format routes from slot *cursor of the token table while whole lines
+ * fit, MGMT_TRAILER_SIZE bytes are left for the caller's cursor line.
+ * *cursor is the slot to resume from, 0 once the table is exhausted.  A
+ * table resize between two pages may repeat or skip some routes.
+ */
+static int page_routes(unsigned int *cursor, char *resbuf, int size, route_format_fn format)
+{
+	unsigned int idx;
+	int len = 0, n;
+
+	size -= MGMT_TRAILER_SIZE;
+	for(idx = *cursor; idx < RtTokenTable.size; idx++)
+	{
+		struct RT_Info *rti = RtTokenTable.slots[idx];
+		if (rti == NULL || rti == RT_TOKEN_TOMBSTONE)
+			continue;
+		n = format(rti, resbuf+len, size-len);
+		if (n < 0 || n >= size-len)
 		{
-			sprintf(resbuf+len, "RelayToken=[%s],Status=[%d]\n", list->relaytoken, list->status);
-			break;
+			resbuf[len] = '\0';
+			if (len == 0)
+				continue;	/* never fits, do not stall the cursor on it */
+			*cursor = idx;
+			return len;
 		}
-		list = list->next;
+		len += n;
 	}
-}
\ No newline at end of file
+	*cursor = 0;
+	return len;
+}
+static int format_route(struct RT_Info *rti, char *buf, int size)
+{
+	return snprintf(buf, size, "RelayToken=[%s],Status=[%d]\n", rti->sig->relaytoken, rti->status);
+}
+static void read_route_counters(const struct RT_Info *rti, int side, struct route_counters *c)
+{
+	struct RT_Fwd_Entry *e = route_fwd_entry(rti, side);
+
+	memcpy(c, route_leg_counters(rti, side), sizeof(*c));
+	if (e != NULL)
+	{
+		c->pkts += e->stats.pkts;
+		c->bytes += e->stats.bytes;
+		c->drops += e->stats.drops;
+	}
+}
+static int format_route_leg(const struct RT_Info *rti, int side, char *buf, int size)
+{
+	const struct sockaddr_in *addr = route_leg_addr(rti, side);
+	struct route_counters c;
+	char ip[INET_ADDRSTRLEN];
+
+	read_route_counters(rti, side, &c);
+	inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+	return snprintf(buf, size, "{\"addr\":\"%s:%d\",\"callno\":%d,\"pkts\":%llu,\"bytes\":%llu,\"drops\":%llu}",
+		ip, ntohs(addr->sin_port), route_leg_callno(rti, side),
+		(unsigned long long)c.pkts, (unsigned long long)c.bytes, (unsigned long long)c.drops);
+}
+static int format_route_stats(struct RT_Info *rti, char *buf, int size)
+{
+	char l_leg[160], r_leg[160];
+
+	format_route_leg(rti, LEFT_SIDE_FRAME, l_leg, sizeof(l_leg));
+	format_route_leg(rti, RIGHT_SIDE_FRAME, r_leg, sizeof(r_leg));
+	return snprintf(buf, size, "{\"token\":\"%s\",\"status\":%d,\"idle\":%ld,\"l\":%s,\"r\":%s}\n",
+		rti->sig->relaytoken, rti->status, (long)(relay_time() - route_last_active(rti)), l_leg, r_leg);
+}
+int list_all_detail_route(unsigned int *cursor, char *resbuf, int size)
+{
+	int len = page_routes(cursor, resbuf, size, format_route);
+
+	if (*cursor)
+		len += snprintf(resbuf+len, size-len, "Next=[%u]\n", *cursor);
+	return len;
+}
+int list_detail_route(char *relaytoken, char *resbuf, int size)
+{
+	struct RT_Info *rti = find_routeinfo_by_relaytoken(relaytoken);
+
+	if (rti == NULL)
+		return 0;
+	return format_route(rti, resbuf, size);
+}
+/* JSON lines, the last line always carries the cursor of the next page */
+int list_route_stats(unsigned int *cursor, char *resbuf, int size)
+{
+	int len = page_routes(cursor, resbuf, size, format_route_stats);
+
+	len += snprintf(resbuf+len, size-len, "{\"next\":%u}\n", *cursor);
+	return len;
+}
+void get_route_usage(struct route_usage *usage)
+{
+	usage->routes = RtTokenTable.used;
+	usage->token_slots = RtTokenTable.size;
+	usage->fwd_entries = RtFwdTable.used;
+	usage->fwd_slots = RtFwdTable.size;
+	usage->pool_bytes = RtInfoPool.in_use * RtInfoPool.obj_size + RtSignalPool.in_use * RtSignalPool.obj_size;
+}
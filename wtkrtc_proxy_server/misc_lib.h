@@ -1,6 +1,9 @@
 #ifndef _misc_lib_h_
 #define _misc_lib_h_
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* recvmmsg/sendmmsg */
+#endif
 #include "define.h"
 
 #include <time.h>
@@ -28,33 +31,108 @@
 #include <getopt.h>
 #include <sys/time.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/epoll.h>
 
+/*
+ * Route record, split by access pattern.  RT_Info holds what signalling
+ * and forwarding state changes touch (one cache line), RT_Signal_Info the
+ * token, usernames and the saved signalling frames replayed to the peer.
+ * Both come from slab pools.
+ */
+/* Traffic received from one leg and forwarded (or dropped) towards the other */
+struct route_counters {
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t drops;
+};
+
+/* Next leg waiting on the forwarding entry another route holds, see RT_Fwd_Entry.pending */
+struct route_pending_link {
+	struct RT_Info *rti;
+	unsigned char side;
+};
+
+struct RT_Signal_Info {
+	char relaytoken[RELAY_TOKEN_SIZE];
+	char l_username[USERNAME_SIZE];
+	char r_username[USERNAME_SIZE];
+
+	int l_pkt_len;
+	uint8_t l_pktbuf[RELAY_SIGBUF_SIZE];
+	int r_pkt_len;
+	uint8_t r_pktbuf[RELAY_SIGBUF_SIZE];
+
+	/* counters folded in from forwarding entries the legs no longer own */
+	struct route_counters l_stats;
+	struct route_counters r_stats;
+
+	/* idle timer wheel slot list */
+	struct RT_Info *timer_next;
+	struct RT_Info **timer_pprev;
+
+	/* pending list links of the two legs, and the allocation order the newest route wins a leg by */
+	struct route_pending_link l_pending;
+	struct route_pending_link r_pending;
+	unsigned int serial;
+};
+
 struct RT_Info {
-	char relaytoken[64];
-	
 	struct sockaddr_in l_ipaddr;
 	struct sockaddr_in r_ipaddr;
 	unsigned short l_callno;
 	unsigned short r_callno;
-	char l_username[USERNAME_SIZE];
-	char r_username[USERNAME_SIZE];
 	unsigned char l_txstatus;
 	unsigned char r_txstatus;
 
 	unsigned char status;
 	unsigned char txstatus;
+	unsigned char fwd_sides;	/* LEFT_SIDE_FRAME/RIGHT_SIDE_FRAME legs present in the forwarding table */
+	unsigned char fwd_pending;	/* legs held by another route with the same addr/callno, on that entry's pending list */
 
-	int l_pkt_len;		
-	uint8_t l_pktbuf[RELAY_PKTBUF_SIZE];
-	int r_pkt_len;		
-	uint8_t r_pktbuf[RELAY_PKTBUF_SIZE];
+	unsigned int tokenhash;
+	time_t update_time;		/* relay clock of the last signalling frame */
+	struct RT_Signal_Info *sig;
+} __attribute__ ((aligned (CACHELINE_SIZE)));
 
-	struct RT_Info* next;
+/* Fixed size object pool, objects are carved from RELAY_SLAB_OBJECTS sized slabs */
+struct slab_pool {
+	size_t obj_size;
+	unsigned int in_use;
+	void *free_list;
+	void *slabs;
 };
-struct RT_Info_List{
-	void *RT_Info;
-	struct RT_Info_List* next;			
+
+/*
+ * Flat forwarding entry keyed on the sender (ip, port, callno).  The peer
+ * address is kept inline so forwarding a frame is one probe and never
+ * touches the RT_Info.  The leg's traffic counters share the cache line,
+ * they are only written by the worker the sender's datagrams hash to.
+ * Other routes with the same leg wait on the pending list, the entry goes
+ * to one of them when the holder lets go.
+ */
+struct RT_Fwd_Entry {
+	uint32_t addr;			/* sender, network order */
+	uint16_t port;			/* sender, network order */
+	uint16_t callno;
+	uint32_t peer_addr;		/* forward destination, network order */
+	uint16_t peer_port;
+	uint8_t side;			/* LEFT_SIDE_FRAME/RIGHT_SIDE_FRAME of the sender */
+	uint8_t state;			/* RT_FWD_EMPTY/RT_FWD_ACTIVE/RT_FWD_IDLE/RT_FWD_DELETED */
+	struct RT_Info *rti;
+	struct route_counters stats;
+	uint32_t last_active;	/* relay clock of the last frame from the sender */
+	uint8_t pending_side;
+	struct RT_Info *pending;	/* first route waiting for the leg, linked through route_pending_link */
+} __attribute__ ((aligned (CACHELINE_SIZE)));
+
+/* Route table occupancy, for capacity reporting */
+struct route_usage {
+	unsigned int routes;
+	unsigned int token_slots;
+	unsigned int fwd_entries;
+	unsigned int fwd_slots;
+	size_t pool_bytes;		/* RT_Info and RT_Signal_Info objects in use */
 };
 
 /* Full frames are always delivered reliably */
@@ -87,7 +165,7 @@ struct ast_iax2_video_hdr {
 } __attribute__ ((__packed__));
 
 struct iax_ies {
-	char relaytoken[64];
+	char relaytoken[RELAY_TOKEN_SIZE];
 	char username[USERNAME_SIZE];
 	unsigned char txreason;
 };
@@ -110,14 +188,42 @@ extern int useSyslog;
 extern int inaddrcmp(const struct sockaddr_in *sin1, const struct sockaddr_in *sin2);
 extern int inonlyaddrcmp(const struct sockaddr_in *sin1, const struct sockaddr_in *sin2);
 extern void TraceEvent(int level, char* file, int line, char* format, ...);
-extern int setup_socket(int port, char* ipaddr, int bind_any);
+extern int init_trace_logger(void);
+extern int setup_socket(int port, char* ipaddr, int bind_any, int reuseport);
 extern int iax_parse_ies(struct iax_ies *ies, unsigned char *data, int datalen);
 extern int modify_txreason_ie(unsigned char *data, int datalen);
 extern int uncompress_subclass(unsigned char csub);
-extern struct RT_Info* find_routeinfo_by_relaytoken(struct RT_Info *list, const char *token);
+extern int init_route_lock(int readers);
+extern void route_read_lock(int reader);
+extern void route_read_unlock(int reader);
+extern void route_write_lock(void);
+extern void route_write_unlock(void);
+extern int slab_pool_init(struct slab_pool *pool, size_t obj_size);
+extern void* slab_alloc(struct slab_pool *pool);
+extern void slab_free(struct slab_pool *pool, void *obj);
+extern void slab_pool_destroy(struct slab_pool *pool);
+extern int init_route_pools(void);
+extern void destroy_route_pools(void);
+extern struct RT_Info* alloc_route(void);
+extern int save_route_frame(struct RT_Info *rti, int side, const uint8_t *buf, size_t len);
+extern int init_RtTokenTable(unsigned int size);
+extern void clear_RtTokenTable(void);
+extern struct RT_Info* find_routeinfo_by_relaytoken(const char *token);
+extern int add_route_to_RtTokenTable(struct RT_Info *rti);
+extern void release_route(struct RT_Info *rti);
+extern time_t update_relay_clock(void);
+extern time_t relay_time(void);
+extern int init_RtTimerWheel(unsigned int timeout);
+extern void expire_idle_routes(time_t now);
+extern int init_RtFwdTable(unsigned int size);
 extern struct RT_Info* find_routeinfo_by_addr_and_callno(struct sockaddr_in *addr, unsigned short scallno, int *flag);
-extern void add_route_to_RtInfoListArray(unsigned short scallno, struct RT_Info *rti);
-extern void del_route_from_RtInfoListArray(struct sockaddr_in *addr, unsigned short scallno);
-extern void list_all_detail_route( struct RT_Info *list,  char *resbuf);
-extern void list_detail_route( struct RT_Info *list,  char *relaytoken, char *resbuf);
+extern int find_forward_by_addr_and_callno(struct sockaddr_in *addr, unsigned short scallno, size_t len, struct sockaddr_in *peer);
+extern void count_route_frame(struct RT_Info *rti, int side, size_t len);
+extern int add_route_to_RtFwdTable(struct RT_Info *rti, int side);
+extern void set_route_addr(struct RT_Info *rti, int side, const struct sockaddr_in *addr);
+extern void set_route_status(struct RT_Info *rti, unsigned char status);
+extern int list_all_detail_route(unsigned int *cursor, char *resbuf, int size);
+extern int list_detail_route(char *relaytoken, char *resbuf, int size);
+extern int list_route_stats(unsigned int *cursor, char *resbuf, int size);
+extern void get_route_usage(struct route_usage *usage);
 #endif
@@ -0,0 +1,283 @@
+#include "uring_lib.h"
+
+#ifdef RELAY_HAVE_URING
+
+/* Receive buffer space handed to the kernel, RELAY_PKT_TAILROOM stays free past the longest datagram */
+#define URING_RECV_LEN	(sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + RELAY_PKTBUF_SIZE - RELAY_PKT_TAILROOM)
+
+//io_uring syscalls, no liburing dependency
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+static int map_rings(struct relay_uring *ur, struct io_uring_params *p)
+{
+	uint8_t *sq, *cq;
+
+	ur->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	ur->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP)
+	{
+		ur->sq_ring_size = MAX(ur->sq_ring_size, ur->cq_ring_size);
+		ur->cq_ring_size = ur->sq_ring_size;
+	}
+	ur->sq_ring = mmap(NULL, ur->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ring == MAP_FAILED)
+	{
+		ur->sq_ring = NULL;
+		return -1;
+	}
+	if (p->features & IORING_FEAT_SINGLE_MMAP)
+	{
+		ur->cq_ring = ur->sq_ring;
+	}
+	else
+	{
+		ur->cq_ring = mmap(NULL, ur->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_CQ_RING);
+		if (ur->cq_ring == MAP_FAILED)
+		{
+			ur->cq_ring = NULL;
+			return -1;
+		}
+	}
+	ur->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED)
+	{
+		ur->sqes = NULL;
+		return -1;
+	}
+
+	sq = (uint8_t *)ur->sq_ring;
+	ur->sq_khead = (unsigned int *)(sq + p->sq_off.head);
+	ur->sq_ktail = (unsigned int *)(sq + p->sq_off.tail);
+	ur->sq_array = (unsigned int *)(sq + p->sq_off.array);
+	ur->sq_mask = *(unsigned int *)(sq + p->sq_off.ring_mask);
+	ur->sq_entries = p->sq_entries;
+	ur->sq_tail = *ur->sq_ktail;
+
+	cq = (uint8_t *)ur->cq_ring;
+	ur->cq_khead = (unsigned int *)(cq + p->cq_off.head);
+	ur->cq_ktail = (unsigned int *)(cq + p->cq_off.tail);
+	ur->cq_mask = *(unsigned int *)(cq + p->cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+	return 0;
+}
+static int setup_buf_ring(struct relay_uring *ur)
+{
+	struct io_uring_buf_reg reg;
+	unsigned int bid;
+
+	if (posix_memalign((void **)&ur->buf_ring, sysconf(_SC_PAGESIZE), RELAY_URING_BUFS * sizeof(struct io_uring_buf)))
+	{
+		ur->buf_ring = NULL;
+		return -1;
+	}
+	memset(ur->buf_ring, 0x00, RELAY_URING_BUFS * sizeof(struct io_uring_buf));
+	ur->bufs = (uint8_t *)malloc(RELAY_URING_BUFS * RELAY_URING_BUF_SIZE);
+	ur->tx = (struct uring_tx *)calloc(RELAY_URING_BUFS, sizeof(struct uring_tx));
+	if (ur->bufs == NULL || ur->tx == NULL)
+		return -1;
+
+	memset(&reg, 0x00, sizeof(reg));
+	reg.ring_addr = (uintptr_t)ur->buf_ring;
+	reg.ring_entries = RELAY_URING_BUFS;
+	reg.bgid = 0;
+	if (sys_io_uring_register(ur->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return -1;
+	for(bid = 0; bid < RELAY_URING_BUFS; bid++)
+		uring_recycle(ur, bid);
+	return 0;
+}
+static struct io_uring_sqe* get_sqe(struct relay_uring *ur)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (ur->sq_tail - __atomic_load_n(ur->sq_khead, __ATOMIC_ACQUIRE) >= ur->sq_entries)
+	{
+		uring_submit(ur);
+		if (ur->sq_tail - __atomic_load_n(ur->sq_khead, __ATOMIC_ACQUIRE) >= ur->sq_entries)
+			return NULL;
+	}
+	idx = ur->sq_tail & ur->sq_mask;
+	sqe = &ur->sqes[idx];
+	memset(sqe, 0x00, sizeof(*sqe));
+	ur->sq_array[idx] = idx;
+	ur->sq_tail++;
+	ur->sq_pending++;
+	return sqe;
+}
+
+//Relay uring API
+struct relay_uring* uring_setup(int sock_fd)
+{
+	struct relay_uring *ur;
+	struct io_uring_params params;
+
+	ur = (struct relay_uring *)calloc(1, sizeof(struct relay_uring));
+	if (ur == NULL)
+		return NULL;
+	ur->sock_fd = sock_fd;
+	ur->cur_bid = -1;
+
+	memset(&params, 0x00, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = RELAY_URING_CQ_ENTRIES;
+	ur->ring_fd = sys_io_uring_setup(RELAY_URING_ENTRIES, &params);
+	if (ur->ring_fd < 0)
+	{
+		TraceEvent(TRACE_WARNING, "io_uring_setup() failed errno %d (%s)", errno, strerror(errno));
+		free(ur);
+		return NULL;
+	}
+	if (map_rings(ur, &params) < 0 || setup_buf_ring(ur) < 0)
+	{
+		TraceEvent(TRACE_WARNING, "io_uring ring/buffer setup failed errno %d (%s)", errno, strerror(errno));
+		uring_destroy(ur);
+		return NULL;
+	}
+	ur->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+	if (uring_arm_recv(ur) < 0 || uring_submit(ur) < 0)
+	{
+		uring_destroy(ur);
+		return NULL;
+	}
+	return ur;
+}
+void uring_destroy(struct relay_uring *ur)
+{
+	if (ur == NULL)
+		return;
+	if (ur->ring_fd >= 0)
+		close(ur->ring_fd);
+	if (ur->sqes != NULL)
+		munmap(ur->sqes, ur->sqes_size);
+	if (ur->cq_ring != NULL && ur->cq_ring != ur->sq_ring)
+		munmap(ur->cq_ring, ur->cq_ring_size);
+	if (ur->sq_ring != NULL)
+		munmap(ur->sq_ring, ur->sq_ring_size);
+	free(ur->buf_ring);
+	free(ur->bufs);
+	free(ur->tx);
+	free(ur);
+}
+/* One multishot recvmsg keeps posting a completion per datagram until it runs out of buffers */
+int uring_arm_recv(struct relay_uring *ur)
+{
+	struct io_uring_sqe *sqe = get_sqe(ur);
+
+	if (sqe == NULL)
+		return -1;
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = ur->sock_fd;
+	sqe->addr = (uintptr_t)&ur->recv_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = (uint64_t)URING_TAG_RECV << 32;
+	ur->recv_armed = 1;
+	return 0;
+}
+int uring_submit(struct relay_uring *ur)
+{
+	int ret;
+
+	if (ur->sq_pending == 0)
+		return 0;
+	__atomic_store_n(ur->sq_ktail, ur->sq_tail, __ATOMIC_RELEASE);
+	do
+	{
+		ret = sys_io_uring_enter(ur->ring_fd, ur->sq_pending, 0, 0);
+	} while(ret < 0 && errno == EINTR);
+	if (ret < 0)
+	{
+		/* EBUSY/EAGAIN: the completion queue is backed up, retried on the next submit */
+		if (errno != EBUSY && errno != EAGAIN)
+			TraceEvent(TRACE_ERROR, "io_uring_enter() failed errno %d (%s)", errno, strerror(errno));
+		return -1;
+	}
+	ur->sq_pending -= ret;
+	return ret;
+}
+struct io_uring_cqe* uring_peek_cqe(struct relay_uring *ur)
+{
+	unsigned int head = *ur->cq_khead;
+
+	if (head == __atomic_load_n(ur->cq_ktail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &ur->cqes[head & ur->cq_mask];
+}
+void uring_cqe_seen(struct relay_uring *ur)
+{
+	__atomic_store_n(ur->cq_khead, *ur->cq_khead + 1, __ATOMIC_RELEASE);
+}
+/* Datagram of a receive completion, NULL if it was truncated */
+uint8_t* uring_recv_payload(struct relay_uring *ur, const struct io_uring_cqe *cqe, struct sockaddr_in *sender, size_t *len)
+{
+	uint8_t *buf = ur->bufs + (cqe->flags >> IORING_CQE_BUFFER_SHIFT) * RELAY_URING_BUF_SIZE;
+	struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+
+	if (cqe->res < (int)(sizeof(*out) + ur->recv_msg.msg_namelen) || (out->flags & MSG_TRUNC))
+		return NULL;
+	memcpy(sender, buf + sizeof(*out), sizeof(struct sockaddr_in));
+	*len = out->payloadlen;
+	return buf + sizeof(*out) + ur->recv_msg.msg_namelen + ur->recv_msg.msg_controllen;
+}
+/*
+ * Queue a send straight out of the receive buffer being processed.  The
+ * buffer goes back to the kernel when the send completes, so at most one
+ * forward per datagram is taken over; -1 lets the caller send it itself.
+ */
+int uring_forward(struct relay_uring *ur, const uint8_t *buf, size_t len, const struct sockaddr_in *peer)
+{
+	const uint8_t *base;
+	struct io_uring_sqe *sqe;
+	struct uring_tx *tx;
+
+	if (ur->cur_bid < 0 || ur->cur_claimed)
+		return -1;
+	base = ur->bufs + ur->cur_bid * RELAY_URING_BUF_SIZE;
+	if (buf < base || buf + len > base + RELAY_URING_BUF_SIZE)
+		return -1;
+	sqe = get_sqe(ur);
+	if (sqe == NULL)
+		return -1;
+	tx = &ur->tx[ur->cur_bid];
+	tx->iov.iov_base = (void *)buf;
+	tx->iov.iov_len = len;
+	memcpy(&tx->addr, peer, sizeof(struct sockaddr_in));
+	tx->msg.msg_name = &tx->addr;
+	tx->msg.msg_namelen = sizeof(struct sockaddr_in);
+	tx->msg.msg_iov = &tx->iov;
+	tx->msg.msg_iovlen = 1;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = ur->sock_fd;
+	sqe->addr = (uintptr_t)&tx->msg;
+	sqe->len = 1;
+	sqe->user_data = ((uint64_t)URING_TAG_SEND << 32) | (unsigned int)ur->cur_bid;
+	ur->cur_claimed = 1;
+	return 0;
+}
+void uring_recycle(struct relay_uring *ur, unsigned short bid)
+{
+	struct io_uring_buf *b = &ur->buf_ring->bufs[ur->buf_tail & (RELAY_URING_BUFS - 1)];
+
+	b->addr = (uintptr_t)(ur->bufs + bid * RELAY_URING_BUF_SIZE);
+	b->len = URING_RECV_LEN;
+	b->bid = bid;
+	ur->buf_tail++;
+	__atomic_store_n(&ur->buf_ring->tail, ur->buf_tail, __ATOMIC_RELEASE);
+}
+
+#endif
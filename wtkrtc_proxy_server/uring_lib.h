@@ -0,0 +1,84 @@
+#ifndef _uring_lib_h_
+#define _uring_lib_h_
+
+#include "misc_lib.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+/* Built unless `make URING=0`, or the kernel headers predate io_uring */
+#if !defined(RELAY_NO_URING) && defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define RELAY_HAVE_URING	1
+#endif
+#endif
+
+struct relay_uring;
+
+#ifdef RELAY_HAVE_URING
+
+#define URING_TAG_RECV		1
+#define URING_TAG_SEND		2
+#define URING_TAG(data)		((unsigned int)((data) >> 32))
+#define URING_BID(data)		((unsigned short)(data))
+
+/* Send state of one receive buffer, a datagram is forwarded straight out of the buffer it arrived in */
+struct uring_tx {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_in addr;
+};
+
+struct relay_uring {
+	int ring_fd;
+	int sock_fd;
+
+	/* submission queue */
+	unsigned int *sq_khead;
+	unsigned int *sq_ktail;
+	unsigned int *sq_array;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int sq_tail;
+	unsigned int sq_pending;
+	struct io_uring_sqe *sqes;
+
+	/* completion queue */
+	unsigned int *cq_khead;
+	unsigned int *cq_ktail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+
+	/* provided receive buffers, RELAY_URING_BUFS of RELAY_URING_BUF_SIZE */
+	struct io_uring_buf_ring *buf_ring;
+	unsigned short buf_tail;
+	uint8_t *bufs;
+	struct uring_tx *tx;
+
+	/* multishot recvmsg template, only the address is received besides the payload */
+	struct msghdr recv_msg;
+	int recv_armed;
+
+	/* buffer being processed and whether a send took it over */
+	int cur_bid;
+	int cur_claimed;
+};
+
+extern struct relay_uring* uring_setup(int sock_fd);
+extern void uring_destroy(struct relay_uring *ur);
+extern int uring_arm_recv(struct relay_uring *ur);
+extern int uring_submit(struct relay_uring *ur);
+extern struct io_uring_cqe* uring_peek_cqe(struct relay_uring *ur);
+extern void uring_cqe_seen(struct relay_uring *ur);
+extern uint8_t* uring_recv_payload(struct relay_uring *ur, const struct io_uring_cqe *cqe, struct sockaddr_in *sender, size_t *len);
+extern int uring_forward(struct relay_uring *ur, const uint8_t *buf, size_t len, const struct sockaddr_in *peer);
+extern void uring_recycle(struct relay_uring *ur, unsigned short bid);
+
+#endif
+#endif
@@ -1,7 +1,5 @@
 #include "wtk-relay.h"
 
-int epoll_fd = -1;
-
 static const struct option long_options[] = {
 	{ "foreground",      no_argument,       NULL, 'f' },
 	{ "local-port",      required_argument, NULL, 'l' },
@@ -9,6 +7,10 @@ static const struct option long_options[] = {
 	{ "manager-port",    required_argument, NULL, 'p' },
 	{ "manager-ip",      required_argument, NULL, 'm' },		
 	{ "md5key",          required_argument, NULL, 'k' },
+	{ "threads",         required_argument, NULL, 'j' },
+	{ "gso",             no_argument,       NULL, 'g' },
+	{ "idle-timeout",    required_argument, NULL, 't' },
+	{ "uring",           no_argument,       NULL, 'u' },
 	{ "help"   ,         no_argument,       NULL, 'h' },
 	{ "verbose",         no_argument,       NULL, 'v' },
 	{ NULL,              0,                 NULL,  0  }
@@ -22,6 +24,10 @@ static void exit_help(int argc, char * const argv[])
 	fprintf( stderr, "-p <lport>\tSet UDP manager listen port to <mport>\n" );
 	fprintf( stderr, "-m <lip>\tSet UDP manager listen ip to <mip>\n" );    
 	fprintf( stderr, "-k <md5key>\tSet md5 key <md5key>\n" );
+	fprintf( stderr, "-j <threads>\tRun <threads> relay workers, each on its own SO_REUSEPORT socket\n" );
+	fprintf( stderr, "-g        \tUse UDP GSO for runs of forwards to the same peer.\n" );
+	fprintf( stderr, "-u        \tForward through io_uring (multishot recvmsg, provided buffers), epoll if unavailable.\n" );
+	fprintf( stderr, "-t <secs>\tRelease routes without signalling or media for <secs> (default %d)\n", ROUTETABLE_AGING_TIMEOUT );
 	fprintf( stderr, "-f        \tRun in foreground.\n" );
 	fprintf( stderr, "-v        \tIncrease verbosity. Can be used multiple times.\n" );
 	fprintf( stderr, "-h        \tThis help message.\n" );
@@ -38,24 +44,48 @@ static void init_rs_info(rs_info_t *rs_info)
 	
 	memset(rs_info->relay_ip, 0x00, sizeof(rs_info->relay_ip));
 	rs_info->relay_port = RELAY_PORT_DEFAULT;
-	rs_info->relay_fd = -1;
+	rs_info->bind_any = 1;
 	
 	strcpy(rs_info->mgmt_ip, "127.0.0.1");
 	rs_info->mgmt_port = MGMT_PORT_DEFAULT;
 	rs_info->mgmt_fd = -1;
 
-	rs_info->rti = NULL;
+	rs_info->idle_timeout = ROUTETABLE_AGING_TIMEOUT;
+	rs_info->timer_fd = -1;
+
+	rs_info->num_workers = 1;
+	rs_info->workers = NULL;
 }
 static void deinit_rs_info(rs_info_t *rs_info)
 {
-	if(rs_info->relay_fd >= 0)
-		close(rs_info->relay_fd);
-	rs_info->relay_fd = -1;
+	int id;
+
+	for(id = 0; rs_info->workers != NULL && id < rs_info->num_workers; id++)
+	{
+		if(rs_info->workers[id].relay_fd >= 0)
+			close(rs_info->workers[id].relay_fd);
+		if(rs_info->workers[id].epoll_fd >= 0)
+			close(rs_info->workers[id].epoll_fd);
+#ifdef RELAY_HAVE_URING
+		uring_destroy(rs_info->workers[id].uring);
+#endif
+		if(rs_info->workers[id].batch != NULL)
+		{
+			free(rs_info->workers[id].batch->rx_bufs);
+			free(rs_info->workers[id].batch);
+		}
+	}
+	free(rs_info->workers);
+	rs_info->workers = NULL;
 	
 	if(rs_info->mgmt_fd >= 0)
 		close(rs_info->mgmt_fd);
 	rs_info->mgmt_fd = -1;
-	//clear_relay_route_list();
+	if(rs_info->timer_fd >= 0)
+		close(rs_info->timer_fd);
+	rs_info->timer_fd = -1;
+	clear_RtTokenTable();
+	destroy_route_pools();
 }
 /*
 //TODO:Verify TXCNT, TXREQ
@@ -66,439 +96,836 @@ if (data_validity_check(ies.relaytoken,rs_info->md5key))
 }
 */
 
-static int process_udp(rs_info_t* rs_info,struct sockaddr_in* sender_sock,uint8_t* udp_buf,size_t udp_size)
+#ifdef UDP_SEGMENT
+/* Coalesce runs of equal sized datagrams to the same peer into one UDP GSO send */
+static int build_gso_msgs(struct relay_batch *batch)
+{
+	int i = 0, msgs = 0;
+
+	while(i < batch->tx_count)
+	{
+		struct msghdr *hdr = &batch->tx_msgs[msgs].msg_hdr;
+		size_t seg = batch->tx_iovs[i].iov_len;
+		size_t total = seg;
+		int j = i + 1;
+
+		while(j < batch->tx_count && j - i < RELAY_GSO_MAX_SEGS
+			&& !inaddrcmp(&batch->tx_addrs[j], &batch->tx_addrs[i])
+			&& batch->tx_iovs[j].iov_len <= seg
+			&& total + batch->tx_iovs[j].iov_len <= RELAY_GSO_MAX_BYTES)
+		{
+			total += batch->tx_iovs[j].iov_len;
+			/* only the last segment may be shorter */
+			if (batch->tx_iovs[j++].iov_len < seg)
+				break;
+		}
+		memset(hdr, 0x00, sizeof(*hdr));
+		hdr->msg_name = &batch->tx_addrs[i];
+		hdr->msg_namelen = sizeof(struct sockaddr_in);
+		hdr->msg_iov = &batch->tx_iovs[i];
+		hdr->msg_iovlen = j - i;
+		if (j - i > 1)
+		{
+			struct cmsghdr *cm;
+
+			hdr->msg_control = batch->tx_cmsgs[msgs];
+			hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+			cm = CMSG_FIRSTHDR(hdr);
+			cm->cmsg_level = IPPROTO_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*(uint16_t *)CMSG_DATA(cm) = seg;
+		}
+		msgs++;
+		i = j;
+	}
+	return msgs;
+}
+#endif
+static int build_tx_msgs(struct relay_batch *batch)
+{
+	int i;
+
+	for(i = 0; i < batch->tx_count; i++)
+	{
+		struct msghdr *hdr = &batch->tx_msgs[i].msg_hdr;
+
+		hdr->msg_name = &batch->tx_addrs[i];
+		hdr->msg_namelen = sizeof(struct sockaddr_in);
+		hdr->msg_iov = &batch->tx_iovs[i];
+		hdr->msg_iovlen = 1;
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		hdr->msg_flags = 0;
+	}
+	return batch->tx_count;
+}
+static void flush_forward_batch(relay_worker_t* worker)
+{
+	struct relay_batch *batch = worker->batch;
+	int msgs = 0;
+	int sent = 0, n;
+
+#ifdef RELAY_HAVE_URING
+	if (worker->uring != NULL)
+	{
+		uring_submit(worker->uring);
+		return;
+	}
+#endif
+	if (batch->tx_count == 0)
+		return;
+#ifdef UDP_SEGMENT
+	if (worker->rs_info->gso)
+		msgs = build_gso_msgs(batch);
+	else
+#endif
+		msgs = build_tx_msgs(batch);
+	while(sent < msgs)
+	{
+		n = sendmmsg(worker->relay_fd, &batch->tx_msgs[sent], msgs - sent, 0);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			/* skip the datagram the kernel refused and carry on with the rest */
+			worker->stats.tx_errors++;
+			TraceEvent( TRACE_WARNING, "sendmmsg() failed to '%s:%d' errno %d (%s)", inet_ntoa(((struct sockaddr_in *)batch->tx_msgs[sent].msg_hdr.msg_name)->sin_addr), ntohs(((struct sockaddr_in *)batch->tx_msgs[sent].msg_hdr.msg_name)->sin_port), errno, strerror(errno));
+			n = 1;
+		}
+		sent += n;
+	}
+	batch->tx_count = 0;
+}
+static void queue_forward(relay_worker_t* worker, uint8_t *buf, size_t len, const struct sockaddr_in *peer)
+{
+	struct relay_batch *batch = worker->batch;
+
+#ifdef RELAY_HAVE_URING
+	if (worker->uring != NULL)
+	{
+		/* sent out of the receive buffer, or right away if the ring can not take it */
+		if (uring_forward(worker->uring, buf, len, peer) < 0
+			&& sendto(worker->relay_fd, buf, len, 0, (const struct sockaddr*)peer, sizeof(struct sockaddr_in)) < 0)
+		{
+			worker->stats.tx_errors++;
+			return;
+		}
+		worker->stats.tx_pkts++;
+		worker->stats.tx_bytes += len;
+		return;
+	}
+#endif
+	if (batch->tx_count == RELAY_BATCH_SIZE)
+		flush_forward_batch(worker);
+	batch->tx_iovs[batch->tx_count].iov_base = buf;
+	batch->tx_iovs[batch->tx_count].iov_len = len;
+	memcpy(&batch->tx_addrs[batch->tx_count], peer, sizeof(struct sockaddr_in));
+	batch->tx_count++;
+	worker->stats.tx_pkts++;
+	worker->stats.tx_bytes += len;
+}
+/*
+ * Signalling replies are sent right away, after whatever the batch has
+ * queued so far so frames keep their order towards a peer.
+ */
+static void relay_sendto(relay_worker_t* worker, const void *buf, size_t len, const struct sockaddr_in *peer)
+{
+	flush_forward_batch(worker);
+	if (sendto(worker->relay_fd, buf, len, 0, (const struct sockaddr*)peer, sizeof(struct sockaddr_in)) < 0)
+	{
+		worker->stats.tx_errors++;
+		return;
+	}
+	worker->stats.tx_pkts++;
+	worker->stats.tx_bytes += len;
+}
+static int process_full_frame(relay_worker_t* worker,struct sockaddr_in* sender_sock,uint8_t* udp_buf,size_t udp_size)
 {
 	int flag=0;
 	int res = udp_size;
 
 	struct iax_ies ies;
-	struct ast_iax2_full_hdr *fh = NULL;
-	struct ast_iax2_mini_hdr *mh = NULL;
-	struct ast_iax2_video_hdr *vh = NULL;
+	struct ast_iax2_full_hdr *fh = (struct ast_iax2_full_hdr *) udp_buf;
 	struct RT_Info *scan = NULL;
 
-	fh = (struct ast_iax2_full_hdr *) udp_buf;
-	mh = (struct ast_iax2_mini_hdr *) udp_buf;
-	vh = (struct ast_iax2_video_hdr *) udp_buf;
-
-	if (res < sizeof(*mh)) {
-		TraceEvent( TRACE_WARNING, "Too small packet received (%d of %d min), packet from '%s:%d'", res, sizeof(struct ast_iax2_mini_hdr), inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+	if (res < sizeof(*fh)) {
+		TraceEvent( TRACE_WARNING, "Rejecting packet from '%s:%d' that is flagged as a full frame but is too short", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
 		return -1;
 	}
-	/*video frame return immediately after deal*/
-	if ((vh->zeros == 0) && (ntohs(vh->callno) & 0x8000))
+	int subclass = -1;
+	if ( fh->type == AST_FRAME_VIDEO) 
 	{
-		if (res < sizeof(*vh)) {
-			TraceEvent( TRACE_WARNING, "Rejecting packet from '%s.%d' that is flagged as a video frame but is too short", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-			return 1;
-		}
-		scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(vh->callno) & ~0x8000,  &flag);
-		if (NULL != scan)
+		subclass = uncompress_subclass(fh->csub & ~0x40) | ((fh->csub >> 6) & 0x1);
+	} else {
+		subclass = uncompress_subclass(fh->csub);
+	}
+	
+	if((subclass == IAX_COMMAND_TXCNT)&&(fh->type == AST_FRAME_IAX))
+	{
+		if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
 		{
-			if (flag == LEFT_SIDE_FRAME)
-			{
-				sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
-			}
-			else
-			{
-				sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-			}
+			TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
 		}
-		else
+		if (strlen(ies.relaytoken)==0)
 		{
-			TraceEvent( TRACE_INFO, "Routing table is not established, Discard Mini Video Frame, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-		}
-	}
-	//Full Frame
-	if (ntohs(fh->scallno) & IAX_FLAG_FULL) 
-	{
-		if (res < sizeof(*fh)) {
-			TraceEvent( TRACE_WARNING, "Rejecting packet from '%s:%d' that is flagged as a full frame but is too short", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			TraceEvent( TRACE_WARNING, "ies.RelayToken is empty, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
 			return -1;
 		}
-		int subclass = -1;
-		if ( fh->type == AST_FRAME_VIDEO) 
+		if (udp_size > RELAY_SIGBUF_SIZE - RELAY_PKT_TAILROOM)
 		{
-			subclass = uncompress_subclass(fh->csub & ~0x40) | ((fh->csub >> 6) & 0x1);
-		} else {
-			subclass = uncompress_subclass(fh->csub);
+			TraceEvent( TRACE_WARNING, "Signalling frame too large (%d bytes), packet from '%s:%d'", (int)udp_size, inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
 		}
-		
-		if((subclass == IAX_COMMAND_TXCNT)&&(fh->type == AST_FRAME_IAX))
+		scan = find_routeinfo_by_relaytoken(ies.relaytoken);
+		if ( NULL == scan )
 		{
-			if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
+			TraceEvent( TRACE_INFO, "Can not find route ies.relaytoken=%s, begin create", ies.relaytoken);
+			scan = alloc_route();
+			if (NULL == scan)
 			{
-				TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+				TraceEvent( TRACE_ERROR, "Unable to allocate route, ies.relaytoken=%s", ies.relaytoken);
 				return -1;
 			}
-			if (strlen(ies.relaytoken)==0)
+			memcpy(scan->sig->relaytoken, ies.relaytoken, strlen(ies.relaytoken));
+			memcpy(scan->sig->l_username, ies.username, strlen(ies.username));
+			memcpy(&(scan->l_ipaddr), sender_sock, sizeof(struct sockaddr_in));
+			scan->l_callno = ntohs(fh->scallno) & ~0x8000;
+			scan->status = ROUTETABLE_SETTING;
+			save_route_frame(scan, LEFT_SIDE_FRAME, udp_buf, udp_size);
+			scan->update_time = relay_time();
+			if (add_route_to_RtTokenTable(scan) < 0)
 			{
-				TraceEvent( TRACE_WARNING, "ies.RelayToken is empty, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+				release_route(scan);
 				return -1;
 			}
-			scan = find_routeinfo_by_relaytoken(rs_info->rti, ies.relaytoken);
-			if ( NULL == scan )
+
+			if (add_route_to_RtFwdTable(scan, LEFT_SIDE_FRAME) < 0)
 			{
-				TraceEvent( TRACE_INFO, "Can not find route ies.relaytoken=%s, begin create", ies.relaytoken);
-				scan = (struct RT_Info*)calloc(1, sizeof(struct RT_Info));
-				memcpy(scan->relaytoken, ies.relaytoken, strlen(ies.relaytoken));
-				memcpy(scan->l_username, ies.username, strlen(ies.username));
-				memcpy(&(scan->l_ipaddr), sender_sock, sizeof(struct sockaddr_in));
-				scan->l_callno = ntohs(fh->scallno) & ~0x8000;
-				scan->status = ROUTETABLE_SETTING;
-				memcpy(scan->l_pktbuf, udp_buf, udp_size); 
-				scan->l_pkt_len = udp_size;
-				rs_info->rti = scan;
-
-				add_route_to_RtInfoListArray(scan->l_callno, scan);
+				release_route(scan);
+				return -1;
 			}
-			else
+		}
+		else
+		{
+			scan->update_time = relay_time();
+			if ((scan->status == ROUTETABLE_SETTING)&&(scan->l_callno == (ntohs(fh->scallno) & ~0x8000)))
 			{
-				if ((scan->status == ROUTETABLE_SETTING)&&(scan->l_callno == (ntohs(fh->scallno) & ~0x8000)))
+				if(inaddrcmp(&scan->l_ipaddr, sender_sock))
 				{
-					if(inaddrcmp(&scan->l_ipaddr, sender_sock))
-					{
-						TraceEvent( TRACE_INFO, "Frame update, l_ipaddr change to [%s:%d]", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-						memcpy(&(scan->l_ipaddr), sender_sock, sizeof(struct sockaddr_in));
-						memcpy(scan->l_pktbuf, udp_buf, udp_size); 
-						scan->l_pkt_len = udp_size;
-					}
-					else
-					{
-						TraceEvent( TRACE_INFO, "Frame retransmissions, ies.relaytoken=%s", ies.relaytoken);
-						memcpy(scan->l_pktbuf, udp_buf, udp_size);
-						scan->l_pkt_len = udp_size;
-					}
+					TraceEvent( TRACE_INFO, "Frame update, l_ipaddr change to [%s:%d]", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+					set_route_addr(scan, LEFT_SIDE_FRAME, sender_sock);
+					save_route_frame(scan, LEFT_SIDE_FRAME, udp_buf, udp_size);
 				}
-				else if((scan->status == ROUTETABLE_SETTING)&&(scan->l_callno != (ntohs(fh->scallno) & ~0x8000)))
+				else
 				{
-					TraceEvent( TRACE_INFO, "Other leg frame transmissions, ies.relaytoken=%s", ies.relaytoken);
-					scan->r_callno = ntohs(fh->scallno) & ~0x8000;
-					memcpy(&(scan->r_ipaddr), sender_sock, sizeof(struct sockaddr_in));
-					memcpy(scan->r_username, ies.username, strlen(ies.username));
-					scan->status = ROUTETABLE_SETTED;
+					TraceEvent( TRACE_INFO, "Frame retransmissions, ies.relaytoken=%s", ies.relaytoken);
+					save_route_frame(scan, LEFT_SIDE_FRAME, udp_buf, udp_size);
+				}
+			}
+			else if((scan->status == ROUTETABLE_SETTING)&&(scan->l_callno != (ntohs(fh->scallno) & ~0x8000)))
+			{
+				TraceEvent( TRACE_INFO, "Other leg frame transmissions, ies.relaytoken=%s", ies.relaytoken);
+				scan->r_callno = ntohs(fh->scallno) & ~0x8000;
+				set_route_addr(scan, RIGHT_SIDE_FRAME, sender_sock);
+				memcpy(scan->sig->r_username, ies.username, strlen(ies.username));
+				set_route_status(scan, ROUTETABLE_SETTED);
 
-					sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-					sendto(rs_info->relay_fd, scan->l_pktbuf, scan->l_pkt_len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
+				relay_sendto(worker, udp_buf, udp_size, &(scan->l_ipaddr));
+				relay_sendto(worker, scan->sig->l_pktbuf, scan->sig->l_pkt_len, &(scan->r_ipaddr));
 
-					add_route_to_RtInfoListArray(scan->r_callno, scan);
-					
-					TraceEvent( TRACE_INFO, "Route table create success, ies.relaytoken = %s", ies.relaytoken);
+				add_route_to_RtFwdTable(scan, RIGHT_SIDE_FRAME);
+				
+				TraceEvent( TRACE_INFO, "Route table create success, ies.relaytoken = %s", ies.relaytoken);
 
-					return 0;
-				}
+				return 0;
 			}
 		}
-		else if((subclass == IAX_COMMAND_HEARTBEAT)&&(fh->type == AST_FRAME_IAX))
+	}
+	else if((subclass == IAX_COMMAND_HEARTBEAT)&&(fh->type == AST_FRAME_IAX))
+	{
+		if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
 		{
-			if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
-			{
-				TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-				return -1;
-			}
-			if (strlen(ies.relaytoken)==0)
-			{
-				TraceEvent( TRACE_WARNING, "ies.RelayToken is empty, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-				return -1;
-			}
-			scan = find_routeinfo_by_relaytoken(rs_info->rti, ies.relaytoken);
-			if ( NULL == scan )
-			{
-				TraceEvent( TRACE_INFO, "Can not find route ies.relaytoken=%s, so return IAX_COMMAND_HEARTBEAT", ies.relaytoken);
-			}
-			else
+			TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
+		}
+		if (strlen(ies.relaytoken)==0)
+		{
+			TraceEvent( TRACE_WARNING, "ies.RelayToken is empty, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
+		}
+		if (udp_size > RELAY_SIGBUF_SIZE - RELAY_PKT_TAILROOM)
+		{
+			TraceEvent( TRACE_WARNING, "Signalling frame too large (%d bytes), packet from '%s:%d'", (int)udp_size, inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
+		}
+		scan = find_routeinfo_by_relaytoken(ies.relaytoken);
+		if ( NULL == scan )
+		{
+			TraceEvent( TRACE_INFO, "Can not find route ies.relaytoken=%s, so return IAX_COMMAND_HEARTBEAT", ies.relaytoken);
+		}
+		else
+		{
+			scan->update_time = relay_time();
+			scan->txstatus = 0;
+			if ((scan->status >= ROUTETABLE_SETTED)||(scan->status <= ROUTETABLE_RELEASING))
 			{
-				scan->txstatus = 0;
-				if ((scan->status >= ROUTETABLE_SETTED)||(scan->status <= ROUTETABLE_RELEASING))
+				int len = 0;
+				
+				if (scan->l_callno == (ntohs(fh->scallno) & ~0x8000))
 				{
-					int len = 0;
-					
-					if (scan->l_callno == (ntohs(fh->scallno) & ~0x8000))
+					if(inaddrcmp(&scan->l_ipaddr, sender_sock))
 					{
-						if(inaddrcmp(&scan->l_ipaddr, sender_sock))
+						set_route_addr(scan, LEFT_SIDE_FRAME, sender_sock);
+						
+						if(scan->status == ROUTETABLE_SETTED || scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
 						{
-							memcpy(&(scan->l_ipaddr), sender_sock, sizeof(struct sockaddr_in));
+							int l_len = scan->sig->l_pkt_len;
+							scan->sig->l_pktbuf[l_len] = IAX_IE_TXEVENT;
+							scan->sig->l_pktbuf[l_len+1] = 1;
+							scan->sig->l_pktbuf[l_len+2] = TX_STATUS_EVENT_RS;    	  							
+							l_len = l_len + 3;
+							
+							relay_sendto(worker, scan->sig->l_pktbuf, l_len, &(scan->r_ipaddr));
 							
-							if(scan->status == ROUTETABLE_SETTED || scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
-							{
-								int l_len = scan->l_pkt_len;
-								scan->l_pktbuf[l_len] = IAX_IE_TXEVENT;
-								scan->l_pktbuf[l_len+1] = 1;
-								scan->l_pktbuf[l_len+2] = TX_STATUS_EVENT_RS;    	  							
-								l_len = l_len + 3;
-								
-								sendto(rs_info->relay_fd, scan->l_pktbuf, l_len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
-								
-								int r_len = scan->r_pkt_len;
-								scan->r_pktbuf[r_len] = IAX_IE_TXEVENT;
-								scan->r_pktbuf[r_len+1] = 1;
-								scan->r_pktbuf[r_len+2] = TX_STATUS_EVENT_RS;    	  							
-								r_len = r_len + 3;
-								sendto(rs_info->relay_fd, scan->r_pktbuf, r_len, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-
-								scan->status = ROUTETABLE_SETTED;
-							}
+							int r_len = scan->sig->r_pkt_len;
+							scan->sig->r_pktbuf[r_len] = IAX_IE_TXEVENT;
+							scan->sig->r_pktbuf[r_len+1] = 1;
+							scan->sig->r_pktbuf[r_len+2] = TX_STATUS_EVENT_RS;    	  							
+							r_len = r_len + 3;
+							relay_sendto(worker, scan->sig->r_pktbuf, r_len, &(scan->l_ipaddr));
+
+							set_route_status(scan, ROUTETABLE_SETTED);
 						}
-						else
+					}
+					else
+					{
+						udp_buf[udp_size] = IAX_IE_APPARENT_ADDR;
+						udp_buf[udp_size+1] = (int)sizeof(struct sockaddr_in);
+						memcpy(udp_buf+udp_size+2, sender_sock, (int)sizeof(struct sockaddr_in));
+						len = udp_size+2+(int)sizeof(struct sockaddr_in);
+						
+						udp_buf[len] = IAX_IE_TXEVENT;
+						udp_buf[len+1] = 1;
+						if(scan->status == ROUTETABLE_SETTED)
 						{
-							udp_buf[udp_size] = IAX_IE_APPARENT_ADDR;
-							udp_buf[udp_size+1] = (int)sizeof(struct sockaddr_in);
-							memcpy(udp_buf+udp_size+2, sender_sock, (int)sizeof(struct sockaddr_in));
-							len = udp_size+2+(int)sizeof(struct sockaddr_in);
-							
-							udp_buf[len] = IAX_IE_TXEVENT;
-							udp_buf[len+1] = 1;
-							if(scan->status == ROUTETABLE_SETTED)
-							{
-								if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
-									udp_buf[len+2] = TX_STATUS_EVENT_INIT_NAT;
-								else
-									udp_buf[len+2] = TX_STATUS_EVENT_INIT_P2P;
-							}
-							else if (scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
-							{
-								udp_buf[len+2] = TX_STATUS_EVENT_NONE;
-							}
-							len = len + 3;
+							if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
+								udp_buf[len+2] = TX_STATUS_EVENT_INIT_NAT;
+							else
+								udp_buf[len+2] = TX_STATUS_EVENT_INIT_P2P;
+						}
+						else if (scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
+						{
+							udp_buf[len+2] = TX_STATUS_EVENT_NONE;
+						}
+						len = len + 3;
+						
+						save_route_frame(scan, LEFT_SIDE_FRAME, udp_buf, udp_size);
+						
+						relay_sendto(worker, udp_buf, len, &(scan->r_ipaddr));
+					}
+				}
+				else
+				{
+					if (inaddrcmp(&scan->r_ipaddr, sender_sock))
+					{
+						set_route_addr(scan, RIGHT_SIDE_FRAME, sender_sock);
+						
+						if(scan->status == ROUTETABLE_SETTED || scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
+						{
+							int l_len = scan->sig->l_pkt_len;
+							scan->sig->l_pktbuf[l_len] = IAX_IE_TXEVENT;
+							scan->sig->l_pktbuf[l_len+1] = 1;
+							scan->sig->l_pktbuf[l_len+2] = TX_STATUS_EVENT_RS;    	  							
+							l_len = l_len + 3;
 							
-							memcpy(scan->l_pktbuf, udp_buf, udp_size);
-							scan->l_pkt_len = udp_size;
+							relay_sendto(worker, scan->sig->l_pktbuf, l_len, &(scan->r_ipaddr));
 							
-							sendto(rs_info->relay_fd, udp_buf, len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
+							int r_len = scan->sig->r_pkt_len;
+							scan->sig->r_pktbuf[r_len] = IAX_IE_TXEVENT;
+							scan->sig->r_pktbuf[r_len+1] = 1;
+							scan->sig->r_pktbuf[r_len+2] = TX_STATUS_EVENT_RS;    	  							
+							r_len = r_len + 3;
+							relay_sendto(worker, scan->sig->r_pktbuf, r_len, &(scan->l_ipaddr));
+
+							set_route_status(scan, ROUTETABLE_SETTED);
 						}
 					}
 					else
 					{
-						if (inaddrcmp(&scan->r_ipaddr, sender_sock))
+						udp_buf[udp_size] = IAX_IE_APPARENT_ADDR;
+						udp_buf[udp_size+1] = (int)sizeof(struct sockaddr_in);
+						memcpy(udp_buf+udp_size+2, sender_sock, (int)sizeof(struct sockaddr_in));
+						len = udp_size+2+(int)sizeof(struct sockaddr_in);
+						udp_buf[len] = IAX_IE_TXEVENT;
+						udp_buf[len+1] = 1;
+						if(scan->status == ROUTETABLE_SETTED)
 						{
-							memcpy(&(scan->r_ipaddr), sender_sock, sizeof(struct sockaddr_in));
-							
-							if(scan->status == ROUTETABLE_SETTED || scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
-							{
-								int l_len = scan->l_pkt_len;
-								scan->l_pktbuf[l_len] = IAX_IE_TXEVENT;
-								scan->l_pktbuf[l_len+1] = 1;
-								scan->l_pktbuf[l_len+2] = TX_STATUS_EVENT_RS;    	  							
-								l_len = l_len + 3;
-								
-								sendto(rs_info->relay_fd, scan->l_pktbuf, l_len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
-								
-								int r_len = scan->r_pkt_len;
-								scan->r_pktbuf[r_len] = IAX_IE_TXEVENT;
-								scan->r_pktbuf[r_len+1] = 1;
-								scan->r_pktbuf[r_len+2] = TX_STATUS_EVENT_RS;    	  							
-								r_len = r_len + 3;
-								sendto(rs_info->relay_fd, scan->r_pktbuf, r_len, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-
-								scan->status = ROUTETABLE_SETTED;
-							}
+							if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
+								udp_buf[len+2] = TX_STATUS_EVENT_INIT_NAT;
+							else
+								udp_buf[len+2] = TX_STATUS_EVENT_INIT_P2P;
 						}
-						else
+						else if (scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
 						{
-							udp_buf[udp_size] = IAX_IE_APPARENT_ADDR;
-							udp_buf[udp_size+1] = (int)sizeof(struct sockaddr_in);
-							memcpy(udp_buf+udp_size+2, sender_sock, (int)sizeof(struct sockaddr_in));
-							len = udp_size+2+(int)sizeof(struct sockaddr_in);
-							udp_buf[len] = IAX_IE_TXEVENT;
-							udp_buf[len+1] = 1;
-							if(scan->status == ROUTETABLE_SETTED)
-							{
-								if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
-									udp_buf[len+2] = TX_STATUS_EVENT_INIT_NAT;
-								else
-									udp_buf[len+2] = TX_STATUS_EVENT_INIT_P2P;
-							}
-							else if (scan->status == ROUTETABLE_NATTED || scan->status == ROUTETABLE_P2PED)
-							{
-								udp_buf[len+2] = TX_STATUS_EVENT_NONE;
-							}
-							len = len + 3;
-
-							memcpy(scan->r_pktbuf, udp_buf, udp_size);
-							scan->r_pkt_len = udp_size;
-							
-							sendto(rs_info->relay_fd, udp_buf, len, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
+							udp_buf[len+2] = TX_STATUS_EVENT_NONE;
 						}
+						len = len + 3;
+
+						save_route_frame(scan, RIGHT_SIDE_FRAME, udp_buf, udp_size);
+						
+						relay_sendto(worker, udp_buf, len, &(scan->l_ipaddr));
 					}
-					return 0;
 				}
+				return 0;
 			}
 		}
-		else if((subclass == IAX_COMMAND_TXREADY)&&(fh->type == AST_FRAME_IAX))
+	}
+	else if((subclass == IAX_COMMAND_TXREADY)&&(fh->type == AST_FRAME_IAX))
+	{
+		if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
 		{
-			if(iax_parse_ies(&ies, udp_buf + sizeof(*fh), res - sizeof(*fh))) 
-			{
-				TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-				return -1;
-			}
-			scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(fh->scallno) & ~0x8000, &flag);
-			if (NULL != scan)
+			TraceEvent( TRACE_WARNING, "iax_parse_ies is fail, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return -1;
+		}
+		scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(fh->scallno) & ~0x8000, &flag);
+		if (NULL != scan)
+		{
+			scan->update_time = relay_time();
+			if (flag == LEFT_SIDE_FRAME)
 			{
-				if (flag == LEFT_SIDE_FRAME)
+				if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
 				{
-					if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
-					{
-						if(scan->status == ROUTETABLE_SETTED)
-							scan->txstatus |= 1<<0;
-					}
-					else 
-					{
-						if (scan->status == ROUTETABLE_SETTED)
-							scan->txstatus |= 1<<2;
-					}
+					if(scan->status == ROUTETABLE_SETTED)
+						scan->txstatus |= 1<<0;
 				}
-				else
+				else 
 				{
-					if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
-					{
-						if(scan->status == ROUTETABLE_SETTED)
-							scan->txstatus |= 1<<1;
-					}
-					else 
-					{
-						if (scan->status == ROUTETABLE_SETTED)
-							scan->txstatus |= 1<<3;
-					}
-				}
-				TraceEvent( TRACE_INFO, "Full frame IAX_COMMAND_TXREADY, scan->txstatus = %d",scan->txstatus);
-				
-				if(scan->txstatus == 3){
-					int l_len = scan->l_pkt_len;
-					scan->l_pktbuf[l_len] = IAX_IE_TXEVENT;
-					scan->l_pktbuf[l_len+1] = 1;
-					scan->l_pktbuf[l_len+2] = TX_STATUS_EVENT_NAT;    	  							
-					l_len = l_len + 3;
-					
-					sendto(rs_info->relay_fd, scan->l_pktbuf, l_len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
-					
-					int r_len = scan->r_pkt_len;
-					scan->r_pktbuf[r_len] = IAX_IE_TXEVENT;
-					scan->r_pktbuf[r_len+1] = 1;
-					scan->r_pktbuf[r_len+2] = TX_STATUS_EVENT_NAT;    	  							
-					r_len = r_len + 3;
-					sendto(rs_info->relay_fd, scan->r_pktbuf, r_len, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-
-					scan->status = ROUTETABLE_NATTED;
-				}
-				if(scan->txstatus == 12){
-					int l_len = scan->l_pkt_len;
-					scan->l_pktbuf[l_len] = IAX_IE_TXEVENT;
-					scan->l_pktbuf[l_len+1] = 1;
-					scan->l_pktbuf[l_len+2] = TX_STATUS_EVENT_P2P;    	  							
-					l_len = l_len + 3;
-					
-					sendto(rs_info->relay_fd, scan->l_pktbuf, l_len, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
-					
-					int r_len = scan->r_pkt_len;
-					scan->r_pktbuf[r_len] = IAX_IE_TXEVENT;
-					scan->r_pktbuf[r_len+1] = 1;
-					scan->r_pktbuf[r_len+2] = TX_STATUS_EVENT_P2P;    	  							
-					r_len = r_len + 3;
-					sendto(rs_info->relay_fd, scan->r_pktbuf, r_len, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
-
-					scan->status = ROUTETABLE_P2PED;
+					if (scan->status == ROUTETABLE_SETTED)
+						scan->txstatus |= 1<<2;
 				}
 			}
-			
-		}
-		else//TXACC:24/PING:2/PONG:3/ACK:4/HANGUP:5/TXREJ:27
-		{
-			scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(fh->scallno) & ~0x8000, &flag);
-			if (NULL != scan)
+			else
 			{
-				if (flag == LEFT_SIDE_FRAME)
+				if(inonlyaddrcmp(&scan->l_ipaddr, &scan->r_ipaddr))
 				{
-					sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
+					if(scan->status == ROUTETABLE_SETTED)
+						scan->txstatus |= 1<<1;
 				}
-				else
+				else 
 				{
-					sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
+					if (scan->status == ROUTETABLE_SETTED)
+						scan->txstatus |= 1<<3;
 				}
+			}
+			TraceEvent( TRACE_INFO, "Full frame IAX_COMMAND_TXREADY, scan->txstatus = %d",scan->txstatus);
+			
+			if(scan->txstatus == 3){
+				int l_len = scan->sig->l_pkt_len;
+				scan->sig->l_pktbuf[l_len] = IAX_IE_TXEVENT;
+				scan->sig->l_pktbuf[l_len+1] = 1;
+				scan->sig->l_pktbuf[l_len+2] = TX_STATUS_EVENT_NAT;    	  							
+				l_len = l_len + 3;
+				
+				relay_sendto(worker, scan->sig->l_pktbuf, l_len, &(scan->r_ipaddr));
+				
+				int r_len = scan->sig->r_pkt_len;
+				scan->sig->r_pktbuf[r_len] = IAX_IE_TXEVENT;
+				scan->sig->r_pktbuf[r_len+1] = 1;
+				scan->sig->r_pktbuf[r_len+2] = TX_STATUS_EVENT_NAT;    	  							
+				r_len = r_len + 3;
+				relay_sendto(worker, scan->sig->r_pktbuf, r_len, &(scan->l_ipaddr));
 
-				if (fh->type == AST_FRAME_IAX)
-				{
-					if(subclass == IAX_COMMAND_HANGUP)
-					{
-						TraceEvent( TRACE_INFO, "IAX_COMMAND_HANGUP, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-						scan->status = ROUTETABLE_RELEASING;
-						del_route_from_RtInfoListArray(&scan->l_ipaddr, scan->l_callno);
-						del_route_from_RtInfoListArray(&scan->r_ipaddr, scan->r_callno);
-						return 0;
-					}
-					else if(subclass == IAX_COMMAND_TXREJ)
-					{
-						TraceEvent( TRACE_INFO, "IAX_COMMAND_TXREJ, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
-						scan->status = ROUTETABLE_RELEASED;
-						del_route_from_RtInfoListArray(&scan->l_ipaddr, scan->l_callno);
-						del_route_from_RtInfoListArray(&scan->r_ipaddr, scan->r_callno);
-						return 0;
-					}
-				}
+				set_route_status(scan, ROUTETABLE_NATTED);
 			}
-			else
-			{
-				TraceEvent( TRACE_INFO, "Routing table is not established, Discard Full Frame=%d, packet from '%s:%d'", subclass, inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			if(scan->txstatus == 12){
+				int l_len = scan->sig->l_pkt_len;
+				scan->sig->l_pktbuf[l_len] = IAX_IE_TXEVENT;
+				scan->sig->l_pktbuf[l_len+1] = 1;
+				scan->sig->l_pktbuf[l_len+2] = TX_STATUS_EVENT_P2P;    	  							
+				l_len = l_len + 3;
+				
+				relay_sendto(worker, scan->sig->l_pktbuf, l_len, &(scan->r_ipaddr));
+				
+				int r_len = scan->sig->r_pkt_len;
+				scan->sig->r_pktbuf[r_len] = IAX_IE_TXEVENT;
+				scan->sig->r_pktbuf[r_len+1] = 1;
+				scan->sig->r_pktbuf[r_len+2] = TX_STATUS_EVENT_P2P;    	  							
+				r_len = r_len + 3;
+				relay_sendto(worker, scan->sig->r_pktbuf, r_len, &(scan->l_ipaddr));
+
+				set_route_status(scan, ROUTETABLE_P2PED);
 			}
 		}
+		
 	}
-	//Mini Frame
-	else
+	else//TXACC:24/PING:2/PONG:3/ACK:4/HANGUP:5/TXREJ:27
 	{
-		scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(mh->callno) & ~0x8000, &flag);
-		if(scan != NULL)
+		scan = find_routeinfo_by_addr_and_callno(sender_sock, ntohs(fh->scallno) & ~0x8000, &flag);
+		if (NULL != scan)
 		{
-			if(flag == LEFT_SIDE_FRAME)
+			count_route_frame(scan, flag, udp_size);
+			if (flag == LEFT_SIDE_FRAME)
 			{
-				sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->r_ipaddr), sizeof(struct sockaddr_in));
+				queue_forward(worker, udp_buf, udp_size, &(scan->r_ipaddr));
 			}
 			else
 			{
-				sendto(rs_info->relay_fd, udp_buf, udp_size, 0, (struct sockaddr*)&(scan->l_ipaddr), sizeof(struct sockaddr_in));
+				queue_forward(worker, udp_buf, udp_size, &(scan->l_ipaddr));
+			}
+
+			if (fh->type == AST_FRAME_IAX)
+			{
+				if(subclass == IAX_COMMAND_HANGUP)
+				{
+					TraceEvent( TRACE_INFO, "IAX_COMMAND_HANGUP, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+					set_route_status(scan, ROUTETABLE_RELEASING);
+					release_route(scan);
+					return 0;
+				}
+				else if(subclass == IAX_COMMAND_TXREJ)
+				{
+					TraceEvent( TRACE_INFO, "IAX_COMMAND_TXREJ, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+					set_route_status(scan, ROUTETABLE_RELEASED);
+					release_route(scan);
+					return 0;
+				}
 			}
 		}
 		else
 		{
-			TraceEvent( TRACE_DEBUG, "Routing table is not established, Discard Mini Frame, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			worker->stats.drop_noroute++;
+			TraceEvent( TRACE_INFO, "Routing table is not established, Discard Full Frame=%d, packet from '%s:%d'", subclass, inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
 		}
 	}
 	return 0;
 }
-static int process_mgmt(rs_info_t* rs_info,struct sockaddr_in* sender_sock,uint8_t* mgmt_buf,size_t mgmt_size)
+/*
+ * Mini audio and video frames, the per packet hot path: only the worker's
+ * own route reader lock is taken and the send happens outside of it.
+ */
+static void forward_frame(relay_worker_t* worker,struct sockaddr_in* sender_sock,unsigned short callno,uint8_t* udp_buf,size_t udp_size,int video)
+{
+	int found=0;
+	struct sockaddr_in peer;
+
+	route_read_lock(worker->id);
+	found = find_forward_by_addr_and_callno(sender_sock, callno, udp_size, &peer);
+	route_read_unlock(worker->id);
+
+	if (found)
+	{
+		queue_forward(worker, udp_buf, udp_size, &peer);
+		return;
+	}
+	worker->stats.drop_noroute++;
+	if (video)
+	{
+		TraceEvent( TRACE_INFO, "Routing table is not established, Discard Mini Video Frame, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+	}
+	else
+	{
+		TraceEvent( TRACE_DEBUG, "Routing table is not established, Discard Mini Frame, packet from '%s:%d'", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+	}
+}
+static int process_udp(relay_worker_t* worker,struct sockaddr_in* sender_sock,uint8_t* udp_buf,size_t udp_size)
 {
-	struct mgmt_type* type=NULL;
-	char resbuf[RELAY_PKTBUF_SIZE*10];
+	int res = udp_size;
+
+	struct ast_iax2_full_hdr *fh = NULL;
+	struct ast_iax2_mini_hdr *mh = NULL;
+	struct ast_iax2_video_hdr *vh = NULL;
 
-	memset(resbuf, 0x00, sizeof(resbuf));
-	type = (struct mgmt_type *)mgmt_buf;
+	fh = (struct ast_iax2_full_hdr *) udp_buf;
+	mh = (struct ast_iax2_mini_hdr *) udp_buf;
+	vh = (struct ast_iax2_video_hdr *) udp_buf;
+
+	if (res < sizeof(*mh)) {
+		worker->stats.drop_invalid++;
+		TraceEvent( TRACE_WARNING, "Too small packet received (%d of %d min), packet from '%s:%d'", res, sizeof(struct ast_iax2_mini_hdr), inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+		return -1;
+	}
+	/*video frame return immediately after deal*/
+	if ((vh->zeros == 0) && (ntohs(vh->callno) & 0x8000))
+	{
+		if (res < sizeof(*vh)) {
+			worker->stats.drop_invalid++;
+			TraceEvent( TRACE_WARNING, "Rejecting packet from '%s.%d' that is flagged as a video frame but is too short", inet_ntoa(sender_sock->sin_addr), ntohs(sender_sock->sin_port));
+			return 1;
+		}
+		forward_frame(worker, sender_sock, ntohs(vh->callno) & ~0x8000, udp_buf, udp_size, 1);
+		return 0;
+	}
+	//Full Frame
+	if (ntohs(fh->scallno) & IAX_FLAG_FULL) 
+	{
+		worker->stats.ctrl_pkts++;
+		route_write_lock();
+		res = process_full_frame(worker, sender_sock, udp_buf, udp_size);
+		route_write_unlock();
+		if (res < 0)
+			worker->stats.drop_invalid++;
+		return res;
+	}
+	//Mini Frame
+	forward_frame(worker, sender_sock, ntohs(mh->callno) & ~0x8000, udp_buf, udp_size, 0);
+	return 0;
+}
+/* Worker totals exported on the management socket, in struct relay_stats order */
+static const struct relay_metric {
+	const char *name;
+	const char *help;
+	size_t offset;
+} relay_metrics[] = {
+	{ "rx_packets",       "Datagrams received on the relay port.",                   offsetof(struct relay_stats, rx_pkts) },
+	{ "rx_bytes",         "Bytes received on the relay port.",                       offsetof(struct relay_stats, rx_bytes) },
+	{ "tx_packets",       "Datagrams forwarded or sent by the relay.",               offsetof(struct relay_stats, tx_pkts) },
+	{ "tx_bytes",         "Bytes forwarded or sent by the relay.",                   offsetof(struct relay_stats, tx_bytes) },
+	{ "control_frames",   "IAX2 full frames received.",                              offsetof(struct relay_stats, ctrl_pkts) },
+	{ "dropped_noroute",  "Frames dropped for lack of a forwarding route.",          offsetof(struct relay_stats, drop_noroute) },
+	{ "dropped_invalid",  "Frames dropped as too short, unparsable or rejected.",    offsetof(struct relay_stats, drop_invalid) },
+	{ "tx_errors",        "Datagrams the kernel refused to send.",                   offsetof(struct relay_stats, tx_errors) },
+};
+#define RELAY_METRICS	(sizeof(relay_metrics) / sizeof(relay_metrics[0]))
+
+static inline uint64_t relay_metric_value(const struct relay_stats *stats, int metric)
+{
+	return *(const uint64_t *)((const char *)stats + relay_metrics[metric].offset);
+}
+static int format_stats_global(relay_worker_t* worker, char *resbuf, int size)
+{
+	rs_info_t* rs_info = worker->rs_info;
+	struct route_usage usage;
+	int metric, id, len;
+
+	route_read_lock(worker->id);
+	get_route_usage(&usage);
+	route_read_unlock(worker->id);
+
+	len = snprintf(resbuf, size, "{\"workers\":%d,\"routes\":%u,\"route_slots\":%u,\"forward_entries\":%u,\"forward_slots\":%u,\"route_pool_bytes\":%lu",
+		rs_info->num_workers, usage.routes, usage.token_slots, usage.fwd_entries, usage.fwd_slots, (unsigned long)usage.pool_bytes);
+	for(metric = 0; metric < RELAY_METRICS && len < size; metric++)
+	{
+		uint64_t total = 0;
+
+		for(id = 0; id < rs_info->num_workers; id++)
+			total += relay_metric_value(&rs_info->workers[id].stats, metric);
+		len += snprintf(resbuf+len, size-len, ",\"%s\":%llu", relay_metrics[metric].name, (unsigned long long)total);
+	}
+	if (len < size)
+		len += snprintf(resbuf+len, size-len, "}\n");
+	return MIN(len, size - 1);
+}
+static int format_stats_prometheus(relay_worker_t* worker, char *resbuf, int size)
+{
+	rs_info_t* rs_info = worker->rs_info;
+	struct route_usage usage;
+	int metric, id, len;
+
+	route_read_lock(worker->id);
+	get_route_usage(&usage);
+	route_read_unlock(worker->id);
+
+	len = snprintf(resbuf, size,
+		"# HELP wtk_relay_workers Relay worker threads.\n# TYPE wtk_relay_workers gauge\nwtk_relay_workers %d\n"
+		"# HELP wtk_relay_routes Routes in the token table.\n# TYPE wtk_relay_routes gauge\nwtk_relay_routes %u\n"
+		"# HELP wtk_relay_route_slots Token table slots.\n# TYPE wtk_relay_route_slots gauge\nwtk_relay_route_slots %u\n"
+		"# HELP wtk_relay_forward_entries Legs in the forwarding table.\n# TYPE wtk_relay_forward_entries gauge\nwtk_relay_forward_entries %u\n"
+		"# HELP wtk_relay_forward_slots Forwarding table slots.\n# TYPE wtk_relay_forward_slots gauge\nwtk_relay_forward_slots %u\n"
+		"# HELP wtk_relay_route_pool_bytes Route records in use, in bytes.\n# TYPE wtk_relay_route_pool_bytes gauge\nwtk_relay_route_pool_bytes %lu\n",
+		rs_info->num_workers, usage.routes, usage.token_slots, usage.fwd_entries, usage.fwd_slots, (unsigned long)usage.pool_bytes);
+	for(metric = 0; metric < RELAY_METRICS && len < size; metric++)
+	{
+		len += snprintf(resbuf+len, size-len, "# HELP wtk_relay_%s_total %s\n# TYPE wtk_relay_%s_total counter\n",
+			relay_metrics[metric].name, relay_metrics[metric].help, relay_metrics[metric].name);
+		for(id = 0; id < rs_info->num_workers && len < size; id++)
+			len += snprintf(resbuf+len, size-len, "wtk_relay_%s_total{worker=\"%d\"} %llu\n",
+				relay_metrics[metric].name, id, (unsigned long long)relay_metric_value(&rs_info->workers[id].stats, metric));
+	}
+	return MIN(len, size - 1);
+}
+static unsigned int mgmt_cursor(const struct mgmt_type *type)
+{
+	uint32_t cursor;
+
+	memcpy(&cursor, type->value, sizeof(cursor));
+	return ntohl(cursor);
+}
+static int process_mgmt(relay_worker_t* worker,struct sockaddr_in* sender_sock,uint8_t* mgmt_buf,size_t mgmt_size)
+{
+	rs_info_t* rs_info = worker->rs_info;
+	struct mgmt_type mgmt;
+	struct mgmt_type* type=&mgmt;
+	char resbuf[MGMT_RESBUF_SIZE];
+	unsigned int cursor;
+	int len = 0;
+
+	resbuf[0] = '\0';
+	memset(&mgmt, 0x00, sizeof(mgmt));
+	memcpy(&mgmt, mgmt_buf, MIN(mgmt_size, sizeof(mgmt) - 1));
 
 	if(type->type == MGMT_ROUTELIST)
 	{
+		route_read_lock(worker->id);
 		if(type->csub == MGMT_ROUTELIST_ALL)
-			list_all_detail_route( rs_info->rti,  resbuf);
+		{
+			cursor = mgmt_cursor(type);
+			len = list_all_detail_route(&cursor, resbuf, sizeof(resbuf));
+		}
 		else if(type->csub == MGMT_ROUTELIST_CUR)
-			list_detail_route(rs_info->rti, (char *)type->value, resbuf);
+			len = list_detail_route((char *)type->value, resbuf, sizeof(resbuf));
+		route_read_unlock(worker->id);
 	}
 	else if(type->type == MGMT_CONFIG)
 	{
 		if (type->csub==MGMT_CONFIG_TRACELEVEL)
 		{
 			TraceEvent( TRACE_WARNING, "Set log level from %d to %d", traceLevel, type->value[0] & 0xFF);
-			sprintf(resbuf, "Set log level from %d to %d", traceLevel, type->value[0] & 0xFF);
+			len = sprintf(resbuf, "Set log level from %d to %d", traceLevel, type->value[0] & 0xFF);
 			traceLevel = type->value[0] & 0xFF;
 		}
 		else
 			return -1;
 	}
+	else if(type->type == MGMT_STATS)
+	{
+		if (type->csub == MGMT_STATS_GLOBAL)
+			len = format_stats_global(worker, resbuf, sizeof(resbuf));
+		else if (type->csub == MGMT_STATS_ROUTES)
+		{
+			cursor = mgmt_cursor(type);
+			route_read_lock(worker->id);
+			len = list_route_stats(&cursor, resbuf, sizeof(resbuf));
+			route_read_unlock(worker->id);
+		}
+		else if (type->csub == MGMT_STATS_PROMETHEUS)
+			len = format_stats_prometheus(worker, resbuf, sizeof(resbuf));
+		else
+			return -1;
+	}
 	else
 		return -1;
 	
-	sendto(rs_info->mgmt_fd, resbuf, strlen(resbuf), 0, (struct sockaddr *)sender_sock, sizeof(struct sockaddr_in));
+	sendto(rs_info->mgmt_fd, resbuf, len, 0, (struct sockaddr *)sender_sock, sizeof(struct sockaddr_in));
 
 	return 0;
 }
 
-static int run_loop(rs_info_t *rs_info)
+/* Drain the relay socket in recvmmsg batches, forwards of a batch leave in one sendmmsg */
+static void process_relay_batch(relay_worker_t *worker)
+{
+	struct relay_batch *batch = worker->batch;
+	int round, n, i;
+
+	for(round = 0; round < RELAY_BATCH_ROUNDS; round++)
+	{
+		for(i = 0; i < RELAY_BATCH_SIZE; i++)
+		{
+			batch->rx_iovs[i].iov_len = RELAY_PKTBUF_SIZE - RELAY_PKT_TAILROOM;
+			batch->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+		n = recvmmsg(worker->relay_fd, batch->rx_msgs, RELAY_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (n <= 0)
+		{
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				TraceEvent( TRACE_ERROR, "recvmmsg() failed %d errno %d (%s)", n, errno, strerror(errno) );
+			break;
+		}
+		for(i = 0; i < n; i++)
+		{
+			if (batch->rx_msgs[i].msg_len == 0)
+				continue;
+			worker->stats.rx_pkts++;
+			worker->stats.rx_bytes += batch->rx_msgs[i].msg_len;
+			process_udp(worker, &batch->rx_addrs[i], batch->rx_iovs[i].iov_base, batch->rx_msgs[i].msg_len);
+		}
+		flush_forward_batch(worker);
+		if (n < RELAY_BATCH_SIZE)
+			break;
+	}
+}
+#ifdef RELAY_HAVE_URING
+/* The multishot receive could not be armed (kernel without it), go back to reading the socket from epoll */
+static void fallback_to_epoll(relay_worker_t *worker)
+{
+	struct epoll_event ev;
+
+	TraceEvent( TRACE_WARNING, "Worker %d: io_uring receive unsupported, falling back to epoll", worker->id );
+	epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, worker->uring->ring_fd, NULL);
+	uring_destroy(worker->uring);
+	worker->uring = NULL;
+	ev.events = EPOLLIN;
+	ev.data.fd = worker->relay_fd;
+	if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->relay_fd, &ev) < 0) 
+		TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: relay_fd=%d, errno %d (%s)", worker->relay_fd, errno, strerror(errno) );
+}
+/*
+ * Reap the ring: every receive completion is processed in the buffer the
+ * kernel filled, a forward sends from that same buffer and hands it back
+ * once the send completes.  Sends queued here go out in one submit.
+ */
+static void process_uring_completions(relay_worker_t *worker)
+{
+	struct relay_uring *ur = worker->uring;
+	struct io_uring_cqe *cqe;
+	struct sockaddr_in sender_sock;
+	uint8_t *udp_buf;
+	size_t udp_size;
+
+	while((cqe = uring_peek_cqe(ur)) != NULL)
+	{
+		if (URING_TAG(cqe->user_data) == URING_TAG_SEND)
+		{
+			if (cqe->res < 0)
+			{
+				worker->stats.tx_errors++;
+				TraceEvent( TRACE_WARNING, "io_uring sendmsg() failed errno %d (%s)", -cqe->res, strerror(-cqe->res));
+			}
+			uring_recycle(ur, URING_BID(cqe->user_data));
+		}
+		else if (URING_TAG(cqe->user_data) == URING_TAG_RECV)
+		{
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+				ur->recv_armed = 0;
+			if (cqe->flags & IORING_CQE_F_BUFFER)
+			{
+				ur->cur_bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				ur->cur_claimed = 0;
+				udp_buf = (cqe->res >= 0) ? uring_recv_payload(ur, cqe, &sender_sock, &udp_size) : NULL;
+				if (udp_buf != NULL && udp_size > 0)
+				{
+					worker->stats.rx_pkts++;
+					worker->stats.rx_bytes += udp_size;
+					process_udp(worker, &sender_sock, udp_buf, udp_size);
+				}
+				if (!ur->cur_claimed)
+					uring_recycle(ur, ur->cur_bid);
+				ur->cur_bid = -1;
+			}
+			else if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+			{
+				uring_cqe_seen(ur);
+				fallback_to_epoll(worker);
+				return;
+			}
+			else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+			{
+				TraceEvent( TRACE_ERROR, "io_uring recvmsg() failed errno %d (%s)", -cqe->res, strerror(-cqe->res));
+			}
+		}
+		uring_cqe_seen(ur);
+	}
+	/* a multishot receive stops when buffers or completion space ran out */
+	if (!ur->recv_armed)
+		uring_arm_recv(ur);
+	uring_submit(ur);
+}
+#endif
+static void* run_loop(void *arg)
 {
+	relay_worker_t *worker = (relay_worker_t *)arg;
+	rs_info_t *rs_info = worker->rs_info;
 	struct epoll_event events[MAXEPOLLSIZE];
 	int event_fds = -1;
 	int id = 0;
@@ -506,22 +933,40 @@ static int run_loop(rs_info_t *rs_info)
 	socklen_t i;
 	uint8_t pktbuf[RELAY_PKTBUF_SIZE];
 	ssize_t numread; 
+	uint64_t expirations;
 	
-	TraceEvent(TRACE_NORMAL, "Relayserver started");
+	TraceEvent(TRACE_NORMAL, "Relay worker %d started", worker->id);
 
 	while(1)
 	{
-		event_fds = epoll_wait(epoll_fd, events, MAXEPOLLSIZE, -1);
-		if(event_fds <= 0)
+		event_fds = epoll_wait(worker->epoll_fd, events, MAXEPOLLSIZE, RELAY_EPOLL_TIMEOUT);
+		if(event_fds == 0)
+			continue;
+		if(event_fds < 0)
 		{
-			TraceEvent(TRACE_ERROR, "epoll_wait return value=%d(0 == timeout) fail!!!!!", event_fds);
+			/* io_uring task work interrupts the wait, its completions show up on the next one */
+			if (errno != EINTR)
+				TraceEvent(TRACE_ERROR, "epoll_wait return value=%d(0 == timeout) fail!!!!!", event_fds);
 			continue;
 		}
 		for(id=0; id<event_fds; id++)
 		{
 			if(-1 == events[id].data.fd)
 				continue;
-			if(events[id].events & EPOLLIN){ 
+			if(!(events[id].events & EPOLLIN))
+				continue;
+			if (events[id].data.fd == worker->relay_fd)
+			{
+				process_relay_batch(worker);
+			}
+#ifdef RELAY_HAVE_URING
+			else if (worker->uring != NULL && events[id].data.fd == worker->uring->ring_fd)
+			{
+				process_uring_completions(worker);
+			}
+#endif
+			else if (events[id].data.fd == rs_info->mgmt_fd)
+			{
 				i = sizeof(sender_sock);
 				memset(pktbuf, 0x00, sizeof(pktbuf));
 				numread = recvfrom( events[id].data.fd, pktbuf, RELAY_PKTBUF_SIZE, 0/*flags*/, (struct sockaddr *)&sender_sock, (socklen_t*)&i);
@@ -530,29 +975,118 @@ static int run_loop(rs_info_t *rs_info)
 					TraceEvent( TRACE_ERROR, "recvfrom() failed %d errno %d (%s)", numread, errno, strerror(errno) );
 					continue;
 				}
-				if ( numread > 0 )
-				{
-					if (events[id].data.fd == rs_info->relay_fd)
-						process_udp(rs_info, &sender_sock, pktbuf, numread);
-					else if	(events[id].data.fd == rs_info->mgmt_fd)
-						process_mgmt(rs_info, &sender_sock, pktbuf, numread);	
-				}
+				process_mgmt(worker, &sender_sock, pktbuf, numread);
+			}
+			else if (events[id].data.fd == rs_info->timer_fd)
+			{
+				if (read(rs_info->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+					continue;
+				route_write_lock();
+				expire_idle_routes(update_relay_clock());
+				route_write_unlock();
 			}
 		}
 	}
-	deinit_rs_info(rs_info);
-	close(epoll_fd);
+	return NULL;
+}
+static int setup_batch(relay_worker_t *worker)
+{
+	struct relay_batch *batch;
+	int i;
+
+	batch = (struct relay_batch *)calloc(1, sizeof(struct relay_batch));
+	if (batch == NULL)
+		return -1;
+	batch->rx_bufs = (uint8_t *)malloc(RELAY_BATCH_SIZE * RELAY_PKTBUF_SIZE);
+	if (batch->rx_bufs == NULL)
+	{
+		free(batch);
+		return -1;
+	}
+	for(i = 0; i < RELAY_BATCH_SIZE; i++)
+	{
+		batch->rx_iovs[i].iov_base = batch->rx_bufs + i * RELAY_PKTBUF_SIZE;
+		batch->rx_msgs[i].msg_hdr.msg_name = &batch->rx_addrs[i];
+		batch->rx_msgs[i].msg_hdr.msg_iov = &batch->rx_iovs[i];
+		batch->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	worker->batch = batch;
+	return 0;
+}
+static int setup_worker(rs_info_t *rs_info, int id)
+{
+	relay_worker_t *worker = &rs_info->workers[id];
+	struct epoll_event ev;
+
+	worker->id = id;
+	worker->rs_info = rs_info;
+	if (setup_batch(worker) < 0)
+	{
+		TraceEvent( TRACE_ERROR, "Failed to allocate packet batch for worker %d", id );
+		return -2;
+	}
+	worker->relay_fd = setup_socket(rs_info->relay_port, rs_info->relay_ip, rs_info->bind_any, rs_info->num_workers > 1);
+	if ( -1 == worker->relay_fd )
+	{
+		TraceEvent( TRACE_ERROR, "Failed to open Relayserver socket for worker %d. %s", id, strerror(errno) );
+		return -2;
+	}
+
+	worker->epoll_fd = epoll_create(MAXEPOLLSIZE);
+	ev.events = EPOLLIN;
+	ev.data.fd = worker->relay_fd;
+#ifdef RELAY_HAVE_URING
+	/* On the io_uring path the relay socket is read by the ring, epoll only waits for its completions */
+	if (rs_info->uring)
+	{
+		worker->uring = uring_setup(worker->relay_fd);
+		if (worker->uring != NULL)
+			ev.data.fd = worker->uring->ring_fd;
+		else
+			TraceEvent( TRACE_WARNING, "io_uring unavailable for worker %d, using epoll", id );
+	}
+#endif
+	if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) 
+	{
+		TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: fd=%d, errno %d (%s)", ev.data.fd, errno, strerror(errno) );
+		return -3;
+	}
+	/* Worker 0 also serves the management socket and ticks the route idle timer wheel */
+	if (id == 0)
+	{
+		struct itimerspec its = { { 1, 0 }, { 1, 0 } };
+
+		ev.events = EPOLLIN;
+		ev.data.fd = rs_info->mgmt_fd;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, rs_info->mgmt_fd, &ev) < 0) 
+		{
+			TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: rs_info.mgmt_fd=%d, errno %d (%s)", rs_info->mgmt_fd, errno, strerror(errno) );
+			return -3;
+		}
+		rs_info->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (rs_info->timer_fd < 0 || timerfd_settime(rs_info->timer_fd, 0, &its, NULL) < 0)
+		{
+			TraceEvent( TRACE_ERROR, "Failed to arm route idle timer, errno %d (%s)", errno, strerror(errno) );
+			return -3;
+		}
+		ev.events = EPOLLIN;
+		ev.data.fd = rs_info->timer_fd;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, rs_info->timer_fd, &ev) < 0) 
+		{
+			TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: rs_info.timer_fd=%d, errno %d (%s)", rs_info->timer_fd, errno, strerror(errno) );
+			return -3;
+		}
+	}
 	return 0;
 }
 int main(int argc, char* const argv[])
 {
 	rs_info_t rs_info;
-	int bind_any = 1;
-	struct epoll_event ev;
+	int id, ret;
 
 	init_rs_info(&rs_info);
 	int opt;
-	while((opt = getopt_long(argc, argv, "fl:a:p:m:k:vh", long_options, NULL)) != -1) 
+	while((opt = getopt_long(argc, argv, "fl:a:p:m:k:j:gt:uvh", long_options, NULL)) != -1) 
 	{
 		switch (opt) 
 		{
@@ -561,7 +1095,7 @@ int main(int argc, char* const argv[])
 			break;
 			case 'a': /* relay_ip */
 				strcpy(rs_info.relay_ip, optarg);
-				bind_any = 0;
+				rs_info.bind_any = 0;
 			break;
 			case 'p': /* manager-port */
 				rs_info.mgmt_port= atoi(optarg);
@@ -572,6 +1106,30 @@ int main(int argc, char* const argv[])
 			case 'k': /* md5key */
 				strcpy(rs_info.md5key, optarg);
 			break;					 
+			case 'j': /* threads */
+				rs_info.num_workers = atoi(optarg);
+				if (rs_info.num_workers < 1 || rs_info.num_workers > RELAY_MAX_WORKERS)
+					exit_help(argc, argv);
+			break;
+			case 'g': /* gso */
+#ifdef UDP_SEGMENT
+				rs_info.gso = 1;
+#else
+				TraceEvent( TRACE_WARNING, "UDP GSO is not supported by this build, ignored" );
+#endif
+			break;
+			case 'u': /* uring */
+#ifdef RELAY_HAVE_URING
+				rs_info.uring = 1;
+#else
+				TraceEvent( TRACE_WARNING, "io_uring is not supported by this build, ignored" );
+#endif
+			break;
+			case 't': /* idle-timeout */
+				rs_info.idle_timeout = atoi(optarg);
+				if (rs_info.idle_timeout < 1)
+					exit_help(argc, argv);
+			break;
 			case 'f': /* foreground */
 				rs_info.daemon = 0;
 			break;
@@ -592,20 +1150,19 @@ int main(int argc, char* const argv[])
 			exit(-5);
 		}
 	}
-	TraceEvent( TRACE_ERROR, "TraceLevel is %d", traceLevel);
-	
-	rs_info.relay_fd = setup_socket(rs_info.relay_port, rs_info.relay_ip, bind_any );/*bind ANY*/
-	if ( -1 == rs_info.relay_fd )
+	if (init_trace_logger() < 0)
 	{
-		TraceEvent( TRACE_ERROR, "Failed to open Relayserver socket. %s", strerror(errno) );
-		exit(-2);
+		TraceEvent( TRACE_WARNING, "Failed to start trace logger, logging synchronously" );
 	}
-	else
+	TraceEvent( TRACE_ERROR, "TraceLevel is %d", traceLevel);
+
+	if (init_route_pools() < 0 || init_RtTokenTable(ROUTETABLE_TOKEN_SIZE) < 0 || init_RtFwdTable(ROUTETABLE_FWD_SIZE) < 0 || init_route_lock(rs_info.num_workers) < 0 || init_RtTimerWheel(rs_info.idle_timeout) < 0)
 	{
-		TraceEvent( TRACE_NORMAL, "Relayserver is listening on UDP %u (main)", rs_info.relay_port );
+		TraceEvent( TRACE_ERROR, "Failed to create route token table" );
+		exit(-4);
 	}
 	
-	rs_info.mgmt_fd = setup_socket(rs_info.mgmt_port, rs_info.mgmt_ip, 0 /* bind LOOPBACK */ );
+	rs_info.mgmt_fd = setup_socket(rs_info.mgmt_port, rs_info.mgmt_ip, 0 /* bind LOOPBACK */, 0);
 	if ( -1 == rs_info.mgmt_fd )
 	{
 		TraceEvent( TRACE_ERROR, "Failed to open management socket. %s", strerror(errno) );
@@ -616,30 +1173,35 @@ int main(int argc, char* const argv[])
 		TraceEvent( TRACE_NORMAL, "Relayserver is listening on UDP %u (management)", rs_info.mgmt_port);
 	}
 
-	epoll_fd = epoll_create(MAXEPOLLSIZE);
-	ev.events = EPOLLIN;
-	ev.data.fd = rs_info.relay_fd;
-	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, rs_info.relay_fd, &ev) < 0) 
+	/* worker stats are written per packet, keep each worker on its own cache lines */
+	if (posix_memalign((void **)&rs_info.workers, CACHELINE_SIZE, rs_info.num_workers * sizeof(relay_worker_t)))
 	{
-		TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: rs_info.relay_fd=%d, errno %d (%s)", rs_info.relay_fd, errno, strerror(errno) );
-		exit(-3);
+		TraceEvent( TRACE_ERROR, "Failed to allocate %d relay workers", rs_info.num_workers );
+		exit(-4);
 	}
-	else
+	memset(rs_info.workers, 0x00, rs_info.num_workers * sizeof(relay_worker_t));
+	for(id = 0; id < rs_info.num_workers; id++)
 	{
-		TraceEvent( TRACE_NORMAL, "relay_fd added in epoll success");
+		rs_info.workers[id].relay_fd = -1;
+		rs_info.workers[id].epoll_fd = -1;
 	}
-	
-	ev.events = EPOLLIN;
-	ev.data.fd = rs_info.mgmt_fd;
-	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, rs_info.mgmt_fd, &ev) < 0) 
+	for(id = 0; id < rs_info.num_workers; id++)
 	{
-		TraceEvent( TRACE_ERROR, "epoll set EPOLL_CTL_ADD error: rs_info.mgmt_fd=%d, errno %d (%s)", rs_info.mgmt_fd, errno, strerror(errno) );
-		exit(-3);
+		if ((ret = setup_worker(&rs_info, id)) < 0)
+			exit(ret);
 	}
-	else
+	TraceEvent( TRACE_NORMAL, "Relayserver is listening on UDP %u (main), %d worker(s)", rs_info.relay_port, rs_info.num_workers);
+
+	for(id = 1; id < rs_info.num_workers; id++)
 	{
-		TraceEvent( TRACE_NORMAL, "mgmt_fd added in epoll success");
+		if (pthread_create(&rs_info.workers[id].thread, NULL, run_loop, &rs_info.workers[id]) != 0)
+		{
+			TraceEvent( TRACE_ERROR, "Failed to start relay worker %d. %s", id, strerror(errno) );
+			exit(-6);
+		}
 	}
+	run_loop(&rs_info.workers[0]);
 
-	return run_loop(&rs_info);
+	deinit_rs_info(&rs_info);
+	return 0;
 }
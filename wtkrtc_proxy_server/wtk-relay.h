@@ -2,9 +2,58 @@
 #define _wtk_relay_h_
 
 #include "misc_lib.h"
+#include "uring_lib.h"
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <stddef.h>
 
 //
+struct relay_batch
+{
+	/* receive side, one RELAY_PKTBUF_SIZE buffer per datagram */
+	struct mmsghdr rx_msgs[RELAY_BATCH_SIZE];
+	struct iovec rx_iovs[RELAY_BATCH_SIZE];
+	struct sockaddr_in rx_addrs[RELAY_BATCH_SIZE];
+	uint8_t *rx_bufs;
+
+	/* send side, forwards point into rx_bufs until the batch is flushed */
+	int tx_count;
+	struct mmsghdr tx_msgs[RELAY_BATCH_SIZE];
+	struct iovec tx_iovs[RELAY_BATCH_SIZE];
+	struct sockaddr_in tx_addrs[RELAY_BATCH_SIZE];
+	char tx_cmsgs[RELAY_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+};
+
+/*
+ * Per worker totals, only the owning worker writes them.  Readers (the
+ * management socket) sum all workers without locking and may see values
+ * a few packets old.
+ */
+struct relay_stats
+{
+	uint64_t rx_pkts;
+	uint64_t rx_bytes;
+	uint64_t tx_pkts;
+	uint64_t tx_bytes;
+	uint64_t ctrl_pkts;			/* full frames */
+	uint64_t drop_noroute;
+	uint64_t drop_invalid;		/* too short, unparsable or rejected */
+	uint64_t tx_errors;
+} __attribute__ ((aligned (CACHELINE_SIZE)));
+
+struct relay_worker
+{
+	struct relay_stats stats;
+	int id;
+	int relay_fd;
+	int epoll_fd;
+	pthread_t thread;
+	struct relay_batch *batch;
+	struct relay_uring *uring;		/* io_uring data plane, NULL on the epoll path */
+	struct relayservice_info *rs_info;
+};
+typedef struct relay_worker relay_worker_t;
+
 struct relayservice_info
 {
 	int daemon;
@@ -12,13 +61,19 @@ struct relayservice_info
 	
 	char relay_ip[32];
 	int relay_port;
-	int relay_fd;
+	int bind_any;
 	
 	char mgmt_ip[32];
 	int mgmt_port;
 	int mgmt_fd;
 
-	struct RT_Info *rti;
+	int idle_timeout;
+	int timer_fd;
+
+	int num_workers;
+	int gso;
+	int uring;
+	relay_worker_t *workers;
 };
 typedef struct relayservice_info rs_info_t;
 